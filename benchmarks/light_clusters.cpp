@@ -0,0 +1,37 @@
+#include <benchmark/benchmark.h>
+
+#include "camera.hpp"
+#include "light_clusters.hpp"
+
+// point lights spread over a 200x200 area in front of the camera, about
+// half of them end up inside the frustum
+static void BM_light_clusters(benchmark::State& state)
+{
+  std::vector<LightPtr> lights;
+  for(int i = 0; i < state.range(0); ++i)
+  {
+    LightPtr light = std::make_shared<Light>();
+    light->set_position(glm::vec3(static_cast<float>(i % 32) * 6.0f - 100.0f,
+                                  static_cast<float>(i % 5),
+                                  static_cast<float>(i / 32) * -6.0f));
+    light->set_radius(2.0f + static_cast<float>(i % 7));
+    lights.push_back(light);
+  }
+
+  Camera camera;
+  camera.perspective(glm::radians(42.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+  camera.look_at(glm::vec3(0.0f, 10.0f, 20.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  LightClusters clusters;
+  while (state.KeepRunning())
+  {
+    clusters.build(lights, camera.get_view_matrix(), camera.get_projection_matrix(),
+                   camera.get_znear(), camera.get_zfar());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_light_clusters)->RangeMultiplier(4)->Range(16, 1024);
+
+BENCHMARK_MAIN()
+
+/* EOF */
@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+
+#include <stdlib.h>
+#include <vector>
+
+#include "pixel_kernels.hpp"
+
+namespace {
+
+// a 4K frame
+int const WIDTH = 3840;
+int const HEIGHT = 2160;
+
+std::vector<uint8_t> random_image(int bytes_per_pixel)
+{
+  std::vector<uint8_t> pixels(static_cast<size_t>(WIDTH) * HEIGHT * bytes_per_pixel);
+  for(auto& value : pixels)
+  {
+    value = static_cast<uint8_t>(rand());
+  }
+  return pixels;
+}
+
+} // namespace
+
+static void BM_swap_red_blue_scalar(benchmark::State& state)
+{
+  int const bpp = static_cast<int>(state.range(0));
+  std::vector<uint8_t> pixels = random_image(bpp);
+  while (state.KeepRunning())
+  {
+    pixel_kernels::scalar::swap_red_blue(pixels.data(), static_cast<size_t>(WIDTH) * HEIGHT, bpp);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+BENCHMARK(BM_swap_red_blue_scalar)->Arg(3)->Arg(4);
+
+static void BM_swap_red_blue(benchmark::State& state)
+{
+  int const bpp = static_cast<int>(state.range(0));
+  std::vector<uint8_t> pixels = random_image(bpp);
+  while (state.KeepRunning())
+  {
+    pixel_kernels::swap_red_blue(pixels.data(), static_cast<size_t>(WIDTH) * HEIGHT, bpp);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+BENCHMARK(BM_swap_red_blue)->Arg(3)->Arg(4);
+
+static void BM_flip_rows_scalar(benchmark::State& state)
+{
+  std::vector<uint8_t> pixels = random_image(4);
+  while (state.KeepRunning())
+  {
+    pixel_kernels::scalar::flip_rows(pixels.data(), HEIGHT, WIDTH * 4, WIDTH * 4);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+BENCHMARK(BM_flip_rows_scalar);
+
+static void BM_flip_rows(benchmark::State& state)
+{
+  std::vector<uint8_t> pixels = random_image(4);
+  while (state.KeepRunning())
+  {
+    pixel_kernels::flip_rows(pixels.data(), HEIGHT, WIDTH * 4, WIDTH * 4);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+BENCHMARK(BM_flip_rows);
+
+// the image is unpremultiplied again on every iteration, which is
+// fine for timing, the work doesn't depend on the values
+static void BM_unpremultiply_scalar(benchmark::State& state)
+{
+  std::vector<uint8_t> pixels = random_image(4);
+  while (state.KeepRunning())
+  {
+    pixel_kernels::scalar::unpremultiply(pixels.data(), static_cast<size_t>(WIDTH) * HEIGHT, true);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+BENCHMARK(BM_unpremultiply_scalar);
+
+static void BM_unpremultiply(benchmark::State& state)
+{
+  std::vector<uint8_t> pixels = random_image(4);
+  while (state.KeepRunning())
+  {
+    pixel_kernels::unpremultiply(pixels.data(), static_cast<size_t>(WIDTH) * HEIGHT, true);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+  state.SetLabel(pixel_kernels::get_isa());
+}
+BENCHMARK(BM_unpremultiply);
+
+BENCHMARK_MAIN()
+
+/* EOF */
@@ -0,0 +1,54 @@
+#include <benchmark/benchmark.h>
+
+#include "camera.hpp"
+#include "model.hpp"
+#include "scene_manager.hpp"
+#include "task_scheduler.hpp"
+
+// 1000 groups of 199 leaves plus the group nodes themselves, 200k nodes
+// with the world root. The models have no meshes and thus empty bounds,
+// so this measures transform update, snapshot and culling, but not the
+// submission.
+static void build_scene(SceneManager& mgr)
+{
+  ModelPtr model = std::make_shared<Model>();
+
+  for(int g = 0; g < 1000; ++g)
+  {
+    SceneNode* group = mgr.get_world()->create_child();
+    group->set_position(glm::vec3(static_cast<float>(g % 40) * 10.0f - 200.0f,
+                                  0.0f,
+                                  static_cast<float>(g / 40) * -10.0f));
+    group->set_orientation(glm::angleAxis(static_cast<float>(g) * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    for(int i = 0; i < 199; ++i)
+    {
+      SceneNode* leaf = group->create_child();
+      leaf->set_position(glm::vec3(static_cast<float>(i % 10), static_cast<float>(i / 10), 0.0f));
+      leaf->set_scale(glm::vec3(0.5f, 0.5f, 0.5f));
+      leaf->attach_model(model);
+    }
+  }
+}
+
+static void BM_scene_prepare(benchmark::State& state)
+{
+  TaskScheduler::get().set_num_threads(static_cast<int>(state.range(0)));
+
+  SceneManager mgr;
+  build_scene(mgr);
+
+  Camera camera;
+  camera.perspective(glm::radians(42.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+  camera.look_at(glm::vec3(0.0f, 10.0f, 20.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  while (state.KeepRunning())
+  {
+    mgr.prepare(camera, camera, &camera);
+  }
+}
+BENCHMARK(BM_scene_prepare)->RangeMultiplier(2)->Range(1, 32)->UseRealTime();
+
+BENCHMARK_MAIN()
+
+/* EOF */
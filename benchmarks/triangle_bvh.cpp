@@ -0,0 +1,65 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/constants.hpp>
+
+#include "triangle_bvh.hpp"
+
+// a sphere of 2 * rings * segments triangles, rays from random points
+// around it aimed at random points inside, so most of them hit
+static void BM_triangle_bvh_raycast(benchmark::State& state)
+{
+  int const rings = static_cast<int>(state.range(0));
+  int const segments = rings * 2;
+
+  std::vector<glm::vec3> positions;
+  std::vector<int> indices;
+  for(int r = 0; r <= rings; ++r)
+  {
+    float const theta = static_cast<float>(r) / static_cast<float>(rings) * glm::pi<float>();
+    for(int s = 0; s <= segments; ++s)
+    {
+      float const phi = static_cast<float>(s) / static_cast<float>(segments) * glm::two_pi<float>();
+      positions.emplace_back(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+    }
+  }
+
+  for(int r = 0; r < rings; ++r)
+  {
+    for(int s = 0; s < segments; ++s)
+    {
+      int const a = r * (segments + 1) + s;
+      int const b = a + segments + 1;
+      indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+    }
+  }
+
+  TriangleBVH bvh(positions, indices);
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<Ray> rays(4096);
+  for(auto& ray : rays)
+  {
+    glm::vec3 const origin = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng))) * 5.0f;
+    glm::vec3 const target(dist(rng) * 0.5f, dist(rng) * 0.5f, dist(rng) * 0.5f);
+    ray = Ray{ origin, glm::normalize(target - origin) };
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning())
+  {
+    RayHit hit;
+    benchmark::DoNotOptimize(bvh.raycast(rays[i % rays.size()], hit));
+    i += 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_triangle_bvh_raycast)->Arg(16)->Arg(64)->Arg(256);
+
+BENCHMARK_MAIN()
+
+/* EOF */
@@ -0,0 +1,54 @@
+// ---------------------------------------------------------------------------
+// Uniform blocks shared by all programs, the layout has to match the
+// structs in src/uniform_blocks.hpp
+
+#ifdef GL_ES
+// no uniform buffers in GLES2, the same names are set as plain uniforms
+uniform mat4 ShadowMatrix;
+uniform vec4 LightWorldPosition;
+
+uniform mat4 ViewMatrix;
+uniform mat4 ProjectionMatrix;
+uniform vec4 LightPosition;
+uniform int EyeIndex;
+
+uniform mat4 ModelMatrix;
+uniform mat4 ModelViewMatrix;
+uniform mat3 NormalMatrix;
+uniform mat4 MVP;
+#else
+// uploaded once per frame
+layout(std140) uniform FrameBlock
+{
+  mat4 ShadowMatrix; // world space to shadow map
+  vec4 LightWorldPosition;
+};
+
+// uploaded once per camera and eye
+layout(std140) uniform ViewBlock
+{
+  mat4 ViewMatrix;
+  mat4 ProjectionMatrix;
+  vec4 LightPosition; // view space
+  int EyeIndex;
+};
+
+// uploaded once per camera and eye, see src/light_clusters.hpp
+layout(std140) uniform LightBlock
+{
+  vec4 ClusterParams; // depth slice scale and bias
+  ivec4 ClusterSize; // grid size and number of lights
+};
+
+// uploaded once per drawn object
+layout(std140) uniform ObjectBlock
+{
+  mat4 ModelMatrix;
+  mat4 ModelViewMatrix;
+  mat3 NormalMatrix;
+  mat4 MVP;
+};
+#endif
+// ---------------------------------------------------------------------------
+
+/* EOF */
\ No newline at end of file
@@ -0,0 +1,60 @@
+// ---------------------------------------------------------------------------
+// Point lights binned into view space clusters by src/light_clusters.cpp,
+// include after blocks.glsl
+
+#ifdef GL_ES
+// no texture buffers in GLES2, only the main light is used
+vec3 cluster_lighting(vec3 position, vec3 normal, vec3 diff, vec3 spec, float shininess)
+{
+  return vec3(0.0);
+}
+#else
+uniform samplerBuffer ClusterLights; // view space position and radius, color
+uniform usamplerBuffer ClusterGrid; // first index and count per cluster
+uniform usamplerBuffer ClusterIndices;
+
+vec3 cluster_lighting(vec3 position, vec3 normal, vec3 diff, vec3 spec, float shininess)
+{
+  vec3 intensity = vec3(0.0);
+  if (ClusterSize.w == 0)
+  {
+    return intensity;
+  }
+
+  vec4 clip = ProjectionMatrix * vec4(position, 1.0);
+  vec2 ndc = clip.xy / clip.w;
+  ivec3 cell;
+  cell.xy = clamp(ivec2(floor((ndc * 0.5 + 0.5) * vec2(ClusterSize.xy))), ivec2(0), ClusterSize.xy - 1);
+  cell.z = clamp(int(floor(log(-position.z) * ClusterParams.x + ClusterParams.y)), 0, ClusterSize.z - 1);
+  int cluster = (cell.z * ClusterSize.y + cell.y) * ClusterSize.x + cell.x;
+
+  uvec2 range = texelFetch(ClusterGrid, cluster).xy;
+
+  vec3 N = normalize(normal);
+  vec3 E = normalize(-position);
+  for(uint i = 0u; i < range.y; ++i)
+  {
+    int light = int(texelFetch(ClusterIndices, int(range.x + i)).x);
+    vec4 position_radius = texelFetch(ClusterLights, 2 * light);
+
+    vec3 L = position_radius.xyz - position;
+    float dist = length(L);
+    if (dist < position_radius.w)
+    {
+      L /= dist;
+      float falloff = 1.0 - dist / position_radius.w;
+      falloff *= falloff;
+
+      vec3 color = texelFetch(ClusterLights, 2 * light + 1).rgb;
+      float lambertTerm = max(dot(N, L), 0.0);
+      float specular = pow(max(dot(reflect(-L, N), E), 0.0), shininess);
+      intensity += color * falloff * (lambertTerm * diff + specular * spec);
+    }
+  }
+
+  return intensity;
+}
+#endif
+// ---------------------------------------------------------------------------
+
+/* EOF */
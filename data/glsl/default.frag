@@ -14,13 +14,15 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include "blocks.glsl"
+#include "clusters.glsl"
+#include "virtual_texture.glsl"
+
 struct LightInfo
 {
   vec3  diffuse;
   vec3  ambient;
   vec3  specular;
-
-  vec3 position;
 };
 
 struct MaterialInfo
@@ -42,11 +44,6 @@ struct MaterialInfo
 uniform LightInfo light;
 uniform MaterialInfo material;
 
-uniform mat4 ModelViewMatrix;
-uniform mat3 NormalMatrix;
-//uniform mat4 ProjectionMatrix;
-uniform mat4 MVP;
-
 varying vec3 world_normal;
 varying vec3 frag_normal;
 varying vec3 frag_position;
@@ -126,7 +123,7 @@ vec3 phong_model(vec3 position, vec3 normal, vec3 diff, vec3 spec)
   vec3 intensity = light.ambient * material.ambient * diff;
 
   vec3 N = normalize(normal);
-  vec3 L = normalize(light.position - position); // eye dir
+  vec3 L = normalize(LightPosition.xyz - position); // eye dir
 
   float lambertTerm = dot(N, L);
   if(lambertTerm > 0.0)
@@ -160,6 +157,13 @@ vec3 diffuse_color()
   return material.diffuse;
 }
 
+#elif defined(DIFFUSE_COLOR_FROM_VIRTUAL_TEXTURE)
+
+vec3 diffuse_color()
+{
+  return material.diffuse * sample_virtual_texture(frag_uv).rgb;
+}
+
 #else //defined(DIFFUSE_COLOR_FROM_TEXTURE)
 vec3 diffuse_color()
 {
@@ -189,6 +193,7 @@ void main(void)
   vec3 diff = diffuse_color();
   vec3 spec = specular_color();
   vec3 intensity = phong_model(frag_position, frag_normal, diff, spec);
+  intensity += cluster_lighting(frag_position, frag_normal, diff, spec, material.shininess);
 
 #if defined(REFLECTION_TEXTURE)
   vec3 o = reflect(frag_position, normalize(frag_normal));
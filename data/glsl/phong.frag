@@ -14,13 +14,14 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include "blocks.glsl"
+#include "clusters.glsl"
+
 struct LightInfo
 {
   vec3  diffuse;
   vec3  ambient;
   vec3  specular;
-
-  vec3 position;
 };
 
 struct MaterialInfo
@@ -35,11 +36,6 @@ struct MaterialInfo
 uniform LightInfo light;
 uniform MaterialInfo material;
 
-uniform mat4 ModelViewMatrix;
-uniform mat3 NormalMatrix;
-//uniform mat4 ProjectionMatrix;
-uniform mat4 MVP;
-
 varying vec3 world_normal;
 varying vec3 frag_normal;
 varying vec3 frag_position;
@@ -112,7 +108,7 @@ vec3 phong_model(vec3 position, vec3 normal)
   vec3 intensity = light.ambient * material.ambient;
 
   vec3 N = normalize(normal);
-  vec3 L = normalize(light.position - position); // eye dir
+  vec3 L = normalize(LightPosition.xyz - position); // eye dir
 
   float lambertTerm = dot(N, L);
 
@@ -135,7 +131,10 @@ void main(void)
 {
   //float light = texture(LightMap, world_normal, 3);
   float shadow = max(0.5, shadow_value_4());
-  gl_FragColor = vec4(phong_model(frag_position, frag_normal) * shadow, 1.0);
+  vec3 intensity = phong_model(frag_position, frag_normal) * shadow;
+  intensity += cluster_lighting(frag_position, frag_normal,
+                                material.diffuse, material.specular, material.shininess);
+  gl_FragColor = vec4(intensity, 1.0);
 }
 
 /* EOF */
@@ -1,3 +1,5 @@
+#include "blocks.glsl"
+
 // ---------------------------------------------------------------------------
 attribute vec3 position;
 attribute vec3 normal;
@@ -7,18 +9,12 @@ varying vec3 frag_normal;
 varying vec3 frag_position;
 
 // ---------------------------------------------------------------------------
-uniform mat4 ShadowMapMatrix;
 varying vec4 shadow_position;
 // ---------------------------------------------------------------------------
 
-uniform mat4 ModelViewMatrix;
-uniform mat3 NormalMatrix;
-uniform mat4 ProjectionMatrix;
-uniform mat4 MVP;
-
 void main(void)
 {
-  shadow_position = ShadowMapMatrix * vec4(position, 1.0);
+  shadow_position = ShadowMatrix * ModelMatrix * vec4(position, 1.0);
 
   frag_position = vec3(ModelViewMatrix * vec4(position, 1.0));
   frag_normal = NormalMatrix * normal;
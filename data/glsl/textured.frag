@@ -14,13 +14,13 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include "blocks.glsl"
+
 struct LightInfo
 {
   vec3  diffuse;
   vec3  ambient;
   vec3  specular;
-
-  vec3 position;
 };
 
 struct MaterialInfo
@@ -35,11 +35,6 @@ struct MaterialInfo
 uniform LightInfo light;
 uniform MaterialInfo material;
 
-uniform mat4 ModelViewMatrix;
-uniform mat3 NormalMatrix;
-//uniform mat4 ProjectionMatrix;
-uniform mat4 MVP;
-
 varying vec3 world_normal;
 varying vec3 frag_normal;
 varying vec3 frag_position;
@@ -114,7 +109,7 @@ vec3 phong_model(vec3 position, vec3 normal, vec3 diff, vec3 spec)
   vec3 intensity = light.ambient * material.ambient;
 
   vec3 N = normalize(normal);
-  vec3 L = normalize(light.position - position); // eye dir
+  vec3 L = normalize(LightPosition.xyz - position); // eye dir
   float lambertTerm = dot(N, L);
 
   if(lambertTerm > 0.0)
@@ -0,0 +1,19 @@
+// ---------------------------------------------------------------------------
+// Page requests of src/virtual_texture_manager.cpp, the page in red and
+// green, the level in the low and the texture id in the high four bits
+// of blue
+
+#include "virtual_texture.glsl"
+
+uniform float VirtualId;
+
+varying vec2 frag_uv;
+
+void main(void)
+{
+  float level = virtual_texture_level(frag_uv);
+  vec2 page = floor(virtual_texture_texel(frag_uv, level) / VirtualSize.w);
+  gl_FragColor = vec4(page / 255.0, (level + 16.0 * VirtualId) / 255.0, 1.0);
+}
+
+/* EOF */
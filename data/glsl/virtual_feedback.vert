@@ -0,0 +1,14 @@
+#include "blocks.glsl"
+
+attribute vec3 position;
+attribute vec2 texcoord;
+
+varying vec2 frag_uv;
+
+void main(void)
+{
+  frag_uv = texcoord;
+  gl_Position = MVP * vec4(position, 1.0);
+}
+
+/* EOF */
@@ -0,0 +1,41 @@
+// ---------------------------------------------------------------------------
+// Virtual texture lookup through the page atlas and indirection texture
+// of src/virtual_texture.cpp, desktop GL only
+
+#ifndef GL_ES
+uniform vec4 VirtualSize; // width, height, levels, page size
+uniform vec4 VirtualAtlasParams; // padded page size, border, atlas size, lod bias
+
+uniform sampler2D VirtualAtlas;
+uniform sampler2D VirtualIndirection;
+
+float virtual_texture_level(vec2 uv)
+{
+  vec2 dx = dFdx(uv * VirtualSize.xy);
+  vec2 dy = dFdy(uv * VirtualSize.xy);
+  float level = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + VirtualAtlasParams.w;
+  return clamp(floor(level + 0.5), 0.0, VirtualSize.z - 1.0);
+}
+
+// texel coordinate in the given level, the texture repeats
+vec2 virtual_texture_texel(vec2 uv, float level)
+{
+  return fract(uv) * max(vec2(1.0), floor(VirtualSize.xy / exp2(level)));
+}
+
+vec4 sample_virtual_texture(vec2 uv)
+{
+  float level = virtual_texture_level(uv);
+  vec2 page = floor(virtual_texture_texel(uv, level) / VirtualSize.w);
+
+  // atlas slot and level of the finest resident page covering this one
+  vec3 entry = floor(texelFetch(VirtualIndirection, ivec2(page), int(level)).xyz * 255.0 + 0.5);
+
+  vec2 texel = virtual_texture_texel(uv, entry.z);
+  vec2 in_page = texel - floor(texel / VirtualSize.w) * VirtualSize.w;
+  vec2 atlas_texel = entry.xy * VirtualAtlasParams.x + VirtualAtlasParams.y + in_page;
+  return textureLod(VirtualAtlas, atlas_texel / VirtualAtlasParams.z, 0.0);
+}
+#endif
+
+/* EOF */
@@ -0,0 +1,104 @@
+#ifndef HEADER_AABB_HPP
+#define HEADER_AABB_HPP
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/** Axis aligned bounding box, a default constructed box is empty */
+class AABB
+{
+public:
+  static AABB infinite()
+  {
+    float inf = std::numeric_limits<float>::infinity();
+    return AABB(glm::vec3(-inf, -inf, -inf), glm::vec3(inf, inf, inf));
+  }
+
+  static AABB from_points(std::vector<glm::vec3> const& points)
+  {
+    AABB box;
+    for(auto const& p : points)
+    {
+      box.extend(p);
+    }
+    return box;
+  }
+
+public:
+  glm::vec3 min;
+  glm::vec3 max;
+
+public:
+  AABB() :
+    min(std::numeric_limits<float>::max()),
+    max(-std::numeric_limits<float>::max())
+  {}
+
+  AABB(glm::vec3 const& min_, glm::vec3 const& max_) :
+    min(min_),
+    max(max_)
+  {}
+
+  bool is_empty() const
+  {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+  }
+
+  bool is_infinite() const
+  {
+    return
+      std::isinf(min.x) || std::isinf(min.y) || std::isinf(min.z) ||
+      std::isinf(max.x) || std::isinf(max.y) || std::isinf(max.z);
+  }
+
+  glm::vec3 get_center() const { return (min + max) * 0.5f; }
+  glm::vec3 get_extent() const { return (max - min) * 0.5f; }
+  glm::vec3 get_size() const { return max - min; }
+
+  void extend(glm::vec3 const& p)
+  {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void extend(AABB const& other)
+  {
+    if (!other.is_empty())
+    {
+      min = glm::min(min, other.min);
+      max = glm::max(max, other.max);
+    }
+  }
+
+  /** Returns the box enclosing this box after transformation by \a m,
+      see Arvo, "Transforming Axis-Aligned Bounding Boxes" */
+  AABB transform(glm::mat4 const& m) const
+  {
+    if (is_empty() || is_infinite())
+    {
+      return *this;
+    }
+    else
+    {
+      glm::vec3 center(m * glm::vec4(get_center(), 1.0f));
+      glm::vec3 extent = get_extent();
+      glm::vec3 new_extent(0.0f, 0.0f, 0.0f);
+      for(int col = 0; col < 3; ++col)
+      {
+        for(int row = 0; row < 3; ++row)
+        {
+          new_extent[row] += std::abs(m[col][row]) * extent[col];
+        }
+      }
+      return AABB(center - new_extent, center + new_extent);
+    }
+  }
+};
+
+#endif
+
+/* EOF */
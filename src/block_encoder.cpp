@@ -0,0 +1,200 @@
+#include "block_encoder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+#include "compressed_image.hpp"
+
+namespace block_encoder {
+
+namespace {
+
+uint16_t to_565(int const* c)
+{
+  return static_cast<uint16_t>(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+void from_565(uint16_t v, int* c)
+{
+  int const r = (v >> 11) & 31;
+  int const g = (v >> 5) & 63;
+  int const b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+void encode_color_block(uint8_t const block[16][4], uint8_t* out)
+{
+  int lo[3] = { 255, 255, 255 };
+  int hi[3] = { 0, 0, 0 };
+  int mean[3] = { 0, 0, 0 };
+  for(int i = 0; i < 16; ++i)
+    for(int c = 0; c < 3; ++c)
+    {
+      lo[c] = std::min(lo[c], static_cast<int>(block[i][c]));
+      hi[c] = std::max(hi[c], static_cast<int>(block[i][c]));
+      mean[c] += block[i][c];
+    }
+
+  // the box corners are on the wrong diagonal when red or blue fall
+  // while green rises
+  int cov_rg = 0;
+  int cov_bg = 0;
+  for(int i = 0; i < 16; ++i)
+  {
+    int const g = block[i][1] - mean[1] / 16;
+    cov_rg += (block[i][0] - mean[0] / 16) * g;
+    cov_bg += (block[i][2] - mean[2] / 16) * g;
+  }
+
+  // pull the endpoints in a bit, the extremes are rarely worth an
+  // exact match
+  for(int c = 0; c < 3; ++c)
+  {
+    int const inset = (hi[c] - lo[c]) >> 4;
+    lo[c] += inset;
+    hi[c] -= inset;
+  }
+  if (cov_rg < 0)
+  {
+    std::swap(lo[0], hi[0]);
+  }
+  if (cov_bg < 0)
+  {
+    std::swap(lo[2], hi[2]);
+  }
+
+  uint16_t c0 = to_565(hi);
+  uint16_t c1 = to_565(lo);
+  uint32_t indices = 0;
+
+  if (c0 != c1)
+  {
+    // c0 > c1 selects the four color mode
+    if (c0 < c1)
+    {
+      std::swap(c0, c1);
+    }
+
+    int palette[4][3];
+    from_565(c0, palette[0]);
+    from_565(c1, palette[1]);
+    for(int c = 0; c < 3; ++c)
+    {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    for(int i = 0; i < 16; ++i)
+    {
+      int best = 0;
+      int best_dist = 1 << 30;
+      for(int k = 0; k < 4; ++k)
+      {
+        int dist = 0;
+        for(int c = 0; c < 3; ++c)
+        {
+          int const d = block[i][c] - palette[k][c];
+          dist += d * d;
+        }
+        if (dist < best_dist)
+        {
+          best = k;
+          best_dist = dist;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (2 * i);
+    }
+  }
+
+  memcpy(out + 0, &c0, 2);
+  memcpy(out + 2, &c1, 2);
+  memcpy(out + 4, &indices, 4);
+}
+
+void encode_alpha_block(uint8_t const block[16][4], uint8_t* out)
+{
+  int a0 = 0;
+  int a1 = 255;
+  for(int i = 0; i < 16; ++i)
+  {
+    a0 = std::max(a0, static_cast<int>(block[i][3]));
+    a1 = std::min(a1, static_cast<int>(block[i][3]));
+  }
+
+  // a0 > a1 selects eight interpolated values
+  int palette[8] = { a0, a1 };
+  for(int k = 2; k < 8; ++k)
+  {
+    palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+  }
+
+  uint64_t indices = 0;
+  if (a0 != a1)
+  {
+    for(int i = 0; i < 16; ++i)
+    {
+      int best = 0;
+      for(int k = 1; k < 8; ++k)
+      {
+        if (abs(block[i][3] - palette[k]) < abs(block[i][3] - palette[best]))
+        {
+          best = k;
+        }
+      }
+      indices |= static_cast<uint64_t>(best) << (3 * i);
+    }
+  }
+
+  out[0] = static_cast<uint8_t>(a0);
+  out[1] = static_cast<uint8_t>(a1);
+  for(int i = 0; i < 6; ++i)
+  {
+    out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+  }
+}
+
+} // namespace
+
+std::vector<uint8_t> encode(uint32_t format, uint8_t const* pixels, int width, int height)
+{
+  if (format != CompressedImage::BC1_RGB && format != CompressedImage::BC3_RGBA)
+  {
+    throw std::runtime_error("block_encoder: only BC1 and BC3 are supported");
+  }
+
+  int const block_bytes = CompressedImage::get_block_bytes(format);
+  int const blocks_x = (width + 3) / 4;
+  int const blocks_y = (height + 3) / 4;
+  std::vector<uint8_t> result(static_cast<size_t>(blocks_x) * blocks_y * block_bytes);
+
+  uint8_t* out = result.data();
+  for(int by = 0; by < blocks_y; ++by)
+    for(int bx = 0; bx < blocks_x; ++bx)
+    {
+      uint8_t block[16][4];
+      for(int y = 0; y < 4; ++y)
+        for(int x = 0; x < 4; ++x)
+        {
+          int const sx = std::min(4 * bx + x, width - 1);
+          int const sy = std::min(4 * by + y, height - 1);
+          memcpy(block[4 * y + x], pixels + 4 * (static_cast<size_t>(sy) * width + sx), 4);
+        }
+
+      if (format == CompressedImage::BC3_RGBA)
+      {
+        encode_alpha_block(block, out);
+        out += 8;
+      }
+      encode_color_block(block, out);
+      out += 8;
+    }
+
+  return result;
+}
+
+} // namespace block_encoder
+
+/* EOF */
@@ -0,0 +1,23 @@
+#ifndef HEADER_BLOCK_ENCODER_HPP
+#define HEADER_BLOCK_ENCODER_HPP
+
+#include <stdint.h>
+#include <vector>
+
+/** Encodes RGBA images into BC1 and BC3 blocks for grumgl-texconv.
+    The endpoints are the inset bounding box of each 4x4 block, turned
+    along the main diagonal of its colors, which is fast and good enough
+    for photos and painted textures. BC7 and ETC2 files have to come
+    from an external encoder, Texture loads them all the same. */
+namespace block_encoder {
+
+/** Encodes the tightly packed RGBA8 \a pixels into \a format, which is
+    CompressedImage::BC1_RGB or BC3_RGBA, partial blocks at the right
+    and top edge repeat the last texel */
+std::vector<uint8_t> encode(uint32_t format, uint8_t const* pixels, int width, int height);
+
+} // namespace block_encoder
+
+#endif
+
+/* EOF */
@@ -69,6 +69,9 @@ public:
   void set_orientation(const glm::quat& q) { m_orientation = q; }
   glm::quat get_orientation() const { return m_orientation; }
 
+  float get_znear() const { return m_znear; }
+  float get_zfar() const { return m_zfar; }
+
   void ortho(float left, float right, float bottom, float top, float znear, float zfar)
   {
     m_type = kOrtho;
@@ -6,9 +6,12 @@
 #include "framebuffer.hpp"
 #include "material.hpp"
 #include "opengl_state.hpp"
+#include "program_registry.hpp"
 #include "viewer.hpp"
 #include "render_context.hpp"
 #include "renderbuffer.hpp"
+#include "uniform_blocks.hpp"
+#include "virtual_texture_manager.hpp"
 #include "log.hpp"
 #include "globals.hpp"
 
@@ -28,33 +31,27 @@ Compositor::Compositor(int screen_w, int screen_h) :
   m_renderbuffer2 = std::make_unique<Renderbuffer>(m_screen_w, m_screen_h);
   g_shadowmap = std::make_unique<Framebuffer>(m_shadowmap_resolution, m_shadowmap_resolution);
 
-  m_cybermaxx_prog = Program::create(
-    Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/composite.vert"),
-    Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/composite.frag",
-                      {"INTERLACED_COMPOSITION"}));
+  m_cybermaxx_prog = ProgramRegistry::get().load(g_datadir + "/glsl/composite.vert",
+                                                 g_datadir + "/glsl/composite.frag",
+                                                 {}, {"INTERLACED_COMPOSITION"});
 
-  m_crosseye_prog = Program::create(
-    Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/composite.vert"),
-    Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/composite.frag",
-                      {"CROSSEYE_COMPOSITION"}));
+  m_crosseye_prog = ProgramRegistry::get().load(g_datadir + "/glsl/composite.vert",
+                                                g_datadir + "/glsl/composite.frag",
+                                                {}, {"CROSSEYE_COMPOSITION"});
 
-  m_anaglyph_prog = Program::create(
-    Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/composite.vert"),
-    Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/composite.frag",
-                      {"ANAGLYPH_COMPOSITION"}));
+  m_anaglyph_prog = ProgramRegistry::get().load(g_datadir + "/glsl/composite.vert",
+                                                g_datadir + "/glsl/composite.frag",
+                                                {}, {"ANAGLYPH_COMPOSITION"});
 
-  m_depth_prog = Program::create(
-    Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/composite.vert"),
-    Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/composite.frag",
-                      {"DEPTH_COMPOSITION"}));
+  m_depth_prog = ProgramRegistry::get().load(g_datadir + "/glsl/composite.vert",
+                                             g_datadir + "/glsl/composite.frag",
+                                             {}, {"DEPTH_COMPOSITION"});
 
-  m_newsprint_prog = Program::create(
-    Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/composite.vert"),
-    Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/newsprint.frag"));
+  m_newsprint_prog = ProgramRegistry::get().load(g_datadir + "/glsl/composite.vert",
+                                                 g_datadir + "/glsl/newsprint.frag");
 
-  m_mono_prog = Program::create(
-    Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/composite.vert"),
-    Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/composite.frag"));
+  m_mono_prog = ProgramRegistry::get().load(g_datadir + "/glsl/composite.vert",
+                                            g_datadir + "/glsl/composite.frag");
 
   m_composition_prog = m_mono_prog;
 
@@ -70,36 +67,87 @@ Compositor::render(Viewer& viewer)
   {
     OpenGLState state;
 
+    // traverse and cull the scene once, all passes below draw from the
+    // same snapshot
 #ifndef HAVE_OPENGLES2
-    if (m_render_shadowmap)
-    {
-      g_shadowmap->bind();
-      render_shadowmap(viewer);
-      g_shadowmap->unbind();
-    }
+    bool const render_shadowmap_pass = m_render_shadowmap;
+#else
+    bool const render_shadowmap_pass = false;
 #endif
 
+    Camera shadow_camera = create_shadow_camera(viewer);
+
+    g_shadowmap_matrix = glm::mat4(0.5, 0.0, 0.0, 0.0,
+                                   0.0, 0.5, 0.0, 0.0,
+                                   0.0, 0.0, 0.5, 0.0,
+                                   0.5, 0.5, 0.5, 1.0);
+    g_shadowmap_matrix = g_shadowmap_matrix * shadow_camera.get_matrix();
+
+    UniformBlocks::get().set_frame(g_shadowmap_matrix, glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
+
+    viewer.m_scene_manager->set_occlusion_culling(viewer.m_cfg.m_occlusion_culling);
+
     if (m_stereo_mode == StereoMode::None)
     {
+      Camera camera = create_eye_camera(viewer, Stereo::Center);
+
+      viewer.m_scene_manager->prepare(camera, camera,
+                                      render_shadowmap_pass ? &shadow_camera : nullptr);
+
+      if (render_shadowmap_pass)
+      {
+        g_shadowmap->bind();
+        render_shadowmap(viewer, shadow_camera);
+        g_shadowmap->unbind();
+      }
+
+#ifndef HAVE_OPENGLES2
+      VirtualTextureManager::get().update(*viewer.m_scene_manager, camera, m_screen_w, m_screen_h);
+#endif
+
       m_renderbuffer1->bind();
-      render_scene(viewer, Stereo::Center);
+      render_scene(viewer, camera, Stereo::Center);
       m_renderbuffer1->unbind();
 
       m_renderbuffer1->blit(*m_framebuffer1);
     }
     else
     {
+      Camera left_camera = create_eye_camera(viewer, Stereo::Left);
+      Camera right_camera = create_eye_camera(viewer, Stereo::Right);
+
+      viewer.m_scene_manager->prepare(left_camera, right_camera,
+                                      render_shadowmap_pass ? &shadow_camera : nullptr);
+
+      if (render_shadowmap_pass)
+      {
+        g_shadowmap->bind();
+        render_shadowmap(viewer, shadow_camera);
+        g_shadowmap->unbind();
+      }
+
+#ifndef HAVE_OPENGLES2
+      // the eyes are close enough to share the pages
+      VirtualTextureManager::get().update(*viewer.m_scene_manager, left_camera, m_screen_w, m_screen_h);
+#endif
+
       m_renderbuffer1->bind();
-      render_scene(viewer, Stereo::Left);
+      render_scene(viewer, left_camera, Stereo::Left);
       m_renderbuffer1->unbind();
 
       m_renderbuffer2->bind();
-      render_scene(viewer, Stereo::Right);
+      render_scene(viewer, right_camera, Stereo::Right);
       m_renderbuffer2->unbind();
 
       m_renderbuffer1->blit(*m_framebuffer1);
       m_renderbuffer2->blit(*m_framebuffer2);
     }
+
+    // transforms are up to date after prepare()
+    if (viewer.m_cfg.m_picking)
+    {
+      viewer.update_hover(create_eye_camera(viewer, Stereo::Center));
+    }
   }
 
   // composit the final image
@@ -206,19 +254,17 @@ Compositor::render_menu(RenderContext const& ctx, Viewer const& viewer)
     viewer.m_dot_surface->draw(ctx, viewer.m_wiimote_dot1.x * m_screen_w, viewer.m_wiimote_dot1.y * m_screen_h);
     viewer.m_dot_surface->draw(ctx, viewer.m_wiimote_dot2.x * m_screen_w, viewer.m_wiimote_dot2.y * m_screen_h);
   }
+
+  if (viewer.m_cfg.m_picking)
+  { // crosshair
+    viewer.m_dot_surface->draw(ctx, m_screen_w / 2.0f, m_screen_h / 2.0f);
+  }
 #endif
 }
 
-void
-Compositor::render_shadowmap(Viewer& viewer)
+Camera
+Compositor::create_shadow_camera(Viewer const& viewer) const
 {
-  OpenGLState state;
-
-  glViewport(0, 0, g_shadowmap->get_width(), g_shadowmap->get_height());
-
-  glClearColor(1.0, 0.0, 1.0, 1.0);
-  glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-
   glm::vec3 light_pos = glm::rotate(glm::vec3(10.0f, 10.0f, 10.0f), viewer.m_cfg.m_light_angle, glm::vec3(0.0f, 1.0f, 0.0f));
   glm::vec3 up = glm::rotate(glm::vec3(0.0f, 1.0f, 0.0f), viewer.m_cfg.m_light_up, glm::vec3(0.0f, 0.0f, 1.0f));
   glm::vec3 look_at(0.0f, 0.0f, 0.0f);
@@ -229,27 +275,25 @@ Compositor::render_shadowmap(Viewer& viewer)
 
   camera.look_at(light_pos, look_at, up);
 
-  g_shadowmap_matrix = glm::mat4(0.5, 0.0, 0.0, 0.0,
-                                 0.0, 0.5, 0.0, 0.0,
-                                 0.0, 0.0, 0.5, 0.0,
-                                 0.5, 0.5, 0.5, 1.0);
-
-  g_shadowmap_matrix = g_shadowmap_matrix * camera.get_matrix();
-
-  viewer.m_scene_manager->render(camera, true);
+  return camera;
 }
 
 void
-Compositor::render_scene(Viewer& viewer, Stereo stereo)
+Compositor::render_shadowmap(Viewer& viewer, Camera const& camera)
 {
   OpenGLState state;
 
-  glViewport(0, 0, m_screen_w, m_screen_h);
+  glViewport(0, 0, g_shadowmap->get_width(), g_shadowmap->get_height());
 
-  // clear the screen
-  glClearColor(0.0, 0.0, 0.0, 1.0);
+  glClearColor(1.0, 0.0, 1.0, 1.0);
   glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
+  viewer.m_scene_manager->draw(camera, true);
+}
+
+Camera
+Compositor::create_eye_camera(Viewer const& viewer, Stereo stereo) const
+{
   glm::vec3 look_at = viewer.m_cfg.m_look_at;
   glm::vec3 up = viewer.m_cfg.m_up;
 
@@ -291,7 +335,21 @@ Compositor::render_scene(Viewer& viewer, Stereo stereo)
   camera.perspective(viewer.m_cfg.m_fov, viewer.m_cfg.m_aspect_ratio, viewer.m_cfg.m_near_z, viewer.m_cfg.m_far_z);
   camera.look_at(eye + sideways, eye + look_at * viewer.m_cfg.m_convergence, up);
 
-  viewer.m_scene_manager->render(camera, false, stereo);
+  return camera;
+}
+
+void
+Compositor::render_scene(Viewer& viewer, Camera const& camera, Stereo stereo)
+{
+  OpenGLState state;
+
+  glViewport(0, 0, m_screen_w, m_screen_h);
+
+  // clear the screen
+  glClearColor(0.0, 0.0, 0.0, 1.0);
+  glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+
+  viewer.m_scene_manager->draw(camera, false, stereo);
 }
 
 void
@@ -55,8 +55,11 @@ public:
   void toggle_stereo_mode();
 
 private:
-  void render_scene(Viewer& viewer, Stereo stereo);
-  void render_shadowmap(Viewer& viewer);
+  Camera create_eye_camera(Viewer const& viewer, Stereo stereo) const;
+  Camera create_shadow_camera(Viewer const& viewer) const;
+
+  void render_scene(Viewer& viewer, Camera const& camera, Stereo stereo);
+  void render_shadowmap(Viewer& viewer, Camera const& camera);
   void render_menu(RenderContext const& ctx, Viewer const& viewer);
 
 private:
@@ -0,0 +1,496 @@
+#include "compressed_image.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string.h>
+
+#include "format.hpp"
+
+namespace {
+
+uint8_t const KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+uint32_t const KTX_ENDIANNESS = 0x04030201;
+size_t const KTX_HEADER_SIZE = 64;
+char const KTX_ORIENTATION_KEY[] = "KTXorientation";
+char const KTX_ORIENTATION_UP[] = "S=r,T=u";
+
+// GL_RGB and GL_RGBA, used as base internal format in the KTX header
+uint32_t const BASE_RGB = 0x1907;
+uint32_t const BASE_RGBA = 0x1908;
+
+size_t const DDS_HEADER_SIZE = 128;
+size_t const DDS_DX10_HEADER_SIZE = 20;
+
+uint32_t fourcc(char const* code)
+{
+  return static_cast<uint32_t>(code[0]) |
+    (static_cast<uint32_t>(code[1]) << 8) |
+    (static_cast<uint32_t>(code[2]) << 16) |
+    (static_cast<uint32_t>(code[3]) << 24);
+}
+
+uint32_t read_u32(std::vector<uint8_t> const& data, size_t offset)
+{
+  if (offset + 4 > data.size())
+  {
+    throw std::runtime_error("unexpected end of file");
+  }
+  uint32_t value;
+  memcpy(&value, data.data() + offset, 4);
+  return value;
+}
+
+void write_u32(std::ostream& out, uint32_t value)
+{
+  out.write(reinterpret_cast<char const*>(&value), 4);
+}
+
+uint32_t format_from_dxgi(uint32_t dxgi)
+{
+  switch(dxgi)
+  {
+    case 71: // DXGI_FORMAT_BC1_UNORM
+    case 72: // DXGI_FORMAT_BC1_UNORM_SRGB
+      return CompressedImage::BC1_RGBA;
+
+    case 77: // DXGI_FORMAT_BC3_UNORM
+    case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+      return CompressedImage::BC3_RGBA;
+
+    case 98: // DXGI_FORMAT_BC7_UNORM
+    case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+      return CompressedImage::BC7_RGBA;
+
+    default:
+      throw std::runtime_error(format("unsupported DXGI format %d", dxgi));
+  }
+}
+
+uint32_t plain_format(uint32_t format)
+{
+  switch(format)
+  {
+    case 0x8C4C: return CompressedImage::BC1_RGB; // GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+    case 0x8C4D: return CompressedImage::BC1_RGBA; // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+    case 0x8C4F: return CompressedImage::BC3_RGBA; // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+    case 0x8E8D: return CompressedImage::BC7_RGBA; // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+    case 0x9275: return CompressedImage::ETC2_RGB8; // GL_COMPRESSED_SRGB8_ETC2
+    case 0x9279: return CompressedImage::ETC2_RGBA8; // GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC
+    default: return format;
+  }
+}
+
+/** Mirrors the first \a rows texel rows of a BC1 block, each row has
+    its own byte of indices */
+void flip_bc1_block(uint8_t* block, int rows)
+{
+  std::reverse(block + 4, block + 4 + rows);
+}
+
+/** Mirrors the first \a rows texel rows of a BC3 alpha block, each row
+    has twelve bits of indices after the two endpoints */
+void flip_bc3_alpha_block(uint8_t* block, int rows)
+{
+  uint64_t bits = 0;
+  memcpy(&bits, block + 2, 6);
+
+  uint64_t flipped = bits & ~((uint64_t(1) << (12 * rows)) - 1);
+  for(int y = 0; y < rows; ++y)
+  {
+    flipped |= ((bits >> (12 * y)) & 0xfff) << (12 * (rows - 1 - y));
+  }
+  memcpy(block + 2, &flipped, 6);
+}
+
+/** Flips \a level upside down by swapping block rows and the texel
+    rows inside each block. False when the height isn't a multiple of
+    the block height, the padding rows would end up at the bottom. */
+bool flip_level(uint32_t gl_format, CompressedImage::Level& level)
+{
+  int rows;
+  if (level.height % 4 == 0)
+  {
+    rows = 4;
+  }
+  else if (level.height < 4)
+  {
+    rows = level.height;
+  }
+  else
+  {
+    return false;
+  }
+
+  int const block_bytes = CompressedImage::get_block_bytes(gl_format);
+  int const blocks_y = (level.height + 3) / 4;
+  size_t const row_bytes = static_cast<size_t>((level.width + 3) / 4) * block_bytes;
+
+  uint8_t* const data = level.data.data();
+  for(int y = 0; y < blocks_y / 2; ++y)
+  {
+    std::swap_ranges(data + y * row_bytes, data + (y + 1) * row_bytes,
+                     data + (blocks_y - 1 - y) * row_bytes);
+  }
+
+  for(size_t offset = 0; offset < level.data.size(); offset += block_bytes)
+  {
+    if (gl_format == CompressedImage::BC3_RGBA)
+    {
+      flip_bc3_alpha_block(data + offset, rows);
+      flip_bc1_block(data + offset + 8, rows);
+    }
+    else
+    {
+      flip_bc1_block(data + offset, rows);
+    }
+  }
+
+  return true;
+}
+
+/** Brings levels stored top to bottom into OpenGL order. Only BC1 and
+    BC3 have a fixed block layout that can be flipped, BC7 and ETC2
+    would have to be decoded and encoded again. The mip chain ends
+    before the first level that can't be flipped. */
+void flip_levels(uint32_t gl_format, std::vector<CompressedImage::Level>& levels)
+{
+  if (gl_format != CompressedImage::BC1_RGB &&
+      gl_format != CompressedImage::BC1_RGBA &&
+      gl_format != CompressedImage::BC3_RGBA)
+  {
+    throw std::runtime_error(format("format 0x%x is stored top to bottom and can't be flipped", gl_format));
+  }
+
+  for(size_t i = 0; i < levels.size(); ++i)
+  {
+    if (!flip_level(gl_format, levels[i]))
+    {
+      if (i == 0)
+      {
+        throw std::runtime_error(format("height %d is stored top to bottom and can't be flipped, "
+                                        "it isn't a multiple of 4", levels[i].height));
+      }
+      levels.resize(i);
+      break;
+    }
+  }
+}
+
+/** True when the KTXorientation key of the key/value data says the
+    rows go up, as OpenGL wants them. Files without it are top to
+    bottom, which is what most tools write. */
+bool is_ktx_bottom_up(std::vector<uint8_t> const& data, size_t offset, size_t end)
+{
+  while(offset + 4 <= end)
+  {
+    uint32_t const size = read_u32(data, offset);
+    offset += 4;
+    if (offset + size > end)
+    {
+      throw std::runtime_error("broken KTX key/value data");
+    }
+
+    char const* const pair = reinterpret_cast<char const*>(data.data() + offset);
+    size_t const key_length = strnlen(pair, size);
+    if (key_length < size && strcmp(pair, KTX_ORIENTATION_KEY) == 0)
+    {
+      std::string const value(pair + key_length + 1, strnlen(pair + key_length + 1, size - key_length - 1));
+      return value.find("T=u") != std::string::npos;
+    }
+
+    offset += (size + 3) & ~3u;
+  }
+  return false;
+}
+
+std::vector<uint8_t> read_file(std::filesystem::path const& filename)
+{
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+  {
+    throw std::runtime_error("couldn't open " + filename.string());
+  }
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+CompressedImage load_ktx(std::vector<uint8_t> const& data)
+{
+  if (data.size() < KTX_HEADER_SIZE || memcmp(data.data(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+  {
+    throw std::runtime_error("not a KTX file");
+  }
+  if (read_u32(data, 12) != KTX_ENDIANNESS)
+  {
+    throw std::runtime_error("byte swapped KTX files aren't supported");
+  }
+
+  uint32_t const gl_type = read_u32(data, 16);
+  uint32_t const gl_format = plain_format(read_u32(data, 28));
+  int const width = static_cast<int>(read_u32(data, 36));
+  int const height = static_cast<int>(read_u32(data, 40));
+  uint32_t const depth = read_u32(data, 44);
+  uint32_t const array_elements = read_u32(data, 48);
+  uint32_t const faces = read_u32(data, 52);
+  uint32_t const num_levels = std::max(1u, read_u32(data, 56));
+  uint32_t const key_value_bytes = read_u32(data, 60);
+
+  if (gl_type != 0 || CompressedImage::get_block_bytes(gl_format) == 0)
+  {
+    throw std::runtime_error(format("unsupported KTX format 0x%x", gl_format));
+  }
+  if (depth > 1 || array_elements > 0 || faces != 1)
+  {
+    throw std::runtime_error("only plain 2D KTX textures are supported");
+  }
+
+  if (KTX_HEADER_SIZE + key_value_bytes > data.size())
+  {
+    throw std::runtime_error("broken KTX key/value data");
+  }
+  bool const bottom_up = is_ktx_bottom_up(data, KTX_HEADER_SIZE, KTX_HEADER_SIZE + key_value_bytes);
+
+  std::vector<CompressedImage::Level> levels;
+  size_t offset = KTX_HEADER_SIZE + key_value_bytes;
+  for(uint32_t i = 0; i < num_levels; ++i)
+  {
+    CompressedImage::Level level;
+    level.width = std::max(1, width >> i);
+    level.height = std::max(1, height >> i);
+
+    uint32_t const image_size = read_u32(data, offset);
+    offset += 4;
+    if (image_size != CompressedImage::get_level_size(gl_format, level.width, level.height) ||
+        offset + image_size > data.size())
+    {
+      throw std::runtime_error(format("broken KTX level %d", i));
+    }
+    level.data.assign(data.begin() + offset, data.begin() + offset + image_size);
+    offset += (image_size + 3) & ~3u;
+
+    levels.push_back(std::move(level));
+  }
+
+  if (!bottom_up)
+  {
+    flip_levels(gl_format, levels);
+  }
+
+  return CompressedImage(gl_format, std::move(levels));
+}
+
+CompressedImage load_dds(std::vector<uint8_t> const& data)
+{
+  if (data.size() < DDS_HEADER_SIZE || read_u32(data, 0) != fourcc("DDS ") || read_u32(data, 4) != 124)
+  {
+    throw std::runtime_error("not a DDS file");
+  }
+
+  int const height = static_cast<int>(read_u32(data, 12));
+  int const width = static_cast<int>(read_u32(data, 16));
+  uint32_t const num_levels = std::max(1u, read_u32(data, 28));
+  uint32_t const code = read_u32(data, 84);
+
+  uint32_t gl_format;
+  size_t offset = DDS_HEADER_SIZE;
+  if (code == fourcc("DXT1"))
+  {
+    gl_format = CompressedImage::BC1_RGBA;
+  }
+  else if (code == fourcc("DXT5"))
+  {
+    gl_format = CompressedImage::BC3_RGBA;
+  }
+  else if (code == fourcc("DX10"))
+  {
+    gl_format = format_from_dxgi(read_u32(data, DDS_HEADER_SIZE));
+    if (read_u32(data, DDS_HEADER_SIZE + 12) != 1)
+    {
+      throw std::runtime_error("DDS texture arrays aren't supported");
+    }
+    offset += DDS_DX10_HEADER_SIZE;
+  }
+  else
+  {
+    throw std::runtime_error("DDS file isn't DXT1, DXT5 or DX10");
+  }
+
+  std::vector<CompressedImage::Level> levels;
+  for(uint32_t i = 0; i < num_levels; ++i)
+  {
+    CompressedImage::Level level;
+    level.width = std::max(1, width >> i);
+    level.height = std::max(1, height >> i);
+
+    size_t const size = CompressedImage::get_level_size(gl_format, level.width, level.height);
+    if (offset + size > data.size())
+    {
+      throw std::runtime_error(format("broken DDS level %d", i));
+    }
+    level.data.assign(data.begin() + offset, data.begin() + offset + size);
+    offset += size;
+
+    levels.push_back(std::move(level));
+  }
+
+  // DDS has no orientation, it is always top to bottom
+  flip_levels(gl_format, levels);
+
+  return CompressedImage(gl_format, std::move(levels));
+}
+
+std::string lowercase_extension(std::filesystem::path const& filename)
+{
+  std::string ext = filename.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext;
+}
+
+} // namespace
+
+CompressedImage
+CompressedImage::from_file(std::filesystem::path const& filename)
+{
+  std::vector<uint8_t> const data = read_file(filename);
+  try
+  {
+    if (lowercase_extension(filename) == ".dds")
+    {
+      return load_dds(data);
+    }
+    else
+    {
+      return load_ktx(data);
+    }
+  }
+  catch(std::exception const& err)
+  {
+    throw std::runtime_error(filename.string() + ": " + err.what());
+  }
+}
+
+bool
+CompressedImage::is_compressed_file(std::filesystem::path const& filename)
+{
+  std::string const ext = lowercase_extension(filename);
+  return ext == ".ktx" || ext == ".dds";
+}
+
+std::filesystem::path
+CompressedImage::find_sibling(std::filesystem::path const& filename)
+{
+  std::error_code ec;
+  std::filesystem::file_time_type const image_time = std::filesystem::last_write_time(filename, ec);
+
+  for(char const* ext : { ".ktx", ".dds" })
+  {
+    std::filesystem::path sibling = filename;
+    sibling.replace_extension(ext);
+
+    std::error_code sibling_ec;
+    std::filesystem::file_time_type const sibling_time = std::filesystem::last_write_time(sibling, sibling_ec);
+    // a sibling without the original image is fine, a stale one isn't
+    if (!sibling_ec && (ec || sibling_time >= image_time))
+    {
+      return sibling;
+    }
+  }
+
+  return {};
+}
+
+int
+CompressedImage::get_block_bytes(uint32_t format)
+{
+  switch(format)
+  {
+    case BC1_RGB:
+    case BC1_RGBA:
+    case ETC2_RGB8:
+      return 8;
+
+    case BC3_RGBA:
+    case BC7_RGBA:
+    case ETC2_RGBA8:
+      return 16;
+
+    default:
+      return 0;
+  }
+}
+
+size_t
+CompressedImage::get_level_size(uint32_t format, int width, int height)
+{
+  return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * get_block_bytes(format);
+}
+
+CompressedImage::CompressedImage(uint32_t format, std::vector<Level> levels) :
+  m_format(format),
+  m_levels(std::move(levels))
+{
+  if (m_levels.empty())
+  {
+    throw std::runtime_error("CompressedImage: no levels");
+  }
+}
+
+size_t
+CompressedImage::get_size() const
+{
+  size_t size = 0;
+  for(auto const& level : m_levels)
+  {
+    size += level.data.size();
+  }
+  return size;
+}
+
+void
+CompressedImage::save_ktx(std::filesystem::path const& filename) const
+{
+  std::ofstream out(filename, std::ios::binary);
+  if (!out)
+  {
+    throw std::runtime_error("couldn't write " + filename.string());
+  }
+
+  out.write(reinterpret_cast<char const*>(KTX_IDENTIFIER), sizeof(KTX_IDENTIFIER));
+  write_u32(out, KTX_ENDIANNESS);
+  write_u32(out, 0); // glType
+  write_u32(out, 1); // glTypeSize
+  write_u32(out, 0); // glFormat
+  write_u32(out, m_format);
+  write_u32(out, has_alpha() ? BASE_RGBA : BASE_RGB);
+  write_u32(out, static_cast<uint32_t>(get_width()));
+  write_u32(out, static_cast<uint32_t>(get_height()));
+  write_u32(out, 0); // pixelDepth
+  write_u32(out, 0); // numberOfArrayElements
+  write_u32(out, 1); // numberOfFaces
+  write_u32(out, static_cast<uint32_t>(m_levels.size()));
+
+  // key and value with their terminating zeros, padded to four bytes
+  uint32_t const pair_size = sizeof(KTX_ORIENTATION_KEY) + sizeof(KTX_ORIENTATION_UP);
+  uint32_t const padding = ((pair_size + 3) & ~3u) - pair_size;
+  write_u32(out, 4 + pair_size + padding); // bytesOfKeyValueData
+
+  write_u32(out, pair_size);
+  out.write(KTX_ORIENTATION_KEY, sizeof(KTX_ORIENTATION_KEY));
+  out.write(KTX_ORIENTATION_UP, sizeof(KTX_ORIENTATION_UP));
+  out.write("\0\0\0", padding);
+
+  for(auto const& level : m_levels)
+  {
+    // block sizes are multiples of four, no padding needed
+    write_u32(out, static_cast<uint32_t>(level.data.size()));
+    out.write(reinterpret_cast<char const*>(level.data.data()), static_cast<std::streamsize>(level.data.size()));
+  }
+
+  if (!out)
+  {
+    throw std::runtime_error("couldn't write " + filename.string());
+  }
+}
+
+/* EOF */
@@ -0,0 +1,76 @@
+#ifndef HEADER_COMPRESSED_IMAGE_HPP
+#define HEADER_COMPRESSED_IMAGE_HPP
+
+#include <filesystem>
+#include <stdint.h>
+#include <vector>
+
+/** A block compressed image with its mip chain, as stored in KTX
+    (version 1) and DDS files. The data is kept as is and handed to
+    glCompressedTexImage2D() in OpenGL row order, bottom to top. DDS
+    files and KTX files without a KTXorientation of "T=u" store the
+    rows top to bottom, BC1 and BC3 blocks of those are flipped on
+    load, other formats are rejected. save_ktx() writes the
+    orientation. sRGB formats are read as their plain counterparts,
+    like all other textures. */
+class CompressedImage
+{
+public:
+  /** GL internal formats, spelled out as the GLES2 headers lack them */
+  enum Format : uint32_t
+  {
+    BC1_RGB = 0x83F0,
+    BC1_RGBA = 0x83F1,
+    BC3_RGBA = 0x83F3,
+    BC7_RGBA = 0x8E8C,
+    ETC2_RGB8 = 0x9274,
+    ETC2_RGBA8 = 0x9278
+  };
+
+  struct Level
+  {
+    int width;
+    int height;
+    std::vector<uint8_t> data;
+  };
+
+  /** Reads a .ktx or .dds file, throws on errors and on formats other
+      than the ones above */
+  static CompressedImage from_file(std::filesystem::path const& filename);
+
+  /** True for the extensions from_file() handles */
+  static bool is_compressed_file(std::filesystem::path const& filename);
+
+  /** The .ktx or .dds file next to the image \a filename, empty when
+      there is none or it is older than the image */
+  static std::filesystem::path find_sibling(std::filesystem::path const& filename);
+
+  /** Bytes per 4x4 block of \a format, 0 for unknown formats */
+  static int get_block_bytes(uint32_t format);
+
+  /** Bytes of a \a width x \a height level in \a format */
+  static size_t get_level_size(uint32_t format, int width, int height);
+
+private:
+  uint32_t m_format;
+  std::vector<Level> m_levels;
+
+public:
+  CompressedImage(uint32_t format, std::vector<Level> levels);
+
+  uint32_t get_format() const { return m_format; }
+  bool has_alpha() const { return m_format != BC1_RGB && m_format != ETC2_RGB8; }
+  std::vector<Level> const& get_levels() const { return m_levels; }
+  int get_width() const { return m_levels.front().width; }
+  int get_height() const { return m_levels.front().height; }
+
+  /** Bytes of all levels together */
+  size_t get_size() const;
+
+  /** Writes the image as KTX, throws on errors */
+  void save_ktx(std::filesystem::path const& filename) const;
+};
+
+#endif
+
+/* EOF */
@@ -1,6 +1,7 @@
 #if 0
 #include "examples.hpp"
 #include "globals.hpp"
+#include "program_registry.hpp"
 
 void make_pose()
 {
@@ -118,8 +119,7 @@ void make_lightcone()
   material->set_uniform("diffuse_texture", 0);
   material->set_uniform("ModelViewMatrix", UniformSymbol::ModelViewMatrix);
   material->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
-  material->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/lightcone.vert"),
-                                        Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/lightcone.frag")));
+  material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/lightcone.vert", g_datadir + "/glsl/lightcone.frag"));
 
   auto mesh = std::make_unique<Mesh>(GL_POINTS);
   // generate light cone mesh
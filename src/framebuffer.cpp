@@ -106,9 +106,10 @@ Framebuffer::draw_depth(float x, float y, float w, float h, float z)
 #ifndef HAVE_OPENGLES2
   OpenGLState state;
 
-  glEnable(GL_TEXTURE_2D);
-
-  glBindTexture(GL_TEXTURE_2D, m_depth_buffer->get_id());
+  // fixed function drawing
+  OpenGLStateTracker::get().use_program(0);
+  OpenGLStateTracker::get().enable(GL_TEXTURE_2D);
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, m_depth_buffer->get_id());
 
   GLint compare_mode;
   GLint compare_func;
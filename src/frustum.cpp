@@ -0,0 +1,71 @@
+#include "frustum.hpp"
+
+Frustum::Frustum() :
+  m_planes()
+{
+}
+
+Frustum::Frustum(glm::mat4 const& m) :
+  m_planes()
+{
+  // Gribb/Hartmann plane extraction, glm matrices are column-major
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+  m_planes[Left]   = row3 + row0;
+  m_planes[Right]  = row3 - row0;
+  m_planes[Bottom] = row3 + row1;
+  m_planes[Top]    = row3 - row1;
+  m_planes[Near]   = row3 + row2;
+  m_planes[Far]    = row3 - row2;
+
+  for(auto& plane : m_planes)
+  {
+    plane /= glm::length(glm::vec3(plane));
+  }
+}
+
+bool
+Frustum::intersects(AABB const& box) const
+{
+  if (box.is_infinite())
+  {
+    return true;
+  }
+  else if (box.is_empty())
+  {
+    return false;
+  }
+  else
+  {
+    for(auto const& plane : m_planes)
+    {
+      // test the corner that lies furthest along the plane normal
+      glm::vec3 p(plane.x > 0.0f ? box.max.x : box.min.x,
+                  plane.y > 0.0f ? box.max.y : box.min.y,
+                  plane.z > 0.0f ? box.max.z : box.min.z);
+      if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+bool
+Frustum::intersects(glm::vec3 const& center, float radius) const
+{
+  for(auto const& plane : m_planes)
+  {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* EOF */
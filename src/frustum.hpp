@@ -0,0 +1,31 @@
+#ifndef HEADER_FRUSTUM_HPP
+#define HEADER_FRUSTUM_HPP
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "aabb.hpp"
+
+/** The six clipping planes of a view-projection matrix, plane normals
+    point to the inside */
+class Frustum
+{
+public:
+  enum { Left, Right, Bottom, Top, Near, Far };
+
+private:
+  glm::vec4 m_planes[6];
+
+public:
+  Frustum();
+  Frustum(glm::mat4 const& view_projection);
+
+  glm::vec4 const& get_plane(int i) const { return m_planes[i]; }
+
+  bool intersects(AABB const& box) const;
+  bool intersects(glm::vec3 const& center, float radius) const;
+};
+
+#endif
+
+/* EOF */
@@ -13,6 +13,8 @@ public:
   GLContext(GLContext&& other);
   ~GLContext();
 
+  SDL_GLContext get() const { return m_context; }
+
 private:
   GLContext(const GLContext&) = delete;
   GLContext& operator=(const GLContext&) = delete;
@@ -33,14 +33,30 @@ private:
   glm::vec4 m_specular;
   float m_shininess;
 
+  // point light in world space, no influence beyond m_radius
+  glm::vec3 m_position;
+  float m_radius;
+
 public:
   Light() :
     m_diffuse(1.0f, 1.0f, 1.0f, 1.0f),
     m_ambient(0.0f, 0.0f, 0.0f, 1.0f),
     m_specular(0.0f, 0.0f, 0.0f, 1.0f),
-    m_shininess(0)
+    m_shininess(0),
+    m_position(0.0f, 0.0f, 0.0f),
+    m_radius(10.0f)
   {}
 
+  void set_position(const glm::vec3& position)
+  {
+    m_position = position;
+  }
+
+  void set_radius(float radius)
+  {
+    m_radius = radius;
+  }
+
   void set_diffuse(const glm::vec4& diffuse)
   {
     m_diffuse = diffuse;
@@ -71,6 +87,16 @@ public:
     return m_specular;
   }
 
+  glm::vec3 get_position() const
+  {
+    return m_position;
+  }
+
+  float get_radius() const
+  {
+    return m_radius;
+  }
+
 private:
   Light(const Light&);
   Light& operator=(const Light&);
@@ -0,0 +1,223 @@
+#include "light_clusters.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+#include "assert_gl.hpp"
+#include "opengl_state.hpp"
+#include "render_stats.hpp"
+#include "stopwatch.hpp"
+
+namespace {
+
+int clamp_cell(float value, int size)
+{
+  return std::max(0, std::min(size - 1, static_cast<int>(floorf(value))));
+}
+
+} // namespace
+
+LightClusters::LightClusters() :
+  m_lights(),
+  m_boxes(),
+  m_grid(),
+  m_indices(),
+  m_cursor(),
+  m_slice_scale(0.0f),
+  m_slice_bias(0.0f),
+  m_buffers(),
+  m_textures()
+{
+}
+
+LightClusters::~LightClusters()
+{
+#ifndef HAVE_OPENGLES2
+  if (m_textures[0])
+  {
+    for(GLuint texture : m_textures)
+    {
+      OpenGLStateTracker::get().forget_texture(texture);
+    }
+    glDeleteTextures(3, m_textures);
+    glDeleteBuffers(3, m_buffers);
+  }
+#endif
+}
+
+void
+LightClusters::bind_samplers(GLuint program)
+{
+#ifndef HAVE_OPENGLES2
+  struct { char const* name; GLint unit; } const samplers[] = {
+    { "ClusterLights", LIGHTS_UNIT },
+    { "ClusterGrid", GRID_UNIT },
+    { "ClusterIndices", INDICES_UNIT }
+  };
+
+  for(auto const& sampler : samplers)
+  {
+    GLint const location = glGetUniformLocation(program, sampler.name);
+    if (location != -1)
+    {
+      glProgramUniform1i(program, location, sampler.unit);
+    }
+  }
+#endif
+}
+
+int
+LightClusters::get_slice(float depth) const
+{
+  return clamp_cell(logf(depth) * m_slice_scale + m_slice_bias, GRID_Z);
+}
+
+void
+LightClusters::build(std::vector<LightPtr> const& lights,
+                     glm::mat4 const& view_matrix, glm::mat4 const& projection_matrix,
+                     float znear, float zfar)
+{
+  Stopwatch stopwatch;
+
+  float const log_range = logf(zfar / znear);
+  m_slice_scale = static_cast<float>(GRID_Z) / log_range;
+  m_slice_bias = -static_cast<float>(GRID_Z) * logf(znear) / log_range;
+
+  m_lights.clear();
+  m_boxes.clear();
+
+  for(auto const& light : lights)
+  {
+    glm::vec3 const p = glm::vec3(view_matrix * glm::vec4(light->get_position(), 1.0f));
+    float const r = light->get_radius();
+
+    // the camera looks down -z
+    float depth_min = -p.z - r;
+    float depth_max = -p.z + r;
+    if (depth_max < znear || depth_min > zfar)
+    {
+      continue;
+    }
+    depth_min = std::max(depth_min, znear);
+    depth_max = std::min(depth_max, zfar);
+
+    // the projected corners of the bounding box, clipped to the depth
+    // range, enclose the projected sphere
+    glm::vec2 ndc_min(1e30f);
+    glm::vec2 ndc_max(-1e30f);
+    for(int i = 0; i < 8; ++i)
+    {
+      glm::vec4 const corner((i & 1) ? p.x + r : p.x - r,
+                             (i & 2) ? p.y + r : p.y - r,
+                             (i & 4) ? -depth_max : -depth_min,
+                             1.0f);
+      glm::vec4 const clip = projection_matrix * corner;
+      glm::vec2 const ndc = glm::vec2(clip) / clip.w;
+      ndc_min = glm::min(ndc_min, ndc);
+      ndc_max = glm::max(ndc_max, ndc);
+    }
+
+    if (ndc_max.x < -1.0f || ndc_min.x > 1.0f ||
+        ndc_max.y < -1.0f || ndc_min.y > 1.0f)
+    {
+      continue;
+    }
+
+    ClusterBox box;
+    box.x0 = clamp_cell((ndc_min.x * 0.5f + 0.5f) * GRID_X, GRID_X);
+    box.x1 = clamp_cell((ndc_max.x * 0.5f + 0.5f) * GRID_X, GRID_X);
+    box.y0 = clamp_cell((ndc_min.y * 0.5f + 0.5f) * GRID_Y, GRID_Y);
+    box.y1 = clamp_cell((ndc_max.y * 0.5f + 0.5f) * GRID_Y, GRID_Y);
+    box.z0 = get_slice(depth_min);
+    box.z1 = get_slice(depth_max);
+    m_boxes.push_back(box);
+
+    m_lights.push_back(ClusterLight{ glm::vec4(p, r), light->get_diffuse() });
+  }
+
+  // count, prefix sum, fill, so that each cluster's lights are
+  // contiguous in m_indices
+  m_grid.assign(2 * NUM_CLUSTERS, 0);
+  for(ClusterBox const& box : m_boxes)
+  {
+    for(int z = box.z0; z <= box.z1; ++z)
+      for(int y = box.y0; y <= box.y1; ++y)
+        for(int x = box.x0; x <= box.x1; ++x)
+        {
+          m_grid[2 * ((z * GRID_Y + y) * GRID_X + x) + 1] += 1;
+        }
+  }
+
+  uint32_t offset = 0;
+  m_cursor.resize(NUM_CLUSTERS);
+  for(int cluster = 0; cluster < NUM_CLUSTERS; ++cluster)
+  {
+    m_grid[2 * cluster] = offset;
+    m_cursor[cluster] = offset;
+    offset += m_grid[2 * cluster + 1];
+  }
+
+  m_indices.resize(offset);
+  for(size_t i = 0; i < m_boxes.size(); ++i)
+  {
+    ClusterBox const& box = m_boxes[i];
+    for(int z = box.z0; z <= box.z1; ++z)
+      for(int y = box.y0; y <= box.y1; ++y)
+        for(int x = box.x0; x <= box.x1; ++x)
+        {
+          m_indices[m_cursor[(z * GRID_Y + y) * GRID_X + x]++] = static_cast<uint32_t>(i);
+        }
+  }
+
+  g_render_stats.lights += static_cast<int>(lights.size());
+  g_render_stats.visible_lights += static_cast<int>(m_lights.size());
+  g_render_stats.light_indices += static_cast<int>(m_indices.size());
+  g_render_stats.light_binning_msec += stopwatch.get_msec();
+}
+
+void
+LightClusters::upload()
+{
+#ifndef HAVE_OPENGLES2
+  if (!m_textures[0])
+  {
+    glGenBuffers(3, m_buffers);
+    glGenTextures(3, m_textures);
+  }
+
+  OpenGLStateTracker& state = OpenGLStateTracker::get();
+
+  struct { GLuint unit; GLenum format; void const* data; size_t size; } const buffers[] = {
+    { LIGHTS_UNIT, GL_RGBA32F, m_lights.data(), m_lights.size() * sizeof(ClusterLight) },
+    { GRID_UNIT, GL_RG32UI, m_grid.data(), m_grid.size() * sizeof(uint32_t) },
+    { INDICES_UNIT, GL_R32UI, m_indices.data(), m_indices.size() * sizeof(uint32_t) }
+  };
+
+  for(int i = 0; i < 3; ++i)
+  {
+    // glBufferData() orphans last frame's storage, an empty buffer
+    // would leave the texture incomplete
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(buffers[i].size, 16),
+                 buffers[i].size ? buffers[i].data : nullptr, GL_STREAM_DRAW);
+
+    state.active_texture(GL_TEXTURE0 + buffers[i].unit);
+    state.bind_texture(GL_TEXTURE_BUFFER, m_textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, buffers[i].format, m_buffers[i]);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  assert_gl("LightClusters::upload");
+#endif
+}
+
+std::vector<uint32_t>
+LightClusters::get_cluster(int x, int y, int z) const
+{
+  int const cluster = (z * GRID_Y + y) * GRID_X + x;
+  uint32_t const first = m_grid[2 * cluster];
+  uint32_t const count = m_grid[2 * cluster + 1];
+  return std::vector<uint32_t>(m_indices.begin() + first, m_indices.begin() + first + count);
+}
+
+/* EOF */
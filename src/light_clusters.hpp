@@ -0,0 +1,96 @@
+#ifndef HEADER_LIGHT_CLUSTERS_HPP
+#define HEADER_LIGHT_CLUSTERS_HPP
+
+#include <stdint.h>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "light.hpp"
+#include "opengl.hpp"
+
+/** Bins point lights into a grid of view space clusters, screen tiles
+    in x and y and exponentially growing depth slices in z, so that a
+    fragment only has to look at the lights that can reach its cluster.
+    Lights outside of the view frustum don't end up in any cluster.
+
+    The light list, the per-cluster ranges and the light indices are
+    handed to the shaders as texture buffers, see data/glsl/clusters.glsl.
+    Nothing is uploaded on GLES2, which only has the main light. */
+class LightClusters
+{
+public:
+  enum { GRID_X = 16, GRID_Y = 8, GRID_Z = 24 };
+  enum { NUM_CLUSTERS = GRID_X * GRID_Y * GRID_Z };
+
+  /** Texture units reserved for the buffers, above what materials use */
+  enum { LIGHTS_UNIT = 13, GRID_UNIT = 14, INDICES_UNIT = 15 };
+
+  /** Layout of a light in the ClusterLights texture buffer */
+  struct ClusterLight
+  {
+    glm::vec4 position_radius; // view space
+    glm::vec4 color;
+  };
+
+  /** Connects the ClusterLights, ClusterGrid and ClusterIndices
+      samplers of \a program to the reserved texture units */
+  static void bind_samplers(GLuint program);
+
+private:
+  struct ClusterBox
+  {
+    int x0, x1;
+    int y0, y1;
+    int z0, z1;
+  };
+
+  std::vector<ClusterLight> m_lights;
+  std::vector<ClusterBox> m_boxes;
+
+  /** Per cluster first index into m_indices and light count */
+  std::vector<uint32_t> m_grid;
+  std::vector<uint32_t> m_indices;
+  std::vector<uint32_t> m_cursor;
+
+  // log(depth) * m_slice_scale + m_slice_bias gives the depth slice
+  float m_slice_scale;
+  float m_slice_bias;
+
+  GLuint m_buffers[3];
+  GLuint m_textures[3];
+
+public:
+  LightClusters();
+  ~LightClusters();
+
+  /** Bins \a lights for a camera with the given matrices and depth
+      range, runs on the CPU only */
+  void build(std::vector<LightPtr> const& lights,
+             glm::mat4 const& view_matrix, glm::mat4 const& projection_matrix,
+             float znear, float zfar);
+
+  /** Uploads the result of build() and binds the buffers to the
+      reserved texture units */
+  void upload();
+
+  int get_light_count() const { return static_cast<int>(m_lights.size()); }
+  int get_index_count() const { return static_cast<int>(m_indices.size()); }
+  float get_slice_scale() const { return m_slice_scale; }
+  float get_slice_bias() const { return m_slice_bias; }
+
+  /** Lights in cluster \a x, \a y, \a z as indices into the visible
+      lights, for tests */
+  std::vector<uint32_t> get_cluster(int x, int y, int z) const;
+
+private:
+  int get_slice(float depth) const;
+
+private:
+  LightClusters(const LightClusters&) = delete;
+  LightClusters& operator=(const LightClusters&) = delete;
+};
+
+#endif
+
+/* EOF */
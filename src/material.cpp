@@ -16,17 +16,27 @@
 
 #include "material.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
 #include "assert_gl.hpp"
+#include "format.hpp"
 #include "log.hpp"
+#include "opengl_state.hpp"
 #include "render_context.hpp"
+#include "render_stats.hpp"
+#include "residency_manager.hpp"
+#include "stopwatch.hpp"
 
 Material::Material() :
   m_cast_shadow(true),
+  m_alpha_test(false),
   m_program(),
+  m_feedback_material(),
   m_textures(),
   m_uniforms(std::make_shared<UniformGroup>()),
   m_capabilities(),
@@ -34,25 +44,30 @@ Material::Material() :
   m_depth_mask(true),
   m_blend_sfactor(GL_ONE),
   m_blend_dfactor(GL_ZERO),
-  m_cull_face(GL_BACK)
+  m_cull_face(GL_BACK),
+  m_finalized(false),
+  m_state()
 {
 }
 
 void
 Material::color_mask(bool r, bool g, bool b, bool a)
 {
+  m_finalized = false;
   m_color_mask = glm::bvec4(r, g, b, a);
 }
 
 void
 Material::depth_mask(bool flag)
 {
+  m_finalized = false;
   m_depth_mask = flag;
 }
 
 void
 Material::blend_func(GLenum sfactor, GLenum dfactor)
 {
+  m_finalized = false;
   m_blend_sfactor = sfactor;
   m_blend_dfactor = dfactor;
 }
@@ -60,103 +75,130 @@ Material::blend_func(GLenum sfactor, GLenum dfactor)
 void
 Material::cull_face(GLenum mode)
 {
+  m_finalized = false;
   m_cull_face = mode;
 }
 
 void
 Material::enable(GLenum cap)
 {
+  m_finalized = false;
   m_capabilities[cap] = true;
 }
 
 void
 Material::disable(GLenum cap)
 {
+  m_finalized = false;
   m_capabilities[cap] = false;
 }
 
+bool
+Material::is_enabled(GLenum cap) const
+{
+  auto it = m_capabilities.find(cap);
+  return it != m_capabilities.end() && it->second;
+}
+
 void
-Material::apply(RenderContext const& context)
+Material::finalize()
 {
-  assert_gl("Material::apply:enter");
+  PipelineState state;
 
   for(auto const& cap : m_capabilities)
   {
+    uint32_t const bit = 1u << PipelineState::capability_bit(cap.first);
+    state.specified_caps |= bit;
     if (cap.second)
     {
-      glEnable(cap.first);
+      state.enabled_caps |= bit;
+    }
+  }
+
+  state.raster = PipelineState::pack_raster(m_color_mask.r, m_color_mask.g, m_color_mask.b, m_color_mask.a,
+                                            m_depth_mask, m_cull_face, m_blend_sfactor, m_blend_dfactor);
+
+  for(auto const& it : m_textures)
+  {
+    int const unit = it.first;
+    TextureValue const& value = it.second;
+    if (unit < 0 || unit >= PipelineState::MAX_TEXTURE_UNITS)
+    {
+      throw std::runtime_error(format("Material: texture unit %d out of range", unit));
+    }
+
+    PipelineState::TextureUnit& texture_unit = state.textures[unit];
+    if (value.type == TextureValue::VIDEO_TEXTURE)
+    {
+      texture_unit = PipelineState::TextureUnit{ GL_TEXTURE_2D, 0, 0, true };
     }
     else
     {
-      glDisable(cap.first);
+      texture_unit = PipelineState::TextureUnit{ value.primary->get_target(),
+                                                 value.primary->get_id(),
+                                                 value.secondary->get_id(),
+                                                 false };
     }
+    state.texture_count = std::max(state.texture_count, unit + 1);
   }
-  assert_gl("caps enable");
 
-  glColorMask(m_color_mask.r, m_color_mask.g, m_color_mask.b, m_color_mask.a);
-  glDepthMask(m_depth_mask);
-  glCullFace(m_cull_face);
+  state.program = m_program ? m_program->get_id() : 0;
+  state.update_sort_key(m_program ? m_program->get_uid() : 0);
 
-  glBlendFunc(m_blend_sfactor, m_blend_dfactor);
-  assert_gl("GL props set");
+  m_state = state;
+  m_finalized = true;
+}
 
-  if (context.get_stereo() == Stereo::Center ||
-      context.get_stereo() == Stereo::Left)
-  {
-    m_uniforms->set_uniform("eye_index", 0);
-  }
-  else
+void
+Material::apply(RenderContext const& context)
+{
+  Stopwatch stopwatch;
+
+  assert_gl("Material::apply:enter");
+
+  if (!m_finalized)
   {
-    m_uniforms->set_uniform("eye_index", 1);
+    finalize();
   }
 
+  TexturePtr const& video_texture = context.get_video_texture();
+  OpenGLStateTracker::get().apply(m_state, context.get_stereo(),
+                                  video_texture ? video_texture->get_target() : 0,
+                                  video_texture ? video_texture->get_id() : 0);
+  assert_gl("pipeline state applied");
+
+  // keeps the textures resident, see ResidencyManager
+  unsigned int const frame = ResidencyManager::get().get_frame();
   for(auto const& it : m_textures)
   {
-    auto const& texture_unit = it.first;
-    auto const& texture_value = it.second;
-
-    if (texture_value.type == TextureValue::VIDEO_TEXTURE)
-    {
-      TexturePtr const& texture = context.get_video_texture();
-      if (texture)
-      {
-        glActiveTexture(GL_TEXTURE0 + texture_unit);
-        glBindTexture(texture->get_target(), texture->get_id());
-      }
-    }
-    else
+    if (it.second.type == TextureValue::REGULAR_TEXTURE)
     {
-      switch(context.get_stereo())
-      {
-        case Stereo::Center:
-        case Stereo::Left:
-          glActiveTexture(GL_TEXTURE0 + texture_unit);
-          glBindTexture(texture_value.primary->get_target(), texture_value.primary->get_id());
-          break;
-
-        case Stereo::Right:
-          glActiveTexture(GL_TEXTURE0 + texture_unit);
-          glBindTexture(texture_value.secondary->get_target(), texture_value.secondary->get_id());
-          break;
-      }
+      it.second.primary->set_last_used(frame);
+      it.second.secondary->set_last_used(frame);
     }
   }
-  assert_gl("textures bound");
 
-  if (m_program)
+  if (context.get_stereo() == Stereo::Center ||
+      context.get_stereo() == Stereo::Left)
+  {
+    m_uniforms->set_uniform("eye_index", 0);
+  }
+  else
   {
-    glUseProgram(m_program->get_id());
-    assert_gl("program bound");
+    m_uniforms->set_uniform("eye_index", 1);
+  }
 
-    if (m_uniforms)
-    {
-      assert_gl("apply uniforms:enter");
-      m_uniforms->apply(m_program, context);
-      assert_gl("apply uniforms:exit");
-    }
+  if (m_program && m_uniforms)
+  {
+    assert_gl("apply uniforms:enter");
+    m_uniforms->apply(m_program, context);
+    assert_gl("apply uniforms:exit");
   }
 
   assert_gl("Material::apply:exit");
+
+  g_render_stats.material_applies += 1;
+  g_render_stats.material_msec += stopwatch.get_msec();
 }
 
 /* EOF */
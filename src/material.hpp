@@ -23,6 +23,7 @@
 #include <tuple>
 #include <unordered_map>
 
+#include "pipeline_state.hpp"
 #include "program.hpp"
 #include "texture.hpp"
 #include "uniform_group.hpp"
@@ -41,8 +42,10 @@ class Material
 {
 private:
   bool m_cast_shadow;
+  bool m_alpha_test;
 
   ProgramPtr m_program;
+  std::shared_ptr<Material> m_feedback_material;
   std::unordered_map<int, TextureValue> m_textures;
   UniformGroupPtr m_uniforms;
 
@@ -56,16 +59,30 @@ private:
 
   GLenum m_cull_face;
 
+  // the above baked by finalize()
+  bool m_finalized;
+  PipelineState m_state;
+
 public:
   Material();
 
   void cast_shadow(bool v) { m_cast_shadow = v; }
   bool cast_shadow() const { return m_cast_shadow; }
 
-  void set_program(ProgramPtr program) { m_program = program; }
-  void set_texture(int unit, TexturePtr texture) { m_textures[unit] = {TextureValue::REGULAR_TEXTURE, texture, texture}; }
-  void set_texture(int unit, TexturePtr left, TexturePtr right) { m_textures[unit] = {TextureValue::REGULAR_TEXTURE, left, right}; }
-  void set_video_texture(int unit) { m_textures[unit] = {TextureValue::VIDEO_TEXTURE, {}, {}}; }
+  /** The fragment program discards fragments, surfaces have holes,
+      set by "material.alpha_test" in .material files */
+  void alpha_test(bool v) { m_alpha_test = v; }
+  bool alpha_test() const { return m_alpha_test; }
+
+  void set_program(ProgramPtr program) { m_program = program; m_finalized = false; }
+  /** Material used in place of this one in the virtual texture
+      feedback pass, see VirtualTexture::get_feedback_material() */
+  void set_feedback_material(std::shared_ptr<Material> material) { m_feedback_material = material; }
+  std::shared_ptr<Material> get_feedback_material() const { return m_feedback_material; }
+
+  void set_texture(int unit, TexturePtr texture) { m_textures[unit] = {TextureValue::REGULAR_TEXTURE, texture, texture}; m_finalized = false; }
+  void set_texture(int unit, TexturePtr left, TexturePtr right) { m_textures[unit] = {TextureValue::REGULAR_TEXTURE, left, right}; m_finalized = false; }
+  void set_video_texture(int unit) { m_textures[unit] = {TextureValue::VIDEO_TEXTURE, {}, {}}; m_finalized = false; }
 
   void color_mask(bool r, bool g, bool b, bool a);
   void depth_mask(bool flag);
@@ -74,6 +91,7 @@ public:
 
   void enable(GLenum cap);
   void disable(GLenum cap);
+  bool is_enabled(GLenum cap) const;
 
   template<typename T>
   void set_uniform(const std::string& name, T const& value)
@@ -81,6 +99,12 @@ public:
     m_uniforms->set_uniform(name, value);
   }
 
+  /** Bakes the state into a PipelineState, done by apply() when the
+      material was changed since the last call */
+  void finalize();
+  PipelineState const& get_pipeline_state() { if (!m_finalized) { finalize(); } return m_state; }
+  uint64_t get_sort_key() { return get_pipeline_state().sort_key; }
+
   void apply(RenderContext const& context);
 
 private:
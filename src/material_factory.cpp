@@ -22,37 +22,72 @@
 #include "globals.hpp"
 #include "framebuffer.hpp"
 #include "material_parser.hpp"
+#include "program_registry.hpp"
 #include "render_context.hpp"
+#include "stopwatch.hpp"
+#include "texture_loader.hpp"
 
 extern glm::mat4 g_shadowmap_matrix;
 extern std::unique_ptr<Framebuffer> g_shadowmap;
 
 MaterialFactory::MaterialFactory() :
-  m_materials()
+  m_recipes(),
+  m_materials(),
+  m_environment_cubemap(),
+  m_uvtest_texture(),
+  m_build_msec(0.0f)
 {
-  m_materials["basic_white"] = create_basic_white();
-  m_materials["phong"] = create_phong(glm::vec3(0.5f, 0.5f, 0.5f),
-                                      glm::vec3(1.0f, 1.0f, 1.0f),
-                                      glm::vec3(1.0f, 1.0f, 1.0f),
-                                      5.0f);
-
-  m_materials["Rim"] = create_phong(glm::vec3(0.5f, 0.5f, 0.5f),
-                                    glm::vec3(1.0f, 1.0f, 1.0f),
-                                    glm::vec3(1.0f, 1.0f, 1.0f),
-                                    1.0f);
-
-  m_materials["Wheel"] = create_phong(glm::vec3(0.1f, 0.1f, 0.1f),
-                                      glm::vec3(1.0f, 1.0f, 1.0f),
-                                      glm::vec3(1.0f, 1.0f, 1.0f),
-                                      8.0f);
-
-  m_materials["Body"] = create_phong(glm::vec3(0.5f, 0.5f, 0.8f),
-                                     glm::vec3(1.0f, 1.0f, 1.0f),
-                                     glm::vec3(0.5f, 0.5f, 0.5f),
-                                     2.5f);
-
-  m_materials["skybox"] = create_skybox();
-  m_materials["textured"] = create_textured();
+  m_recipes["basic_white"] = [this]{ return create_basic_white(); };
+  m_recipes["phong"] = [this]{
+    return create_phong(glm::vec3(0.5f, 0.5f, 0.5f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        5.0f);
+  };
+
+  m_recipes["Rim"] = [this]{
+    return create_phong(glm::vec3(0.5f, 0.5f, 0.5f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        1.0f);
+  };
+
+  m_recipes["Wheel"] = [this]{
+    return create_phong(glm::vec3(0.1f, 0.1f, 0.1f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        8.0f);
+  };
+
+  m_recipes["Body"] = [this]{
+    return create_phong(glm::vec3(0.5f, 0.5f, 0.8f),
+                        glm::vec3(1.0f, 1.0f, 1.0f),
+                        glm::vec3(0.5f, 0.5f, 0.5f),
+                        2.5f);
+  };
+
+  m_recipes["skybox"] = [this]{ return create_skybox(); };
+  m_recipes["textured"] = [this]{ return create_textured(); };
+}
+
+TexturePtr
+MaterialFactory::get_environment_cubemap()
+{
+  if (!m_environment_cubemap)
+  {
+    m_environment_cubemap = Texture::cubemap_from_file(g_datadir + "/textures/miramar/");
+  }
+  return m_environment_cubemap;
+}
+
+TexturePtr
+MaterialFactory::get_uvtest_texture()
+{
+  if (!m_uvtest_texture)
+  {
+    m_uvtest_texture = TextureLoader::get().load(g_datadir + "/textures/uvtest.png");
+  }
+  return m_uvtest_texture;
 }
 
 MaterialPtr
@@ -68,18 +103,20 @@ MaterialFactory::from_file(const std::filesystem::path& filename)
   material->set_uniform("light.diffuse",   glm::vec3(1.0f, 1.0f, 1.0f));
   material->set_uniform("light.ambient",   glm::vec3(0.25f, 0.25f, 0.25f));
   material->set_uniform("light.specular",  glm::vec3(0.6f, 0.6f, 0.6f));
-  material->set_uniform("light.position",
+
+#ifdef HAVE_OPENGLES2
+  // without uniform buffers the blocks.glsl names are plain uniforms
+  material->set_uniform("LightPosition",
                               UniformCallback(
                                 [](ProgramPtr prog, const std::string& name, RenderContext const& ctx) {
-                                  glm::vec3 pos(ctx.get_view_matrix() * glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
-                                  prog->set_uniform(name, pos);
+                                  prog->set_uniform(name, ctx.get_view_matrix() * glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
                                 }));
-
-  material->set_uniform("ShadowMapMatrix",
+  material->set_uniform("ShadowMatrix",
                               UniformCallback(
-                                [](ProgramPtr prog, const std::string& name, RenderContext const& ctx) {
-                                  prog->set_uniform(name, g_shadowmap_matrix * ctx.get_model_matrix());
+                                [](ProgramPtr prog, const std::string& name, RenderContext const&) {
+                                  prog->set_uniform(name, g_shadowmap_matrix);
                                 }));
+#endif
   material->set_texture(2, g_shadowmap->get_depth_texture());
   material->set_uniform("ShadowMap", 2);
 
@@ -90,7 +127,13 @@ MaterialPtr
 MaterialFactory::create(const std::string& name)
 {
   auto it = m_materials.find(name);
-  if (it == m_materials.end())
+  if (it != m_materials.end())
+  {
+    return it->second;
+  }
+
+  auto recipe = m_recipes.find(name);
+  if (recipe == m_recipes.end())
   {
     if (name == "phong")
     {
@@ -103,7 +146,11 @@ MaterialFactory::create(const std::string& name)
   }
   else
   {
-    return it->second;
+    Stopwatch stopwatch;
+    MaterialPtr material = recipe->second();
+    m_materials[name] = material;
+    m_build_msec += stopwatch.get_msec();
+    return material;
   }
 }
 
@@ -117,8 +164,7 @@ MaterialFactory::create_basic_white()
 
   material->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
 
-  material->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER,   g_datadir + "/glsl/basic_white.vert"),
-                                        Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/basic_white.frag")));
+  material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/basic_white.vert", g_datadir + "/glsl/basic_white.frag"));
   return material;
 }
 
@@ -141,33 +187,34 @@ MaterialFactory::create_phong(const glm::vec3& diffuse,
   phong->set_uniform("light.specular",  glm::vec3(1.0f, 1.0f, 1.0f));
   //phong->set_uniform("light.shininess", 3.0f);
   //phong->set_uniform("light.position",  glm::vec3(5.0f, 5.0f, 5.0f));
-  phong->set_uniform("light.position",
-                              UniformCallback(
-                                [](ProgramPtr prog, const std::string& name, RenderContext const& ctx) {
-                                  glm::vec3 pos(ctx.get_view_matrix() * glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
-                                  prog->set_uniform(name, pos);
-                                }));
 
   phong->set_uniform("material.diffuse",   diffuse);
   phong->set_uniform("material.ambient",   ambient);
   phong->set_uniform("material.specular",  specular);
   phong->set_uniform("material.shininess", shininess);
 
-  phong->set_uniform("ModelViewMatrix", UniformSymbol::ModelViewMatrix);
-  phong->set_uniform("NormalMatrix", UniformSymbol::NormalMatrix);
-  phong->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
-
-  phong->set_uniform("ShadowMapMatrix",
+#ifdef HAVE_OPENGLES2
+  // without uniform buffers the blocks.glsl names are plain uniforms
+  phong->set_uniform("LightPosition",
                               UniformCallback(
                                 [](ProgramPtr prog, const std::string& name, RenderContext const& ctx) {
-                                  prog->set_uniform(name, g_shadowmap_matrix * ctx.get_model_matrix());
+                                  prog->set_uniform(name, ctx.get_view_matrix() * glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
                                 }));
+  phong->set_uniform("ShadowMatrix",
+                              UniformCallback(
+                                [](ProgramPtr prog, const std::string& name, RenderContext const&) {
+                                  prog->set_uniform(name, g_shadowmap_matrix);
+                                }));
+  phong->set_uniform("ModelMatrix", UniformSymbol::ModelMatrix);
+  phong->set_uniform("ModelViewMatrix", UniformSymbol::ModelViewMatrix);
+  phong->set_uniform("NormalMatrix", UniformSymbol::NormalMatrix);
+  phong->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
+#endif
   phong->set_texture(0, g_shadowmap->get_depth_texture());
   phong->set_uniform("ShadowMap", 0);
-  phong->set_texture(1, Texture::cubemap_from_file(g_datadir + "/textures/miramar/"));
+  phong->set_texture(1, get_environment_cubemap());
   //phong->set_uniform("LightMap", 1);
-  phong->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/phong.vert"),
-                                              Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/phong.frag")));
+  phong->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/phong.vert", g_datadir + "/glsl/phong.frag"));
   return phong;
 }
 
@@ -180,12 +227,11 @@ MaterialFactory::create_skybox()
   material->enable(GL_BLEND);
   material->enable(GL_CULL_FACE);
   material->enable(GL_DEPTH_TEST);
-  material->set_texture(0, Texture::cubemap_from_file(g_datadir + "/textures/miramar/"));
+  material->set_texture(0, get_environment_cubemap());
   material->set_uniform("diffuse", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
   material->set_uniform("diffuse_texture", 0);
   material->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
-  material->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/cubemap.vert"),
-                                        Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/cubemap.frag")));
+  material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/cubemap.vert", g_datadir + "/glsl/cubemap.frag"));
 
   return material;
 }
@@ -198,38 +244,39 @@ MaterialFactory::create_textured()
   material->enable(GL_CULL_FACE);
   material->enable(GL_DEPTH_TEST);
 
-  material->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/textured.vert"),
-                                        Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/textured.frag")));
+  material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/textured.vert", g_datadir + "/glsl/textured.frag"));
 
-  material->set_texture(0, Texture::from_file(g_datadir + "/textures/uvtest.png"));
-  material->set_texture(1, Texture::from_file(g_datadir + "/textures/uvtest.png"));
+  material->set_texture(0, get_uvtest_texture());
+  material->set_texture(1, get_uvtest_texture());
   material->set_uniform("texture_diff", 0);
   material->set_uniform("texture_spec", 1);
 
-  material->set_uniform("ModelViewMatrix", UniformSymbol::ModelViewMatrix);
-  material->set_uniform("NormalMatrix", UniformSymbol::NormalMatrix);
-  material->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
-
   material->set_uniform("light.diffuse",   glm::vec3(1.0f, 1.0f, 1.0f));
   material->set_uniform("light.ambient",   glm::vec3(0.25f, 0.25f, 0.25f));
   material->set_uniform("light.specular",  glm::vec3(0.6f, 0.6f, 0.6f));
   //material->set_uniform("light.shininess", 3.0f);
   //material->set_uniform("light.position",  glm::vec3(5.0f, 5.0f, 5.0f));
-  material->set_uniform("light.position",
-                              UniformCallback(
-                                [](ProgramPtr prog, const std::string& name, RenderContext const& ctx) {
-                                  glm::vec3 pos(ctx.get_view_matrix() * glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
-                                  prog->set_uniform(name, pos);
-                                }));
 
   material->set_uniform("material.ambient",   glm::vec3(1.0f, 1.0f, 1.0f));
   material->set_uniform("material.shininess", 64.0f);
 
-  material->set_uniform("ShadowMapMatrix",
+#ifdef HAVE_OPENGLES2
+  // without uniform buffers the blocks.glsl names are plain uniforms
+  material->set_uniform("LightPosition",
                               UniformCallback(
                                 [](ProgramPtr prog, const std::string& name, RenderContext const& ctx) {
-                                  prog->set_uniform(name, g_shadowmap_matrix * ctx.get_model_matrix());
+                                  prog->set_uniform(name, ctx.get_view_matrix() * glm::vec4(50.0f, 50.0f, 50.0f, 1.0f));
+                                }));
+  material->set_uniform("ShadowMatrix",
+                              UniformCallback(
+                                [](ProgramPtr prog, const std::string& name, RenderContext const&) {
+                                  prog->set_uniform(name, g_shadowmap_matrix);
                                 }));
+  material->set_uniform("ModelMatrix", UniformSymbol::ModelMatrix);
+  material->set_uniform("ModelViewMatrix", UniformSymbol::ModelViewMatrix);
+  material->set_uniform("NormalMatrix", UniformSymbol::NormalMatrix);
+  material->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
+#endif
   material->set_texture(2, g_shadowmap->get_depth_texture());
   material->set_uniform("ShadowMap", 2);
 
@@ -18,6 +18,7 @@
 #define HEADER_MATERIAL_FACTORY_HPP
 
 #include <filesystem>
+#include <functional>
 #include <string>
 #include <unordered_map>
 
@@ -33,22 +34,40 @@ public:
   }
 
 private:
+  /** Built-in materials are only registered as recipes and built on
+      the first create(), scenes using .material files never pay for
+      them */
+  std::unordered_map<std::string, std::function<MaterialPtr ()> > m_recipes;
   std::unordered_map<std::string, MaterialPtr> m_materials;
 
+  // shared between the built-in materials, loaded on first use
+  TexturePtr m_environment_cubemap;
+  TexturePtr m_uvtest_texture;
+
+  float m_build_msec;
+
 public:
   MaterialFactory();
 
   MaterialPtr from_file(const std::filesystem::path& name);
   MaterialPtr create(const std::string& name);
 
+  /** Number of built-in materials registered and actually built */
+  int get_recipe_count() const { return static_cast<int>(m_recipes.size()); }
+  int get_built_count() const { return static_cast<int>(m_materials.size()); }
+  float get_build_msec() const { return m_build_msec; }
+
 private:
-  static MaterialPtr create_phong(const glm::vec3& diffuse,
-                                  const glm::vec3& ambient,
-                                  const glm::vec3& specular,
-                                  float shininess);
-  static MaterialPtr create_skybox();
-  static MaterialPtr create_basic_white();
-  static MaterialPtr create_textured();
+  MaterialPtr create_phong(const glm::vec3& diffuse,
+                           const glm::vec3& ambient,
+                           const glm::vec3& specular,
+                           float shininess);
+  MaterialPtr create_skybox();
+  MaterialPtr create_basic_white();
+  MaterialPtr create_textured();
+
+  TexturePtr get_environment_cubemap();
+  TexturePtr get_uvtest_texture();
 
 private:
   MaterialFactory(const MaterialFactory&);
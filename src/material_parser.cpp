@@ -5,9 +5,15 @@
 #include <fstream>
 #include <iostream>
 
+#include "compressed_image.hpp"
 #include "globals.hpp"
+#include "log.hpp"
 #include "opengl.hpp"
+#include "program_registry.hpp"
+#include "texture_loader.hpp"
 #include "tokenize.hpp"
+#include "virtual_texture_file.hpp"
+#include "virtual_texture_manager.hpp"
 #include "assert_gl.hpp"
 
 namespace {
@@ -74,11 +80,35 @@ MaterialParser::MaterialParser(const std::filesystem::path& filename) :
 {
 }
 
+TexturePtr
+MaterialParser::load_texture(const std::filesystem::path& filename)
+{
+  // written by grumgl-texconv, needs no decoding and carries its mipmaps
+  std::filesystem::path const compressed = CompressedImage::find_sibling(filename);
+  if (!compressed.empty())
+  {
+    try
+    {
+      if (TexturePtr texture = Texture::from_compressed_file(compressed))
+      {
+        return texture;
+      }
+    }
+    catch(const std::exception& err)
+    {
+      log_warn("%s, using %s instead", err.what(), filename);
+    }
+  }
+
+  return TextureLoader::get().load(filename);
+}
+
 void
 MaterialParser::parse(std::istream& in)
 {
   bool default_program = true;
   bool has_diffuse_texture  = false;
+  bool has_virtual_texture = false;
   bool has_specular_texture = false;
   bool has_reflection_texture = false;
   int current_texture_unit = 0;
@@ -115,27 +145,47 @@ MaterialParser::parse(std::istream& in)
           if (args.size() == 2)
           {
             std::string diffuse_texture_name = to_string(args.begin()+1, args.end());
+#ifndef HAVE_OPENGLES2
+            std::filesystem::path const vtex_filename =
+              (std::filesystem::path(diffuse_texture_name).extension() == ".vtex") ?
+              m_directory / diffuse_texture_name :
+              VirtualTextureFile::find_sibling(m_directory / diffuse_texture_name);
+#endif
             if (diffuse_texture_name == "buildin://video-texture")
             {
               m_material->set_video_texture(current_texture_unit);
             }
+#ifndef HAVE_OPENGLES2
+            else if (!vtex_filename.empty())
+            {
+              // the atlas takes the diffuse unit, the indirection texture the next one
+              VirtualTexture& texture = VirtualTextureManager::get().load(vtex_filename);
+              has_virtual_texture = true;
+              m_material->set_texture(current_texture_unit, texture.get_atlas());
+              m_material->set_texture(current_texture_unit + 1, texture.get_indirection());
+              m_material->set_uniform("VirtualAtlas", current_texture_unit);
+              m_material->set_uniform("VirtualIndirection", current_texture_unit + 1);
+              texture.set_uniforms(*m_material, 0.0f);
+              m_material->set_feedback_material(texture.get_feedback_material(VirtualTextureManager::FEEDBACK_SCALE));
+            }
+#endif
             else
             {
-              m_material->set_texture(current_texture_unit, Texture::from_file(m_directory / diffuse_texture_name));
+              m_material->set_texture(current_texture_unit, load_texture(m_directory / diffuse_texture_name));
             }
           }
           else if (args.size() == 3)
           {
             m_material->set_texture(current_texture_unit,
-                                    Texture::from_file(m_directory / args[1]),
-                                    Texture::from_file(m_directory / args[2]));
+                                    load_texture(m_directory / args[1]),
+                                    load_texture(m_directory / args[2]));
           }
           else
           {
             throw std::runtime_error("broken");
           }
           m_material->set_uniform("material.diffuse_texture", current_texture_unit);
-          current_texture_unit += 1;
+          current_texture_unit += has_virtual_texture ? 2 : 1;
         }
         else if (args[0] == "material.specular")
         {
@@ -146,7 +196,7 @@ MaterialParser::parse(std::istream& in)
         else if (args[0] == "material.specular_texture")
         {
           has_specular_texture = true;
-          m_material->set_texture(current_texture_unit, Texture::from_file(m_directory / to_string(args.begin()+1, args.end())));
+          m_material->set_texture(current_texture_unit, load_texture(m_directory / to_string(args.begin()+1, args.end())));
           m_material->set_uniform("material.specular_texture", current_texture_unit);
           current_texture_unit += 1;
         }
@@ -203,6 +253,11 @@ MaterialParser::parse(std::istream& in)
             throw std::runtime_error("unknown token: " + args[1]);
           }
         }
+        else if (args[0] == "material.alpha_test")
+        {
+          // the fragment program discards, the surface has holes
+          m_material->alpha_test(true);
+        }
         else if (boost::algorithm::starts_with(args[0], "uniform."))
         {
           std::string uniform_name = args[0].substr(8);
@@ -236,7 +291,11 @@ MaterialParser::parse(std::istream& in)
 
   if (default_program)
   {
-    if (has_diffuse_texture)
+    if (has_virtual_texture)
+    {
+      program_fragment_defines.emplace_back("DIFFUSE_COLOR_FROM_VIRTUAL_TEXTURE");
+    }
+    else if (has_diffuse_texture)
     {
       program_fragment_defines.emplace_back("DIFFUSE_COLOR_FROM_TEXTURE");
     }
@@ -262,8 +321,7 @@ MaterialParser::parse(std::istream& in)
     program_fragment_defines.emplace_back("SHADOW_VALUE_4");
   }
 
-  ProgramPtr program = Program::create(Shader::from_file(GL_VERTEX_SHADER, program_vertex, program_vertex_defines),
-                                       Shader::from_file(GL_FRAGMENT_SHADER, program_fragment, program_fragment_defines));
+  ProgramPtr program = ProgramRegistry::get().load(program_vertex, program_fragment, program_vertex_defines, program_fragment_defines);
   m_material->set_program(program);
 }
 
@@ -6,6 +6,7 @@
 #include <filesystem>
 
 #include "material.hpp"
+#include "texture.hpp"
 
 class MaterialParser
 {
@@ -21,6 +22,11 @@ public:
   void parse(std::istream& in);
   MaterialPtr get_material() { return m_material; }
 
+private:
+  /** Prefers an up to date .ktx or .dds next to \a filename, the
+      image itself is loaded in the background */
+  TexturePtr load_texture(const std::filesystem::path& filename);
+
 private:
   MaterialParser(const MaterialParser&);
   MaterialParser& operator=(const MaterialParser&);
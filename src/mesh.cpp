@@ -23,6 +23,7 @@
 #include "opengl.hpp"
 #include "log.hpp"
 #include "opengl_state.hpp"
+#include "upload_thread.hpp"
 
 namespace {
 
@@ -256,22 +257,90 @@ Mesh::Mesh(GLenum primitive_type) :
   m_primitive_type(primitive_type),
   m_attribute_arrays(),
   m_element_array_vbo(0),
-  m_element_count(-1)
+  m_element_count(-1),
+  m_bounding_box(AABB::infinite()),
+  m_deformable(false),
+  m_bvh(),
+  m_pending_uploads(std::make_shared<int>(0))
 {
 }
 
 Mesh::~Mesh()
 {
+  std::vector<GLuint> buffers;
   for(auto const& array : m_attribute_arrays)
   {
-    glDeleteBuffers(1, &array.second.vbo);
+    if (array.second.vbo != 0)
+    {
+      buffers.push_back(array.second.vbo);
+    }
+  }
+  if (m_element_array_vbo != 0)
+  {
+    buffers.push_back(m_element_array_vbo);
+  }
+
+  // meshes that only carry a BVH never touch GL, they work without a
+  // context
+  if (buffers.empty())
+  {
+    return;
+  }
+
+  if (use_upload_thread())
+  {
+    // queued behind the uploads, so that a freed name can't be reused
+    // by the GL thread before an upload into it has happened
+    UploadThread::get().submit([buffers]{ glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data()); },
+                               {});
   }
-  glDeleteBuffers(1, &m_element_array_vbo);
+  else
+  {
+    glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+  }
+}
+
+bool
+Mesh::use_upload_thread()
+{
+#ifndef HAVE_OPENGLES2
+  return UploadThread::get().is_running();
+#else
+  return false;
+#endif
+}
+
+void
+Mesh::upload_shared(GLuint vbo, void const* data, size_t size)
+{
+#ifndef HAVE_OPENGLES2
+  auto copy = std::make_shared<std::vector<uint8_t>>(static_cast<uint8_t const*>(data),
+                                                     static_cast<uint8_t const*>(data) + size);
+  std::shared_ptr<int> pending = m_pending_uploads;
+  *pending += 1;
+
+  UploadThread::get().submit(
+    [vbo, copy]{
+      // the element array binding belongs to a vertex array object,
+      // which the upload context doesn't have, any target will do
+      glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+      glBufferData(GL_COPY_WRITE_BUFFER, copy->size(), copy->data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    },
+    [pending]{
+      *pending -= 1;
+    });
+#endif
 }
 
 void
 Mesh::draw()
 {
+  if (*m_pending_uploads > 0)
+  {
+    return;
+  }
+
   OpenGLState state;
 
   GLint program;
@@ -332,4 +401,17 @@ Mesh::draw()
   // FIXME: missing glDisableVertexAttribArray()
 }
 
+void
+Mesh::build_bvh(std::vector<glm::vec3> const& positions, std::vector<int> const& indices)
+{
+  if (m_primitive_type != GL_TRIANGLES)
+  {
+    throw std::runtime_error("Mesh::build_bvh: only GL_TRIANGLES are supported");
+  }
+  else
+  {
+    m_bvh = std::make_unique<TriangleBVH>(positions, indices);
+  }
+}
+
 /* EOF */
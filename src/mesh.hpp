@@ -23,7 +23,9 @@
 #include <memory>
 #include <unordered_map>
 
+#include "aabb.hpp"
 #include "opengl_state.hpp"
+#include "triangle_bvh.hpp"
 
 typedef std::vector<glm::vec3>  NormalLst;
 typedef std::vector<glm::vec3>  VertexLst;
@@ -68,6 +70,15 @@ private:
   std::unordered_map<std::string, Array> m_attribute_arrays;
   GLuint m_element_array_vbo;
   int m_element_count;
+  AABB m_bounding_box;
+  bool m_deformable;
+
+  /** optional CPU copy of the triangles for ray casting */
+  std::unique_ptr<TriangleBVH> m_bvh;
+
+  /** buffers still on their way through the UploadThread, shared with
+      its done tasks, which may outlive the mesh */
+  std::shared_ptr<int> m_pending_uploads;
 
 public:
   /** Create a cube with cubemap texture coordinates */
@@ -84,8 +95,23 @@ public:
   Mesh(GLenum primitive_type);
   ~Mesh();
 
+  /** Does nothing until the buffers given to the UploadThread are
+      filled */
   void draw();
 
+  /** Returns the object space bounds of the "position" array, meshes
+      that get deformed by bones or have no positions are unbounded */
+  AABB get_bounding_box() const { return m_deformable ? AABB::infinite() : m_bounding_box; }
+
+  /** Keep the triangles given by \a positions and \a indices on the
+      CPU for raycast(), they should match the arrays attached for
+      drawing. Deformation by bones is ignored. */
+  void build_bvh(std::vector<glm::vec3> const& positions, std::vector<int> const& indices);
+  TriangleBVH const* get_bvh() const { return m_bvh.get(); }
+
+  /** Object space ray cast, returns false if the mesh has no BVH */
+  bool raycast(Ray const& ray, RayHit& hit) const { return m_bvh && m_bvh->raycast(ray, hit); }
+
   void attach_array(const std::string& name, Array const& array, int element_count)
   {
     if (m_attribute_arrays.find(name) != m_attribute_arrays.end())
@@ -100,6 +126,11 @@ public:
     {
       m_element_count = element_count;
       m_attribute_arrays[name] = array;
+
+      if (name == "bone_weight" || name == "bone_index")
+      {
+        m_deformable = true;
+      }
     }
   }
 
@@ -109,6 +140,17 @@ public:
     attach_array(name, Array(Array::Float, 1, vbo), vec.size());
   }
 
+  void attach_float_array(const std::string& name, const std::vector<glm::vec3>& vec)
+  {
+    GLuint vbo = build_vbo(GL_ARRAY_BUFFER, vec);
+    attach_array(name, Array(Array::Float, 3, vbo), vec.size());
+
+    if (name == "position")
+    {
+      m_bounding_box = AABB::from_points(vec);
+    }
+  }
+
   template<typename T>
   void attach_float_array(const std::string& name, const std::vector<T>& vec)
   {
@@ -148,12 +190,24 @@ private:
   {
     GLuint vbo;
     glGenBuffers(1, &vbo);
-    glBindBuffer(target, vbo);
-    glBufferData(target, sizeof(T) * vec.size(), vec.data(), GL_STATIC_DRAW);
-    glBindBuffer(target, 0);
+    if (use_upload_thread())
+    {
+      upload_shared(vbo, vec.data(), sizeof(T) * vec.size());
+    }
+    else
+    {
+      glBindBuffer(target, vbo);
+      glBufferData(target, sizeof(T) * vec.size(), vec.data(), GL_STATIC_DRAW);
+      glBindBuffer(target, 0);
+    }
     return vbo;
   }
 
+  static bool use_upload_thread();
+
+  /** Fills \a vbo with a copy of \a data on the UploadThread */
+  void upload_shared(GLuint vbo, void const* data, size_t size);
+
 private:
   Mesh(const Mesh&) = delete;
   Mesh& operator=(const Mesh&) = delete;
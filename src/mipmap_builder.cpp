@@ -0,0 +1,285 @@
+#include "mipmap_builder.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+
+#include "task_scheduler.hpp"
+
+namespace {
+
+// rows handed to a task at once
+size_t const ROW_GRAIN = 16;
+
+struct Kernel
+{
+  // source texel 2 * x + offset + i contributes weights[i] to texel x
+  int offset;
+  std::vector<float> weights;
+};
+
+Kernel const& box_kernel()
+{
+  static Kernel const kernel{ 0, { 0.5f, 0.5f } };
+  return kernel;
+}
+
+float bessel_i0(float x)
+{
+  float sum = 1.0f;
+  float term = 1.0f;
+  for(int k = 1; k < 16; ++k)
+  {
+    term *= (x / (2.0f * static_cast<float>(k))) * (x / (2.0f * static_cast<float>(k)));
+    sum += term;
+  }
+  return sum;
+}
+
+/** Kaiser windowed sinc with a support of three source texels on
+    either side of the destination texel center */
+Kernel const& kaiser_kernel()
+{
+  static Kernel const kernel = []{
+    float const alpha = 4.0f;
+    float const support = 3.0f;
+
+    Kernel result{ -2, std::vector<float>(6) };
+    float sum = 0.0f;
+    for(int i = 0; i < 6; ++i)
+    {
+      // distance from the destination texel center in source texels
+      float const d = static_cast<float>(result.offset + i) + 0.5f - 1.0f;
+      float const x = d / 2.0f;
+      float const sinc = (x == 0.0f) ? 1.0f : sinf(static_cast<float>(M_PI) * x) / (static_cast<float>(M_PI) * x);
+      float const r = d / support;
+      float const window = (fabsf(r) > 1.0f) ? 0.0f : bessel_i0(alpha * sqrtf(1.0f - r * r)) / bessel_i0(alpha);
+      result.weights[i] = sinc * window;
+      sum += result.weights[i];
+    }
+    for(float& weight : result.weights)
+    {
+      weight /= sum;
+    }
+    return result;
+  }();
+  return kernel;
+}
+
+float const* srgb_to_linear_table()
+{
+  static std::vector<float> const table = []{
+    std::vector<float> result(256);
+    for(int i = 0; i < 256; ++i)
+    {
+      float const c = static_cast<float>(i) / 255.0f;
+      result[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return result;
+  }();
+  return table.data();
+}
+
+// indexed with the linear value scaled to 4095, fine enough that every
+// 8 bit sRGB value round trips
+int const LINEAR_STEPS = 4096;
+
+uint8_t const* linear_to_srgb_table()
+{
+  static std::vector<uint8_t> const table = []{
+    std::vector<uint8_t> result(LINEAR_STEPS);
+    for(int i = 0; i < LINEAR_STEPS; ++i)
+    {
+      float const c = static_cast<float>(i) / static_cast<float>(LINEAR_STEPS - 1);
+      float const s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+      result[i] = static_cast<uint8_t>(std::min(255.0f, s * 255.0f + 0.5f));
+    }
+    return result;
+  }();
+  return table.data();
+}
+
+void for_rows(bool parallel, int rows, std::function<void (size_t, size_t)> const& func)
+{
+  if (parallel)
+  {
+    TaskScheduler::get().parallel_for(0, rows, ROW_GRAIN, func);
+  }
+  else
+  {
+    func(0, rows);
+  }
+}
+
+/** Filters the \a src_width texels of a row down to \a dst_width
+    texels with \a kernel, the channel count is a template argument so
+    that the inner loops get unrolled */
+template<int channels>
+void downsample_row(float const* src, int src_width, float* dst, int dst_width, Kernel const& kernel)
+{
+  int const taps = static_cast<int>(kernel.weights.size());
+  float const* weights = kernel.weights.data();
+  for(int x = 0; x < dst_width; ++x)
+  {
+    float sum[channels] = {};
+    int const first = 2 * x + kernel.offset;
+    if (first >= 0 && first + taps <= src_width)
+    {
+      float const* p = src + first * channels;
+      for(int i = 0; i < taps; ++i)
+        for(int c = 0; c < channels; ++c)
+        {
+          sum[c] += weights[i] * p[i * channels + c];
+        }
+    }
+    else
+    {
+      // clamp to the edge
+      for(int i = 0; i < taps; ++i)
+      {
+        int const sx = std::max(0, std::min(src_width - 1, first + i));
+        for(int c = 0; c < channels; ++c)
+        {
+          sum[c] += weights[i] * src[sx * channels + c];
+        }
+      }
+    }
+    for(int c = 0; c < channels; ++c)
+    {
+      dst[x * channels + c] = sum[c];
+    }
+  }
+}
+
+void downsample_row(float const* src, int src_width, float* dst, int dst_width,
+                    int channels, Kernel const& kernel)
+{
+  if (channels == 4)
+  {
+    downsample_row<4>(src, src_width, dst, dst_width, kernel);
+  }
+  else
+  {
+    downsample_row<3>(src, src_width, dst, dst_width, kernel);
+  }
+}
+
+} // namespace
+
+int
+MipmapBuilder::get_level_count(int width, int height)
+{
+  int levels = 1;
+  while(width > 1 || height > 1)
+  {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    levels += 1;
+  }
+  return levels;
+}
+
+std::vector<MipmapBuilder::Level>
+MipmapBuilder::build(uint8_t const* pixels, int width, int height, int pitch,
+                     int bytes_per_pixel, Filter filter, bool srgb, bool parallel)
+{
+  Kernel const& kernel = (filter == KAISER) ? kaiser_kernel() : box_kernel();
+  int const channels = bytes_per_pixel;
+  int const color_channels = std::min(channels, 3);
+  float const* to_linear = srgb_to_linear_table();
+  uint8_t const* to_srgb = linear_to_srgb_table();
+
+  // level 0 in linear light
+  std::vector<float> current(static_cast<size_t>(width) * height * channels);
+  for_rows(parallel, height, [&](size_t begin, size_t end){
+      for(size_t y = begin; y < end; ++y)
+      {
+        uint8_t const* src = pixels + y * pitch;
+        float* dst = current.data() + y * width * channels;
+        for(int x = 0; x < width; ++x)
+        {
+          for(int c = 0; c < color_channels; ++c)
+          {
+            dst[c] = srgb ? to_linear[src[c]] : static_cast<float>(src[c]) * (1.0f / 255.0f);
+          }
+          if (channels == 4)
+          {
+            dst[3] = static_cast<float>(src[3]) * (1.0f / 255.0f);
+          }
+          src += channels;
+          dst += channels;
+        }
+      }
+    });
+
+  std::vector<Level> levels;
+  std::vector<float> horizontal;
+  std::vector<float> next;
+  while(width > 1 || height > 1)
+  {
+    int const next_width = std::max(1, width / 2);
+    int const next_height = std::max(1, height / 2);
+
+    horizontal.resize(static_cast<size_t>(next_width) * height * channels);
+    for_rows(parallel, height, [&](size_t begin, size_t end){
+        for(size_t y = begin; y < end; ++y)
+        {
+          downsample_row(current.data() + y * width * channels, width,
+                         horizontal.data() + y * next_width * channels, next_width,
+                         channels, kernel);
+        }
+      });
+
+    Level level;
+    level.width = next_width;
+    level.height = next_height;
+    level.pixels.resize(static_cast<size_t>(next_width) * next_height * channels);
+    next.resize(level.pixels.size());
+
+    size_t const row_size = static_cast<size_t>(next_width) * channels;
+    int const taps = static_cast<int>(kernel.weights.size());
+    for_rows(parallel, next_height, [&](size_t begin, size_t end){
+        for(size_t y = begin; y < end; ++y)
+        {
+          float* dst = next.data() + y * row_size;
+          std::fill(dst, dst + row_size, 0.0f);
+          for(int i = 0; i < taps; ++i)
+          {
+            int const sy = std::max(0, std::min(height - 1, 2 * static_cast<int>(y) + kernel.offset + i));
+            float const w = kernel.weights[i];
+            float const* src = horizontal.data() + sy * row_size;
+            for(size_t j = 0; j < row_size; ++j)
+            {
+              dst[j] += w * src[j];
+            }
+          }
+
+          uint8_t* out = level.pixels.data() + y * row_size;
+          for(size_t j = 0; j < row_size; ++j)
+          {
+            // the Kaiser kernel has negative lobes that overshoot
+            float const v = std::max(0.0f, std::min(1.0f, dst[j]));
+            out[j] = static_cast<uint8_t>(v * 255.0f + 0.5f);
+          }
+          if (srgb)
+          {
+            for(size_t j = 0; j < row_size; j += channels)
+              for(int c = 0; c < color_channels; ++c)
+              {
+                float const v = std::max(0.0f, std::min(1.0f, dst[j + c]));
+                out[j + c] = to_srgb[static_cast<int>(v * static_cast<float>(LINEAR_STEPS - 1) + 0.5f)];
+              }
+          }
+        }
+      });
+
+    levels.push_back(std::move(level));
+    current.swap(next);
+    width = next_width;
+    height = next_height;
+  }
+
+  return levels;
+}
+
+/* EOF */
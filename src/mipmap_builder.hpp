@@ -0,0 +1,44 @@
+#ifndef HEADER_MIPMAP_BUILDER_HPP
+#define HEADER_MIPMAP_BUILDER_HPP
+
+#include <stdint.h>
+#include <vector>
+
+/** Builds the mip chain of an 8 bit RGB or RGBA image on the CPU. Each
+    level is filtered from the one above it with a separable kernel,
+    in floating point so that the errors don't add up over the levels.
+
+    For color textures the color channels are converted from sRGB to
+    linear light before filtering and back afterwards, otherwise bright
+    and dark texels average to something too dark. Alpha is always
+    filtered as is.
+
+    Unlike gluBuild2DMipmaps() the image isn't rescaled, each level is
+    half the size of the previous one rounded down. */
+class MipmapBuilder
+{
+public:
+  enum Filter { BOX, KAISER };
+
+  struct Level
+  {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels; // tightly packed
+  };
+
+  /** Number of levels down to 1x1, including level 0 */
+  static int get_level_count(int width, int height);
+
+  /** Returns levels 1 and up of the image \a pixels with rows \a pitch
+      bytes apart. With \a parallel the rows are spread over the
+      TaskScheduler, leave it off on threads that shouldn't wait for the
+      scheduler. */
+  static std::vector<Level> build(uint8_t const* pixels, int width, int height, int pitch,
+                                  int bytes_per_pixel, Filter filter, bool srgb,
+                                  bool parallel = true);
+};
+
+#endif
+
+/* EOF */
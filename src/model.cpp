@@ -37,7 +37,16 @@ Model::draw(RenderContext const& context)
 
     MaterialPtr material;
 
-    if (context.get_override_material())
+    if (context.is_feedback_pass())
+    {
+      // surfaces without a virtual texture only fill the depth buffer
+      material = m_material->get_feedback_material();
+      if (!material)
+      {
+        material = context.get_override_material();
+      }
+    }
+    else if (context.get_override_material())
     {
       if (m_material->cast_shadow())
       {
@@ -58,9 +67,46 @@ Model::draw(RenderContext const& context)
         (*i)->draw();
       }
     }
+  }
+}
+
+AABB
+Model::get_bounding_box() const
+{
+  AABB box;
+  for(auto const& mesh : m_meshes)
+  {
+    box.extend(mesh->get_bounding_box());
+  }
+  return box;
+}
 
-    glUseProgram(0);
+bool
+Model::raycast(Ray const& ray, RayHit& hit, int& mesh) const
+{
+  bool found = false;
+  for(size_t i = 0; i < m_meshes.size(); ++i)
+  {
+    if (m_meshes[i]->raycast(ray, hit))
+    {
+      mesh = static_cast<int>(i);
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool
+Model::has_bvh() const
+{
+  for(auto const& mesh : m_meshes)
+  {
+    if (mesh->get_bvh())
+    {
+      return true;
+    }
   }
+  return false;
 }
 
 /* EOF */
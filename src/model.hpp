@@ -35,19 +35,45 @@ private:
 
   MaterialPtr m_material;
 
+  // CPU copy of the geometry for occlusion culling, empty when the
+  // model doesn't act as occluder
+  std::vector<glm::vec3> m_occluder_positions;
+  std::vector<int> m_occluder_indices;
+
 public:
   Model() :
     m_meshes(),
-    m_material()
+    m_material(),
+    m_occluder_positions(),
+    m_occluder_indices()
   {}
 
   void draw(RenderContext const& context);
 
+  /** Object space bounds of all meshes */
+  AABB get_bounding_box() const;
+
+  /** Object space ray cast against all meshes that have a BVH,
+      \a mesh is set to the index of the mesh that was hit */
+  bool raycast(Ray const& ray, RayHit& hit, int& mesh) const;
+  bool has_bvh() const;
+
   void set_material(MaterialPtr material) { m_material = material; }
+  MaterialPtr const& get_material() const { return m_material; }
   void add_mesh(std::unique_ptr<Mesh> mesh)
   {
     m_meshes.push_back(std::move(mesh));
   }
+
+  void set_occluder(std::vector<glm::vec3> const& positions, std::vector<int> const& indices)
+  {
+    m_occluder_positions = positions;
+    m_occluder_indices = indices;
+  }
+
+  bool is_occluder() const { return !m_occluder_indices.empty(); }
+  std::vector<glm::vec3> const& get_occluder_positions() const { return m_occluder_positions; }
+  std::vector<int> const& get_occluder_indices() const { return m_occluder_indices; }
 };
 
 #endif
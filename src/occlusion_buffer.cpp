@@ -0,0 +1,422 @@
+#include "occlusion_buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "format.hpp"
+#include "task_scheduler.hpp"
+
+namespace {
+
+/** Below this many triangles splitting the work costs more than it saves */
+const size_t k_parallel_threshold = 512;
+
+/** Clip the polygon \a in against the near plane z + w >= 0 */
+int clip_near(glm::vec4 const* in, int count, glm::vec4* out)
+{
+  int n = 0;
+  for(int i = 0; i < count; ++i)
+  {
+    glm::vec4 const& a = in[i];
+    glm::vec4 const& b = in[(i + 1) % count];
+    float da = a.z + a.w;
+    float db = b.z + b.w;
+
+    if (da >= 0.0f)
+    {
+      out[n++] = a;
+    }
+
+    if ((da >= 0.0f) != (db >= 0.0f))
+    {
+      out[n++] = a + (b - a) * (da / (da - db));
+    }
+  }
+  return n;
+}
+
+} // namespace
+
+OcclusionBuffer::OcclusionBuffer(int width, int height) :
+  m_width(width),
+  m_height(height),
+  m_tiles_x(width / TILE_SIZE),
+  m_tiles_y(height / TILE_SIZE),
+  m_bins_x(width / BIN_SIZE),
+  m_bins_y(height / BIN_SIZE),
+  m_view_projection(1.0f),
+  m_depth(width * height, 1.0f),
+  m_tile_max(m_tiles_x * m_tiles_y, 1.0f),
+  m_triangles(),
+  m_clip_positions(),
+  m_bins(m_bins_x * m_bins_y)
+{
+  if (width <= 0 || height <= 0 ||
+      width % BIN_SIZE != 0 || height % BIN_SIZE != 0)
+  {
+    throw std::runtime_error(format("OcclusionBuffer: size must be a multiple of %d, got %dx%d",
+                                    BIN_SIZE, width, height));
+  }
+}
+
+void
+OcclusionBuffer::clear(glm::mat4 const& view_projection)
+{
+  m_view_projection = view_projection;
+
+  std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+  std::fill(m_tile_max.begin(), m_tile_max.end(), 1.0f);
+
+  m_triangles.clear();
+  for(auto& bin : m_bins)
+  {
+    bin.clear();
+  }
+}
+
+void
+OcclusionBuffer::add_occluder(glm::mat4 const& model_matrix,
+                              std::vector<glm::vec3> const& positions,
+                              std::vector<int> const& indices)
+{
+  glm::mat4 const mvp = m_view_projection * model_matrix;
+
+  m_clip_positions.resize(positions.size());
+  for(size_t i = 0; i < positions.size(); ++i)
+  {
+    m_clip_positions[i] = mvp * glm::vec4(positions[i], 1.0f);
+  }
+
+  for(size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    glm::vec4 const& a = m_clip_positions[indices[i + 0]];
+    glm::vec4 const& b = m_clip_positions[indices[i + 1]];
+    glm::vec4 const& c = m_clip_positions[indices[i + 2]];
+
+    // trivially reject triangles completely outside of one plane
+    if ((a.x >  a.w && b.x >  b.w && c.x >  c.w) ||
+        (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+        (a.y >  a.w && b.y >  b.w && c.y >  c.w) ||
+        (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+        (a.z >  a.w && b.z >  b.w && c.z >  c.w) ||
+        (a.z < -a.w && b.z < -b.w && c.z < -c.w))
+    {
+      continue;
+    }
+
+    if (a.z < -a.w || b.z < -b.w || c.z < -c.w)
+    {
+      glm::vec4 const in[3] = { a, b, c };
+      glm::vec4 out[4];
+      int n = clip_near(in, 3, out);
+      for(int j = 2; j < n; ++j)
+      {
+        add_triangle(out[0], out[j - 1], out[j]);
+      }
+    }
+    else
+    {
+      add_triangle(a, b, c);
+    }
+  }
+}
+
+void
+OcclusionBuffer::add_triangle(glm::vec4 const& a, glm::vec4 const& b, glm::vec4 const& c)
+{
+  glm::vec3 p[3];
+  glm::vec4 const* clip[3] = { &a, &b, &c };
+  for(int i = 0; i < 3; ++i)
+  {
+    glm::vec3 ndc = glm::vec3(*clip[i]) / clip[i]->w;
+    p[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * static_cast<float>(m_width),
+                     (ndc.y * 0.5f + 0.5f) * static_cast<float>(m_height),
+                     ndc.z * 0.5f + 0.5f);
+  }
+
+  // occluders are two sided, bring everything into counter-clockwise order
+  float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+  if (area < 0.0f)
+  {
+    std::swap(p[1], p[2]);
+    area = -area;
+  }
+
+  if (area < 1.0e-6f)
+  {
+    return;
+  }
+
+  Triangle tri;
+
+  tri.x0 = std::max(0, static_cast<int>(std::floor(std::min({p[0].x, p[1].x, p[2].x}))));
+  tri.y0 = std::max(0, static_cast<int>(std::floor(std::min({p[0].y, p[1].y, p[2].y}))));
+  tri.x1 = std::min(m_width - 1, static_cast<int>(std::ceil(std::max({p[0].x, p[1].x, p[2].x}))));
+  tri.y1 = std::min(m_height - 1, static_cast<int>(std::ceil(std::max({p[0].y, p[1].y, p[2].y}))));
+
+  if (tri.x0 > tri.x1 || tri.y0 > tri.y1)
+  {
+    return;
+  }
+
+  // edge i is the one opposite of vertex i, its value at a pixel is
+  // the barycentric weight of vertex i scaled by the area
+  for(int i = 0; i < 3; ++i)
+  {
+    glm::vec3 const& e0 = p[(i + 1) % 3];
+    glm::vec3 const& e1 = p[(i + 2) % 3];
+    tri.edge_a[i] = e0.y - e1.y;
+    tri.edge_b[i] = e1.x - e0.x;
+    // anchor the edge at the same vertex regardless of direction, so
+    // that the neighbouring triangle gets the exact negated function
+    glm::vec3 const& anchor = (e0.x < e1.x || (e0.x == e1.x && e0.y < e1.y)) ? e0 : e1;
+    tri.edge_c[i] = -(tri.edge_a[i] * anchor.x + tri.edge_b[i] * anchor.y);
+
+    // pixels centered exactly on an edge shared by two triangles are
+    // covered by exactly one of them, whose inner normal points to +x
+    // (or +y for horizontal edges)
+    tri.edge_inclusive[i] = tri.edge_a[i] > 0.0f || (tri.edge_a[i] == 0.0f && tri.edge_b[i] > 0.0f);
+  }
+
+  // window space depth is linear in screen space
+  tri.depth_a = (tri.edge_a[0] * p[0].z + tri.edge_a[1] * p[1].z + tri.edge_a[2] * p[2].z) / area;
+  tri.depth_b = (tri.edge_b[0] * p[0].z + tri.edge_b[1] * p[1].z + tri.edge_b[2] * p[2].z) / area;
+  tri.depth_c = (tri.edge_c[0] * p[0].z + tri.edge_c[1] * p[1].z + tri.edge_c[2] * p[2].z) / area;
+
+  m_triangles.push_back(tri);
+}
+
+void
+OcclusionBuffer::rasterize()
+{
+  for(size_t i = 0; i < m_triangles.size(); ++i)
+  {
+    Triangle const& tri = m_triangles[i];
+    for(int by = tri.y0 / BIN_SIZE; by <= tri.y1 / BIN_SIZE; ++by)
+    {
+      for(int bx = tri.x0 / BIN_SIZE; bx <= tri.x1 / BIN_SIZE; ++bx)
+      {
+        m_bins[by * m_bins_x + bx].push_back(static_cast<int>(i));
+      }
+    }
+  }
+
+  // bins don't overlap, so tasks can write without locking
+  size_t const grain = (m_triangles.size() < k_parallel_threshold) ? m_bins.size() : 1;
+  TaskScheduler::get().parallel_for(0, m_bins.size(), grain,
+                                    [this](size_t begin, size_t end) {
+                                      for(size_t bin = begin; bin < end; ++bin)
+                                      {
+                                        rasterize_bin(static_cast<int>(bin));
+                                      }
+                                    });
+}
+
+void
+OcclusionBuffer::rasterize_bin(int bin)
+{
+  if (m_bins[bin].empty())
+  {
+    return;
+  }
+
+  int const x0 = (bin % m_bins_x) * BIN_SIZE;
+  int const y0 = (bin / m_bins_x) * BIN_SIZE;
+  int const x1 = x0 + BIN_SIZE;
+  int const y1 = y0 + BIN_SIZE;
+
+  for(int idx : m_bins[bin])
+  {
+    rasterize_triangle(m_triangles[idx], x0, y0, x1, y1);
+  }
+
+  update_tile_max(x0, y0, x1, y1);
+}
+
+void
+OcclusionBuffer::rasterize_triangle(Triangle const& tri, int bin_x0, int bin_y0, int bin_x1, int bin_y1)
+{
+  // start on a multiple of four so that the SIMD loop never leaves the bin
+  int const x0 = std::max(tri.x0, bin_x0) & ~3;
+  int const x1 = std::min(tri.x1, bin_x1 - 1);
+  int const y0 = std::max(tri.y0, bin_y0);
+  int const y1 = std::min(tri.y1, bin_y1 - 1);
+
+#ifdef __SSE2__
+  __m128 const offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  __m128 const zero = _mm_setzero_ps();
+
+  __m128 edge_a[3];
+  __m128 edge_inclusive[3];
+  for(int i = 0; i < 3; ++i)
+  {
+    edge_a[i] = _mm_set1_ps(tri.edge_a[i]);
+    edge_inclusive[i] = _mm_castsi128_ps(_mm_set1_epi32(tri.edge_inclusive[i] ? -1 : 0));
+  }
+  __m128 const depth_a = _mm_set1_ps(tri.depth_a);
+
+  // edge functions are evaluated directly instead of stepped
+  // incrementally, pixels on shared edges have to see bit-identical
+  // values from both triangles
+  auto inside = [&zero, &edge_a, &edge_inclusive](int i, __m128 px, __m128 row_value) {
+    __m128 e = _mm_add_ps(_mm_mul_ps(edge_a[i], px), row_value);
+    return _mm_or_ps(_mm_cmpgt_ps(e, zero),
+                     _mm_and_ps(_mm_cmpeq_ps(e, zero), edge_inclusive[i]));
+  };
+
+  for(int y = y0; y <= y1; ++y)
+  {
+    float const py = static_cast<float>(y) + 0.5f;
+    float* row = &m_depth[y * m_width];
+
+    __m128 const row0 = _mm_set1_ps(tri.edge_b[0] * py + tri.edge_c[0]);
+    __m128 const row1 = _mm_set1_ps(tri.edge_b[1] * py + tri.edge_c[1]);
+    __m128 const row2 = _mm_set1_ps(tri.edge_b[2] * py + tri.edge_c[2]);
+    __m128 const row_depth = _mm_set1_ps(tri.depth_b * py + tri.depth_c);
+
+    for(int x = x0; x <= x1; x += 4)
+    {
+      __m128 const px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+
+      __m128 mask = _mm_and_ps(_mm_and_ps(inside(0, px, row0),
+                                          inside(1, px, row1)),
+                               inside(2, px, row2));
+      if (_mm_movemask_ps(mask))
+      {
+        __m128 z = _mm_add_ps(_mm_mul_ps(depth_a, px), row_depth);
+        __m128 depth = _mm_loadu_ps(row + x);
+        __m128 nearest = _mm_min_ps(depth, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(mask, nearest),
+                                         _mm_andnot_ps(mask, depth)));
+      }
+    }
+  }
+#else
+  auto inside = [&tri](int i, float px, float py) {
+    float e = tri.edge_a[i] * px + (tri.edge_b[i] * py + tri.edge_c[i]);
+    return e > 0.0f || (e == 0.0f && tri.edge_inclusive[i]);
+  };
+
+  for(int y = y0; y <= y1; ++y)
+  {
+    float const py = static_cast<float>(y) + 0.5f;
+    float* row = &m_depth[y * m_width];
+
+    for(int x = x0; x <= x1; ++x)
+    {
+      float const px = static_cast<float>(x) + 0.5f;
+
+      if (inside(0, px, py) && inside(1, px, py) && inside(2, px, py))
+      {
+        float z = tri.depth_a * px + (tri.depth_b * py + tri.depth_c);
+        row[x] = std::min(row[x], z);
+      }
+    }
+  }
+#endif
+}
+
+void
+OcclusionBuffer::update_tile_max(int bin_x0, int bin_y0, int bin_x1, int bin_y1)
+{
+  for(int ty = bin_y0 / TILE_SIZE; ty < bin_y1 / TILE_SIZE; ++ty)
+  {
+    for(int tx = bin_x0 / TILE_SIZE; tx < bin_x1 / TILE_SIZE; ++tx)
+    {
+      float farthest = 0.0f;
+      for(int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; ++y)
+      {
+        float const* row = &m_depth[y * m_width + tx * TILE_SIZE];
+        for(int x = 0; x < TILE_SIZE; ++x)
+        {
+          farthest = std::max(farthest, row[x]);
+        }
+      }
+      m_tile_max[ty * m_tiles_x + tx] = farthest;
+    }
+  }
+}
+
+bool
+OcclusionBuffer::is_visible(AABB const& box) const
+{
+  if (box.is_empty())
+  {
+    return false;
+  }
+  else if (box.is_infinite())
+  {
+    return true;
+  }
+
+  glm::vec2 lo(std::numeric_limits<float>::max());
+  glm::vec2 hi(-std::numeric_limits<float>::max());
+  float nearest = 1.0f;
+
+  for(int i = 0; i < 8; ++i)
+  {
+    glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                     (i & 2) ? box.max.y : box.min.y,
+                     (i & 4) ? box.max.z : box.min.z);
+    glm::vec4 clip = m_view_projection * glm::vec4(corner, 1.0f);
+
+    if (clip.w <= 0.0f || clip.z < -clip.w)
+    {
+      // crosses the near plane
+      return true;
+    }
+
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    glm::vec2 p((ndc.x * 0.5f + 0.5f) * static_cast<float>(m_width),
+                (ndc.y * 0.5f + 0.5f) * static_cast<float>(m_height));
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+    nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+  }
+
+  int const x0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+  int const y0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+  int const x1 = std::min(m_width - 1, static_cast<int>(std::floor(hi.x)));
+  int const y1 = std::min(m_height - 1, static_cast<int>(std::floor(hi.y)));
+
+  if (x0 > x1 || y0 > y1)
+  {
+    // off screen, that is for the frustum culling to decide
+    return true;
+  }
+
+  for(int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ++ty)
+  {
+    for(int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; ++tx)
+    {
+      if (nearest <= m_tile_max[ty * m_tiles_x + tx])
+      {
+        int const px0 = std::max(x0, tx * TILE_SIZE);
+        int const py0 = std::max(y0, ty * TILE_SIZE);
+        int const px1 = std::min(x1, (tx + 1) * TILE_SIZE - 1);
+        int const py1 = std::min(y1, (ty + 1) * TILE_SIZE - 1);
+
+        for(int y = py0; y <= py1; ++y)
+        {
+          for(int x = px0; x <= px1; ++x)
+          {
+            if (nearest <= m_depth[y * m_width + x])
+            {
+              return true;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+/* EOF */
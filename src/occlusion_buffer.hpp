@@ -0,0 +1,97 @@
+#ifndef HEADER_OCCLUSION_BUFFER_HPP
+#define HEADER_OCCLUSION_BUFFER_HPP
+
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "aabb.hpp"
+
+/** Low resolution software depth buffer for occlusion culling.
+
+    Occluder triangles are transformed, clipped and binned on the
+    calling thread, the bins are then rasterized in parallel on the
+    TaskScheduler. After
+    rasterization every 8x8 tile stores its farthest depth, so most
+    visibility queries are answered without touching single pixels.
+    Depth is window space z in [0,1] with 1 at the far plane. */
+class OcclusionBuffer
+{
+public:
+  static const int TILE_SIZE = 8;
+  static const int BIN_SIZE = 32;
+
+private:
+  /** Edge functions and depth plane of a window space triangle, a
+      pixel is covered when all three edge functions are positive, or
+      zero on an inclusive edge */
+  struct Triangle
+  {
+    float edge_a[3];
+    float edge_b[3];
+    float edge_c[3];
+    bool edge_inclusive[3];
+    float depth_a;
+    float depth_b;
+    float depth_c;
+    int x0, y0, x1, y1; // inclusive pixel bounds
+  };
+
+private:
+  int m_width;
+  int m_height;
+  int m_tiles_x;
+  int m_tiles_y;
+  int m_bins_x;
+  int m_bins_y;
+
+  glm::mat4 m_view_projection;
+
+  std::vector<float> m_depth;
+  std::vector<float> m_tile_max;
+
+  std::vector<Triangle> m_triangles;
+  std::vector<glm::vec4> m_clip_positions;
+  std::vector<std::vector<int> > m_bins;
+
+public:
+  /** \a width and \a height have to be multiples of BIN_SIZE */
+  OcclusionBuffer(int width, int height);
+
+  int get_width() const { return m_width; }
+  int get_height() const { return m_height; }
+
+  /** Reset all depth values to the far plane and start a new frame */
+  void clear(glm::mat4 const& view_projection);
+
+  /** Queue the triangles given by \a indices for rasterization */
+  void add_occluder(glm::mat4 const& model_matrix,
+                    std::vector<glm::vec3> const& positions,
+                    std::vector<int> const& indices);
+
+  /** Rasterize all queued occluders */
+  void rasterize();
+
+  /** Returns false if the world space \a box is completely hidden
+      behind the rasterized occluders. The test is conservative, boxes
+      crossing the near plane or leaving the screen are visible. */
+  bool is_visible(AABB const& box) const;
+
+  float get_depth(int x, int y) const { return m_depth[y * m_width + x]; }
+  int get_triangle_count() const { return static_cast<int>(m_triangles.size()); }
+
+private:
+  void add_triangle(glm::vec4 const& a, glm::vec4 const& b, glm::vec4 const& c);
+  void rasterize_bin(int bin);
+  void rasterize_triangle(Triangle const& tri, int bin_x0, int bin_y0, int bin_x1, int bin_y1);
+  void update_tile_max(int bin_x0, int bin_y0, int bin_x1, int bin_y1);
+
+private:
+  OcclusionBuffer(const OcclusionBuffer&) = delete;
+  OcclusionBuffer& operator=(const OcclusionBuffer&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -1,5 +1,47 @@
 #include "opengl_state.hpp"
 
+#include "log.hpp"
+#include "render_stats.hpp"
+
+namespace {
+
+/** The glGetIntegerv() query for the texture bound to \a target, 0
+    when there is none */
+GLenum texture_binding_query(GLenum target)
+{
+  switch(target)
+  {
+    case GL_TEXTURE_2D:
+      return GL_TEXTURE_BINDING_2D;
+
+    case GL_TEXTURE_CUBE_MAP:
+      return GL_TEXTURE_BINDING_CUBE_MAP;
+
+#ifndef HAVE_OPENGLES2
+    case GL_TEXTURE_3D:
+      return GL_TEXTURE_BINDING_3D;
+
+    case GL_TEXTURE_2D_MULTISAMPLE:
+      return GL_TEXTURE_BINDING_2D_MULTISAMPLE;
+
+    case GL_TEXTURE_BUFFER:
+      return GL_TEXTURE_BINDING_BUFFER;
+#endif
+
+    default:
+      return 0;
+  }
+}
+
+GLint get_integer(GLenum pname)
+{
+  GLint value = 0;
+  glGetIntegerv(pname, &value);
+  return value;
+}
+
+} // namespace
+
 OpenGLState::OpenGLState()
 {
   assert_gl("OpenGLState");
@@ -16,4 +58,341 @@ OpenGLState::~OpenGLState()
   assert_gl("~OpenGLState-exit");
 }
 
+OpenGLStateTracker::OpenGLStateTracker() :
+  m_validate(false),
+  m_capabilities(),
+  m_color_mask_known(false),
+  m_color_mask(),
+  m_depth_mask_known(false),
+  m_depth_mask(GL_TRUE),
+  m_cull_face(0),
+  m_blend_func_known(false),
+  m_blend_sfactor(GL_ONE),
+  m_blend_dfactor(GL_ZERO),
+  m_active_texture(0),
+  m_textures(),
+  m_program_known(false),
+  m_program(0),
+  m_pipeline_known(false),
+  m_pipeline_enabled_caps(0),
+  m_pipeline_specified_caps(0),
+  m_pipeline_raster(0)
+{
+}
+
+template<typename Check>
+bool
+OpenGLStateTracker::redundant(bool same, char const* what, Check const& check)
+{
+  if (!same)
+  {
+    return false;
+  }
+  else if (m_validate && !check())
+  {
+    log_error("OpenGLStateTracker: %s out of sync with GL, something bypassed the tracker", what);
+    g_render_stats.gl_state_mismatches += 1;
+    return false;
+  }
+  else
+  {
+    g_render_stats.gl_calls_filtered += 1;
+    return true;
+  }
+}
+
+void
+OpenGLStateTracker::issued()
+{
+  g_render_stats.gl_calls_issued += 1;
+}
+
+void
+OpenGLStateTracker::set_capability(GLenum cap, bool enabled)
+{
+  forget_pipeline();
+
+  auto it = m_capabilities.begin();
+  while(it != m_capabilities.end() && it->cap != cap)
+  {
+    ++it;
+  }
+
+  bool const same = (it != m_capabilities.end() && it->enabled == enabled);
+  if (!redundant(same, "capability",
+                 [&]{ return (glIsEnabled(cap) == GL_TRUE) == enabled; }))
+  {
+    if (enabled)
+    {
+      glEnable(cap);
+    }
+    else
+    {
+      glDisable(cap);
+    }
+    issued();
+
+    if (it == m_capabilities.end())
+    {
+      m_capabilities.push_back(Capability{ cap, enabled });
+    }
+    else
+    {
+      it->enabled = enabled;
+    }
+  }
+}
+
+void
+OpenGLStateTracker::color_mask(bool r, bool g, bool b, bool a)
+{
+  forget_pipeline();
+
+  GLboolean const mask[4] = {
+    static_cast<GLboolean>(r ? GL_TRUE : GL_FALSE),
+    static_cast<GLboolean>(g ? GL_TRUE : GL_FALSE),
+    static_cast<GLboolean>(b ? GL_TRUE : GL_FALSE),
+    static_cast<GLboolean>(a ? GL_TRUE : GL_FALSE)
+  };
+
+  bool const same = m_color_mask_known &&
+    m_color_mask[0] == mask[0] && m_color_mask[1] == mask[1] &&
+    m_color_mask[2] == mask[2] && m_color_mask[3] == mask[3];
+  if (!redundant(same, "color mask",
+                 [&]{
+                   GLboolean current[4];
+                   glGetBooleanv(GL_COLOR_WRITEMASK, current);
+                   return (current[0] == mask[0] && current[1] == mask[1] &&
+                           current[2] == mask[2] && current[3] == mask[3]);
+                 }))
+  {
+    glColorMask(mask[0], mask[1], mask[2], mask[3]);
+    issued();
+
+    m_color_mask_known = true;
+    for(int i = 0; i < 4; ++i)
+    {
+      m_color_mask[i] = mask[i];
+    }
+  }
+}
+
+void
+OpenGLStateTracker::depth_mask(bool flag)
+{
+  forget_pipeline();
+
+  GLboolean const mask = flag ? GL_TRUE : GL_FALSE;
+  if (!redundant(m_depth_mask_known && m_depth_mask == mask, "depth mask",
+                 [&]{
+                   GLboolean current;
+                   glGetBooleanv(GL_DEPTH_WRITEMASK, &current);
+                   return current == mask;
+                 }))
+  {
+    glDepthMask(mask);
+    issued();
+
+    m_depth_mask_known = true;
+    m_depth_mask = mask;
+  }
+}
+
+void
+OpenGLStateTracker::cull_face(GLenum mode)
+{
+  forget_pipeline();
+
+  if (!redundant(m_cull_face == mode, "cull face",
+                 [&]{ return static_cast<GLenum>(get_integer(GL_CULL_FACE_MODE)) == mode; }))
+  {
+    glCullFace(mode);
+    issued();
+
+    m_cull_face = mode;
+  }
+}
+
+void
+OpenGLStateTracker::blend_func(GLenum sfactor, GLenum dfactor)
+{
+  forget_pipeline();
+
+  bool const same = m_blend_func_known && m_blend_sfactor == sfactor && m_blend_dfactor == dfactor;
+  if (!redundant(same, "blend func",
+                 [&]{
+                   return (static_cast<GLenum>(get_integer(GL_BLEND_SRC_RGB)) == sfactor &&
+                           static_cast<GLenum>(get_integer(GL_BLEND_DST_RGB)) == dfactor);
+                 }))
+  {
+    glBlendFunc(sfactor, dfactor);
+    issued();
+
+    m_blend_func_known = true;
+    m_blend_sfactor = sfactor;
+    m_blend_dfactor = dfactor;
+  }
+}
+
+void
+OpenGLStateTracker::active_texture(GLenum unit)
+{
+  forget_pipeline();
+
+  if (!redundant(m_active_texture == unit, "active texture",
+                 [&]{ return static_cast<GLenum>(get_integer(GL_ACTIVE_TEXTURE)) == unit; }))
+  {
+    glActiveTexture(unit);
+    issued();
+
+    m_active_texture = unit;
+  }
+}
+
+void
+OpenGLStateTracker::bind_texture(GLenum target, GLuint id)
+{
+  forget_pipeline();
+
+  int const index = static_cast<int>(m_active_texture) - GL_TEXTURE0;
+  if (m_active_texture == 0 || index < 0 || index >= MAX_TEXTURE_UNITS)
+  {
+    // unknown unit, nothing to compare against or to remember
+    glBindTexture(target, id);
+    issued();
+  }
+  else
+  {
+    TextureBinding& binding = m_textures[index];
+    bool const same = (binding.target == target && binding.id == id);
+    if (!redundant(same, "texture binding",
+                   [&]{
+                     GLenum const query = texture_binding_query(target);
+                     return query == 0 || static_cast<GLuint>(get_integer(query)) == id;
+                   }))
+    {
+      glBindTexture(target, id);
+      issued();
+
+      binding.target = target;
+      binding.id = id;
+    }
+  }
+}
+
+void
+OpenGLStateTracker::use_program(GLuint id)
+{
+  forget_pipeline();
+
+  if (!redundant(m_program_known && m_program == id, "program",
+                 [&]{ return static_cast<GLuint>(get_integer(GL_CURRENT_PROGRAM)) == id; }))
+  {
+    glUseProgram(id);
+    issued();
+
+    m_program_known = true;
+    m_program = id;
+  }
+}
+
+void
+OpenGLStateTracker::forget_texture(GLuint id)
+{
+  for(auto& binding : m_textures)
+  {
+    if (binding.id == id)
+    {
+      binding.target = 0;
+    }
+  }
+}
+
+void
+OpenGLStateTracker::forget_program(GLuint id)
+{
+  if (m_program == id)
+  {
+    m_program_known = false;
+  }
+}
+
+void
+OpenGLStateTracker::invalidate()
+{
+  m_capabilities.clear();
+  m_color_mask_known = false;
+  m_depth_mask_known = false;
+  m_cull_face = 0;
+  m_blend_func_known = false;
+  m_active_texture = 0;
+  for(auto& binding : m_textures)
+  {
+    binding.target = 0;
+  }
+  m_program_known = false;
+  m_pipeline_known = false;
+}
+
+void
+OpenGLStateTracker::apply(PipelineState const& state, Stereo stereo, GLenum video_target, GLuint video_id)
+{
+  // in validation mode everything goes through the checked setters
+  bool const diff = m_pipeline_known && !m_validate;
+
+  uint32_t changed_caps = state.specified_caps;
+  if (diff)
+  {
+    // caps the previous block didn't set may have any value
+    changed_caps &= (state.enabled_caps ^ m_pipeline_enabled_caps) | ~m_pipeline_specified_caps;
+  }
+
+  while(changed_caps)
+  {
+    int const bit = __builtin_ctz(changed_caps);
+    changed_caps &= changed_caps - 1;
+    set_capability(PipelineState::capability_from_bit(bit), (state.enabled_caps >> bit) & 1);
+  }
+
+  if (!diff || state.raster != m_pipeline_raster)
+  {
+    color_mask(state.color_mask(0), state.color_mask(1), state.color_mask(2), state.color_mask(3));
+    depth_mask(state.depth_mask());
+    cull_face(state.cull_face());
+    blend_func(state.blend_sfactor(), state.blend_dfactor());
+  }
+
+  for(int unit = 0; unit < state.texture_count; ++unit)
+  {
+    PipelineState::TextureUnit const& texture = state.textures[unit];
+    GLenum target = texture.target;
+    GLuint id = state.get_texture(unit, stereo);
+    if (texture.video)
+    {
+      target = video_target;
+      id = video_id;
+    }
+
+    if (target == 0 ||
+        (diff && m_textures[unit].target == target && m_textures[unit].id == id))
+    {
+      // unused unit, no video or already bound
+      continue;
+    }
+
+    active_texture(GL_TEXTURE0 + unit);
+    bind_texture(target, id);
+  }
+
+  if (state.program != 0)
+  {
+    use_program(state.program);
+  }
+
+  m_pipeline_known = true;
+  m_pipeline_enabled_caps = state.enabled_caps;
+  m_pipeline_specified_caps = state.specified_caps;
+  m_pipeline_raster = state.raster;
+}
+
 /* EOF */
@@ -17,8 +17,12 @@
 #ifndef HEADER_OPENGL_STATE_HPP
 #define HEADER_OPENGL_STATE_HPP
 
+#include <vector>
+
 #include "assert_gl.hpp"
+#include "pipeline_state.hpp"
 
+/** Scope guard around code that changes GL state */
 class OpenGLState
 {
 public:
@@ -30,6 +34,111 @@ private:
   OpenGLState& operator=(const OpenGLState&) = delete;
 };
 
+/** Shadow copy of the GL state that materials switch between draws.
+    Calls that would set a value that is already current are dropped.
+    This only works as long as all code changes that state through
+    here, with validation enabled every dropped call is checked
+    against the real GL state first and a stale shadow copy is
+    reported and repaired. */
+class OpenGLStateTracker
+{
+public:
+  static OpenGLStateTracker& get()
+  {
+    static OpenGLStateTracker instance;
+    return instance;
+  }
+
+  static const int MAX_TEXTURE_UNITS = 32;
+
+private:
+  struct Capability
+  {
+    GLenum cap;
+    bool enabled;
+  };
+
+  struct TextureBinding
+  {
+    GLenum target; // 0 when unknown
+    GLuint id;
+  };
+
+private:
+  bool m_validate;
+
+  // only capabilities that have been set once are known
+  std::vector<Capability> m_capabilities;
+
+  bool m_color_mask_known;
+  GLboolean m_color_mask[4];
+
+  bool m_depth_mask_known;
+  GLboolean m_depth_mask;
+
+  GLenum m_cull_face; // 0 when unknown
+
+  bool m_blend_func_known;
+  GLenum m_blend_sfactor;
+  GLenum m_blend_dfactor;
+
+  GLenum m_active_texture; // 0 when unknown
+  TextureBinding m_textures[MAX_TEXTURE_UNITS];
+
+  bool m_program_known;
+  GLuint m_program;
+
+  // the PipelineState applied last, as long as nothing else changed
+  // the state since
+  bool m_pipeline_known;
+  uint32_t m_pipeline_enabled_caps;
+  uint32_t m_pipeline_specified_caps;
+  uint32_t m_pipeline_raster;
+
+public:
+  OpenGLStateTracker();
+
+  void enable(GLenum cap) { set_capability(cap, true); }
+  void disable(GLenum cap) { set_capability(cap, false); }
+  void set_capability(GLenum cap, bool enabled);
+
+  void color_mask(bool r, bool g, bool b, bool a);
+  void depth_mask(bool flag);
+  void cull_face(GLenum mode);
+  void blend_func(GLenum sfactor, GLenum dfactor);
+
+  /** \a unit is GL_TEXTURE0 + n as with glActiveTexture() */
+  void active_texture(GLenum unit);
+  void bind_texture(GLenum target, GLuint id);
+  void use_program(GLuint id);
+
+  /** Switches to \a state, only the parts that differ from the
+      previously applied PipelineState are looked at */
+  void apply(PipelineState const& state, Stereo stereo, GLenum video_target, GLuint video_id);
+
+  /** Must be called before the GL object is deleted, as deleting
+      unbinds it behind the trackers back */
+  void forget_texture(GLuint id);
+  void forget_program(GLuint id);
+
+  /** Forget everything, for when GL state was changed elsewhere */
+  void invalidate();
+
+  void set_validation(bool validate) { m_validate = validate; }
+  bool get_validation() const { return m_validate; }
+
+private:
+  template<typename Check>
+  bool redundant(bool same, char const* what, Check const& check);
+
+  void issued();
+  void forget_pipeline() { m_pipeline_known = false; }
+
+private:
+  OpenGLStateTracker(const OpenGLStateTracker&) = delete;
+  OpenGLStateTracker& operator=(const OpenGLStateTracker&) = delete;
+};
+
 #endif
 
 /* EOF */
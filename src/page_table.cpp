@@ -0,0 +1,129 @@
+#include "page_table.hpp"
+
+#include <algorithm>
+
+namespace {
+
+int next_power_of_two(int value)
+{
+  int result = 1;
+  while(result < value)
+  {
+    result *= 2;
+  }
+  return result;
+}
+
+} // namespace
+
+PageTable::PageTable(int width, int height, int page_size, int levels, int atlas_pages) :
+  m_width(width),
+  m_height(height),
+  m_page_size(page_size),
+  m_levels(levels),
+  m_atlas_pages(atlas_pages),
+  m_slots(atlas_pages * atlas_pages, Slot{ 0, false, false, 0 }),
+  m_resident()
+{
+}
+
+int
+PageTable::get_pages_x(int level) const
+{
+  return (std::max(1, m_width >> level) + m_page_size - 1) / m_page_size;
+}
+
+int
+PageTable::get_pages_y(int level) const
+{
+  return (std::max(1, m_height >> level) + m_page_size - 1) / m_page_size;
+}
+
+int
+PageTable::get_indirection_width(int level) const
+{
+  return std::max(1, next_power_of_two(get_pages_x(0)) >> level);
+}
+
+int
+PageTable::get_indirection_height(int level) const
+{
+  return std::max(1, next_power_of_two(get_pages_y(0)) >> level);
+}
+
+int
+PageTable::get_slot(int level, int x, int y) const
+{
+  auto it = m_resident.find(make_key(level, x, y));
+  return (it != m_resident.end()) ? it->second : -1;
+}
+
+int
+PageTable::allocate(int level, int x, int y, unsigned int frame)
+{
+  int best = -1;
+  for(int i = 0; i < static_cast<int>(m_slots.size()); ++i)
+  {
+    Slot const& slot = m_slots[i];
+    if (!slot.used)
+    {
+      best = i;
+      break;
+    }
+    else if (!slot.pinned && slot.last_used != frame &&
+             (best == -1 || slot.last_used < m_slots[best].last_used))
+    {
+      best = i;
+    }
+  }
+
+  if (best == -1)
+  {
+    return -1;
+  }
+
+  Slot& slot = m_slots[best];
+  if (slot.used)
+  {
+    m_resident.erase(slot.key);
+  }
+
+  slot.key = make_key(level, x, y);
+  slot.used = true;
+  slot.pinned = (level == m_levels - 1);
+  slot.last_used = frame;
+  m_resident[slot.key] = best;
+
+  return best;
+}
+
+void
+PageTable::build_indirection(int level, std::vector<uint8_t>& texels) const
+{
+  int const width = get_indirection_width(level);
+  int const height = get_indirection_height(level);
+  texels.assign(static_cast<size_t>(width) * height * 4, 0);
+
+  for(int y = 0; y < std::min(height, get_pages_y(level)); ++y)
+  {
+    for(int x = 0; x < std::min(width, get_pages_x(level)); ++x)
+    {
+      // the page at the same place one level up covers four pages
+      for(int l = level; l < m_levels; ++l)
+      {
+        int const slot = get_slot(l, x >> (l - level), y >> (l - level));
+        if (slot != -1)
+        {
+          uint8_t* texel = texels.data() + (static_cast<size_t>(y) * width + x) * 4;
+          texel[0] = static_cast<uint8_t>(slot % m_atlas_pages);
+          texel[1] = static_cast<uint8_t>(slot / m_atlas_pages);
+          texel[2] = static_cast<uint8_t>(l);
+          texel[3] = 255;
+          break;
+        }
+      }
+    }
+  }
+}
+
+/* EOF */
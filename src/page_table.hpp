@@ -0,0 +1,87 @@
+#ifndef HEADER_PAGE_TABLE_HPP
+#define HEADER_PAGE_TABLE_HPP
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/** Bookkeeping of a virtual texture, which page sits in which slot of
+    the physical atlas. Slots are reused least recently used first,
+    the single page of the coarsest level is never evicted, so that a
+    lookup always finds at least that one. The pixels are moved by
+    VirtualTexture. */
+class PageTable
+{
+public:
+  struct Page
+  {
+    int level;
+    int x;
+    int y;
+  };
+
+  static uint32_t make_key(int level, int x, int y)
+  {
+    return (static_cast<uint32_t>(level) << 24) | (static_cast<uint32_t>(y) << 12) | static_cast<uint32_t>(x);
+  }
+
+  static Page from_key(uint32_t key)
+  {
+    return Page{ static_cast<int>(key >> 24), static_cast<int>(key & 0xfff), static_cast<int>((key >> 12) & 0xfff) };
+  }
+
+private:
+  struct Slot
+  {
+    uint32_t key;
+    bool used;
+    bool pinned;
+    unsigned int last_used;
+  };
+
+private:
+  int m_width;
+  int m_height;
+  int m_page_size;
+  int m_levels;
+  int m_atlas_pages;
+
+  std::vector<Slot> m_slots;
+  std::unordered_map<uint32_t, int> m_resident;
+
+public:
+  /** \a atlas_pages is the number of slots along one side of the atlas */
+  PageTable(int width, int height, int page_size, int levels, int atlas_pages);
+
+  int get_levels() const { return m_levels; }
+  int get_atlas_pages() const { return m_atlas_pages; }
+  int get_pages_x(int level) const;
+  int get_pages_y(int level) const;
+
+  /** The indirection texture has a texel per page, rounded up to a
+      power of two so that its mip levels line up with the pages */
+  int get_indirection_width(int level) const;
+  int get_indirection_height(int level) const;
+
+  /** Slot of a resident page, -1 if it isn't */
+  int get_slot(int level, int x, int y) const;
+  int get_resident_count() const { return static_cast<int>(m_resident.size()); }
+
+  void touch(int slot, unsigned int frame) { m_slots[slot].last_used = frame; }
+
+  /** Finds a slot for the page, a free one or the least recently used
+      one not used in \a frame, -1 when there is none */
+  int allocate(int level, int x, int y, unsigned int frame);
+
+  /** RGBA8 texels for \a level of the indirection texture, the atlas
+      slot and level of the finest resident page that covers each page */
+  void build_indirection(int level, std::vector<uint8_t>& texels) const;
+
+private:
+  PageTable(const PageTable&) = delete;
+  PageTable& operator=(const PageTable&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,138 @@
+#include "pipeline_state.hpp"
+
+#include <stdexcept>
+
+#include "format.hpp"
+
+namespace {
+
+GLenum const g_capabilities[] = {
+  GL_BLEND,
+  GL_CULL_FACE,
+  GL_DEPTH_TEST,
+  GL_STENCIL_TEST,
+  GL_SCISSOR_TEST,
+  GL_POLYGON_OFFSET_FILL,
+  GL_DITHER,
+  GL_SAMPLE_ALPHA_TO_COVERAGE,
+  GL_SAMPLE_COVERAGE,
+#ifndef HAVE_OPENGLES2
+  GL_POINT_SPRITE,
+  GL_PROGRAM_POINT_SIZE,
+  GL_MULTISAMPLE,
+  GL_TEXTURE_CUBE_MAP_SEAMLESS,
+  GL_FRAMEBUFFER_SRGB,
+  GL_LINE_SMOOTH,
+  GL_POLYGON_OFFSET_LINE,
+  GL_CLIP_PLANE0,
+#endif
+};
+
+int const g_capability_count = sizeof(g_capabilities) / sizeof(g_capabilities[0]);
+static_assert(g_capability_count <= 32, "capabilities don't fit into the mask");
+
+GLenum const g_cull_faces[] = { GL_BACK, GL_FRONT, GL_FRONT_AND_BACK };
+
+GLenum const g_blend_factors[] = {
+  GL_ZERO,
+  GL_ONE,
+  GL_SRC_COLOR,
+  GL_ONE_MINUS_SRC_COLOR,
+  GL_DST_COLOR,
+  GL_ONE_MINUS_DST_COLOR,
+  GL_SRC_ALPHA,
+  GL_ONE_MINUS_SRC_ALPHA,
+  GL_DST_ALPHA,
+  GL_ONE_MINUS_DST_ALPHA,
+  GL_CONSTANT_COLOR,
+  GL_ONE_MINUS_CONSTANT_COLOR,
+  GL_CONSTANT_ALPHA,
+  GL_ONE_MINUS_CONSTANT_ALPHA,
+  GL_SRC_ALPHA_SATURATE
+};
+
+template<size_t N>
+uint32_t index_of(GLenum const (&table)[N], GLenum value, char const* what)
+{
+  for(size_t i = 0; i < N; ++i)
+  {
+    if (table[i] == value)
+    {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  throw std::runtime_error(format("PipelineState: unsupported %s: 0x%x", what, value));
+}
+
+} // namespace
+
+int
+PipelineState::capability_bit(GLenum cap)
+{
+  return static_cast<int>(index_of(g_capabilities, cap, "capability"));
+}
+
+GLenum
+PipelineState::capability_from_bit(int bit)
+{
+  return g_capabilities[bit];
+}
+
+uint32_t
+PipelineState::pack_raster(bool r, bool g, bool b, bool a, bool depth_mask,
+                           GLenum cull_face, GLenum blend_sfactor, GLenum blend_dfactor)
+{
+  return
+    (static_cast<uint32_t>(r) << (COLOR_MASK_SHIFT + 0)) |
+    (static_cast<uint32_t>(g) << (COLOR_MASK_SHIFT + 1)) |
+    (static_cast<uint32_t>(b) << (COLOR_MASK_SHIFT + 2)) |
+    (static_cast<uint32_t>(a) << (COLOR_MASK_SHIFT + 3)) |
+    (static_cast<uint32_t>(depth_mask) << DEPTH_MASK_SHIFT) |
+    (index_of(g_cull_faces, cull_face, "cull face") << CULL_FACE_SHIFT) |
+    (index_of(g_blend_factors, blend_sfactor, "blend factor") << BLEND_SRC_SHIFT) |
+    (index_of(g_blend_factors, blend_dfactor, "blend factor") << BLEND_DST_SHIFT);
+}
+
+GLenum
+PipelineState::cull_face() const
+{
+  return g_cull_faces[(raster >> CULL_FACE_SHIFT) & 0x3];
+}
+
+GLenum
+PipelineState::blend_sfactor() const
+{
+  return g_blend_factors[(raster >> BLEND_SRC_SHIFT) & 0xf];
+}
+
+GLenum
+PipelineState::blend_dfactor() const
+{
+  return g_blend_factors[(raster >> BLEND_DST_SHIFT) & 0xf];
+}
+
+void
+PipelineState::update_sort_key(unsigned int program_uid)
+{
+  uint64_t const blended = (enabled_caps >> capability_bit(GL_BLEND)) & 1;
+
+  GLuint first_texture = 0;
+  for(int unit = 0; unit < texture_count; ++unit)
+  {
+    if (textures[unit].target != 0 && !textures[unit].video)
+    {
+      first_texture = textures[unit].left;
+      break;
+    }
+  }
+
+  // 1 bit blending, 16 bits program, 16 bits texture, 31 bits state
+  sort_key =
+    (blended << 63) |
+    ((static_cast<uint64_t>(program_uid) & 0xffff) << 47) |
+    ((static_cast<uint64_t>(first_texture) & 0xffff) << 31) |
+    ((static_cast<uint64_t>(raster) & 0x7fff) << 16) |
+    (static_cast<uint64_t>(enabled_caps) & 0xffff);
+}
+
+/* EOF */
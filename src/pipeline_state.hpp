@@ -0,0 +1,77 @@
+#ifndef HEADER_PIPELINE_STATE_HPP
+#define HEADER_PIPELINE_STATE_HPP
+
+#include <stdint.h>
+
+#include "opengl.hpp"
+#include "stereo.hpp"
+
+/** The fixed function state, textures and program of a Material,
+    baked into plain values by Material::finalize() so that applying
+    it is a comparison against the previously applied block instead
+    of a walk over hash maps.
+
+    Capabilities are bits in a mask, color mask, depth mask, cull face
+    and blend function are packed into a single raster word. */
+class PipelineState
+{
+public:
+  static const int MAX_TEXTURE_UNITS = 8;
+
+  struct TextureUnit
+  {
+    GLenum target; // 0 when the unit isn't used
+    GLuint left;
+    GLuint right;
+    bool video; // bound from RenderContext::get_video_texture()
+  };
+
+  // raster word layout
+  static const uint32_t COLOR_MASK_SHIFT = 0;  // 4 bits, rgba
+  static const uint32_t DEPTH_MASK_SHIFT = 4;  // 1 bit
+  static const uint32_t CULL_FACE_SHIFT = 5;   // 2 bits
+  static const uint32_t BLEND_SRC_SHIFT = 7;   // 4 bits
+  static const uint32_t BLEND_DST_SHIFT = 11;  // 4 bits
+
+public:
+  /** Returns the bit for \a cap, throws for capabilities that
+      materials can't use */
+  static int capability_bit(GLenum cap);
+  static GLenum capability_from_bit(int bit);
+
+  static uint32_t pack_raster(bool r, bool g, bool b, bool a, bool depth_mask,
+                              GLenum cull_face, GLenum blend_sfactor, GLenum blend_dfactor);
+
+public:
+  uint32_t enabled_caps = 0;
+  uint32_t specified_caps = 0; // caps the material sets, others are left alone
+  uint32_t raster = 0;
+
+  int texture_count = 0; // one past the highest used unit
+  TextureUnit textures[MAX_TEXTURE_UNITS] = {};
+
+  GLuint program = 0;
+
+  /** Orders blended after opaque blocks, then by program, textures
+      and raster state, so that sorted draws switch as little as
+      possible */
+  uint64_t sort_key = 0;
+
+public:
+  bool color_mask(int channel) const { return (raster >> (COLOR_MASK_SHIFT + channel)) & 1; }
+  bool depth_mask() const { return (raster >> DEPTH_MASK_SHIFT) & 1; }
+  GLenum cull_face() const;
+  GLenum blend_sfactor() const;
+  GLenum blend_dfactor() const;
+
+  GLuint get_texture(int unit, Stereo stereo) const
+  {
+    return (stereo == Stereo::Right) ? textures[unit].right : textures[unit].left;
+  }
+
+  void update_sort_key(unsigned int program_uid);
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,411 @@
+#include "pixel_kernels.hpp"
+
+#include <algorithm>
+
+// on x86 SSE2 is the baseline, the AVX2 and SSSE3 kernels are built
+// with target attributes and picked at runtime, as the default build
+// doesn't enable them
+#if (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))) && defined(__GNUC__)
+#  define PIXEL_KERNELS_X86
+#  include <immintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+namespace pixel_kernels {
+
+namespace {
+
+/** round(255 * 256 / alpha), so that (c * table[alpha]) >> 8 is
+    c * 255 / alpha, 256 leaves a channel as is */
+struct ReciprocalTable
+{
+  uint16_t recip[256];
+#ifdef PIXEL_KERNELS_X86
+  // four 16 bit lanes of multipliers for a whole pixel, alpha included
+  uint64_t pixel[256];
+#endif
+
+  ReciprocalTable()
+  {
+    recip[0] = 0;
+    for(int a = 1; a < 256; ++a)
+    {
+      recip[a] = static_cast<uint16_t>((255 * 256 + a / 2) / a);
+    }
+
+#ifdef PIXEL_KERNELS_X86
+    for(int a = 0; a < 256; ++a)
+    {
+      uint64_t const r = recip[a];
+      pixel[a] = r | (r << 16) | (r << 32) | (uint64_t(256) << 48);
+    }
+#endif
+  }
+};
+
+ReciprocalTable const& reciprocal_table()
+{
+  static ReciprocalTable const table;
+  return table;
+}
+
+#ifdef PIXEL_KERNELS_X86
+/** min(x, 255) for unsigned 16 bit lanes, SSE2 only has the signed min */
+inline __m128i clamp_255(__m128i x)
+{
+  return _mm_sub_epi16(x, _mm_subs_epu16(x, _mm_set1_epi16(255)));
+}
+
+/** Unpremultiplies the two pixels in the 16 bit lanes of \a x */
+inline __m128i unpremultiply_2(__m128i x, uint64_t m0, uint64_t m1, bool swap)
+{
+  if (swap)
+  {
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 0, 1, 2));
+  }
+  __m128i const m = _mm_set_epi64x(static_cast<int64_t>(m1), static_cast<int64_t>(m0));
+  return clamp_255(_mm_mulhi_epu16(_mm_slli_epi16(x, 8), m));
+}
+#endif
+
+#ifdef PIXEL_KERNELS_X86
+// The x86 kernels convert as many pixels as fit into whole registers
+// and return how many that were, the scalar loops do the rest
+
+__attribute__((target("avx2")))
+size_t swap_red_blue_4_avx2(uint8_t* pixels, size_t count)
+{
+  __m256i const keep = _mm256_set1_epi32(static_cast<int>(0xff00ff00));
+  __m256i const low = _mm256_set1_epi32(0xff);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8)
+  {
+    __m256i* p = reinterpret_cast<__m256i*>(pixels + 4 * i);
+    __m256i const x = _mm256_loadu_si256(p);
+    __m256i const y = _mm256_or_si256(_mm256_and_si256(x, keep),
+                                      _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 16), low),
+                                                      _mm256_slli_epi32(_mm256_and_si256(x, low), 16)));
+    _mm256_storeu_si256(p, y);
+  }
+  return i;
+}
+
+size_t swap_red_blue_4_sse2(uint8_t* pixels, size_t count)
+{
+  __m128i const keep = _mm_set1_epi32(static_cast<int>(0xff00ff00));
+  __m128i const low = _mm_set1_epi32(0xff);
+  size_t i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i* p = reinterpret_cast<__m128i*>(pixels + 4 * i);
+    __m128i const x = _mm_loadu_si128(p);
+    __m128i const y = _mm_or_si128(_mm_and_si128(x, keep),
+                                   _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 16), low),
+                                                _mm_slli_epi32(_mm_and_si128(x, low), 16)));
+    _mm_storeu_si128(p, y);
+  }
+  return i;
+}
+
+__attribute__((target("ssse3")))
+size_t swap_red_blue_3_ssse3(uint8_t* pixels, size_t count)
+{
+  // 16 pixels in three registers per step, every output byte comes
+  // from two bytes before or after it, so a few of them are picked
+  // from the neighbouring register
+  int8_t const Z = -128;
+  __m128i const m00 = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, Z);
+  __m128i const m01 = _mm_setr_epi8(Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 1);
+  __m128i const m10 = _mm_setr_epi8(Z, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+  __m128i const m11 = _mm_setr_epi8(0, Z, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, Z, 15);
+  __m128i const m12 = _mm_setr_epi8(Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 0, Z);
+  __m128i const m21 = _mm_setr_epi8(14, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+  __m128i const m22 = _mm_setr_epi8(Z, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13);
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16)
+  {
+    __m128i* p = reinterpret_cast<__m128i*>(pixels + 3 * i);
+    __m128i const a = _mm_loadu_si128(p + 0);
+    __m128i const b = _mm_loadu_si128(p + 1);
+    __m128i const c = _mm_loadu_si128(p + 2);
+    _mm_storeu_si128(p + 0, _mm_or_si128(_mm_shuffle_epi8(a, m00), _mm_shuffle_epi8(b, m01)));
+    _mm_storeu_si128(p + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, m10), _mm_shuffle_epi8(b, m11)),
+                                         _mm_shuffle_epi8(c, m12)));
+    _mm_storeu_si128(p + 2, _mm_or_si128(_mm_shuffle_epi8(b, m21), _mm_shuffle_epi8(c, m22)));
+  }
+  return i;
+}
+
+/** Without SSSE3 there is no byte shuffle, 3 byte pixels stay scalar */
+size_t swap_red_blue_3_none(uint8_t*, size_t)
+{
+  return 0;
+}
+
+__attribute__((target("avx2")))
+size_t flip_row_avx2(uint8_t* top, uint8_t* bottom, size_t row_bytes)
+{
+  size_t i = 0;
+  for(; i + 32 <= row_bytes; i += 32)
+  {
+    __m256i const a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(top + i));
+    __m256i const b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(bottom + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(top + i), b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(bottom + i), a);
+  }
+  return i;
+}
+
+size_t flip_row_sse2(uint8_t* top, uint8_t* bottom, size_t row_bytes)
+{
+  size_t i = 0;
+  for(; i + 16 <= row_bytes; i += 16)
+  {
+    __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(top + i));
+    __m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(bottom + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(top + i), b);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bottom + i), a);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+size_t unpremultiply_avx2(uint8_t* pixels, size_t count, bool swap)
+{
+  ReciprocalTable const& table = reciprocal_table();
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const max = _mm256_set1_epi16(255);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8)
+  {
+    uint8_t* p = pixels + 4 * i;
+    __m256i const x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+
+    // unpacking works within 128 bit lanes, lo holds pixels 0, 1, 4, 5
+    // and hi holds 2, 3, 6, 7
+    __m256i lo = _mm256_unpacklo_epi8(x, zero);
+    __m256i hi = _mm256_unpackhi_epi8(x, zero);
+    if (swap)
+    {
+      lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+      hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    __m256i const m_lo = _mm256_set_epi64x(static_cast<int64_t>(table.pixel[p[23]]), static_cast<int64_t>(table.pixel[p[19]]),
+                                           static_cast<int64_t>(table.pixel[p[7]]), static_cast<int64_t>(table.pixel[p[3]]));
+    __m256i const m_hi = _mm256_set_epi64x(static_cast<int64_t>(table.pixel[p[31]]), static_cast<int64_t>(table.pixel[p[27]]),
+                                           static_cast<int64_t>(table.pixel[p[15]]), static_cast<int64_t>(table.pixel[p[11]]));
+
+    lo = _mm256_mulhi_epu16(_mm256_slli_epi16(lo, 8), m_lo);
+    hi = _mm256_mulhi_epu16(_mm256_slli_epi16(hi, 8), m_hi);
+    lo = _mm256_sub_epi16(lo, _mm256_subs_epu16(lo, max));
+    hi = _mm256_sub_epi16(hi, _mm256_subs_epu16(hi, max));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_packus_epi16(lo, hi));
+  }
+  return i;
+}
+
+size_t unpremultiply_sse2(uint8_t* pixels, size_t count, bool swap)
+{
+  ReciprocalTable const& table = reciprocal_table();
+  __m128i const zero = _mm_setzero_si128();
+  size_t i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    uint8_t* p = pixels + 4 * i;
+    __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    __m128i const lo = unpremultiply_2(_mm_unpacklo_epi8(x, zero), table.pixel[p[3]], table.pixel[p[7]], swap);
+    __m128i const hi = unpremultiply_2(_mm_unpackhi_epi8(x, zero), table.pixel[p[11]], table.pixel[p[15]], swap);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(lo, hi));
+  }
+  return i;
+}
+
+/** The best kernels the CPU runs, picked once on first use */
+struct Kernels
+{
+  size_t (*swap_red_blue_4)(uint8_t* pixels, size_t count);
+  size_t (*swap_red_blue_3)(uint8_t* pixels, size_t count);
+  size_t (*flip_row)(uint8_t* top, uint8_t* bottom, size_t row_bytes);
+  size_t (*unpremultiply)(uint8_t* pixels, size_t count, bool swap);
+  char const* isa;
+
+  Kernels()
+  {
+    __builtin_cpu_init();
+    bool const avx2 = __builtin_cpu_supports("avx2");
+    bool const ssse3 = __builtin_cpu_supports("ssse3");
+
+    swap_red_blue_4 = avx2 ? swap_red_blue_4_avx2 : swap_red_blue_4_sse2;
+    swap_red_blue_3 = ssse3 ? swap_red_blue_3_ssse3 : swap_red_blue_3_none;
+    flip_row = avx2 ? flip_row_avx2 : flip_row_sse2;
+    unpremultiply = avx2 ? unpremultiply_avx2 : unpremultiply_sse2;
+    isa = avx2 ? "AVX2" : (ssse3 ? "SSSE3" : "SSE2");
+  }
+};
+
+Kernels const& kernels()
+{
+  static Kernels const instance;
+  return instance;
+}
+#endif
+
+} // namespace
+
+namespace scalar {
+
+void swap_red_blue(uint8_t* pixels, size_t count, int bytes_per_pixel)
+{
+  for(size_t i = 0; i < count; ++i)
+  {
+    uint8_t* p = pixels + i * bytes_per_pixel;
+    std::swap(p[0], p[2]);
+  }
+}
+
+void flip_rows(uint8_t* pixels, int height, size_t row_bytes, size_t pitch)
+{
+  for(int y = 0; y < height / 2; ++y)
+  {
+    uint8_t* top = pixels + y * pitch;
+    uint8_t* bottom = pixels + (height - y - 1) * pitch;
+    std::swap_ranges(top, top + row_bytes, bottom);
+  }
+}
+
+void unpremultiply(uint8_t* pixels, size_t count, bool swap)
+{
+  uint16_t const* recip = reciprocal_table().recip;
+  for(size_t i = 0; i < count; ++i)
+  {
+    uint8_t* p = pixels + 4 * i;
+    uint32_t const r = recip[p[3]];
+    uint8_t const c0 = static_cast<uint8_t>(std::min(255u, (p[0] * r) >> 8));
+    uint8_t const c1 = static_cast<uint8_t>(std::min(255u, (p[1] * r) >> 8));
+    uint8_t const c2 = static_cast<uint8_t>(std::min(255u, (p[2] * r) >> 8));
+    p[0] = swap ? c2 : c0;
+    p[1] = c1;
+    p[2] = swap ? c0 : c2;
+  }
+}
+
+} // namespace scalar
+
+void swap_red_blue(uint8_t* pixels, size_t count, int bytes_per_pixel)
+{
+  size_t i = 0;
+
+  if (bytes_per_pixel == 4)
+  {
+#if defined(PIXEL_KERNELS_X86)
+    i = kernels().swap_red_blue_4(pixels, count);
+#elif defined(__ARM_NEON)
+    for(; i + 16 <= count; i += 16)
+    {
+      uint8x16x4_t x = vld4q_u8(pixels + 4 * i);
+      std::swap(x.val[0], x.val[2]);
+      vst4q_u8(pixels + 4 * i, x);
+    }
+#endif
+  }
+  else
+  {
+#if defined(PIXEL_KERNELS_X86)
+    i = kernels().swap_red_blue_3(pixels, count);
+#elif defined(__ARM_NEON)
+    for(; i + 16 <= count; i += 16)
+    {
+      uint8x16x3_t x = vld3q_u8(pixels + 3 * i);
+      std::swap(x.val[0], x.val[2]);
+      vst3q_u8(pixels + 3 * i, x);
+    }
+#endif
+  }
+
+  scalar::swap_red_blue(pixels + i * bytes_per_pixel, count - i, bytes_per_pixel);
+}
+
+void flip_rows(uint8_t* pixels, int height, size_t row_bytes, size_t pitch)
+{
+  for(int y = 0; y < height / 2; ++y)
+  {
+    uint8_t* top = pixels + y * pitch;
+    uint8_t* bottom = pixels + (height - y - 1) * pitch;
+
+    size_t i = 0;
+#if defined(PIXEL_KERNELS_X86)
+    i = kernels().flip_row(top, bottom, row_bytes);
+#elif defined(__ARM_NEON)
+    for(; i + 16 <= row_bytes; i += 16)
+    {
+      uint8x16_t const a = vld1q_u8(top + i);
+      uint8x16_t const b = vld1q_u8(bottom + i);
+      vst1q_u8(top + i, b);
+      vst1q_u8(bottom + i, a);
+    }
+#endif
+    std::swap_ranges(top + i, top + row_bytes, bottom + i);
+  }
+}
+
+void unpremultiply(uint8_t* pixels, size_t count, bool swap)
+{
+  size_t i = 0;
+
+#if defined(PIXEL_KERNELS_X86)
+  i = kernels().unpremultiply(pixels, count, swap);
+#elif defined(__ARM_NEON)
+  ReciprocalTable const& table = reciprocal_table();
+  for(; i + 16 <= count; i += 16)
+  {
+    uint8_t* p = pixels + 4 * i;
+    uint8x16x4_t x = vld4q_u8(p);
+
+    uint16_t recip[16];
+    for(int j = 0; j < 16; ++j)
+    {
+      recip[j] = table.recip[p[4 * j + 3]];
+    }
+    uint16x8_t const r_lo = vld1q_u16(recip);
+    uint16x8_t const r_hi = vld1q_u16(recip + 8);
+
+    for(int c = 0; c < 3; ++c)
+    {
+      uint16x8_t const v_lo = vmovl_u8(vget_low_u8(x.val[c]));
+      uint16x8_t const v_hi = vmovl_u8(vget_high_u8(x.val[c]));
+      // the products need 24 bits, the narrowing saturates to 255
+      uint16x8_t const lo = vcombine_u16(vqshrn_n_u32(vmull_u16(vget_low_u16(v_lo), vget_low_u16(r_lo)), 8),
+                                         vqshrn_n_u32(vmull_u16(vget_high_u16(v_lo), vget_high_u16(r_lo)), 8));
+      uint16x8_t const hi = vcombine_u16(vqshrn_n_u32(vmull_u16(vget_low_u16(v_hi), vget_low_u16(r_hi)), 8),
+                                         vqshrn_n_u32(vmull_u16(vget_high_u16(v_hi), vget_high_u16(r_hi)), 8));
+      x.val[c] = vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi));
+    }
+    if (swap)
+    {
+      std::swap(x.val[0], x.val[2]);
+    }
+    vst4q_u8(p, x);
+  }
+#endif
+
+  scalar::unpremultiply(pixels + 4 * i, count - i, swap);
+}
+
+char const* get_isa()
+{
+#if defined(PIXEL_KERNELS_X86)
+  return kernels().isa;
+#elif defined(__ARM_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+} // namespace pixel_kernels
+
+/* EOF */
@@ -0,0 +1,45 @@
+#ifndef HEADER_PIXEL_KERNELS_HPP
+#define HEADER_PIXEL_KERNELS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** In-place conversions of 8 bit RGB(A) pixels done while loading
+    images. On x86 the AVX2, SSSE3 or SSE2 kernels are picked at
+    runtime from what the CPU supports, ARM uses NEON when the compiler
+    targets it, with scalar loops for everything else and for the
+    leftover pixels at the end of a row. */
+namespace pixel_kernels {
+
+/** Swaps the first and the third channel of \a count pixels, RGB to
+    BGR or RGBA to BGRA, \a bytes_per_pixel is 3 or 4 */
+void swap_red_blue(uint8_t* pixels, size_t count, int bytes_per_pixel);
+
+/** Turns the image upside down, \a row_bytes of each of the \a height
+    rows that are \a pitch bytes apart are swapped, the padding is left
+    alone */
+void flip_rows(uint8_t* pixels, int height, size_t row_bytes, size_t pitch);
+
+/** Converts \a count premultiplied RGBA pixels to straight alpha, color
+    channels are multiplied with a table lookup of 255 / alpha instead
+    of divided. With \a swap the first and third channel are swapped as
+    well, as needed for Cairo's native byte order. */
+void unpremultiply(uint8_t* pixels, size_t count, bool swap);
+
+/** Name of the instruction set the kernels run with */
+char const* get_isa();
+
+/** The portable versions, the SIMD ones give bit-identical results */
+namespace scalar {
+
+void swap_red_blue(uint8_t* pixels, size_t count, int bytes_per_pixel);
+void flip_rows(uint8_t* pixels, int height, size_t row_bytes, size_t pitch);
+void unpremultiply(uint8_t* pixels, size_t count, bool swap);
+
+} // namespace scalar
+
+} // namespace pixel_kernels
+
+#endif
+
+/* EOF */
@@ -3,55 +3,110 @@
 #include <vector>
 
 #include "assert_gl.hpp"
+#include "light_clusters.hpp"
 #include "log.hpp"
+#include "opengl_state.hpp"
+#include "program_cache.hpp"
+#include "stopwatch.hpp"
+#include "uniform_blocks.hpp"
+
+bool Program::s_deferred = true;
+float Program::s_wait_msec = 0.0f;
+
+void
+Program::init_parallel_compile()
+{
+#ifndef HAVE_OPENGLES2
+  if (GLEW_KHR_parallel_shader_compile)
+  {
+    // 0xFFFFFFFF lets the implementation pick the thread count
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    log_info("KHR_parallel_shader_compile available");
+  }
+#endif
+}
 
 ProgramPtr
 Program::create(ShaderPtr shader)
 {
-  ProgramPtr program = std::make_shared<Program>();
-  program->attach(shader);
-  program->link();
-
-  program->inspect();
-
-  return program;
+  return create(std::vector<ShaderPtr>{ shader });
 }
 
 ProgramPtr
 Program::create(ShaderPtr shader1, ShaderPtr shader2)
 {
-  ProgramPtr program = std::make_shared<Program>();
-  program->attach(shader1);
-  program->attach(shader2);
-  program->link();
-
-  program->inspect();
-
-  return program;
+  return create(std::vector<ShaderPtr>{ shader1, shader2 });
 }
 
 ProgramPtr
 Program::create(ShaderPtr shader1, ShaderPtr shader2, ShaderPtr shader3)
 {
+  return create(std::vector<ShaderPtr>{ shader1, shader2, shader3 });
+}
+
+ProgramPtr
+Program::create(std::vector<ShaderPtr> const& shaders)
+{
+  Stopwatch stopwatch;
+
+  ProgramCache& cache = ProgramCache::get();
+
   ProgramPtr program = std::make_shared<Program>();
-  program->attach(shader1);
-  program->attach(shader2);
-  program->attach(shader3);
-  program->link();
+  std::string const key = cache.make_key(shaders);
+  if (!cache.load(key, *program))
+  {
+    for(auto const& shader : shaders)
+    {
+      if (s_deferred)
+      {
+        // shared shaders are only compiled once
+        if (!shader->is_compiled())
+        {
+          shader->compile();
+        }
+      }
+      else
+      {
+        shader->compile_checked();
+      }
+      program->attach(shader);
+    }
+    program->link();
+
+    if (s_deferred)
+    {
+      program->m_pending = std::make_unique<PendingLink>(PendingLink{ shaders, key });
+    }
+    else
+    {
+      program->finish_link(shaders, key);
+    }
+  }
+  else
+  {
+    program->inspect();
+  }
 
-  program->inspect();
+  cache.add_time(stopwatch.get_msec());
 
   return program;
 }
 
 Program::Program() :
-  m_program()
+  m_program(),
+  m_uid(),
+  m_pending(),
+  m_uniform_infos()
 {
+  static unsigned int next_uid = 1;
+
   m_program = glCreateProgram();
+  m_uid = next_uid++;
 }
 
 Program::~Program()
 {
+  OpenGLStateTracker::get().forget_program(m_program);
   glDeleteProgram(m_program);
 }
 
@@ -64,9 +119,199 @@ Program::attach(ShaderPtr shader)
 void
 Program::link()
 {
+#ifndef HAVE_OPENGLES2
+  glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
   glLinkProgram(m_program);
 }
 
+void
+Program::finish_link(std::vector<ShaderPtr> const& shaders, std::string const& cache_key) const
+{
+  if (!get_link_status())
+  {
+    // a failed compile shows up as a failed link, report the shader
+    // error with its filename like compile_checked() does
+    for(auto const& shader : shaders)
+    {
+      shader->check_compile_status();
+    }
+
+    log_error("program link failed:\n%s", get_info_log());
+    return;
+  }
+
+  reflect();
+  inspect();
+  ProgramCache::get().store(cache_key, *this);
+}
+
+bool
+Program::is_ready() const
+{
+  if (!m_pending)
+  {
+    return true;
+  }
+
+#ifndef HAVE_OPENGLES2
+  if (GLEW_KHR_parallel_shader_compile)
+  {
+    GLint completed = GL_FALSE;
+    glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+  }
+#endif
+
+  // without the extension any status query blocks
+  return false;
+}
+
+void
+Program::wait() const
+{
+  if (!m_pending)
+  {
+    return;
+  }
+
+  // reset first, a compile error thrown below must not be reported
+  // again on the next use
+  std::unique_ptr<PendingLink> pending = std::move(m_pending);
+
+  Stopwatch stopwatch;
+  finish_link(pending->shaders, pending->cache_key);
+
+  float const msec = stopwatch.get_msec();
+  s_wait_msec += msec;
+  ProgramCache::get().add_time(msec);
+}
+
+bool
+Program::load_binary(GLenum format, void const* data, GLsizei size)
+{
+#ifdef HAVE_OPENGLES2
+  return false;
+#else
+  glProgramBinary(m_program, format, data, size);
+  // a rejected binary is reported as GL_INVALID_ENUM or a failed link
+  bool const ok = (glGetError() == GL_NO_ERROR) && get_link_status();
+  if (ok)
+  {
+    reflect();
+  }
+  return ok;
+#endif
+}
+
+bool
+Program::get_binary(GLenum& format, std::vector<char>& data) const
+{
+#ifdef HAVE_OPENGLES2
+  return false;
+#else
+  GLint length = 0;
+  glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+  {
+    return false;
+  }
+
+  data.resize(length);
+  GLsizei written = 0;
+  glGetProgramBinary(m_program, length, &written, &format, data.data());
+  data.resize(written);
+  return written > 0;
+#endif
+}
+
+void
+Program::reflect() const
+{
+  m_uniform_infos.clear();
+
+  GLint active_uniforms;
+  GLint active_uniform_max_length;
+
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &active_uniforms);
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &active_uniform_max_length);
+
+  std::vector<GLchar> buffer(active_uniform_max_length);
+  for(GLint i = 0; i < active_uniforms; ++i)
+  {
+    GLsizei length;
+    GLint size;
+    GLenum type;
+
+    glGetActiveUniform(m_program, i, buffer.size(), &length, &size, &type, buffer.data());
+    std::string name(buffer.data(), length);
+
+    GLint location = glGetUniformLocation(m_program, name.c_str());
+    if (location == -1)
+    {
+      // uniforms in a uniform block don't have a location
+      continue;
+    }
+
+    m_uniform_infos[name] = UniformInfo{ location, type, size };
+
+    // arrays are reported as "name[0]", make "name" and every element
+    // available as well
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+    {
+      std::string const base = name.substr(0, name.size() - 3);
+      m_uniform_infos[base] = UniformInfo{ location, type, size };
+
+      for(GLint element = 1; element < size; ++element)
+      {
+        std::string const element_name = base + "[" + std::to_string(element) + "]";
+        GLint element_location = glGetUniformLocation(m_program, element_name.c_str());
+        if (element_location != -1)
+        {
+          m_uniform_infos[element_name] = UniformInfo{ element_location, type, size - element };
+        }
+      }
+    }
+  }
+
+  UniformBlocks::bind_blocks(m_program);
+  LightClusters::bind_samplers(m_program);
+
+  assert_gl("Program::reflect");
+}
+
+Program::UniformInfo const*
+Program::get_uniform_info(const std::string& name) const
+{
+  wait();
+
+  auto it = m_uniform_infos.find(name);
+  if (it == m_uniform_infos.end())
+  {
+    return nullptr;
+  }
+  else
+  {
+    return &it->second;
+  }
+}
+
+GLint
+Program::get_uniform_location(const std::string& name) const
+{
+  wait();
+
+  auto it = m_uniform_infos.find(name);
+  if (it == m_uniform_infos.end())
+  {
+    return -1;
+  }
+  else
+  {
+    return it->second.location;
+  }
+}
+
 void
 Program::validate()
 {
@@ -174,25 +419,7 @@ Program::inspect() const
     }
   }
 
-  { // handle uniforms
-    GLint active_uniforms;
-    GLint active_uniform_max_length;
-
-    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &active_uniforms);
-    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &active_uniform_max_length);
-
-    for(GLint i = 0; i < active_uniforms; ++i)
-    {
-      GLsizei length;
-      GLint size;
-      GLenum type;
-      std::vector<GLchar> name(active_uniform_max_length);
-
-      glGetActiveUniform(m_program, i, name.size(), &length, &size, &type, name.data());
-
-      //log_info("Uniform: %s type:%d size:%d", std::string(name.data(), length), type, size);
-    }
-  }
+  // uniforms are collected by reflect() at link time
 
   assert_gl("Program::inspect");
 }
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -10,6 +12,7 @@
 #include "opengl.hpp"
 #include "assert_gl.hpp"
 #include "log.hpp"
+#include "render_stats.hpp"
 #include "shader.hpp"
 
 class Program;
@@ -18,35 +21,101 @@ typedef std::shared_ptr<Program> ProgramPtr;
 
 class Program
 {
+public:
+  /** An active uniform as reported by the driver after linking, array
+      uniforms have an entry for the bare name and for each element */
+  struct UniformInfo
+  {
+    GLint location;
+    GLenum type;
+    GLint size;
+  };
+
 private:
   GLuint m_program;
 
+  /** unique for the lifetime of the process, unlike the GL name */
+  unsigned int m_uid;
+
+  /** A link that was submitted but whose status wasn't queried yet */
+  struct PendingLink
+  {
+    std::vector<ShaderPtr> shaders;
+    std::string cache_key;
+  };
+
+  // filled in on first use by wait(), hence mutable
+  mutable std::unique_ptr<PendingLink> m_pending;
+  mutable std::unordered_map<std::string, UniformInfo> m_uniform_infos;
+
+  static bool s_deferred;
+  static float s_wait_msec;
+
+public:
+  /** When enabled, create() only submits the compile and link and the
+      status is queried when the program is first used. With
+      KHR_parallel_shader_compile the driver then builds all programs
+      concurrently, without it the work still overlaps with the rest of
+      the startup. */
+  static void set_deferred(bool deferred) { s_deferred = deferred; }
+  static bool get_deferred() { return s_deferred; }
+
+  /** Lets the driver use as many compiler threads as it likes, needs
+      a GL context */
+  static void init_parallel_compile();
+
+  /** Time spent blocking on deferred compiles and links */
+  static float get_wait_msec() { return s_wait_msec; }
+
 public:
   static ProgramPtr create(ShaderPtr shader);
   static ProgramPtr create(ShaderPtr shader1, ShaderPtr shader2);
   static ProgramPtr create(ShaderPtr shader1, ShaderPtr shader2, ShaderPtr shader3);
 
+  /** Compiles and links \a shaders, or loads the program from the
+      ProgramCache when it was built before */
+  static ProgramPtr create(std::vector<ShaderPtr> const& shaders);
+
 public:
   Program();
   ~Program();
 
   void attach(ShaderPtr shader);
   void link();
+
+  /** glProgramBinary(), returns false when the driver rejects it */
+  bool load_binary(GLenum format, void const* data, GLsizei size);
+  bool get_binary(GLenum& format, std::vector<char>& data) const;
   void validate();
 
   std::string get_info_log() const;
   bool get_link_status() const;
   bool get_validate_status() const;
 
-  GLuint get_id() const { return m_program; }
+  GLuint get_id() const { wait(); return m_program; }
+  unsigned int get_uid() const { return m_uid; }
 
   void inspect() const;
 
+  /** True when a deferred link has finished, never blocks */
+  bool is_ready() const;
+
+  /** Blocks until a deferred link has finished, reports compile errors
+      the same way a synchronous create() does */
+  void wait() const;
+
+  /** Returns nullptr when \a name isn't an active uniform */
+  UniformInfo const* get_uniform_info(const std::string& name) const;
+
+  /** Looks up the location in the reflection table built after linking,
+      returns -1 when \a name isn't an active uniform */
+  GLint get_uniform_location(const std::string& name) const;
+
   template<typename T>
   void set_uniform(const std::string& name, T const& v)
   {
     assert_gl("set_uniform:enter");
-    int loc = glGetUniformLocation(m_program, name.c_str());
+    int loc = get_uniform_location(name);
     if (loc == -1)
     {
       //log_debug("uniform location '%s' not found, ignoring", name);
@@ -54,6 +123,7 @@ public:
     else
     {
       set_uniform(loc, v);
+      g_render_stats.uniform_calls += 1;
     }
     assert_gl("set_uniform:exit: %s", name);
   }
@@ -89,6 +159,10 @@ public:
   void set_uniform(GLint loc, const glm::mat4& v) { glProgramUniformMatrix4fv(m_program, loc, 1, GL_FALSE, glm::value_ptr(v)); }
 #endif
 
+private:
+  void reflect() const;
+  void finish_link(std::vector<ShaderPtr> const& shaders, std::string const& cache_key) const;
+
 private:
   Program(const Program&);
   Program& operator=(const Program&);
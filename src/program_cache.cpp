@@ -0,0 +1,202 @@
+#include "program_cache.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdlib.h>
+
+#include "format.hpp"
+#include "log.hpp"
+#include "program.hpp"
+
+namespace {
+
+char const CACHE_MAGIC[4] = { 'V', 'P', 'R', 'G' };
+
+// anything larger is a corrupt header
+uint32_t const MAX_BINARY_SIZE = 64 * 1024 * 1024;
+
+struct CacheHeader
+{
+  char magic[4];
+  uint32_t format;
+  uint32_t size;
+};
+
+// FNV-1a, std::hash isn't guaranteed to be stable between builds
+void hash_bytes(uint64_t& hash, char const* data, size_t size)
+{
+  for(size_t i = 0; i < size; ++i)
+  {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+void hash_string(uint64_t& hash, std::string const& str)
+{
+  // include the terminator so that "ab"+"c" and "a"+"bc" differ
+  hash_bytes(hash, str.c_str(), str.size() + 1);
+}
+
+std::string get_gl_string(GLenum name)
+{
+  char const* str = reinterpret_cast<char const*>(glGetString(name));
+  return str ? str : "";
+}
+
+std::filesystem::path default_directory()
+{
+  if (char const* xdg_cache_home = getenv("XDG_CACHE_HOME"))
+  {
+    return std::filesystem::path(xdg_cache_home) / "viewer" / "programs";
+  }
+  else if (char const* home = getenv("HOME"))
+  {
+    return std::filesystem::path(home) / ".cache" / "viewer" / "programs";
+  }
+  else
+  {
+    return {};
+  }
+}
+
+} // namespace
+
+ProgramCache::ProgramCache() :
+#ifdef HAVE_OPENGLES2
+  m_enabled(false),
+#else
+  m_enabled(true),
+#endif
+  m_directory(default_directory()),
+  m_driver(),
+  m_hits(0),
+  m_misses(0),
+  m_msec(0.0f)
+{
+}
+
+std::string
+ProgramCache::make_key(std::vector<ShaderPtr> const& shaders)
+{
+  if (!m_enabled || m_directory.empty())
+  {
+    return {};
+  }
+
+  if (m_driver.empty())
+  {
+    m_driver = get_gl_string(GL_VENDOR) + '\n' +
+      get_gl_string(GL_RENDERER) + '\n' +
+      get_gl_string(GL_VERSION) + '\n' +
+      get_gl_string(GL_SHADING_LANGUAGE_VERSION);
+  }
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash_string(hash, m_driver);
+  for(auto const& shader : shaders)
+  {
+    GLenum const type = shader->get_type();
+    hash_bytes(hash, reinterpret_cast<char const*>(&type), sizeof(type));
+    for(auto const& source : shader->get_sources())
+    {
+      hash_string(hash, source);
+    }
+  }
+
+  return format("%016x", hash);
+}
+
+std::filesystem::path
+ProgramCache::get_filename(std::string const& key) const
+{
+  return m_directory / (key + ".bin");
+}
+
+bool
+ProgramCache::load(std::string const& key, Program& program)
+{
+  if (key.empty())
+  {
+    m_misses += 1;
+    return false;
+  }
+
+  std::ifstream in(get_filename(key), std::ios::binary);
+  if (!in)
+  {
+    m_misses += 1;
+    return false;
+  }
+
+  CacheHeader header;
+  std::vector<char> data;
+  if (in.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+      std::equal(header.magic, header.magic + 4, CACHE_MAGIC) &&
+      header.size <= MAX_BINARY_SIZE)
+  {
+    data.resize(header.size);
+    in.read(data.data(), header.size);
+  }
+
+  if (!in || data.empty() ||
+      !program.load_binary(header.format, data.data(), static_cast<GLsizei>(data.size())))
+  {
+    // a driver update can reject binaries even with identical version
+    // strings, the program is compiled and the entry replaced
+    log_info("program cache: %s: stale entry, rebuilding", get_filename(key).string());
+    m_misses += 1;
+    return false;
+  }
+
+  m_hits += 1;
+  return true;
+}
+
+void
+ProgramCache::store(std::string const& key, Program const& program)
+{
+  if (key.empty())
+  {
+    return;
+  }
+
+  GLenum binary_format;
+  std::vector<char> data;
+  if (!program.get_binary(binary_format, data))
+  {
+    return;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(m_directory, ec);
+
+  // write to a temporary file first, so that a second instance never
+  // reads a half written entry
+  std::filesystem::path const filename = get_filename(key);
+  std::filesystem::path tmp_filename = filename;
+  tmp_filename += ".tmp";
+
+  {
+    std::ofstream out(tmp_filename, std::ios::binary);
+    CacheHeader header;
+    std::copy(CACHE_MAGIC, CACHE_MAGIC + 4, header.magic);
+    header.format = binary_format;
+    header.size = static_cast<uint32_t>(data.size());
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(data.data(), data.size());
+    if (!out)
+    {
+      log_warn("program cache: %s: failed to write", tmp_filename.string());
+      return;
+    }
+  }
+
+  std::filesystem::rename(tmp_filename, filename, ec);
+  if (ec)
+  {
+    log_warn("program cache: %s: %s", filename.string(), ec.message());
+  }
+}
+
+/* EOF */
@@ -0,0 +1,69 @@
+#ifndef HEADER_PROGRAM_CACHE_HPP
+#define HEADER_PROGRAM_CACHE_HPP
+
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "shader.hpp"
+
+class Program;
+
+/** Keeps glGetProgramBinary() output on disk, so that programs don't
+    have to be compiled again on the next start. Entries are keyed by a
+    hash of the preprocessed shader sources, which include the defines
+    and all included files, and of the driver vendor, renderer and
+    version strings. A binary the driver rejects is simply rebuilt. */
+class ProgramCache
+{
+public:
+  static ProgramCache& get()
+  {
+    static ProgramCache instance;
+    return instance;
+  }
+
+private:
+  bool m_enabled;
+  std::filesystem::path m_directory;
+  std::string m_driver; // queried on first use, needs a GL context
+
+  int m_hits;
+  int m_misses;
+  float m_msec;
+
+public:
+  ProgramCache();
+
+  /** Defaults to $XDG_CACHE_HOME/viewer/programs/ or ~/.cache/viewer/programs/ */
+  void set_directory(std::filesystem::path const& directory) { m_directory = directory; }
+  void set_enabled(bool enabled) { m_enabled = enabled; }
+
+  std::string make_key(std::vector<ShaderPtr> const& shaders);
+
+  /** Returns false when there is no usable entry for \a key, \a program
+      is then left unlinked */
+  bool load(std::string const& key, Program& program);
+  void store(std::string const& key, Program const& program);
+
+  /** Time spent in Program::create(), compiling or loading */
+  void add_time(float msec) { m_msec += msec; }
+
+  /** Programs loaded from the cache and programs that had to be
+      compiled, including all of them when the cache is disabled */
+  int get_hits() const { return m_hits; }
+  int get_misses() const { return m_misses; }
+  float get_msec() const { return m_msec; }
+
+private:
+  std::filesystem::path get_filename(std::string const& key) const;
+
+private:
+  ProgramCache(const ProgramCache&) = delete;
+  ProgramCache& operator=(const ProgramCache&) = delete;
+};
+
+#endif
+
+/* EOF */
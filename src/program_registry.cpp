@@ -0,0 +1,91 @@
+#include "program_registry.hpp"
+
+#include "shader.hpp"
+#include "shader_source_manager.hpp"
+
+namespace {
+
+void append_stage(std::string& key, std::filesystem::path const& filename,
+                  std::vector<std::string> const& defines)
+{
+  key += ShaderSourceManager::normalize(filename);
+  for(auto const& def : defines)
+  {
+    key += '\0';
+    key += def;
+  }
+  key += '\n';
+}
+
+} // namespace
+
+ProgramRegistry::ProgramRegistry() :
+  m_programs(),
+  m_loads(0),
+  m_builds(0)
+{
+}
+
+ProgramPtr
+ProgramRegistry::load(std::filesystem::path const& vertex_filename,
+                      std::filesystem::path const& fragment_filename,
+                      std::vector<std::string> const& vertex_defines,
+                      std::vector<std::string> const& fragment_defines)
+{
+  std::string key;
+  append_stage(key, vertex_filename, vertex_defines);
+  append_stage(key, fragment_filename, fragment_defines);
+
+  m_loads += 1;
+
+  Entry& entry = m_programs[key];
+  if (ProgramPtr program = entry.program.lock())
+  {
+    return program;
+  }
+  else
+  {
+    program = Program::create(Shader::from_file(GL_VERTEX_SHADER, vertex_filename, vertex_defines),
+                              Shader::from_file(GL_FRAGMENT_SHADER, fragment_filename, fragment_defines));
+    entry.program = program;
+    entry.vertex_filename = ShaderSourceManager::normalize(vertex_filename);
+    entry.fragment_filename = ShaderSourceManager::normalize(fragment_filename);
+    m_builds += 1;
+    return program;
+  }
+}
+
+int
+ProgramRegistry::get_alive() const
+{
+  int count = 0;
+  for(auto const& it : m_programs)
+  {
+    if (!it.second.program.expired())
+    {
+      count += 1;
+    }
+  }
+  return count;
+}
+
+std::vector<std::string>
+ProgramRegistry::get_affected(std::filesystem::path const& filename) const
+{
+  ShaderSourceManager& sources = ShaderSourceManager::get();
+
+  std::vector<std::string> result;
+  for(auto const& it : m_programs)
+  {
+    Entry const& entry = it.second;
+    if (!entry.program.expired() &&
+        (sources.depends_on(entry.vertex_filename, filename) ||
+         sources.depends_on(entry.fragment_filename, filename)))
+    {
+      result.push_back(entry.vertex_filename + " + " + entry.fragment_filename);
+    }
+  }
+  return result;
+}
+
+/* EOF */
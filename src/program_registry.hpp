@@ -0,0 +1,64 @@
+#ifndef HEADER_PROGRAM_REGISTRY_HPP
+#define HEADER_PROGRAM_REGISTRY_HPP
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "program.hpp"
+
+/** Hands out one shared Program per combination of shader files and
+    defines. The registry only keeps weak references, a program is
+    deleted once the last material using it is gone and built again on
+    the next load(). */
+class ProgramRegistry
+{
+public:
+  static ProgramRegistry& get()
+  {
+    static ProgramRegistry instance;
+    return instance;
+  }
+
+private:
+  struct Entry
+  {
+    std::weak_ptr<Program> program;
+    std::string vertex_filename;
+    std::string fragment_filename;
+  };
+
+  std::unordered_map<std::string, Entry> m_programs;
+
+  int m_loads;
+  int m_builds;
+
+public:
+  ProgramRegistry();
+
+  ProgramPtr load(std::filesystem::path const& vertex_filename,
+                  std::filesystem::path const& fragment_filename,
+                  std::vector<std::string> const& vertex_defines = {},
+                  std::vector<std::string> const& fragment_defines = {});
+
+  /** Number of load() calls and how many of them had to build a program */
+  int get_loads() const { return m_loads; }
+  int get_builds() const { return m_builds; }
+
+  /** Programs that are currently in use */
+  int get_alive() const;
+
+  /** Programs in use that were built from \a filename or from a file
+      including it and thus need rebuilding when it changes, as
+      "vertex_filename + fragment_filename" */
+  std::vector<std::string> get_affected(std::filesystem::path const& filename) const;
+
+private:
+  ProgramRegistry(const ProgramRegistry&) = delete;
+  ProgramRegistry& operator=(const ProgramRegistry&) = delete;
+};
+
+#endif
+
+/* EOF */
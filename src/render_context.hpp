@@ -13,6 +13,7 @@ private:
   Camera m_camera;
   SceneNode* m_node;
   bool m_geometry_pass;
+  bool m_feedback_pass;
   MaterialPtr m_override_material;
   Stereo m_stero;
   TexturePtr m_video_texture;
@@ -23,6 +24,7 @@ public:
     m_camera(camera),
     m_node(node),
     m_geometry_pass(false),
+    m_feedback_pass(false),
     m_override_material(),
     m_stero(Stereo::Center)
   {
@@ -53,6 +55,17 @@ public:
     return m_geometry_pass;
   }
 
+  /** Virtual texture feedback, see VirtualTextureManager */
+  void set_feedback_pass()
+  {
+    m_feedback_pass = true;
+  }
+
+  bool is_feedback_pass() const
+  {
+    return m_feedback_pass;
+  }
+
   Stereo get_stereo() const
   {
     return m_stero;
@@ -0,0 +1,84 @@
+#include "render_stats.hpp"
+
+#include <ostream>
+
+RenderStats g_render_stats;
+
+void
+RenderStats::print(std::ostream& out) const
+{
+  if (frames == 0)
+  {
+    return;
+  }
+
+  float const n = static_cast<float>(frames);
+
+  out << "scene: nodes: " << static_cast<float>(nodes) / n
+      << " items: " << static_cast<float>(draw_items) / n
+      << " visible: " << static_cast<float>(visible) / n
+      << " shadow_casters: " << static_cast<float>(shadow_casters) / n
+      << " prepare: " << prepare_msec / n << "ms"
+      << " submit: " << submit_msec / n << "ms"
+      << std::endl;
+
+  if (occluders > 0)
+  {
+    out << "occlusion: occluders: " << static_cast<float>(occluders) / n
+        << " triangles: " << static_cast<float>(occluder_triangles) / n
+        << " occluded: " << static_cast<float>(occluded) / n
+        << " time: " << occlusion_msec / n << "ms"
+        << std::endl;
+  }
+
+  if (lights > 0)
+  {
+    out << "lights: total: " << static_cast<float>(lights) / n
+        << " visible: " << static_cast<float>(visible_lights) / n
+        << " cluster_refs: " << static_cast<float>(light_indices) / n
+        << " binning: " << light_binning_msec / n << "ms"
+        << std::endl;
+  }
+
+  if (material_applies > 0)
+  {
+    out << "materials: applies: " << static_cast<float>(material_applies) / n
+        << " time: " << material_msec / n << "ms"
+        << " uniform_allocations: " << uniform_allocations
+        << std::endl;
+  }
+
+  if (uniform_calls > 0 || uniform_block_uploads > 0)
+  {
+    out << "uniforms: calls: " << static_cast<float>(uniform_calls) / n
+        << " block_uploads: " << static_cast<float>(uniform_block_uploads) / n
+        << std::endl;
+  }
+
+  if (gl_calls_issued > 0 || gl_calls_filtered > 0)
+  {
+    out << "gl state: issued: " << static_cast<float>(gl_calls_issued) / n
+        << " filtered: " << static_cast<float>(gl_calls_filtered) / n
+        << " mismatches: " << gl_state_mismatches
+        << std::endl;
+  }
+
+  if (texture_bytes > 0)
+  {
+    out << "textures: resident: " << static_cast<float>(texture_bytes) / (1024.0f * 1024.0f) << "MB"
+        << " evictions: " << texture_evictions
+        << " reloads: " << texture_reloads
+        << std::endl;
+  }
+
+  if (virtual_pages_resident > 0)
+  {
+    out << "virtual textures: pages: " << static_cast<float>(virtual_pages_resident) / n
+        << " requests: " << static_cast<float>(virtual_page_requests) / n
+        << " reads: " << static_cast<float>(virtual_page_reads) / n
+        << " uploads: " << static_cast<float>(virtual_page_uploads) / n
+        << std::endl;
+  }
+}
+
+/* EOF */
@@ -0,0 +1,74 @@
+#ifndef HEADER_RENDER_STATS_HPP
+#define HEADER_RENDER_STATS_HPP
+
+#include <iosfwd>
+#include <stddef.h>
+
+/** Counters accumulated over a number of frames, printed and reset by
+    the main loop */
+class RenderStats
+{
+public:
+  int frames = 0;
+
+  // SceneManager::prepare()
+  int nodes = 0;
+  int draw_items = 0;
+  int visible = 0;
+  int shadow_casters = 0;
+  float prepare_msec = 0.0f;
+  float submit_msec = 0.0f;
+
+  // occlusion culling, part of prepare()
+  int occluders = 0;
+  int occluder_triangles = 0;
+  int occluded = 0;
+  float occlusion_msec = 0.0f;
+
+  // LightClusters::build(), part of submit, per view
+  int lights = 0;
+  int visible_lights = 0;
+  int light_indices = 0;
+  float light_binning_msec = 0.0f;
+
+  // Material::apply(), part of submit
+  int material_applies = 0;
+  float material_msec = 0.0f;
+
+  // UniformGroup records added, zero once all materials are set up
+  int uniform_allocations = 0;
+
+  // glUniform*() calls made by Program and UniformGroup, and uniform
+  // block ranges streamed by UniformBlocks
+  int uniform_calls = 0;
+  int uniform_block_uploads = 0;
+
+  // OpenGLStateTracker, state changes passed on to GL and dropped as
+  // redundant, mismatches are only detected with validation enabled
+  int gl_calls_issued = 0;
+  int gl_calls_filtered = 0;
+  int gl_state_mismatches = 0;
+
+  // ResidencyManager, the bytes are the current total, not a sum
+  size_t texture_bytes = 0;
+  int texture_evictions = 0;
+  int texture_reloads = 0;
+
+  // VirtualTextureManager, feedback texels that asked for a page, pages
+  // read from disk, pages uploaded, and the pages resident in the
+  // atlases summed over frames
+  int virtual_page_requests = 0;
+  int virtual_page_reads = 0;
+  int virtual_page_uploads = 0;
+  int virtual_pages_resident = 0;
+
+public:
+  void reset() { *this = RenderStats(); }
+  void print(std::ostream& out) const;
+};
+
+extern RenderStats g_render_stats;
+
+#endif
+
+/* EOF */
@@ -0,0 +1,132 @@
+#include "residency_manager.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "assert_gl.hpp"
+#include "opengl_state.hpp"
+#include "render_stats.hpp"
+#include "texture_loader.hpp"
+
+ResidencyManager::ResidencyManager() :
+  m_entries(),
+  m_frame(1),
+  m_budget(0),
+  m_evictions(0),
+  m_reloads(0)
+{
+}
+
+void
+ResidencyManager::add(TexturePtr const& texture, std::filesystem::path const& filename, int dropped_levels)
+{
+  // a dead texture's address may be reused, so everything is overwritten
+  Entry& entry = m_entries[texture.get()];
+  entry.texture = texture;
+  entry.filename = filename;
+  entry.dropped_levels = dropped_levels;
+  entry.loading = false;
+}
+
+int
+ResidencyManager::get_evict_level(Texture const& texture)
+{
+  int level = 0;
+  while(level < texture.get_levels() - 1 && texture.get_level_bytes(level) > EVICTED_BYTES)
+  {
+    level += 1;
+  }
+  return level;
+}
+
+bool
+ResidencyManager::evict(TexturePtr const& texture, Entry& entry)
+{
+  int const level = get_evict_level(*texture);
+  if (level <= entry.dropped_levels)
+  {
+    return false;
+  }
+
+#ifndef HAVE_OPENGLES2
+  texture->set_base_level(level);
+
+  // the storage is mutable, zero sized levels give the memory back
+  OpenGLState state;
+  OpenGLStateTracker::get().bind_texture(texture->get_target(), texture->get_id());
+  for(int i = 0; i < level; ++i)
+  {
+    glTexImage2D(texture->get_target(), i, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  }
+  assert_gl("ResidencyManager::evict");
+
+  entry.dropped_levels = level;
+#else
+  // the accounting catches up once the smaller image is uploaded
+  TextureLoader::get().reload(texture, entry.filename, level);
+  entry.loading = true;
+#endif
+
+  m_evictions += 1;
+  g_render_stats.texture_evictions += 1;
+  return true;
+}
+
+void
+ResidencyManager::update()
+{
+  m_frame += 1;
+
+  std::vector<std::pair<TexturePtr, Entry*>> candidates;
+  for(auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    TexturePtr texture = it->second.texture.lock();
+    if (!texture)
+    {
+      it = m_entries.erase(it);
+      continue;
+    }
+
+    Entry& entry = it->second;
+    if (!entry.loading)
+    {
+      if (entry.dropped_levels > 0 && texture->get_last_used() + 1 >= m_frame)
+      {
+        // drawn in the last frame, it keeps showing the coarse levels
+        // until the full image is back
+        TextureLoader::get().reload(texture, entry.filename);
+        entry.loading = true;
+        m_reloads += 1;
+        g_render_stats.texture_reloads += 1;
+      }
+      else if (texture->get_last_used() + GRACE_FRAMES < m_frame)
+      {
+        candidates.emplace_back(std::move(texture), &entry);
+      }
+    }
+
+    ++it;
+  }
+
+  if (m_budget > 0 && Texture::get_total_bytes() > m_budget)
+  {
+    std::sort(candidates.begin(), candidates.end(),
+              [](std::pair<TexturePtr, Entry*> const& lhs, std::pair<TexturePtr, Entry*> const& rhs)
+              {
+                return lhs.first->get_last_used() < rhs.first->get_last_used();
+              });
+
+    for(auto& candidate : candidates)
+    {
+      if (Texture::get_total_bytes() <= m_budget)
+      {
+        break;
+      }
+      evict(candidate.first, *candidate.second);
+    }
+  }
+
+  g_render_stats.texture_bytes = Texture::get_total_bytes();
+}
+
+/* EOF */
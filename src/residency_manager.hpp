@@ -0,0 +1,93 @@
+#ifndef HEADER_RESIDENCY_MANAGER_HPP
+#define HEADER_RESIDENCY_MANAGER_HPP
+
+#include <filesystem>
+#include <memory>
+#include <stddef.h>
+#include <unordered_map>
+
+#include "texture.hpp"
+
+/** Keeps the estimated texture memory, Texture::get_total_bytes(),
+    below a budget. When the budget is exceeded the finest mip levels
+    of the textures that weren't drawn for the longest time are
+    dropped, down to a small top level, and are loaded from the file
+    again once the texture is drawn.
+
+    Only mipmapped textures of TextureLoader can be evicted, they have
+    mutable storage and a file to come back from. On desktop GL the
+    eviction raises GL_TEXTURE_BASE_LEVEL and releases the levels above
+    it right away. GLES2 has no base level, there the texture is
+    reloaded at a reduced size instead. */
+class ResidencyManager
+{
+public:
+  static ResidencyManager& get()
+  {
+    static ResidencyManager instance;
+    return instance;
+  }
+
+  /** Frames a texture has to go undrawn before it can be evicted */
+  enum { GRACE_FRAMES = 60 };
+
+  /** Largest top level an evicted texture keeps, 64x64 RGBA */
+  enum { EVICTED_BYTES = 64 * 64 * 4 };
+
+private:
+  struct Entry
+  {
+    std::weak_ptr<Texture> texture;
+    std::filesystem::path filename;
+
+    // mip levels the GL texture is short of the file
+    int dropped_levels;
+
+    // a reload is in flight
+    bool loading;
+  };
+
+private:
+  std::unordered_map<Texture const*, Entry> m_entries;
+  unsigned int m_frame;
+  size_t m_budget;
+  int m_evictions;
+  int m_reloads;
+
+public:
+  ResidencyManager();
+
+  /** Called by TextureLoader whenever \a texture finished loading,
+      \a dropped_levels is the number of levels left out */
+  void add(TexturePtr const& texture, std::filesystem::path const& filename, int dropped_levels);
+
+  /** Budget in bytes, 0 means unlimited */
+  void set_budget(size_t bytes) { m_budget = bytes; }
+  size_t get_budget() const { return m_budget; }
+
+  /** Current frame number, for Texture::set_last_used() */
+  unsigned int get_frame() const { return m_frame; }
+
+  /** Starts a new frame, reloads evicted textures that were drawn in
+      the last one and evicts when over budget. Must be called once per
+      frame on the GL thread. */
+  void update();
+
+  int get_evictions() const { return m_evictions; }
+  int get_reloads() const { return m_reloads; }
+
+  /** The level that becomes the top one when \a texture is evicted */
+  static int get_evict_level(Texture const& texture);
+
+private:
+  /** Returns false when there is nothing left to drop */
+  bool evict(TexturePtr const& texture, Entry& entry);
+
+private:
+  ResidencyManager(const ResidencyManager&) = delete;
+  ResidencyManager& operator=(const ResidencyManager&) = delete;
+};
+
+#endif
+
+/* EOF */
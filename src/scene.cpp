@@ -1,6 +1,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/format.hpp>
 #include <boost/tokenizer.hpp>
+#include <algorithm>
 #include <fstream>
 #include <stdexcept>
 
@@ -9,8 +10,17 @@
 
 #include "scene.hpp"
 
-std::unique_ptr<SceneNode>
-Scene::from_file(const std::string& filename)
+namespace {
+
+/** Objects this large (in world units, with the transforms of all
+    parents applied) become occluders even without an explicit
+    "occluder" line */
+const float k_occluder_min_size = 2.0f;
+
+} // namespace
+
+SceneNodePtr
+Scene::from_file(const std::string& filename, bool keep_geometry)
 {
   std::ifstream in(filename.c_str());
   if(!in)
@@ -21,12 +31,13 @@ Scene::from_file(const std::string& filename)
   {
     Scene scene;
     scene.set_directory(std::filesystem::path(filename).parent_path());
+    scene.set_keep_geometry(keep_geometry);
     scene.parse_istream(in);
     return scene.get_node();
   }
 }
 
-std::unique_ptr<SceneNode>
+SceneNodePtr
 Scene::from_istream(std::istream& in)
 {
   Scene scene;
@@ -36,7 +47,8 @@ Scene::from_istream(std::istream& in)
 
 Scene::Scene() :
   m_directory(),
-  m_node(std::make_unique<SceneNode>())
+  m_node(SceneNode::create()),
+  m_keep_geometry(false)
 {
 }
 
@@ -53,11 +65,24 @@ Scene::parse_istream(std::istream& in)
   // inspiration from it:
   // http://www.martinreddy.net/gfx/3d/OBJ.spec
   std::unordered_map<std::string, SceneNode*> nodes;
-  std::unordered_map<std::string, std::unique_ptr<SceneNode> > unattached_children;
+  std::unordered_map<std::string, SceneNodePtr > unattached_children;
+
+  // opaque models that may become occluders once their size in the
+  // world is known
+  struct OccluderCandidate
+  {
+    SceneNode* node;
+    ModelPtr model;
+    bool forced;
+    std::vector<glm::vec3> positions;
+    std::vector<int> indices;
+  };
+  std::vector<OccluderCandidate> occluder_candidates;
 
   std::string name;
   std::string parent;
   std::string material = "phong";
+  bool occluder = false;
   glm::vec3 location(0.0f, 0.0f, 0.0f);
   glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
   glm::vec3 scale(1.0f, 1.0f, 1.0f);
@@ -100,6 +125,12 @@ Scene::parse_istream(std::istream& in)
             mesh->attach_float_array("bone_weight", bone_weight);
             mesh->attach_int_array("bone_index", bone_index);
           }
+          else if (m_keep_geometry)
+          {
+            // skinned meshes are left out, the BVH would only match
+            // the rest pose
+            mesh->build_bvh(position, index);
+          }
 
           // create Model
           model = std::make_shared<Model>();
@@ -113,12 +144,13 @@ Scene::parse_istream(std::istream& in)
           {
             model->set_material(MaterialFactory::get().create(material));
           }
+
         }
       }
 
       // create SceneNode
       {
-        std::unique_ptr<SceneNode> node = std::make_unique<SceneNode>(name);
+        SceneNodePtr node = SceneNode::create(name);
         node->set_position(location);
         node->set_orientation(rotation);
         node->set_scale(scale);
@@ -126,6 +158,13 @@ Scene::parse_istream(std::istream& in)
         if (model)
         {
           node->attach_model(model);
+
+          // blended and alpha tested surfaces don't hide what is behind them
+          MaterialPtr const& model_material = model->get_material();
+          if (model_material && !model_material->is_enabled(GL_BLEND) && !model_material->alpha_test())
+          {
+            occluder_candidates.push_back(OccluderCandidate{ node.get(), model, occluder, position, index });
+          }
         }
 
         if (nodes.find(name) != nodes.end())
@@ -151,6 +190,7 @@ Scene::parse_istream(std::istream& in)
       texcoord.clear();
       position.clear();
       index.clear();
+      occluder = false;
       location = glm::vec3(0.0f, 0.0f, 0.0f);
       rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
       scale = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -195,6 +235,10 @@ Scene::parse_istream(std::istream& in)
           INCR_AND_CHECK;
           parent = *it;
         }
+        else if (*it == "occluder")
+        {
+          occluder = true;
+        }
         else if (*it == "mat")
         {
           INCR_AND_CHECK;
@@ -336,9 +380,23 @@ Scene::parse_istream(std::istream& in)
       p->second->attach_child(std::move(it.second));
     }
   }
+
+  // keep a copy of the geometry of large opaque objects around for
+  // occlusion culling, measured in the world so that rotated and
+  // scaled parents count
+  m_node->update_transform();
+  for(auto& candidate : occluder_candidates)
+  {
+    glm::vec3 const size = AABB::from_points(candidate.positions)
+      .transform(candidate.node->get_transform()).get_size();
+    if (candidate.forced || std::max(size.x, std::max(size.y, size.z)) >= k_occluder_min_size)
+    {
+      candidate.model->set_occluder(candidate.positions, candidate.indices);
+    }
+  }
 }
 
-std::unique_ptr<SceneNode>
+SceneNodePtr
 Scene::get_node()
 {
   return std::move(m_node);
@@ -5,24 +5,28 @@
 #include <string>
 #include <filesystem>
 
-class SceneNode;
+#include "scene_node.hpp"
 
 class Scene
 {
 public:
-  static std::unique_ptr<SceneNode> from_istream(std::istream& in);
-  static std::unique_ptr<SceneNode> from_file(const std::string& filename);
+  static SceneNodePtr from_istream(std::istream& in);
+  /** \a keep_geometry builds a BVH for every static mesh, so the
+      scene can be used with SceneManager::raycast() */
+  static SceneNodePtr from_file(const std::string& filename, bool keep_geometry = false);
 
 private:
   std::filesystem::path m_directory;
-  std::unique_ptr<SceneNode> m_node;
+  SceneNodePtr m_node;
+  bool m_keep_geometry;
 
 public:
   Scene();
 
   void set_directory(const std::filesystem::path& path);
+  void set_keep_geometry(bool keep_geometry) { m_keep_geometry = keep_geometry; }
   void parse_istream(std::istream& in);
-  std::unique_ptr<SceneNode> get_node();
+  SceneNodePtr get_node();
 
 private:
   Scene(const Scene&);
@@ -1,13 +1,67 @@
 #include "scene_manager.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
 #include "camera.hpp"
+#include "frustum.hpp"
+#include "model.hpp"
+#include "occlusion_buffer.hpp"
 #include "render_context.hpp"
+#include "render_stats.hpp"
+#include "stopwatch.hpp"
+#include "task_scheduler.hpp"
+#include "uniform_blocks.hpp"
+
+namespace {
+
+/** The view tree is attached to the camera, so it is rendered with the
+    camera moved to the origin */
+Camera make_view_camera(Camera const& camera)
+{
+  Camera id = camera;
+  id.set_position(glm::vec3(0.0f, 0.0f, 0.0f));
+  return id;
+}
+
+/** Slab test of \a ray against \a box, limited to [0, max_distance] */
+bool intersects(Ray const& ray, AABB const& box, float max_distance)
+{
+  float tnear = 0.0f;
+  float tfar = max_distance;
+  for(int i = 0; i < 3; ++i)
+  {
+    float const inv_d = 1.0f / ray.direction[i];
+    float t0 = (box.min[i] - ray.origin[i]) * inv_d;
+    float t1 = (box.max[i] - ray.origin[i]) * inv_d;
+    if (t0 > t1)
+    {
+      std::swap(t0, t1);
+    }
+    tnear = std::max(tnear, t0);
+    tfar = std::min(tfar, t1);
+  }
+  return tnear <= tfar;
+}
+
+} // namespace
 
 SceneManager::SceneManager() :
-  m_world(std::make_unique<SceneNode>()),
-  m_view(std::make_unique<SceneNode>()),
+  m_world(SceneNode::create("world")),
+  m_view(SceneNode::create("view")),
   m_lights(),
-  m_override_material()
+  m_light_clusters(),
+  m_override_material(),
+  m_feedback_depth_material(),
+  m_snapshot(),
+  m_draw_list(),
+  m_shadow_list(),
+  m_top_level(),
+  m_collect_chunks(),
+  m_cull_chunks(),
+  m_occlusion_culling(false),
+  m_occlusion_buffers()
 {}
 
 SceneManager::~SceneManager()
@@ -35,47 +89,409 @@ SceneManager::create_light()
 }
 
 void
-SceneManager::render(Camera const& camera, bool geometry_pass, Stereo stereo)
+SceneManager::prepare(Camera const& left, Camera const& right, Camera const* shadow_camera)
 {
-  m_world->update_transform();
-  m_view->update_transform();
+  Stopwatch stopwatch;
 
-  render_node(camera, m_world.get(), geometry_pass, stereo);
+  TaskScheduler& scheduler = TaskScheduler::get();
 
-  Camera id = camera;
-  id.set_position(glm::vec3(0.0f, 0.0f, 0.0f));
-  render_node(id, m_view.get(), geometry_pass, stereo);
+  // Update transforms and build the snapshot, one task per range of
+  // top level subtrees. Chunks are concatenated in order, so the
+  // snapshot matches a serial depth-first traversal.
+  m_snapshot.clear();
+  m_world->update_global_transform(glm::mat4(1));
+  collect_models(m_world.get(), false, m_snapshot);
+
+  // siblings are linked by handle, gather the top level into an array
+  // so the ranges can be split up
+  std::vector<SceneNode*>& children = m_top_level;
+  children.clear();
+  for(SceneNode* child : m_world->get_children())
+  {
+    children.push_back(child);
+  }
+
+  size_t const collect_grain = std::max<size_t>(1, children.size() / (scheduler.get_num_threads() * 4));
+  size_t const num_collect_chunks = (children.size() + collect_grain - 1) / collect_grain;
+  if (m_collect_chunks.size() < num_collect_chunks)
+  {
+    m_collect_chunks.resize(num_collect_chunks);
+  }
+
+  std::atomic<int> num_nodes(1);
+  glm::mat4 const& world_transform = m_world->get_transform();
+  scheduler.parallel_for(0, children.size(), collect_grain,
+                         [this, &children, &world_transform, &num_nodes, collect_grain](size_t begin, size_t end) {
+                           std::vector<DrawItem>& items = m_collect_chunks[begin / collect_grain];
+                           items.clear();
+                           int count = 0;
+                           for(size_t i = begin; i < end; ++i)
+                           {
+                             collect(children[i], world_transform, false, items, count);
+                           }
+                           num_nodes += count;
+                         });
+
+  for(size_t i = 0; i < num_collect_chunks; ++i)
+  {
+    m_snapshot.insert(m_snapshot.end(), m_collect_chunks[i].begin(), m_collect_chunks[i].end());
+  }
+
+  int num_view_nodes = 0;
+  collect(m_view.get(), glm::mat4(1), true, m_snapshot, num_view_nodes);
+
+  // Cull the snapshot in fixed size chunks, m_snapshot must not change
+  // from here on as the lists point into it
+  CullFrustums frustums;
+  frustums.left = Frustum(left.get_matrix());
+  frustums.left_view = Frustum(make_view_camera(left).get_matrix());
+  frustums.stereo = (&left != &right);
+  if (frustums.stereo)
+  {
+    frustums.right = Frustum(right.get_matrix());
+    frustums.right_view = Frustum(make_view_camera(right).get_matrix());
+  }
+  frustums.shadow = (shadow_camera != nullptr);
+  if (frustums.shadow)
+  {
+    frustums.shadow_world = Frustum(shadow_camera->get_matrix());
+    frustums.shadow_view = Frustum(make_view_camera(*shadow_camera).get_matrix());
+  }
+
+  size_t const cull_grain = 1024;
+  size_t const num_cull_chunks = (m_snapshot.size() + cull_grain - 1) / cull_grain;
+  if (m_cull_chunks.size() < num_cull_chunks)
+  {
+    m_cull_chunks.resize(num_cull_chunks);
+  }
+
+  scheduler.parallel_for(0, m_snapshot.size(), cull_grain,
+                         [this, &frustums, cull_grain](size_t begin, size_t end) {
+                           cull(begin, end, frustums, m_cull_chunks[begin / cull_grain]);
+                         });
+
+  m_draw_list.clear();
+  m_shadow_list.clear();
+  for(size_t i = 0; i < num_cull_chunks; ++i)
+  {
+    CullResult const& result = m_cull_chunks[i];
+    m_draw_list.insert(m_draw_list.end(), result.draw_list.begin(), result.draw_list.end());
+    m_shadow_list.insert(m_shadow_list.end(), result.shadow_list.begin(), result.shadow_list.end());
+  }
+
+  if (m_occlusion_culling)
+  {
+    occlusion_cull(left, right);
+  }
+
+  // stereo pairs share the blend order, sorted from between the eyes
+  sort_draw_list(0.5f * (left.get_position() + right.get_position()));
+
+  g_render_stats.nodes += num_nodes + num_view_nodes;
+  g_render_stats.draw_items += static_cast<int>(m_snapshot.size());
+  g_render_stats.visible += static_cast<int>(m_draw_list.size());
+  g_render_stats.shadow_casters += static_cast<int>(m_shadow_list.size());
+  g_render_stats.prepare_msec += stopwatch.get_msec();
 }
 
-extern TexturePtr g_video_texture;
+void
+SceneManager::collect_models(SceneNode* node, bool view_space, std::vector<DrawItem>& items)
+{
+  glm::mat4 const& transform = node->get_transform();
+  for(auto const& model : node->get_models())
+  {
+    items.push_back(DrawItem{ node, model.get(),
+          model->get_bounding_box().transform(transform),
+          view_space });
+  }
+}
 
 void
-SceneManager::render_node(Camera const& camera, SceneNode* node, bool geometry_pass, Stereo stereo)
+SceneManager::collect(SceneNode* node, glm::mat4 const& parent_transform, bool view_space,
+                      std::vector<DrawItem>& items, int& num_nodes)
 {
-  OpenGLState state;
+  node->update_global_transform(parent_transform);
+  num_nodes += 1;
+
+  collect_models(node, view_space, items);
+
+  for(SceneNode* child : node->get_children())
+  {
+    collect(child, node->get_transform(), view_space, items, num_nodes);
+  }
+}
+
+void
+SceneManager::cull(size_t begin, size_t end, CullFrustums const& frustums, CullResult& result) const
+{
+  result.draw_list.clear();
+  result.shadow_list.clear();
+
+  for(size_t i = begin; i < end; ++i)
+  {
+    DrawItem const& item = m_snapshot[i];
+
+    // models visible to either eye share one list
+    if ((item.view_space ? frustums.left_view : frustums.left).intersects(item.bounds) ||
+        (frustums.stereo && (item.view_space ? frustums.right_view : frustums.right).intersects(item.bounds)))
+    {
+      result.draw_list.push_back(&item);
+    }
+
+    if (frustums.shadow &&
+        (item.view_space ? frustums.shadow_view : frustums.shadow_world).intersects(item.bounds))
+    {
+      // Model::draw() skips non-casters when an override material is set
+      MaterialPtr const& material = item.model->get_material();
+      if (!m_override_material || (material && material->cast_shadow()))
+      {
+        result.shadow_list.push_back(&item);
+      }
+    }
+  }
+}
+
+void
+SceneManager::occlusion_cull(Camera const& left, Camera const& right)
+{
+  Stopwatch stopwatch;
+
+  if (!m_occlusion_buffers[0])
+  {
+    m_occlusion_buffers[0] = std::make_unique<OcclusionBuffer>(256, 192);
+    m_occlusion_buffers[1] = std::make_unique<OcclusionBuffer>(256, 192);
+  }
+
+  // each eye needs its own buffer, an object hidden from one eye might
+  // still be visible from the other
+  Camera const* cameras[2] = { &left, &right };
+  int const num_buffers = (&left != &right) ? 2 : 1;
+
+  for(int i = 0; i < num_buffers; ++i)
+  {
+    OcclusionBuffer& buffer = *m_occlusion_buffers[i];
+
+    buffer.clear(cameras[i]->get_matrix());
+    for(DrawItem const* item : m_draw_list)
+    {
+      if (!item->view_space && item->model->is_occluder())
+      {
+        buffer.add_occluder(item->node->get_transform(),
+                            item->model->get_occluder_positions(),
+                            item->model->get_occluder_indices());
+
+        if (i == 0)
+        {
+          g_render_stats.occluders += 1;
+        }
+      }
+    }
+    buffer.rasterize();
+
+    g_render_stats.occluder_triangles += buffer.get_triangle_count();
+  }
+
+  auto is_hidden = [this, num_buffers](DrawItem const* item) {
+    if (item->view_space || item->model->is_occluder())
+    {
+      return false;
+    }
+    else
+    {
+      for(int i = 0; i < num_buffers; ++i)
+      {
+        if (m_occlusion_buffers[i]->is_visible(item->bounds))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
 
-  RenderContext context(camera, node);
+  auto it = std::remove_if(m_draw_list.begin(), m_draw_list.end(), is_hidden);
+  g_render_stats.occluded += static_cast<int>(m_draw_list.end() - it);
+  m_draw_list.erase(it, m_draw_list.end());
 
-  context.set_video_texture(g_video_texture);
+  g_render_stats.occlusion_msec += stopwatch.get_msec();
+}
+
+SceneManager::RaycastResult
+SceneManager::raycast(glm::vec3 const& origin, glm::vec3 const& direction) const
+{
+  RaycastResult result;
+  RayHit hit;
+  raycast(m_world.get(), Ray{ origin, direction }, hit, result);
+  return result;
+}
+
+void
+SceneManager::raycast(SceneNode* node, Ray const& ray, RayHit& hit, RaycastResult& result)
+{
+  glm::mat4 const& transform = node->get_transform();
+  for(auto const& model : node->get_models())
+  {
+    if (model->has_bvh() &&
+        intersects(ray, model->get_bounding_box().transform(transform), hit.distance))
+    {
+      // the ray is moved into object space instead of the triangles to
+      // world space, the distance stays the same as the direction is
+      // transformed along
+      glm::mat4 const inv = glm::inverse(transform);
+      Ray const local_ray{ glm::vec3(inv * glm::vec4(ray.origin, 1.0f)),
+                           glm::vec3(inv * glm::vec4(ray.direction, 0.0f)) };
 
-  context.set_stereo(stereo);
+      int mesh = -1;
+      if (model->raycast(local_ray, hit, mesh))
+      {
+        result.node = node;
+        result.model = model.get();
+        result.mesh = mesh;
+        result.triangle = hit.triangle;
+        result.distance = hit.distance;
+      }
+    }
+  }
 
-  if (geometry_pass)
+  for(SceneNode* child : node->get_children())
   {
-    context.set_override_material(m_override_material);
+    raycast(child, ray, hit, result);
   }
+}
 
-  for(auto& model : node->get_models())
+void
+SceneManager::sort_draw_list(glm::vec3 const& eye)
+{
+  // group the opaque draws by Material::get_sort_key() so that
+  // consecutive draws share as much state as possible. Blended draws
+  // go last and back to front, farthest first, as they only compose
+  // correctly in that order. The view tree comes after the world in the
+  // snapshot and stays there, equal keys keep their order.
+  m_sort_buffer.clear();
+  for(DrawItem const* item : m_draw_list)
   {
-    model->draw(context);
+    MaterialPtr const& material = item->model->get_material();
+    uint64_t key = material ? material->get_sort_key() : 0;
+    if (key >> 63)
+    {
+      // view tree bounds are in eye space, the eye is at the origin
+      glm::vec3 const center = 0.5f * (item->bounds.min + item->bounds.max);
+      glm::vec3 const delta = center - (item->view_space ? glm::vec3(0.0f) : eye);
+      float const distance = glm::dot(delta, delta);
+
+      // positive floats order like their bits, inverted for far to near
+      uint32_t bits;
+      memcpy(&bits, &distance, sizeof(bits));
+      key = (uint64_t(1) << 63) | ~bits;
+    }
+    m_sort_buffer.emplace_back(key, item);
   }
 
-  for(auto const& child : node->get_children())
+  auto const by_key = [](std::pair<uint64_t, DrawItem const*> const& lhs,
+                       std::pair<uint64_t, DrawItem const*> const& rhs) {
+    // snapshot order breaks ties
+    return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+  };
+  auto const view_begin = std::find_if(m_sort_buffer.begin(), m_sort_buffer.end(),
+                                       [](std::pair<uint64_t, DrawItem const*> const& entry) {
+                                         return entry.second->view_space;
+                                       });
+  std::sort(m_sort_buffer.begin(), view_begin, by_key);
+  std::sort(view_begin, m_sort_buffer.end(), by_key);
+
+  for(size_t i = 0; i < m_sort_buffer.size(); ++i)
   {
-    render_node(camera, child.get(), geometry_pass, stereo);
+    m_draw_list[i] = m_sort_buffer[i].second;
   }
 }
 
+extern TexturePtr g_video_texture;
+
+void
+SceneManager::draw(Camera const& camera, bool geometry_pass, Stereo stereo)
+{
+  Stopwatch stopwatch;
+
+  OpenGLState state;
+
+  Camera const view_camera = make_view_camera(camera);
+
+  // the shadow pass uses plain uniforms, the blocks are only needed for
+  // the color passes
+  UniformBlocks& blocks = UniformBlocks::get();
+  bool view_space_bound = false;
+  if (!geometry_pass)
+  {
+    blocks.set_view(camera, stereo);
+  }
+
+  // the feedback pass doesn't shade, it leaves the lights alone
+  if (!geometry_pass && !m_feedback_depth_material)
+  {
+    LightBlock light_block;
+    if (!m_lights.empty())
+    {
+      m_light_clusters.build(m_lights, camera.get_view_matrix(), camera.get_projection_matrix(),
+                             camera.get_znear(), camera.get_zfar());
+      m_light_clusters.upload();
+    }
+    light_block.cluster_params = glm::vec4(m_light_clusters.get_slice_scale(),
+                                           m_light_clusters.get_slice_bias(),
+                                           0.0f, 0.0f);
+    light_block.cluster_size = glm::ivec4(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z,
+                                          m_lights.empty() ? 0 : m_light_clusters.get_light_count());
+    blocks.set_lights(light_block);
+  }
+
+  for(DrawItem const* item : geometry_pass ? m_shadow_list : m_draw_list)
+  {
+    RenderContext context(item->view_space ? view_camera : camera, item->node);
+
+    if (!geometry_pass)
+    {
+      if (item->view_space != view_space_bound)
+      {
+        blocks.set_view(item->view_space ? view_camera : camera, stereo);
+        view_space_bound = item->view_space;
+      }
+      blocks.set_object(item->node->get_transform());
+    }
+
+    context.set_video_texture(g_video_texture);
+
+    context.set_stereo(stereo);
+
+    if (geometry_pass)
+    {
+      context.set_override_material(m_override_material);
+    }
+    else if (m_feedback_depth_material)
+    {
+      context.set_feedback_pass();
+      context.set_override_material(m_feedback_depth_material);
+    }
+
+    item->model->draw(context);
+  }
+
+  g_render_stats.submit_msec += stopwatch.get_msec();
+}
+
+void
+SceneManager::render(Camera const& camera, bool geometry_pass, Stereo stereo)
+{
+  prepare(camera, camera, geometry_pass ? &camera : nullptr);
+  draw(camera, geometry_pass, stereo);
+}
+
+void
+SceneManager::draw_feedback(Camera const& camera, MaterialPtr const& depth_material)
+{
+  m_feedback_depth_material = depth_material;
+  draw(camera, false);
+  m_feedback_depth_material.reset();
+}
+
 void
 SceneManager::set_override_material(MaterialPtr material)
 {
@@ -3,22 +3,87 @@
 
 #include <vector>
 
+#include "aabb.hpp"
+#include "frustum.hpp"
 #include "light.hpp"
+#include "light_clusters.hpp"
 #include "scene_node.hpp"
 #include "opengl_state.hpp"
 #include "material.hpp"
 #include "stereo.hpp"
+#include "triangle_bvh.hpp"
 
 class Camera;
+class Model;
+class OcclusionBuffer;
 
 class SceneManager
 {
+public:
+  /** The closest triangle found by raycast(), node is nullptr when
+      nothing was hit */
+  struct RaycastResult
+  {
+    SceneNode* node = nullptr;
+    Model* model = nullptr;
+    int mesh = -1;
+    int triangle = -1;
+    float distance = std::numeric_limits<float>::infinity();
+  };
+
 private:
-  std::unique_ptr<SceneNode> m_world;
-  std::unique_ptr<SceneNode> m_view;
+  /** A single model as it was found in the scene graph at prepare() time */
+  struct DrawItem
+  {
+    SceneNode* node;
+    Model* model;
+    AABB bounds; // world space, or eye space for the view tree
+    bool view_space;
+  };
+
+  struct CullFrustums
+  {
+    Frustum left;
+    Frustum left_view;
+    Frustum right;
+    Frustum right_view;
+    Frustum shadow_world;
+    Frustum shadow_view;
+    bool stereo = false;
+    bool shadow = false;
+  };
+
+  struct CullResult
+  {
+    std::vector<DrawItem const*> draw_list;
+    std::vector<DrawItem const*> shadow_list;
+  };
+
+private:
+  SceneNodePtr m_world;
+  SceneNodePtr m_view;
   std::vector<LightPtr> m_lights;
+  LightClusters m_light_clusters;
   MaterialPtr m_override_material;
 
+  // set while draw_feedback() runs
+  MaterialPtr m_feedback_depth_material;
+
+  /** Per-frame snapshot of the scene graph and the lists culled from it,
+      shared by the shadow pass and both stereo eyes */
+  std::vector<DrawItem> m_snapshot;
+  std::vector<DrawItem const*> m_draw_list;
+  std::vector<DrawItem const*> m_shadow_list;
+
+  // per task output of prepare(), kept around to reuse the allocations
+  std::vector<SceneNode*> m_top_level;
+  std::vector<std::vector<DrawItem> > m_collect_chunks;
+  std::vector<CullResult> m_cull_chunks;
+  std::vector<std::pair<uint64_t, DrawItem const*> > m_sort_buffer;
+
+  bool m_occlusion_culling;
+  std::unique_ptr<OcclusionBuffer> m_occlusion_buffers[2];
+
 public:
   SceneManager();
   ~SceneManager();
@@ -28,11 +93,47 @@ public:
 
   LightPtr create_light();
 
+  /** Traverse the scene graph once, update all transforms and build the
+      draw lists. Models are kept when they are visible from either
+      \a left or \a right, pass the same camera twice for mono
+      rendering. The shadow list is only built when \a shadow_camera is
+      given. The work is spread over the TaskScheduler, the resulting
+      lists don't depend on the number of threads. */
+  void prepare(Camera const& left, Camera const& right, Camera const* shadow_camera = nullptr);
+
+  /** Submit the lists built by the last prepare(), the shadow list when
+      \a geometry_pass is set, the draw list otherwise */
+  void draw(Camera const& camera, bool geometry_pass = false, Stereo stereo = Stereo::Center);
+
+  /** prepare() and draw() in one go, for simple one-pass scenes */
   void render(Camera const& camera, bool geometry_pass = false, Stereo stereo = Stereo::Center);
-  void render_node(Camera const& camera, SceneNode* node, bool geometry_pass, Stereo stereo);
 
   void set_override_material(MaterialPtr material);
 
+  /** Draw the draw list of the last prepare() for the virtual texture
+      feedback, surfaces without a feedback material are drawn with
+      \a depth_material, see VirtualTextureManager */
+  void draw_feedback(Camera const& camera, MaterialPtr const& depth_material);
+
+  /** Remove models hidden behind occluders from the draw list, see
+      Model::set_occluder() */
+  void set_occlusion_culling(bool enabled) { m_occlusion_culling = enabled; }
+
+  /** Find the closest triangle along the world space ray, only meshes
+      with a BVH are considered, see Mesh::build_bvh(). The distance is
+      measured in multiples of \a direction. Uses the transforms of the
+      last prepare() or SceneNode::update_transform(). */
+  RaycastResult raycast(glm::vec3 const& origin, glm::vec3 const& direction) const;
+
+private:
+  static void collect_models(SceneNode* node, bool view_space, std::vector<DrawItem>& items);
+  static void collect(SceneNode* node, glm::mat4 const& parent_transform, bool view_space,
+                      std::vector<DrawItem>& items, int& num_nodes);
+  void cull(size_t begin, size_t end, CullFrustums const& frustums, CullResult& result) const;
+  void occlusion_cull(Camera const& left, Camera const& right);
+  void sort_draw_list(glm::vec3 const& eye);
+  static void raycast(SceneNode* node, Ray const& ray, RayHit& hit, RaycastResult& result);
+
 private:
   SceneManager(const SceneManager&);
   SceneManager& operator=(const SceneManager&);
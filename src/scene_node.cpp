@@ -16,21 +16,120 @@
 
 #include "scene_node.hpp"
 
+#include <stdexcept>
 #include <glm/gtx/transform.hpp>
 
-SceneNode::SceneNode(const std::string& name) :
+void
+SceneNodeDeleter::operator()(SceneNode* node) const
+{
+  SceneNodePool::get().destroy(node);
+}
+
+SceneNodePool::SceneNodePool() :
+  m_mutex(),
+  m_chunks(),
+  m_free_handles(),
+  m_next_handle(0),
+  m_node_count(0),
+  m_allocation_count(0)
+{
+}
+
+SceneNode*
+SceneNodePool::create(const std::string& name)
+{
+  SceneNodeHandle handle;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_free_handles.empty())
+    {
+      handle = m_free_handles.back();
+      m_free_handles.pop_back();
+    }
+    else
+    {
+      if (m_next_handle % CHUNK_SIZE == 0)
+      {
+        SceneNodeHandle chunk = m_next_handle >> CHUNK_BITS;
+        if (chunk >= static_cast<SceneNodeHandle>(MAX_CHUNKS))
+        {
+          throw std::runtime_error("SceneNodePool: out of nodes");
+        }
+
+        m_chunks[chunk] = std::make_unique<Chunk>();
+        m_allocation_count += 1;
+      }
+
+      handle = m_next_handle;
+      m_next_handle += 1;
+    }
+
+    m_node_count += 1;
+  }
+
+  return new (resolve(handle)) SceneNode(handle, name);
+}
+
+void
+SceneNodePool::destroy(SceneNode* node)
+{
+  SceneNodeHandle handle = node->m_handle;
+
+  // destroys the children as well, so don't hold the lock here
+  node->~SceneNode();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_free_handles.push_back(handle);
+  m_node_count -= 1;
+}
+
+SceneNodePtr
+SceneNode::create(const std::string& name)
+{
+  return SceneNodePtr(SceneNodePool::get().create(name));
+}
+
+SceneNode::SceneNode(SceneNodeHandle handle, const std::string& name) :
+  m_handle(handle),
+  m_parent(SceneNodePool::INVALID_HANDLE),
+  m_first_child(SceneNodePool::INVALID_HANDLE),
+  m_last_child(SceneNodePool::INVALID_HANDLE),
+  m_prev_sibling(SceneNodePool::INVALID_HANDLE),
+  m_next_sibling(SceneNodePool::INVALID_HANDLE),
   m_name(name),
   m_position(0.0f, 0.0f, 0.0f),
   m_orientation(1.0f, 0.0f, 0.0f, 0.0f),
   m_scale(1.0f , 1.0f, 1.0f),
   m_global_transform(1),
-  m_children(),
   m_models()
 {
 }
 
 SceneNode::~SceneNode()
 {
+  SceneNodePool& pool = SceneNodePool::get();
+
+  SceneNodeHandle handle = m_first_child;
+  while (handle != SceneNodePool::INVALID_HANDLE)
+  {
+    SceneNode* child = pool.resolve(handle);
+    handle = child->m_next_sibling;
+    pool.destroy(child);
+  }
+}
+
+SceneNode*
+SceneNode::get_parent() const
+{
+  if (m_parent == SceneNodePool::INVALID_HANDLE)
+  {
+    return nullptr;
+  }
+  else
+  {
+    return SceneNodePool::get().resolve(m_parent);
+  }
 }
 
 void
@@ -77,17 +176,23 @@ SceneNode::get_transform() const
 
 void
 SceneNode::update_transform(const glm::mat4& parent_transform)
+{
+  update_global_transform(parent_transform);
+
+  for(SceneNode* child : get_children())
+  {
+    child->update_transform(m_global_transform);
+  }
+}
+
+void
+SceneNode::update_global_transform(const glm::mat4& parent_transform)
 {
   m_global_transform =
     parent_transform *
     glm::translate(m_position) *
     glm::mat4_cast(m_orientation) *
     glm::scale(m_scale);
-
-  for(auto& child : m_children)
-  {
-    child->update_transform(m_global_transform);
-  }
 }
 
 void
@@ -97,18 +202,73 @@ SceneNode::attach_model(ModelPtr model)
 }
 
 void
-SceneNode::attach_child(std::unique_ptr<SceneNode> child)
+SceneNode::attach_child(SceneNodePtr child)
 {
-  m_children.push_back(std::move(child));
+  if (child->m_parent != SceneNodePool::INVALID_HANDLE)
+  {
+    throw std::runtime_error("SceneNode::attach_child: node already has a parent");
+  }
+
+  SceneNode* node = child.release();
+
+  node->m_parent = m_handle;
+  node->m_prev_sibling = m_last_child;
+  node->m_next_sibling = SceneNodePool::INVALID_HANDLE;
+
+  if (m_last_child == SceneNodePool::INVALID_HANDLE)
+  {
+    m_first_child = node->m_handle;
+  }
+  else
+  {
+    SceneNodePool::get().resolve(m_last_child)->m_next_sibling = node->m_handle;
+  }
+  m_last_child = node->m_handle;
 }
 
 SceneNode*
 SceneNode::create_child()
 {
-  std::unique_ptr<SceneNode> child = std::make_unique<SceneNode>();
+  SceneNodePtr child = SceneNode::create();
   SceneNode* ptr = child.get();
   attach_child(std::move(child));
   return ptr;
 }
 
+SceneNodePtr
+SceneNode::detach()
+{
+  if (m_parent == SceneNodePool::INVALID_HANDLE)
+  {
+    throw std::runtime_error("SceneNode::detach: node has no parent");
+  }
+
+  SceneNodePool& pool = SceneNodePool::get();
+  SceneNode* parent = pool.resolve(m_parent);
+
+  if (m_prev_sibling == SceneNodePool::INVALID_HANDLE)
+  {
+    parent->m_first_child = m_next_sibling;
+  }
+  else
+  {
+    pool.resolve(m_prev_sibling)->m_next_sibling = m_next_sibling;
+  }
+
+  if (m_next_sibling == SceneNodePool::INVALID_HANDLE)
+  {
+    parent->m_last_child = m_prev_sibling;
+  }
+  else
+  {
+    pool.resolve(m_next_sibling)->m_prev_sibling = m_prev_sibling;
+  }
+
+  m_parent = SceneNodePool::INVALID_HANDLE;
+  m_prev_sibling = SceneNodePool::INVALID_HANDLE;
+  m_next_sibling = SceneNodePool::INVALID_HANDLE;
+
+  return SceneNodePtr(this);
+}
+
 /* EOF */
@@ -20,13 +20,80 @@
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "model.hpp"
 
+class SceneNode;
+
+/** Index of a SceneNode in the SceneNodePool */
+typedef uint32_t SceneNodeHandle;
+
+struct SceneNodeDeleter
+{
+  void operator()(SceneNode* node) const;
+};
+
+/** Owns a SceneNode that isn't attached to a parent */
+typedef std::unique_ptr<SceneNode, SceneNodeDeleter> SceneNodePtr;
+
+/** Walks the sibling list of a node */
+class SceneNodeIterator
+{
+public:
+  typedef std::forward_iterator_tag iterator_category;
+  typedef SceneNode* value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef SceneNode* const* pointer;
+  typedef SceneNode* reference;
+
+private:
+  SceneNodeHandle m_handle;
+
+public:
+  explicit SceneNodeIterator(SceneNodeHandle handle) : m_handle(handle) {}
+
+  inline SceneNode* operator*() const;
+  inline SceneNodeIterator& operator++();
+
+  bool operator==(SceneNodeIterator const& rhs) const { return m_handle == rhs.m_handle; }
+  bool operator!=(SceneNodeIterator const& rhs) const { return m_handle != rhs.m_handle; }
+};
+
+class SceneNodeRange
+{
+private:
+  SceneNodeHandle m_first;
+
+public:
+  explicit SceneNodeRange(SceneNodeHandle first) : m_first(first) {}
+
+  inline SceneNodeIterator begin() const;
+  inline SceneNodeIterator end() const;
+  inline bool empty() const;
+};
+
 class SceneNode
 {
+public:
+  /** Allocate a new node from the SceneNodePool */
+  static SceneNodePtr create(const std::string& name = std::string());
+
 private:
+  friend class SceneNodeIterator;
+  friend class SceneNodePool;
+
+  SceneNodeHandle m_handle;
+  SceneNodeHandle m_parent;
+  SceneNodeHandle m_first_child;
+  SceneNodeHandle m_last_child;
+  SceneNodeHandle m_prev_sibling;
+  SceneNodeHandle m_next_sibling;
+
   std::string m_name;
   glm::vec3 m_position;
   glm::quat m_orientation;
@@ -34,13 +101,17 @@ private:
 
   glm::mat4 m_global_transform;
 
-  std::vector<std::unique_ptr<SceneNode> > m_children;
   std::vector<ModelPtr> m_models;
 
-public:
-  SceneNode(const std::string& name = std::string());
+private:
+  SceneNode(SceneNodeHandle handle, const std::string& name);
   ~SceneNode();
 
+public:
+  std::string const& get_name() const { return m_name; }
+  SceneNodeHandle get_handle() const { return m_handle; }
+  SceneNode* get_parent() const;
+
   void set_position(const glm::vec3& p);
   glm::vec3 get_position() const;
 
@@ -54,11 +125,17 @@ public:
 
   void update_transform(const glm::mat4& parent_transform = glm::mat4(1));
 
+  /** Like update_transform(), but leaves the children untouched */
+  void update_global_transform(const glm::mat4& parent_transform);
+
   void attach_model(ModelPtr model);
-  void attach_child(std::unique_ptr<SceneNode> child);
+  void attach_child(SceneNodePtr child);
   SceneNode* create_child();
 
-  const std::vector<std::unique_ptr<SceneNode> >& get_children() const { return m_children; }
+  /** Unlink this node from its parent and hand ownership to the caller */
+  SceneNodePtr detach();
+
+  SceneNodeRange get_children() const { return SceneNodeRange(m_first_child); }
   const std::vector<ModelPtr>&   get_models() const { return m_models; }
 
 private:
@@ -66,6 +143,93 @@ private:
   SceneNode& operator=(const SceneNode&);
 };
 
+/** Slab allocator for SceneNodes. Nodes live in chunks of CHUNK_SIZE
+    that are never freed or moved, so a 32 bit handle is enough to
+    find a node and pointers to nodes stay valid while they are
+    alive. */
+class SceneNodePool
+{
+public:
+  static SceneNodePool& get()
+  {
+    static SceneNodePool instance;
+    return instance;
+  }
+
+  static const SceneNodeHandle INVALID_HANDLE = 0xffffffff;
+
+private:
+  static const int CHUNK_BITS = 10;
+  static const SceneNodeHandle CHUNK_SIZE = 1 << CHUNK_BITS;
+  static const int MAX_CHUNKS = 4096;
+
+  struct Chunk
+  {
+    alignas(SceneNode) unsigned char nodes[CHUNK_SIZE][sizeof(SceneNode)];
+  };
+
+private:
+  std::mutex m_mutex;
+  std::unique_ptr<Chunk> m_chunks[MAX_CHUNKS];
+  std::vector<SceneNodeHandle> m_free_handles;
+  SceneNodeHandle m_next_handle;
+
+  int m_node_count;
+  int m_allocation_count;
+
+public:
+  SceneNodePool();
+
+  SceneNode* create(const std::string& name);
+  void destroy(SceneNode* node);
+
+  SceneNode* resolve(SceneNodeHandle handle) const
+  {
+    return reinterpret_cast<SceneNode*>(m_chunks[handle >> CHUNK_BITS]->nodes[handle & (CHUNK_SIZE - 1)]);
+  }
+
+  /** Number of nodes currently alive */
+  int get_node_count() const { return m_node_count; }
+
+  /** Number of chunks allocated from the heap so far */
+  int get_allocation_count() const { return m_allocation_count; }
+
+private:
+  SceneNodePool(const SceneNodePool&) = delete;
+  SceneNodePool& operator=(const SceneNodePool&) = delete;
+};
+
+inline SceneNode*
+SceneNodeIterator::operator*() const
+{
+  return SceneNodePool::get().resolve(m_handle);
+}
+
+inline SceneNodeIterator&
+SceneNodeIterator::operator++()
+{
+  m_handle = SceneNodePool::get().resolve(m_handle)->m_next_sibling;
+  return *this;
+}
+
+inline SceneNodeIterator
+SceneNodeRange::begin() const
+{
+  return SceneNodeIterator(m_first);
+}
+
+inline SceneNodeIterator
+SceneNodeRange::end() const
+{
+  return SceneNodeIterator(SceneNodePool::INVALID_HANDLE);
+}
+
+inline bool
+SceneNodeRange::empty() const
+{
+  return m_first == SceneNodePool::INVALID_HANDLE;
+}
+
 #endif
 
 /* EOF */
@@ -26,9 +26,9 @@ SceneVisitor::visit(SceneNode* node, const glm::mat4& matrix)
     visit(model);
   }
 
-  for(auto const& child : node->get_children())
+  for(SceneNode* child : node->get_children())
   {
-    visit(child.get(), m);
+    visit(child, m);
   }
 }
 
@@ -4,119 +4,56 @@
 #include <boost/format.hpp>
 #include <filesystem>
 #include <sstream>
-#include <fstream>
-#include <regex>
 
 #include "log.hpp"
-
-namespace {
-
-void include_file(std::filesystem::path const& filename, std::ostream& os)
-{
-  std::ifstream in(filename.string());
-  if (!in)
-  {
-    throw std::runtime_error((boost::format("%s: failed to open file") % filename).str());
-  }
-  else
-  {
-    std::string line;
-    while(std::getline(in, line))
-    {
-      os << line << '\n';
-    }
-  }
-}
-
-} // namespace
+#include "shader_source_manager.hpp"
 
 ShaderPtr
 Shader::from_file(GLenum type, std::filesystem::path const& filename,
                   std::vector<std::string> const& defines)
 {
-  std::ifstream in(filename.string());
-  if (!in)
-  {
-    throw std::runtime_error((boost::format("%s: failed to open file") % filename).str());
-  }
-  else
-  {
-    std::vector<std::string> sources;
+  std::vector<std::string> sources;
 
-    // add version declaration
+  // add version declaration
 #ifdef HAVE_OPENGLES2
-    sources.emplace_back("#version 100\n");
+  sources.emplace_back("#version 100\n");
 #else
-    sources.emplace_back("#version 330 core\n");
+  sources.emplace_back("#version 330 core\n");
 #endif
 
-    { // add custom defines
-      std::ostringstream os;
-      for(auto const& def : defines)
+  { // add custom defines
+    std::ostringstream os;
+    for(auto const& def : defines)
+    {
+      auto equal_pos = def.find('=');
+      if (equal_pos == std::string::npos)
       {
-        auto equal_pos = def.find('=');
-        if (equal_pos == std::string::npos)
-        {
-          os << "#define " << def << '\n';
-        }
-        else
-        {
-          os << "#define " << def.substr(0, equal_pos) << ' ' << def.substr(equal_pos+1) << '\n';
-        }
+        os << "#define " << def << '\n';
       }
-      sources.emplace_back(os.str());
-    }
-
-    { // add the actual source file
-      std::regex include_rx("^#\\s*include\\s+\"([^\"]*)\".*$");
-      int line_count = 0;
-      std::ostringstream os;
-      std::string line;
-      while(std::getline(in, line))
+      else
       {
-        std::smatch rx_results;
-        if (std::regex_match(line, rx_results, include_rx))
-        {
-          std::filesystem::path include_filename(rx_results[1]);
-          if (include_filename.is_absolute())
-          {
-            include_file(include_filename.string(), os);
-          }
-          else
-          {
-            include_file((std::filesystem::path(filename).parent_path() / include_filename).string(),
-                         os);
-          }
-          os << "#line " << line_count << '\n';
-        }
-        else
-        {
-          os << line << '\n';
-        }
-
-        line_count += 1;
+        os << "#define " << def.substr(0, equal_pos) << ' ' << def.substr(equal_pos+1) << '\n';
       }
-      sources.emplace_back(os.str());
     }
+    sources.emplace_back(os.str());
+  }
 
-    ShaderPtr shader = std::make_shared<Shader>(type);
-
-    shader->source(sources);
-    shader->compile();
+  // add the actual source file, preprocessed only once per process
+  sources.emplace_back(ShaderSourceManager::get().get_source(filename));
 
-    if (!shader->get_compile_status())
-    {
-      throw std::runtime_error((boost::format("%s: error:\n %s") % filename % shader->get_info_log()).str());
-    }
+  ShaderPtr shader = std::make_shared<Shader>(type, filename.string());
 
-    //log_debug("%s: shader compile successful", filename);
+  shader->source(sources);
 
-    return shader;
-  }
+  return shader;
 }
 
-Shader::Shader(GLenum type) :
-  m_shader()
+Shader::Shader(GLenum type, std::string const& filename) :
+  m_shader(),
+  m_type(type),
+  m_filename(filename),
+  m_sources(),
+  m_compiled(false)
 {
   m_shader = glCreateShader(type);
 }
@@ -136,6 +73,7 @@ Shader::source(std::vector<std::string> const& sources)
     source_lst[i] = sources[i].c_str();
     length_lst[i] = static_cast<GLint>(sources[i].size());
   }
+  m_sources = sources;
 
   glShaderSource(m_shader, sources.size(), source_lst.data(), length_lst.data());
 }
@@ -146,12 +84,47 @@ Shader::source(const std::string& str)
   const char* source_lst[] = {str.c_str()};
   GLint length_lst[] = {static_cast<GLint>(str.size())};
   glShaderSource(m_shader, 1, source_lst, length_lst);
+  m_sources = { str };
 }
 
 void
 Shader::compile()
 {
   glCompileShader(m_shader);
+  m_compiled = true;
+}
+
+void
+Shader::compile_checked()
+{
+  if (!m_compiled)
+  {
+    compile();
+    check_compile_status();
+  }
+}
+
+void
+Shader::check_compile_status() const
+{
+  if (!get_compile_status())
+  {
+    // the info log only has source string numbers, name the files
+    std::ostringstream files;
+    if (!m_filename.empty())
+    {
+      ShaderSourceManager& manager = ShaderSourceManager::get();
+      for(auto const& dependency : manager.get_dependencies(m_filename))
+      {
+        files << "\n  " << manager.get_source_id(dependency) << ": " << dependency;
+      }
+    }
+
+    throw std::runtime_error((boost::format("%s: error:\n %s\nsource strings:%s")
+                              % m_filename % get_info_log() % files.str()).str());
+  }
+
+  //log_debug("%s: shader compile successful", m_filename);
 }
 
 std::string
@@ -18,6 +18,7 @@
 #define HEADER_SHADER_HPP
 
 #include <memory>
+#include <string>
 #include <tuple>
 #include <vector>
 #include <filesystem>
@@ -28,27 +29,45 @@ class Shader;
 
 typedef std::shared_ptr<Shader> ShaderPtr;
 
+/** A shader object with its preprocessed source. Compilation is left
+    to Program::create(), which can skip it when the linked program is
+    found in the ProgramCache. */
 class Shader
 {
 private:
   GLuint m_shader;
+  GLenum m_type;
+  std::string m_filename;
+  std::vector<std::string> m_sources;
+  bool m_compiled;
 
 public:
   static ShaderPtr from_file(GLenum type, std::filesystem::path const& filename,
                              std::vector<std::string> const& defines = {});
 
 public:
-  Shader(GLenum type);
+  Shader(GLenum type, std::string const& filename = {});
   ~Shader();
 
   void source(std::vector<std::string> const& sources);
   void source(const std::string& source);
   void compile();
 
+  /** Compiles unless already done, throws with the info log when
+      compilation fails */
+  void compile_checked();
+
+  /** Throws with the info log when compilation failed, this blocks
+      until the compile submitted by compile() has finished */
+  void check_compile_status() const;
+
   std::string get_info_log() const;
   bool get_compile_status() const;
 
   GLuint get_id() const { return m_shader; }
+  GLenum get_type() const { return m_type; }
+  bool is_compiled() const { return m_compiled; }
+  std::vector<std::string> const& get_sources() const { return m_sources; }
 
 private:
   Shader(const Shader&) = delete;
@@ -0,0 +1,327 @@
+#include "shader_source_manager.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "format.hpp"
+#include "log.hpp"
+
+namespace {
+
+#ifdef HAVE_OPENGLES2
+// GLSL ES 1.00 numbers the line following '#line N' as N + 1, GLSL
+// 3.30 as N
+int const LINE_OFFSET = -1;
+#else
+int const LINE_OFFSET = 0;
+#endif
+
+/** Matches '#include "filename"' the same way the old
+    ^#\s*include\s+"([^"]*)".*$ regex did, without the regex cost */
+bool parse_include(std::string const& line, std::string& filename)
+{
+  if (line.empty() || line[0] != '#')
+  {
+    return false;
+  }
+
+  size_t i = 1;
+  while(i < line.size() && isspace(static_cast<unsigned char>(line[i]))) { ++i; }
+
+  if (line.compare(i, 7, "include") != 0)
+  {
+    return false;
+  }
+  i += 7;
+
+  size_t const space_start = i;
+  while(i < line.size() && isspace(static_cast<unsigned char>(line[i]))) { ++i; }
+  if (i == space_start || i >= line.size() || line[i] != '"')
+  {
+    return false;
+  }
+
+  size_t const end = line.find('"', i + 1);
+  if (end == std::string::npos)
+  {
+    return false;
+  }
+
+  filename = line.substr(i + 1, end - i - 1);
+  return true;
+}
+
+/** FNV-1a, unlike std::hash it gives the same value in every build */
+uint32_t hash_path(std::string const& filename)
+{
+  uint32_t hash = 2166136261u;
+  for(char c : filename)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+} // namespace
+
+ShaderSourceManager::ShaderSourceManager() :
+  m_files(),
+  m_ids(),
+  m_filenames(),
+  m_stack(),
+  m_reads(0)
+{
+}
+
+std::string
+ShaderSourceManager::normalize(std::filesystem::path const& filename)
+{
+  // "data/glsl/a.vert", "data/glsl/../glsl/a.vert" and "../glsl/a.vert"
+  // run from data/ are all the same file, which only resolving against
+  // the working directory and symlinks shows
+  std::error_code ec;
+  std::filesystem::path const canonical = std::filesystem::weakly_canonical(filename, ec);
+  if (ec)
+  {
+    return filename.lexically_normal().string();
+  }
+  else
+  {
+    return canonical.string();
+  }
+}
+
+std::string const&
+ShaderSourceManager::get_source(std::filesystem::path const& filename)
+{
+  return load(normalize(filename)).text;
+}
+
+ShaderSourceManager::File const&
+ShaderSourceManager::load(std::string const& filename)
+{
+  auto it = m_files.find(filename);
+  if (it != m_files.end())
+  {
+    return it->second;
+  }
+
+  if (std::find(m_stack.begin(), m_stack.end(), filename) != m_stack.end())
+  {
+    throw std::runtime_error(format("%s: include cycle", filename));
+  }
+
+  std::ifstream in(filename);
+  if (!in)
+  {
+    throw std::runtime_error(format("%s: failed to open file", filename));
+  }
+
+  auto id_it = m_ids.find(filename);
+  if (id_it == m_ids.end())
+  {
+    id_it = m_ids.emplace(filename, make_id(filename)).first;
+  }
+
+  File file;
+  file.id = id_it->second;
+
+  std::error_code ec;
+  file.mtime = std::filesystem::last_write_time(filename, ec);
+
+  m_stack.push_back(filename);
+  try
+  {
+    std::ostringstream os;
+    os << "#line " << 1 + LINE_OFFSET << ' ' << file.id << '\n';
+
+    int line_number = 1;
+    std::string line;
+    std::string include;
+    while(std::getline(in, line))
+    {
+      if (parse_include(line, include))
+      {
+        std::filesystem::path include_filename(include);
+        if (!include_filename.is_absolute())
+        {
+          include_filename = std::filesystem::path(filename).parent_path() / include_filename;
+        }
+
+        std::string const include_name = normalize(include_filename);
+        os << load(include_name).text;
+        file.includes.push_back(include_name);
+
+        // continue numbering the including file after the directive
+        os << "#line " << line_number + 1 + LINE_OFFSET << ' ' << file.id << '\n';
+      }
+      else
+      {
+        os << line << '\n';
+      }
+
+      line_number += 1;
+    }
+
+    file.text = os.str();
+  }
+  catch(...)
+  {
+    m_stack.pop_back();
+    throw;
+  }
+  m_stack.pop_back();
+
+  m_reads += 1;
+
+  return m_files.emplace(filename, std::move(file)).first->second;
+}
+
+int
+ShaderSourceManager::make_id(std::string const& filename)
+{
+  int const start = static_cast<int>(hash_path(filename) % FILE_ID_RANGE);
+  for(int i = 0; i < FILE_ID_RANGE; ++i)
+  {
+    int const id = FIRST_FILE_ID + (start + i) % FILE_ID_RANGE;
+    if (m_filenames.emplace(id, filename).second)
+    {
+      if (i != 0)
+      {
+        // the colliding files now get their ids in load order, which
+        // makes the shader text, and with it the cache keys, unstable
+        log_warn("%s: source id collides with %s, program cache keys may change between runs",
+                  filename, m_filenames[FIRST_FILE_ID + start]);
+      }
+      return id;
+    }
+  }
+
+  throw std::runtime_error(format("%s: out of shader source ids", filename));
+}
+
+void
+ShaderSourceManager::collect_dependencies(std::string const& filename, std::vector<std::string>& result)
+{
+  if (std::find(result.begin(), result.end(), filename) != result.end())
+  {
+    return;
+  }
+
+  result.push_back(filename);
+
+  // copy, load() may rehash m_files
+  std::vector<std::string> const includes = load(filename).includes;
+  for(auto const& include : includes)
+  {
+    collect_dependencies(include, result);
+  }
+}
+
+std::vector<std::string>
+ShaderSourceManager::get_dependencies(std::filesystem::path const& filename)
+{
+  std::vector<std::string> result;
+  collect_dependencies(normalize(filename), result);
+  return result;
+}
+
+bool
+ShaderSourceManager::depends_on(std::filesystem::path const& filename,
+                                std::filesystem::path const& dependency)
+{
+  std::vector<std::string> const deps = get_dependencies(filename);
+  return std::find(deps.begin(), deps.end(), normalize(dependency)) != deps.end();
+}
+
+std::vector<std::string>
+ShaderSourceManager::invalidate(std::filesystem::path const& filename)
+{
+  std::vector<std::string> affected{ normalize(filename) };
+
+  // walk the include graph upwards until no more includers are found
+  bool found = true;
+  while(found)
+  {
+    found = false;
+    for(auto const& it : m_files)
+    {
+      if (std::find(affected.begin(), affected.end(), it.first) == affected.end() &&
+          std::any_of(it.second.includes.begin(), it.second.includes.end(),
+                      [&affected](std::string const& include) {
+                        return std::find(affected.begin(), affected.end(), include) != affected.end();
+                      }))
+      {
+        affected.push_back(it.first);
+        found = true;
+      }
+    }
+  }
+
+  std::vector<std::string> dropped;
+  for(auto const& name : affected)
+  {
+    if (m_files.erase(name))
+    {
+      dropped.push_back(name);
+    }
+  }
+  return dropped;
+}
+
+std::vector<std::string>
+ShaderSourceManager::poll_changes()
+{
+  std::vector<std::string> changed;
+  for(auto const& it : m_files)
+  {
+    std::error_code ec;
+    auto const mtime = std::filesystem::last_write_time(it.first, ec);
+    if (ec || mtime != it.second.mtime)
+    {
+      changed.push_back(it.first);
+    }
+  }
+
+  for(auto const& name : changed)
+  {
+    invalidate(name);
+  }
+
+  return changed;
+}
+
+std::string
+ShaderSourceManager::get_filename(int id) const
+{
+  auto it = m_filenames.find(id);
+  if (it == m_filenames.end())
+  {
+    return {};
+  }
+  else
+  {
+    return it->second;
+  }
+}
+
+int
+ShaderSourceManager::get_source_id(std::filesystem::path const& filename) const
+{
+  auto it = m_ids.find(normalize(filename));
+  if (it == m_ids.end())
+  {
+    return -1;
+  }
+  else
+  {
+    return it->second;
+  }
+}
+
+/* EOF */
@@ -0,0 +1,105 @@
+#ifndef HEADER_SHADER_SOURCE_MANAGER_HPP
+#define HEADER_SHADER_SOURCE_MANAGER_HPP
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Reads each .glsl file once and keeps the text with all #include
+    directives expanded, so that building another permutation of a
+    shader only assembles strings. Every file gets its own source
+    string number in the #line directives, get_filename() maps the
+    number in a compile error back to the file. The number is a hash
+    of the normalized path, so it doesn't depend on the order files
+    are read in and the text stays the same across runs of the same
+    installation, as ProgramCache keys require.
+
+    The manager also records which file includes which, so that a
+    change to a single file can be traced to everything built from
+    it. */
+class ShaderSourceManager
+{
+public:
+  static ShaderSourceManager& get()
+  {
+    static ShaderSourceManager instance;
+    return instance;
+  }
+
+  /** Source string numbers start here to stay clear of the string
+      indices glShaderSource() assigns to the version and defines */
+  static int const FIRST_FILE_ID = 16;
+
+  /** Number of source string numbers the path hashes are spread over */
+  static int const FILE_ID_RANGE = 1 << 16;
+
+private:
+  struct File
+  {
+    int id;
+    std::string text; // with includes expanded
+    std::vector<std::string> includes; // direct includes only
+    std::filesystem::file_time_type mtime;
+  };
+
+  std::unordered_map<std::string, File> m_files;
+
+  // ids stay the same when a file is invalidated and read again
+  std::unordered_map<std::string, int> m_ids;
+  std::unordered_map<int, std::string> m_filenames;
+
+  /** Files currently being expanded, to catch include cycles */
+  std::vector<std::string> m_stack;
+
+  int m_reads;
+
+public:
+  ShaderSourceManager();
+
+  /** Returns the expanded text of \a filename, reading it only on
+      first use or after it was invalidated */
+  std::string const& get_source(std::filesystem::path const& filename);
+
+  /** \a filename and every file it includes, directly or not */
+  std::vector<std::string> get_dependencies(std::filesystem::path const& filename);
+
+  /** True when \a filename is \a dependency or includes it */
+  bool depends_on(std::filesystem::path const& filename,
+                  std::filesystem::path const& dependency);
+
+  /** Drops \a filename and every cached file that includes it, returns
+      the names of the dropped files */
+  std::vector<std::string> invalidate(std::filesystem::path const& filename);
+
+  /** Compares the modification time of all cached files against the
+      disk, invalidates the ones that changed and returns their names */
+  std::vector<std::string> poll_changes();
+
+  /** The file behind a source string number, empty when unknown */
+  std::string get_filename(int id) const;
+
+  /** The source string number of \a filename, -1 when it wasn't read yet */
+  int get_source_id(std::filesystem::path const& filename) const;
+
+  /** Number of times a file was actually read from disk */
+  int get_reads() const { return m_reads; }
+
+  /** The key a file is known by, also used by ProgramRegistry. Paths
+      are made absolute and symlinks resolved, so that every spelling of
+      a file maps to the same key. */
+  static std::string normalize(std::filesystem::path const& filename);
+
+private:
+  int make_id(std::string const& filename);
+  File const& load(std::string const& filename);
+  void collect_dependencies(std::string const& filename, std::vector<std::string>& result);
+
+private:
+  ShaderSourceManager(const ShaderSourceManager&) = delete;
+  ShaderSourceManager& operator=(const ShaderSourceManager&) = delete;
+};
+
+#endif
+
+/* EOF */
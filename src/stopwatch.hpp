@@ -0,0 +1,30 @@
+#ifndef HEADER_STOPWATCH_HPP
+#define HEADER_STOPWATCH_HPP
+
+#include <chrono>
+
+class Stopwatch
+{
+private:
+  std::chrono::steady_clock::time_point m_start;
+
+public:
+  Stopwatch() :
+    m_start(std::chrono::steady_clock::now())
+  {}
+
+  void restart()
+  {
+    m_start = std::chrono::steady_clock::now();
+  }
+
+  /** Time since construction or the last restart() in milliseconds */
+  float get_msec() const
+  {
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+  }
+};
+
+#endif
+
+/* EOF */
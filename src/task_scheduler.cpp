@@ -0,0 +1,230 @@
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+thread_local TaskScheduler const* t_scheduler = nullptr;
+thread_local int t_queue_index = 0;
+
+} // namespace
+
+TaskScheduler::TaskScheduler(int num_threads) :
+  m_queues(),
+  m_threads(),
+  m_queued(0),
+  m_quit(false),
+  m_sleep_mutex(),
+  m_sleep_cond()
+{
+  start(num_threads);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  stop();
+}
+
+void
+TaskScheduler::set_num_threads(int num_threads)
+{
+  stop();
+  start(num_threads);
+}
+
+void
+TaskScheduler::start(int num_threads)
+{
+  if (num_threads <= 0)
+  {
+    num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  m_quit = false;
+
+  for(int i = 0; i < num_threads; ++i)
+  {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+
+  for(int i = 1; i < num_threads; ++i)
+  {
+    m_threads.emplace_back(&TaskScheduler::worker_main, this, i);
+  }
+}
+
+void
+TaskScheduler::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    m_quit = true;
+  }
+  m_sleep_cond.notify_all();
+
+  for(auto& thread : m_threads)
+  {
+    thread.join();
+  }
+
+  m_threads.clear();
+  m_queues.clear();
+}
+
+int
+TaskScheduler::get_queue_index() const
+{
+  return (t_scheduler == this) ? t_queue_index : 0;
+}
+
+void
+TaskScheduler::run(TaskGroup& group, std::function<void ()> task)
+{
+  group.m_pending += 1;
+
+  auto wrapped = [&group, task = std::move(task)]{
+    try
+    {
+      task();
+    }
+    catch(...)
+    {
+      // wait() rethrows it, the group must still count the task as done
+      std::lock_guard<std::mutex> lock(group.m_mutex);
+      if (!group.m_exception)
+      {
+        group.m_exception = std::current_exception();
+      }
+    }
+    group.m_pending -= 1;
+  };
+
+  if (m_queues.size() == 1)
+  {
+    wrapped();
+  }
+  else
+  {
+    Queue& queue = *m_queues[get_queue_index()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(wrapped));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_sleep_mutex);
+      m_queued += 1;
+    }
+    m_sleep_cond.notify_one();
+  }
+}
+
+void
+TaskScheduler::wait(TaskGroup& group)
+{
+  int const index = get_queue_index();
+  while (group.m_pending > 0)
+  {
+    if (!run_one(index))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  std::exception_ptr exception;
+  {
+    std::lock_guard<std::mutex> lock(group.m_mutex);
+    std::swap(exception, group.m_exception);
+  }
+  if (exception)
+  {
+    std::rethrow_exception(exception);
+  }
+}
+
+void
+TaskScheduler::parallel_for(size_t begin, size_t end, size_t grain,
+                            std::function<void (size_t, size_t)> const& func)
+{
+  grain = std::max<size_t>(1, grain);
+
+  if (end - begin <= grain || m_queues.size() == 1)
+  {
+    for(size_t i = begin; i < end; i += grain)
+    {
+      func(i, std::min(i + grain, end));
+    }
+  }
+  else
+  {
+    TaskGroup group;
+    for(size_t i = begin; i < end; i += grain)
+    {
+      size_t const chunk_end = std::min(i + grain, end);
+      run(group, [&func, i, chunk_end]{ func(i, chunk_end); });
+    }
+    wait(group);
+  }
+}
+
+bool
+TaskScheduler::run_one(int index)
+{
+  std::function<void ()> task;
+
+  { // newest task from our own queue, it is the most likely to be in cache
+    Queue& queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty())
+    {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+  }
+
+  // otherwise steal the oldest task from somebody else
+  for(size_t i = 1; !task && i < m_queues.size(); ++i)
+  {
+    Queue& queue = *m_queues[(index + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty())
+    {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+
+  if (task)
+  {
+    m_queued -= 1;
+    task();
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+void
+TaskScheduler::worker_main(int index)
+{
+  t_scheduler = this;
+  t_queue_index = index;
+
+  while (true)
+  {
+    if (!run_one(index))
+    {
+      std::unique_lock<std::mutex> lock(m_sleep_mutex);
+      m_sleep_cond.wait(lock, [this]{ return m_quit || m_queued > 0; });
+      if (m_quit)
+      {
+        return;
+      }
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,101 @@
+#ifndef HEADER_TASK_SCHEDULER_HPP
+#define HEADER_TASK_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskScheduler;
+
+/** Counts the outstanding tasks started with TaskScheduler::run() and
+    keeps the first exception one of them threw */
+class TaskGroup
+{
+private:
+  friend class TaskScheduler;
+  std::atomic<int> m_pending;
+  std::mutex m_mutex;
+  std::exception_ptr m_exception;
+
+public:
+  TaskGroup() : m_pending(0), m_mutex(), m_exception() {}
+
+private:
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+};
+
+/** Work-stealing thread pool. Every worker owns a queue that it works
+    on from the back, idle workers steal from the front of the others.
+    Threads that aren't workers share the first queue. Waiting threads
+    execute pending tasks instead of blocking, so tasks may spawn and
+    wait for tasks themselves. */
+class TaskScheduler
+{
+public:
+  static TaskScheduler& get()
+  {
+    static TaskScheduler instance;
+    return instance;
+  }
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void ()> > tasks;
+  };
+
+private:
+  std::vector<std::unique_ptr<Queue> > m_queues;
+  std::vector<std::thread> m_threads;
+
+  std::atomic<int> m_queued;
+  std::atomic<bool> m_quit;
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_sleep_cond;
+
+public:
+  /** Creates \a num_threads - 1 workers, the calling thread is expected
+      to help out in wait(). 0 picks one thread per core. */
+  TaskScheduler(int num_threads = 0);
+  ~TaskScheduler();
+
+  /** Restart the pool with a different size, must not be called while
+      tasks are pending */
+  void set_num_threads(int num_threads);
+  int get_num_threads() const { return static_cast<int>(m_queues.size()); }
+
+  void run(TaskGroup& group, std::function<void ()> task);
+
+  /** Returns once every task of \a group is done, then rethrows the
+      first exception one of them threw */
+  void wait(TaskGroup& group);
+
+  /** Call \a func(begin, end) for consecutive ranges of at most
+      \a grain elements, the ranges are the same regardless of the
+      number of threads */
+  void parallel_for(size_t begin, size_t end, size_t grain,
+                    std::function<void (size_t, size_t)> const& func);
+
+private:
+  void start(int num_threads);
+  void stop();
+  void worker_main(int index);
+  bool run_one(int index);
+  int get_queue_index() const;
+
+private:
+  TaskScheduler(const TaskScheduler&) = delete;
+  TaskScheduler& operator=(const TaskScheduler&) = delete;
+};
+
+#endif
+
+/* EOF */
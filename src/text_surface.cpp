@@ -23,6 +23,8 @@
 #include "assert_gl.hpp"
 #include "material_factory.hpp"
 #include "opengl_state.hpp"
+#include "pixel_kernels.hpp"
+#include "program_registry.hpp"
 
 std::shared_ptr<TextSurface>
 TextSurface::create(const std::string& text, TextProperties const& text_props)
@@ -38,8 +40,7 @@ TextSurface::create(const std::string& text, TextProperties const& text_props)
 
   MaterialPtr material = std::make_shared<Material>();
 
-  material->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER,   g_datadir + "/glsl/basic_texture.vert"),
-                                        Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/basic_texture.frag")));
+  material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/basic_texture.vert", g_datadir + "/glsl/basic_texture.frag"));
 
   material->enable(GL_BLEND);
   material->blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -139,40 +140,22 @@ TextSurface::create_opengl_texture(Cairo::RefPtr<Cairo::ImageSurface> surface)
   glPixelStorei(GL_UNPACK_ROW_LENGTH, surface->get_width());
 #endif
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture->get_id());
+  OpenGLStateTracker::get().active_texture(GL_TEXTURE0);
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, texture->get_id());
   assert_gl("Texture failure");
 
-  // flip RGBA to BGRA
+  // Cairo's premultiplied BGRA to straight RGBA
   for(int y = 0; y < surface->get_height(); ++y)
   {
-    uint8_t* pixels = surface->get_data() + surface->get_stride() * y;
-
-    for(int x = 0; x < surface->get_width()*4; x += 4)
-    {
-      uint8_t r = pixels[x+0];
-      uint8_t g = pixels[x+1];
-      uint8_t b = pixels[x+2];
-      uint8_t a = pixels[x+3];
-
-      // removing pre-multiplayed alpha
-      if (a != 0)
-      {
-        pixels[x+0] = static_cast<uint8_t>(b * 255 / a);
-        pixels[x+1] = static_cast<uint8_t>(g * 255 / a);
-        pixels[x+2] = static_cast<uint8_t>(r * 255 / a);
-      }
-
-      // debug foobar
-      //if (pixels[x+3] == 0)
-      //  pixels[x+3] = 32;
-    }
+    pixel_kernels::unpremultiply(surface->get_data() + surface->get_stride() * y,
+                                 surface->get_width(), true);
   }
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
                surface->get_width(), surface->get_height(), 0,
                GL_RGBA, GL_UNSIGNED_BYTE, surface->get_data());
   assert_gl("Texture failure");
+  texture->set_storage(static_cast<size_t>(surface->get_width()) * surface->get_height() * 4, 1);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
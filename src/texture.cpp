@@ -2,6 +2,7 @@
 
 #include <SDL.h>
 #include <SDL_image.h>
+#include <algorithm>
 #include <assert.h>
 #include <math.h>
 #include <stdexcept>
@@ -10,37 +11,153 @@
 
 #include "log.hpp"
 #include "assert_gl.hpp"
+#include "compressed_image.hpp"
+#include "format.hpp"
+#include "mipmap_builder.hpp"
 #include "opengl_state.hpp"
+#include "pixel_kernels.hpp"
+#include "stopwatch.hpp"
+#include "task_scheduler.hpp"
+#include "texture_cache.hpp"
 
 namespace {
 
 void flip_rgb(SDL_Surface* surface)
 {
   for(int y = 0; y < surface->h; ++y)
-    for(int x = 0; x < surface->w; ++x)
+  {
+    pixel_kernels::swap_red_blue(static_cast<uint8_t*>(surface->pixels) + y * surface->pitch,
+                                 surface->w, surface->format->BytesPerPixel);
+  }
+}
+
+void vflip_surface(SDL_Surface* surface)
+{
+  pixel_kernels::flip_rows(static_cast<uint8_t*>(surface->pixels), surface->h,
+                           surface->w * surface->format->BytesPerPixel, surface->pitch);
+}
+
+/** Allocates immutable storage for \a levels levels of the bound
+    \a target, returns false where only mutable storage exists */
+bool allocate_storage(GLenum target, int levels, int width, int height)
+{
+#ifndef HAVE_OPENGLES2
+  if (GLEW_ARB_texture_storage)
+  {
+    glTexStorage2D(target, levels, GL_RGB8, width, height);
+    return true;
+  }
+#endif
+  return false;
+}
+
+/** Uploads one mip level, \a image_target is the bound target or one of
+    the faces of a bound cubemap */
+void upload_level(GLenum image_target, int level, int width, int height, int pitch,
+                  int bytes_per_pixel, void const* pixels, bool immutable)
+{
+  GLenum const format = (bytes_per_pixel == 4) ? GL_RGBA : GL_RGB;
+
+  // SDL pads rows to four bytes, MipmapBuilder packs them tightly
+  glPixelStorei(GL_UNPACK_ALIGNMENT, (pitch == width * bytes_per_pixel) ? 1 : 4);
+#ifndef HAVE_OPENGLES2
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / bytes_per_pixel);
+#endif
+
+  if (immutable)
+  {
+    glTexSubImage2D(image_target, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+  }
+  else
+  {
+#ifdef HAVE_OPENGLES2
+    glTexImage2D(image_target, level, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+#else
+    glTexImage2D(image_target, level, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+#endif
+  }
+}
+
+/** Uploads level 0 and, when they are built on the CPU, the remaining
+    levels of an image. \a srgb marks color images. */
+void upload_image(GLenum image_target, int width, int height, int pitch, int bytes_per_pixel,
+                  void const* pixels, bool mipmaps, bool srgb, bool immutable)
+{
+  upload_level(image_target, 0, width, height, pitch, bytes_per_pixel, pixels, immutable);
+
+  Texture::MipmapMode const mode = Texture::get_mipmap_mode();
+  if (mipmaps && mode != Texture::GPU_MIPMAPS)
+  {
+    auto const levels = MipmapBuilder::build(static_cast<uint8_t const*>(pixels),
+                                             width, height, pitch, bytes_per_pixel,
+                                             (mode == Texture::KAISER_MIPMAPS) ? MipmapBuilder::KAISER : MipmapBuilder::BOX,
+                                             srgb);
+    for(size_t i = 0; i < levels.size(); ++i)
     {
-      uint8_t* p = static_cast<uint8_t*>(surface->pixels) + y * surface->pitch + x * surface->format->BytesPerPixel;
-      std::swap(p[0], p[2]);
+      upload_level(image_target, static_cast<int>(i) + 1, levels[i].width, levels[i].height,
+                   levels[i].width * bytes_per_pixel, bytes_per_pixel, levels[i].pixels.data(),
+                   immutable);
     }
+  }
 }
 
-void vflip_surface(SDL_Surface* surface)
+/** Completes the mip chain of the bound \a target once every image is
+    uploaded */
+void finish_mipmaps(GLenum target, int levels, bool immutable)
 {
-  size_t len = surface->w * surface->format->BytesPerPixel;
-  std::vector<uint8_t> tmp_vec(len);
-  for(int y = 0; y < surface->h/2; ++y)
+  if (Texture::get_mipmap_mode() == Texture::GPU_MIPMAPS)
   {
-    uint8_t* src = static_cast<uint8_t*>(surface->pixels) + y * surface->pitch;
-    uint8_t* dst = static_cast<uint8_t*>(surface->pixels) + (surface->h - y - 1) * surface->pitch;
-    uint8_t* tmp = tmp_vec.data();
-    memcpy(tmp, src, len);
-    memcpy(src, dst, len);
-    memcpy(dst, tmp, len);
+    glGenerateMipmap(target);
   }
+
+#ifndef HAVE_OPENGLES2
+  if (!immutable)
+  {
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  }
+#endif
+}
+
+bool is_format_supported(uint32_t format)
+{
+#ifndef HAVE_OPENGLES2
+  // core profiles aren't required to list every format
+  switch(format)
+  {
+    case CompressedImage::BC1_RGB:
+    case CompressedImage::BC1_RGBA:
+    case CompressedImage::BC3_RGBA:
+      if (GLEW_EXT_texture_compression_s3tc) return true;
+      break;
+
+    case CompressedImage::BC7_RGBA:
+      if (GLEW_ARB_texture_compression_bptc) return true;
+      break;
+
+    case CompressedImage::ETC2_RGB8:
+    case CompressedImage::ETC2_RGBA8:
+      if (GLEW_ARB_ES3_compatibility) return true;
+      break;
+  }
+#endif
+
+  static std::vector<GLint> const formats = []{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    std::vector<GLint> result(count);
+    if (count > 0)
+    {
+      glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, result.data());
+    }
+    return result;
+  }();
+  return std::find(formats.begin(), formats.end(), static_cast<GLint>(format)) != formats.end();
 }
 
 } // namespace
 
+Texture::MipmapMode Texture::s_mipmap_mode = Texture::GPU_MIPMAPS;
+size_t Texture::s_total_bytes = 0;
 
 TexturePtr
 Texture::create_empty(GLenum target, GLenum format, int width, int height)
@@ -51,7 +168,7 @@ Texture::create_empty(GLenum target, GLenum format, int width, int height)
   GLuint texture;
   glGenTextures(1, &texture);
   assert_gl("framebuffer2");
-  glBindTexture(target, texture);
+  OpenGLStateTracker::get().bind_texture(target, texture);
   assert_gl("framebuffer1");
 #ifdef HAVE_OPENGLES2
   glTexImage2D(target, 0, format,  width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
@@ -64,7 +181,9 @@ Texture::create_empty(GLenum target, GLenum format, int width, int height)
 #endif
   assert_gl("framebuffer");
 
-  return std::make_shared<Texture>(target, texture);
+  TexturePtr result = std::make_shared<Texture>(target, texture);
+  result->set_storage(static_cast<size_t>(width) * height * 4, 1);
+  return result;
 }
 
 TexturePtr
@@ -79,7 +198,7 @@ Texture::create_shadowmap(int width, int height)
 
   assert_gl("Texture::create_shadowmap: start");
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, texture);
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,  width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL);
 
@@ -101,7 +220,9 @@ Texture::create_shadowmap(int width, int height)
 
   assert_gl("Texture::create_shadowmap");
 
-  return std::make_shared<Texture>(GL_TEXTURE_2D, texture);
+  TexturePtr result = std::make_shared<Texture>(GL_TEXTURE_2D, texture);
+  result->set_storage(static_cast<size_t>(width) * height * 4, 1);
+  return result;
 #endif
 }
 
@@ -113,12 +234,7 @@ Texture::create_random_noise(int width, int height)
   GLuint texture;
 
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-#ifndef HAVE_OPENGLES2
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
-#endif
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, texture);
 
   std::vector<uint8_t> data(width*height*3);
 
@@ -127,10 +243,11 @@ Texture::create_random_noise(int width, int height)
     data[i+0] = data[i+1] = data[i+2] = rand() % 255;
   }
 
-#ifndef HAVE_OPENGLES2
-  gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, data.data());
+  int const levels = MipmapBuilder::get_level_count(width, height);
+  bool const immutable = allocate_storage(GL_TEXTURE_2D, levels, width, height);
+  upload_image(GL_TEXTURE_2D, width, height, width * 3, 3, data.data(), true, false, immutable);
+  finish_mipmaps(GL_TEXTURE_2D, levels, immutable);
   assert_gl("texture0()");
-#endif
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   assert_gl("texture-0()");
@@ -146,7 +263,9 @@ Texture::create_random_noise(int width, int height)
   assert_gl("texture2()");
 #endif
 
-  return std::make_shared<Texture>(GL_TEXTURE_2D, texture);
+  TexturePtr result = std::make_shared<Texture>(GL_TEXTURE_2D, texture);
+  result->set_storage(static_cast<size_t>(width) * height * 3, levels);
+  return result;
 }
 
 TexturePtr
@@ -157,13 +276,9 @@ Texture::create_lightspot(int width, int height)
   GLuint texture;
 
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, texture);
 
   const int pitch = width * 3;
-#ifndef HAVE_OPENGLES2
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
-#endif
 
   std::vector<uint8_t> data(width*height*3);
   for(int y = 0; y < height; ++y)
@@ -179,10 +294,11 @@ Texture::create_lightspot(int width, int height)
       data[y * pitch + 3*x+2] = static_cast<uint8_t>(std::max(0.0f, std::min(f * 255.0f, 255.0f)));
     }
 
-#ifndef HAVE_OPENGLES2
-  gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, data.data());
+  int const levels = MipmapBuilder::get_level_count(width, height);
+  bool const immutable = allocate_storage(GL_TEXTURE_2D, levels, width, height);
+  upload_image(GL_TEXTURE_2D, width, height, pitch, 3, data.data(), true, false, immutable);
+  finish_mipmaps(GL_TEXTURE_2D, levels, immutable);
   assert_gl("texture0()");
-#endif
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -193,7 +309,9 @@ Texture::create_lightspot(int width, int height)
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 8.0f);
 #endif
 
-  return std::make_shared<Texture>(GL_TEXTURE_2D, texture);
+  TexturePtr result = std::make_shared<Texture>(GL_TEXTURE_2D, texture);
+  result->set_storage(static_cast<size_t>(width) * height * 3, levels);
+  return result;
 }
 
 namespace {
@@ -209,46 +327,158 @@ SDL_Surface* surface_from_file(const std::filesystem::path& filename)
     return surface;
   }
 }
+
+/** Copies the face at \a x, \a y, counted in faces, out of a cubemap
+    in the cross layout written by tools/joincubemap.py */
+SDL_Surface* surface_from_cross(SDL_Surface* cross, int x, int y)
+{
+  int const size = cross->w / 4;
+  SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, size, size, cross->format->BitsPerPixel,
+                                                        cross->format->format);
+  if (!surface)
+  {
+    throw std::runtime_error(format("SDL_CreateRGBSurfaceWithFormat() failed: %s", SDL_GetError()));
+  }
+
+  size_t const row_bytes = static_cast<size_t>(size) * cross->format->BytesPerPixel;
+  for(int row = 0; row < size; ++row)
+  {
+    memcpy(static_cast<uint8_t*>(surface->pixels) + row * surface->pitch,
+           static_cast<uint8_t const*>(cross->pixels) + (y * size + row) * cross->pitch + x * row_bytes,
+           row_bytes);
+  }
+  return surface;
+}
 } // namespace
 
 TexturePtr
 Texture::cubemap_from_file(const std::filesystem::path& filename)
 {
+  if (TexturePtr texture = TextureCache::get().find(filename, GL_TEXTURE_CUBE_MAP, true))
+  {
+    return texture;
+  }
+
+  Stopwatch stopwatch;
   OpenGLState state;
 
-  SDL_Surface* up = surface_from_file(filename / "up.png");
-  SDL_Surface* dn = surface_from_file(filename / "dn.png");
-  SDL_Surface* ft = surface_from_file(filename / "ft.png");
-  SDL_Surface* bk = surface_from_file(filename / "bk.png");
-  SDL_Surface* lf = surface_from_file(filename / "lf.png");
-  SDL_Surface* rt = surface_from_file(filename / "rt.png");
-
-  assert(up);
-  assert(dn);
-  assert(ft);
-  assert(bk);
-  assert(lf);
-  assert(rt);
-
-  flip_rgb(up);
-  flip_rgb(dn);
-  flip_rgb(ft);
-  flip_rgb(bk);
-  flip_rgb(lf);
-  flip_rgb(rt);
+  // a directory holds one file per face, a single file has the faces
+  // arranged in a cross, see tools/joincubemap.py
+  struct Face
+  {
+    GLenum target;
+    char const* name;
+    int cross_x;
+    int cross_y;
+    SDL_Surface* surface;
+    std::vector<MipmapBuilder::Level> levels;
+    std::string error;
+  };
+  Face faces[] = {
+    { GL_TEXTURE_CUBE_MAP_POSITIVE_Y, "up", 1, 0, nullptr, {}, {} },
+    { GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, "dn", 1, 2, nullptr, {}, {} },
+    { GL_TEXTURE_CUBE_MAP_NEGATIVE_X, "lf", 0, 1, nullptr, {}, {} },
+    { GL_TEXTURE_CUBE_MAP_POSITIVE_X, "rt", 2, 1, nullptr, {}, {} },
+    { GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, "ft", 1, 1, nullptr, {}, {} },
+    { GL_TEXTURE_CUBE_MAP_POSITIVE_Z, "bk", 3, 1, nullptr, {}, {} }
+  };
+
+  // the loaders are initialized lazily by IMG_Load(), which isn't
+  // safe to do from several threads at once
+  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+  bool const cross = std::filesystem::is_regular_file(filename);
+  SDL_Surface* cross_surface = nullptr;
+  if (cross)
+  {
+    cross_surface = surface_from_file(filename);
+    if (cross_surface->w % 4 != 0 || cross_surface->w / 4 * 3 != cross_surface->h)
+    {
+      SDL_FreeSurface(cross_surface);
+      throw std::runtime_error(format("%s: expected a 4x3 cross of square faces", filename));
+    }
+  }
+
+  // decode, convert and, unless the GPU does it, build the mipmaps of
+  // all faces at once
+  Texture::MipmapMode const mode = Texture::get_mipmap_mode();
+  TaskScheduler::get().parallel_for(0, 6, 1, [&](size_t begin, size_t end){
+      for(size_t i = begin; i < end; ++i)
+      {
+        Face& face = faces[i];
+        try
+        {
+          face.surface = cross ?
+            surface_from_cross(cross_surface, face.cross_x, face.cross_y) :
+            surface_from_file(filename / (std::string(face.name) + ".png"));
+          flip_rgb(face.surface);
+
+          if (mode != Texture::GPU_MIPMAPS)
+          {
+            face.levels = MipmapBuilder::build(static_cast<uint8_t const*>(face.surface->pixels),
+                                               face.surface->w, face.surface->h, face.surface->pitch,
+                                               face.surface->format->BytesPerPixel,
+                                               (mode == Texture::KAISER_MIPMAPS) ? MipmapBuilder::KAISER : MipmapBuilder::BOX,
+                                               true, false);
+          }
+        }
+        catch(std::exception const& err)
+        {
+          face.error = err.what();
+        }
+      }
+    });
 
-#ifndef HAVE_OPENGLES2
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, up->pitch / up->format->BytesPerPixel);
-#endif
+  if (cross_surface)
+  {
+    SDL_FreeSurface(cross_surface);
+  }
+
+  std::string error;
+  for(Face const& face : faces)
+  {
+    if (!face.error.empty())
+    {
+      error = face.error;
+      break;
+    }
+  }
 
-  //glActiveTexture(GL_TEXTURE0);
-  //glEnable(GL_TEXTURE_CUBE_MAP);
+  // the storage is allocated from the first face, the others have to
+  // match it
+  for(size_t i = 1; error.empty() && i < 6; ++i)
+  {
+    SDL_Surface const* first = faces[0].surface;
+    SDL_Surface const* surface = faces[i].surface;
+    if (surface->w != first->w || surface->h != first->h ||
+        surface->format->BytesPerPixel != first->format->BytesPerPixel)
+    {
+      error = format("%s: face %s is %dx%d with %d bytes per pixel, face %s is %dx%d with %d",
+                     filename, faces[i].name, surface->w, surface->h,
+                     static_cast<int>(surface->format->BytesPerPixel),
+                     faces[0].name, first->w, first->h,
+                     static_cast<int>(first->format->BytesPerPixel));
+    }
+  }
+
+  if (!error.empty())
+  {
+    for(Face const& face : faces)
+    {
+      if (face.surface)
+      {
+        SDL_FreeSurface(face.surface);
+      }
+    }
+    throw std::runtime_error(error);
+  }
+
+  float const decode_msec = stopwatch.get_msec();
 
   GLuint texture;
   GLenum target = GL_TEXTURE_CUBE_MAP;
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_CUBE_MAP, texture);
 
   glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -258,41 +488,60 @@ Texture::cubemap_from_file(const std::filesystem::path& filename)
   glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 #endif
 
-#ifndef HAVE_OPENGLES2
-  gluBuild2DMipmaps(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, GL_RGB, up->w, up->h, up->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, up->pixels);
-  gluBuild2DMipmaps(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, GL_RGB, dn->w, dn->h, dn->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, dn->pixels);
-
-  gluBuild2DMipmaps(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, GL_RGB, lf->w, lf->h, lf->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, lf->pixels);
-  gluBuild2DMipmaps(GL_TEXTURE_CUBE_MAP_POSITIVE_X, GL_RGB, rt->w, rt->h, rt->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, rt->pixels);
-
-  gluBuild2DMipmaps(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, GL_RGB, ft->w, ft->h, ft->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, ft->pixels);
-  gluBuild2DMipmaps(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, GL_RGB, bk->w, bk->h, bk->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, bk->pixels);
-#endif
-
-#ifndef HAVE_OPENGLES2
-  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
-  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 10);
-  glGenerateMipmap(target);
-#endif
+  // all faces share the size of the first one, checked above
+  SDL_Surface const* first = faces[0].surface;
+  int const width = first->w;
+  int const height = first->h;
+  int const bytes_per_pixel = first->format->BytesPerPixel;
+  int const levels = MipmapBuilder::get_level_count(width, height);
+  bool const immutable = allocate_storage(target, levels, width, height);
 
-  SDL_FreeSurface(up);
-  SDL_FreeSurface(dn);
-  SDL_FreeSurface(ft);
-  SDL_FreeSurface(bk);
-  SDL_FreeSurface(lf);
-  SDL_FreeSurface(rt);
+  for(Face& face : faces)
+  {
+    upload_level(face.target, 0, face.surface->w, face.surface->h, face.surface->pitch,
+                 face.surface->format->BytesPerPixel, face.surface->pixels, immutable);
+    for(size_t i = 0; i < face.levels.size(); ++i)
+    {
+      MipmapBuilder::Level const& level = face.levels[i];
+      upload_level(face.target, static_cast<int>(i) + 1, level.width, level.height,
+                   level.width * bytes_per_pixel, bytes_per_pixel, level.pixels.data(), immutable);
+    }
+    SDL_FreeSurface(face.surface);
+  }
+  finish_mipmaps(target, levels, immutable);
 
   assert_gl("cube texture");
 
-  return std::make_shared<Texture>(target, texture);
+  log_info("cubemap: %s: %dx%d, %d files, decode: %sms, total: %sms",
+           filename, width, height, cross ? 1 : 6, decode_msec, stopwatch.get_msec());
+
+  TexturePtr result = std::make_shared<Texture>(target, texture);
+  result->set_storage(6 * static_cast<size_t>(width) * height * bytes_per_pixel, levels);
+  TextureCache::get().insert(filename, target, true, result, result->get_bytes());
+  return result;
 }
 
 TexturePtr
 Texture::from_file(const std::filesystem::path& filename, bool build_mipmaps, bool exception_on_fail)
 {
+  if (TexturePtr texture = TextureCache::get().find(filename, GL_TEXTURE_2D, build_mipmaps))
+  {
+    return texture;
+  }
+
+  if (CompressedImage::is_compressed_file(filename))
+  {
+    // an unsupported format ends up with the replacement texture below
+    if (TexturePtr texture = from_compressed_file(filename))
+    {
+      return texture;
+    }
+  }
+
   OpenGLState state;
 
   SDL_Surface* surface = IMG_Load(filename.c_str());
+  bool const replacement = !surface;
   if (!surface)
   {
     if (exception_on_fail)
@@ -324,12 +573,7 @@ Texture::from_file(const std::filesystem::path& filename, bool build_mipmaps, bo
     GLenum target = GL_TEXTURE_2D;
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(target, texture);
-
-#ifndef HAVE_OPENGLES2
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, surface->pitch / surface->format->BytesPerPixel);
-#endif
+    OpenGLStateTracker::get().bind_texture(target, texture);
 
     glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(target, GL_TEXTURE_MIN_FILTER, build_mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
@@ -341,31 +585,107 @@ Texture::from_file(const std::filesystem::path& filename, bool build_mipmaps, bo
     float max_anisotrophy = 0.0f;
     glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotrophy);
     glTexParameteri(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotrophy);
+#endif
 
+    int const levels = build_mipmaps ? MipmapBuilder::get_level_count(surface->w, surface->h) : 1;
+    bool const immutable = allocate_storage(target, levels, surface->w, surface->h);
+    upload_image(target, surface->w, surface->h, surface->pitch, surface->format->BytesPerPixel,
+                 surface->pixels, build_mipmaps, true, immutable);
     if (build_mipmaps)
     {
-      gluBuild2DMipmaps(target, GL_RGB, surface->w, surface->h,
-                        surface->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB,
-                        GL_UNSIGNED_BYTE, surface->pixels);
+      finish_mipmaps(target, levels, immutable);
     }
-    else
-#endif
+
+    TexturePtr result = std::make_shared<Texture>(target, texture);
+    result->set_storage(static_cast<size_t>(surface->w) * surface->h * surface->format->BytesPerPixel, levels);
+
+    SDL_FreeSurface(surface);
+
+    if (!replacement)
     {
-      glTexImage2D(target, 0, GL_RGB, surface->w, surface->h, 0,
-#ifndef HAVE_OPENGLES2
-                   surface->format->BytesPerPixel == 4 ? GL_RGBA : GL_RGB,
+      // a missing file gets another try on the next request
+      TextureCache::get().insert(filename, target, build_mipmaps, result, result->get_bytes());
+    }
+    return result;
+  }
+}
+
+TexturePtr
+Texture::from_compressed_file(const std::filesystem::path& filename)
+{
+  GLenum const target = GL_TEXTURE_2D;
+
+  if (TexturePtr texture = TextureCache::get().find(filename, target, true))
+  {
+    return texture;
+  }
+
+  CompressedImage const image = CompressedImage::from_file(filename);
+  if (!is_format_supported(image.get_format()))
+  {
+    log_warn("Texture: %s: compressed format 0x%x isn't supported", filename, image.get_format());
+    return {};
+  }
+
+  OpenGLState state;
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  OpenGLStateTracker::get().bind_texture(target, texture);
+
+  int const levels = static_cast<int>(image.get_levels().size());
+#ifdef HAVE_OPENGLES2
+  // GLES2 has no GL_TEXTURE_MAX_LEVEL, a partial chain can't be used
+  bool const mipmapped = (levels == MipmapBuilder::get_level_count(image.get_width(), image.get_height()));
 #else
-                   GL_RGB,
+  bool const mipmapped = (levels > 1);
 #endif
-                   GL_UNSIGNED_BYTE, surface->pixels);
-    }
 
-    SDL_FreeSurface(surface);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    return std::make_shared<Texture>(target, texture);
+  bool immutable = false;
+#ifndef HAVE_OPENGLES2
+  float max_anisotropy = 0.0f;
+  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+  glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropy);
+
+  if (GLEW_ARB_texture_storage)
+  {
+    glTexStorage2D(target, levels, image.get_format(), image.get_width(), image.get_height());
+    immutable = true;
   }
-}
+  else
+  {
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  }
+#endif
 
+  for(int i = 0; i < levels; ++i)
+  {
+    CompressedImage::Level const& level = image.get_levels()[i];
+    GLsizei const size = static_cast<GLsizei>(level.data.size());
+    if (immutable)
+    {
+      glCompressedTexSubImage2D(target, i, 0, 0, level.width, level.height,
+                                image.get_format(), size, level.data.data());
+    }
+    else
+    {
+      glCompressedTexImage2D(target, i, image.get_format(), level.width, level.height, 0,
+                             size, level.data.data());
+    }
+  }
+
+  assert_gl("Texture::from_compressed_file");
+
+  TexturePtr result = std::make_shared<Texture>(target, texture);
+  result->set_storage(image.get_levels().front().data.size(), levels);
+  TextureCache::get().insert(filename, target, true, result, image.get_size());
+  return result;
+}
 
 TexturePtr
 Texture::from_rgb_data(int width, int height, int pitch, void* data)
@@ -375,7 +695,7 @@ Texture::from_rgb_data(int width, int height, int pitch, void* data)
   GLenum target = GL_TEXTURE_2D;
   GLuint texture;
   glGenTextures(1, &texture);
-  glBindTexture(target, texture);
+  OpenGLStateTracker::get().bind_texture(target, texture);
 
 #ifndef HAVE_OPENGLES2
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -389,7 +709,9 @@ Texture::from_rgb_data(int width, int height, int pitch, void* data)
 
   glTexImage2D(target, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 
-  return std::make_shared<Texture>(target, texture);
+  TexturePtr result = std::make_shared<Texture>(target, texture);
+  result->set_storage(static_cast<size_t>(width) * height * 3, 1);
+  return result;
 }
 
 TexturePtr
@@ -402,15 +724,57 @@ Texture::create_handle(GLenum target)
 
 Texture::Texture(GLenum target, GLuint id) :
   m_target(target),
-  m_id(id)
+  m_id(id),
+  m_level0_bytes(0),
+  m_levels(1),
+  m_base_level(0),
+  m_last_used(0)
 {
 }
 
 Texture::~Texture()
 {
+  s_total_bytes -= get_bytes();
+  OpenGLStateTracker::get().forget_texture(m_id);
   glDeleteTextures(1, &m_id);
 }
 
+void
+Texture::set_storage(size_t level0_bytes, int levels)
+{
+  s_total_bytes -= get_bytes();
+  m_level0_bytes = level0_bytes;
+  m_levels = std::max(1, levels);
+  m_base_level = std::min(m_base_level, m_levels - 1);
+  s_total_bytes += get_bytes();
+}
+
+void
+Texture::set_base_level(int level)
+{
+  s_total_bytes -= get_bytes();
+  m_base_level = std::max(0, std::min(level, m_levels - 1));
+  s_total_bytes += get_bytes();
+
+#ifndef HAVE_OPENGLES2
+  OpenGLState state;
+  OpenGLStateTracker::get().bind_texture(m_target, m_id);
+  glTexParameteri(m_target, GL_TEXTURE_BASE_LEVEL, m_base_level);
+#endif
+}
+
+size_t
+Texture::get_bytes() const
+{
+  // every level has a quarter of the texels of the one above
+  size_t bytes = 0;
+  for(int level = m_base_level; level < m_levels; ++level)
+  {
+    bytes += get_level_bytes(level);
+  }
+  return bytes;
+}
+
 void
 Texture::upload(int width, int height, int pitch, void* data)
 {
@@ -421,7 +785,7 @@ Texture::upload(int width, int height, int pitch, void* data)
   glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
 #endif
 
-  glBindTexture(m_target, m_id);
+  OpenGLStateTracker::get().bind_texture(m_target, m_id);
   glTexSubImage2D(m_target, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
   assert_gl("Texture::upload");
 }
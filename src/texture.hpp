@@ -13,13 +13,36 @@ typedef std::shared_ptr<Texture> TexturePtr;
 
 class Texture
 {
+public:
+  /** How the mipmaps of images loaded from files are built, on the GPU
+      with glGenerateMipmap() or with MipmapBuilder on the CPU */
+  enum MipmapMode { GPU_MIPMAPS, BOX_MIPMAPS, KAISER_MIPMAPS };
+
 private:
+  static MipmapMode s_mipmap_mode;
+  static size_t s_total_bytes;
+
   GLenum m_target;
   GLuint m_id;
 
+  // estimated video memory, see set_storage()
+  size_t m_level0_bytes;
+  int m_levels;
+  int m_base_level;
+  unsigned int m_last_used;
+
 public:
+  static void set_mipmap_mode(MipmapMode mode) { s_mipmap_mode = mode; }
+  static MipmapMode get_mipmap_mode() { return s_mipmap_mode; }
+
+  /** Loads a directory with up.png, dn.png, lf.png, rt.png, ft.png and
+      bk.png or a single image with the faces arranged in a cross */
   static TexturePtr cubemap_from_file(const std::filesystem::path& filename);
   static TexturePtr from_file(const std::filesystem::path& filename, bool build_mipmaps = true, bool exception_on_fail = false);
+
+  /** Loads a .ktx or .dds file with its stored mipmaps, returns nullptr
+      when the GL can't sample its format */
+  static TexturePtr from_compressed_file(const std::filesystem::path& filename);
   static TexturePtr from_rgb_data(int width, int height, int pitch, void* data);
   static TexturePtr create_lightspot(int width, int height);
   static TexturePtr create_random_noise(int width, int height);
@@ -34,6 +57,27 @@ public:
   GLuint get_id() const { return m_id; }
   GLenum get_target() const { return m_target; }
 
+  /** Records the size of level 0 and the number of mip levels, called
+      by whatever fills the texture so that its memory is accounted for */
+  void set_storage(size_t level0_bytes, int levels);
+  int get_levels() const { return m_levels; }
+
+  /** Levels finer than \a level are no longer sampled and not counted
+      as resident, see ResidencyManager */
+  void set_base_level(int level);
+  int get_base_level() const { return m_base_level; }
+
+  /** Estimated bytes of the levels from the base level down */
+  size_t get_bytes() const;
+  size_t get_level_bytes(int level) const { return m_level0_bytes >> (2 * level); }
+
+  /** Frame number of the last draw that used the texture */
+  void set_last_used(unsigned int frame) { m_last_used = frame; }
+  unsigned int get_last_used() const { return m_last_used; }
+
+  /** Estimated bytes of all textures together */
+  static size_t get_total_bytes() { return s_total_bytes; }
+
   void upload(int width, int height, int pitch, void* data);
 
 private:
@@ -0,0 +1,121 @@
+#include "texture_cache.hpp"
+
+#include <algorithm>
+
+namespace {
+
+std::filesystem::file_time_type newest_write_time(std::filesystem::path const& filename)
+{
+  std::error_code ec;
+  if (std::filesystem::is_directory(filename, ec))
+  {
+    // the directory time doesn't change when a face is overwritten
+    std::filesystem::file_time_type newest = std::filesystem::file_time_type::min();
+    for(auto const& entry : std::filesystem::directory_iterator(filename, ec))
+    {
+      newest = std::max(newest, std::filesystem::last_write_time(entry.path(), ec));
+    }
+    return newest;
+  }
+  else
+  {
+    return std::filesystem::last_write_time(filename, ec);
+  }
+}
+
+} // namespace
+
+TextureCache::TextureCache() :
+  m_entries(),
+  m_inserts_since_sweep(0),
+  m_hits(0),
+  m_misses(0),
+  m_bytes_saved(0)
+{
+}
+
+std::string
+TextureCache::make_key(std::filesystem::path const& filename, GLenum target, bool mipmaps)
+{
+  std::error_code ec;
+  std::filesystem::path path = std::filesystem::canonical(filename, ec);
+  if (ec)
+  {
+    // missing files still get a stable key, loading them will fail
+    path = std::filesystem::absolute(filename, ec).lexically_normal();
+  }
+
+  std::string key = path.string();
+  key += '\0';
+  key += std::to_string(newest_write_time(filename).time_since_epoch().count());
+  key += '\0';
+  key += std::to_string(target);
+  key += mipmaps ? "m" : "";
+  return key;
+}
+
+TexturePtr
+TextureCache::find(std::filesystem::path const& filename, GLenum target, bool mipmaps)
+{
+  auto it = m_entries.find(make_key(filename, target, mipmaps));
+  if (it != m_entries.end())
+  {
+    if (TexturePtr texture = it->second.texture.lock())
+    {
+      m_hits += 1;
+      m_bytes_saved += it->second.bytes;
+      return texture;
+    }
+  }
+
+  m_misses += 1;
+  return {};
+}
+
+void
+TextureCache::insert(std::filesystem::path const& filename, GLenum target, bool mipmaps,
+                     TexturePtr const& texture, size_t bytes)
+{
+  m_entries[make_key(filename, target, mipmaps)] = Entry{ texture, bytes };
+
+  m_inserts_since_sweep += 1;
+  if (m_inserts_since_sweep > 64)
+  {
+    sweep();
+  }
+}
+
+void
+TextureCache::erase(std::filesystem::path const& filename, GLenum target, bool mipmaps,
+                    Texture const& texture)
+{
+  auto it = m_entries.find(make_key(filename, target, mipmaps));
+  if (it != m_entries.end())
+  {
+    // a later load may have replaced the entry already
+    TexturePtr const cached = it->second.texture.lock();
+    if (!cached || cached.get() == &texture)
+    {
+      m_entries.erase(it);
+    }
+  }
+}
+
+void
+TextureCache::sweep()
+{
+  for(auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    if (it->second.texture.expired())
+    {
+      it = m_entries.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  m_inserts_since_sweep = 0;
+}
+
+/* EOF */
@@ -0,0 +1,72 @@
+#ifndef HEADER_TEXTURE_CACHE_HPP
+#define HEADER_TEXTURE_CACHE_HPP
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "texture.hpp"
+
+/** Shares textures loaded from the same file. Entries are keyed by the
+    canonical path, the modification time, the target and whether
+    mipmaps were built, so a file changed on disk is loaded again. Only
+    weak references are kept, a texture is freed once the last user is
+    gone. */
+class TextureCache
+{
+public:
+  static TextureCache& get()
+  {
+    static TextureCache instance;
+    return instance;
+  }
+
+private:
+  struct Entry
+  {
+    std::weak_ptr<Texture> texture;
+    size_t bytes;
+  };
+
+  std::unordered_map<std::string, Entry> m_entries;
+  int m_inserts_since_sweep;
+
+  int m_hits;
+  int m_misses;
+  size_t m_bytes_saved;
+
+public:
+  TextureCache();
+
+  /** Returns the texture loaded earlier from \a filename, nullptr when
+      there is none, a directory stands for the cubemap in it */
+  TexturePtr find(std::filesystem::path const& filename, GLenum target, bool mipmaps);
+
+  /** Remembers \a texture, \a bytes is its estimated size in video
+      memory and counted as saved on every later hit. Replaces an
+      existing entry. */
+  void insert(std::filesystem::path const& filename, GLenum target, bool mipmaps,
+              TexturePtr const& texture, size_t bytes);
+
+  /** Forgets the entry of \a filename when it still refers to
+      \a texture, for textures that turned out not to be loadable */
+  void erase(std::filesystem::path const& filename, GLenum target, bool mipmaps,
+             Texture const& texture);
+
+  int get_hits() const { return m_hits; }
+  int get_misses() const { return m_misses; }
+  size_t get_bytes_saved() const { return m_bytes_saved; }
+
+private:
+  static std::string make_key(std::filesystem::path const& filename, GLenum target, bool mipmaps);
+  void sweep();
+
+private:
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,561 @@
+#include "texture_loader.hpp"
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <algorithm>
+#include <string.h>
+
+#include "assert_gl.hpp"
+#include "log.hpp"
+#include "opengl_state.hpp"
+#include "residency_manager.hpp"
+#include "stopwatch.hpp"
+#include "texture_cache.hpp"
+#include "upload_thread.hpp"
+
+namespace {
+
+// shown until the real image is uploaded, same size as the
+// replacement Texture::from_file() uses for missing files
+int const PLACEHOLDER_SIZE = 32;
+
+} // namespace
+
+TextureLoader::TextureLoader() :
+  m_threads(),
+  m_mutex(),
+  m_cond(),
+  m_ready_cond(),
+  m_decode_queue(),
+  m_ready_queue(),
+  m_quit(false),
+  m_upload_queue(),
+  m_pending(0),
+  m_pbo(0),
+  m_shared_uploads(0),
+  m_async(true),
+  m_upload_budget(4 * 1024 * 1024),
+  m_loaded(0),
+  m_loaded_bytes(0),
+  m_decode_msec(0.0f),
+  m_upload_msec(0.0f)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_cond.notify_all();
+
+  for(auto& thread : m_threads)
+  {
+    thread.join();
+  }
+
+#ifndef HAVE_OPENGLES2
+  if (m_pbo)
+  {
+    glDeleteBuffers(1, &m_pbo);
+  }
+#endif
+}
+
+void
+TextureLoader::start_threads()
+{
+  // the loaders are initialized lazily by IMG_Load(), which isn't
+  // safe to do from several threads at once
+  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+  unsigned int const num_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  for(unsigned int i = 0; i < num_threads; ++i)
+  {
+    m_threads.emplace_back([this]{ worker_main(); });
+  }
+}
+
+TexturePtr
+TextureLoader::load(std::filesystem::path const& filename, bool build_mipmaps)
+{
+  GLenum const target = GL_TEXTURE_2D;
+
+  // a texture that is still loading is shared as well
+  if (TexturePtr texture = TextureCache::get().find(filename, target, build_mipmaps))
+  {
+    return texture;
+  }
+
+  OpenGLState state;
+
+  GLuint id;
+  glGenTextures(1, &id);
+  OpenGLStateTracker::get().bind_texture(target, id);
+
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // switched to mipmapping once the mipmaps exist
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+  std::vector<uint8_t> const grey(PLACEHOLDER_SIZE * PLACEHOLDER_SIZE * 3, 128);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+#ifndef HAVE_OPENGLES2
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+  glTexImage2D(target, 0, GL_RGB, PLACEHOLDER_SIZE, PLACEHOLDER_SIZE, 0,
+               GL_RGB, GL_UNSIGNED_BYTE, grey.data());
+
+  assert_gl("TextureLoader::load");
+
+  TexturePtr texture = std::make_shared<Texture>(target, id);
+  texture->set_storage(grey.size(), 1);
+  // the size is filled in once the image is decoded
+  TextureCache::get().insert(filename, target, build_mipmaps, texture, 0);
+
+  JobPtr job = std::make_unique<Job>();
+  job->filename = filename;
+  job->texture = texture;
+  job->build_mipmaps = build_mipmaps;
+  job->skip_levels = 0;
+  submit(std::move(job));
+
+  return texture;
+}
+
+void
+TextureLoader::reload(TexturePtr const& texture, std::filesystem::path const& filename, int skip_levels)
+{
+  JobPtr job = std::make_unique<Job>();
+  job->filename = filename;
+  job->texture = texture;
+  job->build_mipmaps = true;
+  job->skip_levels = skip_levels;
+  submit(std::move(job));
+}
+
+void
+TextureLoader::submit(JobPtr job)
+{
+  job->width = 0;
+  job->height = 0;
+  job->bytes_per_pixel = 0;
+  job->failed = false;
+  job->decode_msec = 0.0f;
+  job->next_row = 0;
+  job->upload_msec = 0.0f;
+
+  m_pending += 1;
+
+  if (!m_async)
+  {
+    decode(*job);
+    m_upload_queue.push_back(std::move(job));
+    finish();
+  }
+  else
+  {
+    if (m_threads.empty())
+    {
+      start_threads();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_decode_queue.push_back(std::move(job));
+    }
+    m_cond.notify_one();
+  }
+}
+
+void
+TextureLoader::worker_main()
+{
+  while(true)
+  {
+    JobPtr job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]{ return m_quit || !m_decode_queue.empty(); });
+      if (m_quit)
+      {
+        return;
+      }
+
+      job = std::move(m_decode_queue.front());
+      m_decode_queue.pop_front();
+    }
+
+    decode(*job);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_ready_queue.push_back(std::move(job));
+    }
+    m_ready_cond.notify_all();
+  }
+}
+
+void
+TextureLoader::decode(Job& job)
+{
+  Stopwatch stopwatch;
+
+  SDL_Surface* surface = IMG_Load(job.filename.c_str());
+  if (surface && surface->format->BytesPerPixel != 3 && surface->format->BytesPerPixel != 4)
+  {
+    // paletted and grayscale images, RGBA in byte order
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
+    SDL_FreeSurface(surface);
+    surface = converted;
+  }
+
+  if (!surface)
+  {
+    job.failed = true;
+    return;
+  }
+
+  job.width = surface->w;
+  job.height = surface->h;
+  job.bytes_per_pixel = surface->format->BytesPerPixel;
+
+  // flip while removing the row padding, GL wants the bottom row first
+  size_t const row_bytes = static_cast<size_t>(job.width) * job.bytes_per_pixel;
+  job.pixels.resize(row_bytes * job.height);
+  for(int y = 0; y < job.height; ++y)
+  {
+    memcpy(job.pixels.data() + (job.height - y - 1) * row_bytes,
+           static_cast<uint8_t const*>(surface->pixels) + y * surface->pitch,
+           row_bytes);
+  }
+
+  SDL_FreeSurface(surface);
+
+  if (job.skip_levels > 0)
+  {
+    // an evicted texture only gets its coarse levels back
+    std::vector<MipmapBuilder::Level> levels =
+      MipmapBuilder::build(job.pixels.data(), job.width, job.height,
+                           static_cast<int>(row_bytes), job.bytes_per_pixel,
+                           MipmapBuilder::BOX, true, false);
+    if (!levels.empty())
+    {
+      job.skip_levels = std::min(job.skip_levels, static_cast<int>(levels.size()));
+      MipmapBuilder::Level& level = levels[job.skip_levels - 1];
+      job.width = level.width;
+      job.height = level.height;
+      job.pixels = std::move(level.pixels);
+    }
+    else
+    {
+      job.skip_levels = 0;
+    }
+  }
+
+  Texture::MipmapMode const mode = Texture::get_mipmap_mode();
+  if (job.build_mipmaps && mode != Texture::GPU_MIPMAPS)
+  {
+    // the worker pool already runs one image per thread
+    // the pitch of the level the skip above left, not of the file
+    job.levels = MipmapBuilder::build(job.pixels.data(), job.width, job.height,
+                                      job.width * job.bytes_per_pixel, job.bytes_per_pixel,
+                                      (mode == Texture::KAISER_MIPMAPS) ? MipmapBuilder::KAISER : MipmapBuilder::BOX,
+                                      true, false);
+  }
+
+  job.decode_msec = stopwatch.get_msec();
+}
+
+size_t
+TextureLoader::upload(Job& job, size_t budget)
+{
+  TexturePtr texture = job.texture.lock();
+  if (!texture)
+  {
+    // dropped before it was ever shown
+    job.next_row = job.height;
+    return 0;
+  }
+
+  Stopwatch stopwatch;
+  OpenGLState state;
+
+  GLenum const target = texture->get_target();
+  GLenum const format = (job.bytes_per_pixel == 4) ? GL_RGBA : GL_RGB;
+  size_t const row_bytes = static_cast<size_t>(job.width) * job.bytes_per_pixel;
+
+  OpenGLStateTracker::get().bind_texture(target, texture->get_id());
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+#ifndef HAVE_OPENGLES2
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+
+  if (job.next_row == 0)
+  {
+    // respecify the placeholder, the GL name stays the same
+#ifdef HAVE_OPENGLES2
+    glTexImage2D(target, 0, format, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+#else
+    glTexImage2D(target, 0, GL_RGB, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+#endif
+  }
+
+  int const rows = std::min(job.height - job.next_row,
+                            std::max(1, static_cast<int>(budget / row_bytes)));
+  size_t const size = rows * row_bytes;
+  uint8_t const* data = job.pixels.data() + job.next_row * row_bytes;
+
+#ifdef HAVE_OPENGLES2
+  glTexSubImage2D(target, 0, 0, job.next_row, job.width, rows, format, GL_UNSIGNED_BYTE, data);
+#else
+  // orphan and refill the PBO, the copy into the texture then happens
+  // asynchronously instead of stalling on the client memory
+  if (!m_pbo)
+  {
+    glGenBuffers(1, &m_pbo);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  memcpy(dst, data, size);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glTexSubImage2D(target, 0, 0, job.next_row, job.width, rows, format, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
+
+  job.next_row += rows;
+
+  if (job.next_row == job.height && job.build_mipmaps)
+  {
+    if (texture->get_base_level() != 0)
+    {
+      // a reload after an eviction, the levels are built from level 0
+      texture->set_base_level(0);
+    }
+
+    upload_mipmaps(job, target, format);
+  }
+
+  assert_gl("TextureLoader::upload");
+
+  job.upload_msec += stopwatch.get_msec();
+
+  return size;
+}
+
+void
+TextureLoader::upload_mipmaps(Job& job, GLenum target, GLenum format)
+{
+  if (job.levels.empty())
+  {
+    glGenerateMipmap(target);
+  }
+  else
+  {
+    for(size_t i = 0; i < job.levels.size(); ++i)
+    {
+      MipmapBuilder::Level const& level = job.levels[i];
+#ifdef HAVE_OPENGLES2
+      glTexImage2D(target, static_cast<int>(i) + 1, format, level.width, level.height, 0,
+                   format, GL_UNSIGNED_BYTE, level.pixels.data());
+#else
+      glTexImage2D(target, static_cast<int>(i) + 1, GL_RGB, level.width, level.height, 0,
+                   format, GL_UNSIGNED_BYTE, level.pixels.data());
+#endif
+    }
+    job.levels.clear();
+  }
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+#ifndef HAVE_OPENGLES2
+  float max_anisotropy = 0.0f;
+  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+  glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropy);
+#endif
+}
+
+#ifndef HAVE_OPENGLES2
+void
+TextureLoader::upload_shared(JobPtr job_ptr)
+{
+  TexturePtr texture = job_ptr->texture.lock();
+  if (!texture)
+  {
+    // dropped before it was ever shown
+    complete(*job_ptr);
+    return;
+  }
+
+  // std::function wants something copyable
+  std::shared_ptr<Job> job(std::move(job_ptr));
+  GLenum const target = texture->get_target();
+  GLuint const id = texture->get_id();
+
+  m_shared_uploads += 1;
+  UploadThread::get().submit(
+    [job, target, id]{
+      // the whole image at once, this thread has time to wait for it
+      Stopwatch stopwatch;
+      GLenum const format = (job->bytes_per_pixel == 4) ? GL_RGBA : GL_RGB;
+
+      glBindTexture(target, id);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      glTexImage2D(target, 0, GL_RGB, job->width, job->height, 0, format, GL_UNSIGNED_BYTE,
+                   job->pixels.data());
+      if (job->build_mipmaps)
+      {
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+        upload_mipmaps(*job, target, format);
+      }
+      glBindTexture(target, 0);
+      assert_gl("TextureLoader::upload_shared");
+
+      job->upload_msec = stopwatch.get_msec();
+    },
+    // keeps the texture, and with it the GL name, alive until the
+    // upload is done
+    [this, job, texture]{
+      m_shared_uploads -= 1;
+
+      // the texture might be bound with its old content
+      OpenGLStateTracker::get().forget_texture(texture->get_id());
+      if (job->build_mipmaps && texture->get_base_level() != 0)
+      {
+        texture->set_base_level(0);
+      }
+      complete(*job);
+    });
+}
+#endif
+
+void
+TextureLoader::update()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while(!m_ready_queue.empty())
+    {
+      m_upload_queue.push_back(std::move(m_ready_queue.front()));
+      m_ready_queue.pop_front();
+    }
+  }
+
+#ifndef HAVE_OPENGLES2
+  if (UploadThread::get().is_running())
+  {
+    // the upload thread takes whole images, there is no budget
+    while(!m_upload_queue.empty())
+    {
+      JobPtr job = std::move(m_upload_queue.front());
+      m_upload_queue.pop_front();
+      if (job->failed)
+      {
+        complete(*job);
+      }
+      else
+      {
+        upload_shared(std::move(job));
+      }
+    }
+    return;
+  }
+#endif
+
+  size_t budget = m_upload_budget;
+  while(!m_upload_queue.empty() && budget > 0)
+  {
+    Job& job = *m_upload_queue.front();
+    if (!job.failed)
+    {
+      budget -= std::min(budget, upload(job, budget));
+      if (job.next_row < job.height)
+      {
+        // continued next frame
+        break;
+      }
+    }
+
+    complete(job);
+    m_upload_queue.pop_front();
+  }
+}
+
+void
+TextureLoader::complete(Job& job)
+{
+  if (job.failed)
+  {
+    log_error("Texture: couldn't open %s, keeping placeholder texture", job.filename);
+
+    // the next load() should try the file again instead of sharing the
+    // placeholder
+    if (TexturePtr texture = job.texture.lock())
+    {
+      TextureCache::get().erase(job.filename, texture->get_target(), job.build_mipmaps, *texture);
+    }
+  }
+  else
+  {
+    log_info("texture: %s: %dx%d, decode: %sms, upload: %sms",
+             job.filename, job.width, job.height, job.decode_msec, job.upload_msec);
+    if (TexturePtr texture = job.texture.lock())
+    {
+      texture->set_storage(static_cast<size_t>(job.width) * job.height * job.bytes_per_pixel,
+                           job.build_mipmaps ? MipmapBuilder::get_level_count(job.width, job.height) : 1);
+      TextureCache::get().insert(job.filename, texture->get_target(), job.build_mipmaps, texture,
+                                 texture->get_bytes());
+      if (job.build_mipmaps)
+      {
+        ResidencyManager::get().add(texture, job.filename, job.skip_levels);
+      }
+    }
+    m_loaded += 1;
+    m_loaded_bytes += static_cast<size_t>(job.width) * job.height * job.bytes_per_pixel;
+    m_decode_msec += job.decode_msec;
+    m_upload_msec += job.upload_msec;
+  }
+
+  m_pending -= 1;
+
+  if (m_pending == 0)
+  {
+    // decode includes the mipmaps when they are built on the CPU
+    log_info("textures: %d loaded, %sMB, decode: %sms, upload: %sms",
+             m_loaded, static_cast<float>(m_loaded_bytes) / (1024.0f * 1024.0f),
+             m_decode_msec, m_upload_msec);
+  }
+}
+
+void
+TextureLoader::finish()
+{
+  size_t const budget = m_upload_budget;
+  m_upload_budget = static_cast<size_t>(-1);
+
+  while(m_pending > 0)
+  {
+    update();
+
+    if (m_pending > 0 && m_upload_queue.empty())
+    {
+#ifndef HAVE_OPENGLES2
+      if (m_shared_uploads > 0)
+      {
+        UploadThread::get().finish();
+        continue;
+      }
+#endif
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_ready_cond.wait(lock, [this]{ return !m_ready_queue.empty(); });
+    }
+  }
+
+  m_upload_budget = budget;
+}
+
+/* EOF */
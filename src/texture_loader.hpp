@@ -0,0 +1,152 @@
+#ifndef HEADER_TEXTURE_LOADER_HPP
+#define HEADER_TEXTURE_LOADER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "mipmap_builder.hpp"
+#include "texture.hpp"
+
+/** Loads image files in the background. load() returns a texture with
+    a small placeholder image right away, the file is decoded and
+    flipped on a worker thread and update() later uploads the result
+    into the same GL texture, so materials don't notice the swap.
+
+    Uploads go through a pixel buffer object and are split into bands
+    of rows, update() stops once the per-frame byte budget is used up,
+    so a large image is spread over several frames instead of causing a
+    hitch.
+
+    The workers are separate from the TaskScheduler, a decode running
+    there would stall the frame whenever the main thread helps out in
+    TaskScheduler::wait(). Mipmaps that Texture::get_mipmap_mode() wants
+    built on the CPU are built by the workers as well. The storage stays
+    mutable, the placeholder has to be respecified.
+
+    Mipmapped textures are handed to the ResidencyManager, which evicts
+    and reloads them through reload().
+
+    When the UploadThread is running, decoded images are uploaded there
+    in one piece instead, the upload budget then doesn't apply. */
+class TextureLoader
+{
+public:
+  static TextureLoader& get()
+  {
+    static TextureLoader instance;
+    return instance;
+  }
+
+private:
+  struct Job
+  {
+    std::filesystem::path filename;
+    std::weak_ptr<Texture> texture;
+    bool build_mipmaps;
+
+    // finest mip levels left out, for textures evicted by ResidencyManager
+    int skip_levels;
+
+    // filled in by the worker, rows are bottom to top and tightly packed
+    std::vector<uint8_t> pixels;
+    int width;
+    int height;
+    int bytes_per_pixel;
+    bool failed;
+    float decode_msec;
+
+    // levels 1 and up, unless the GPU builds them
+    std::vector<MipmapBuilder::Level> levels;
+
+    // progress of the upload on the GL thread
+    int next_row;
+    float upload_msec;
+  };
+
+  typedef std::unique_ptr<Job> JobPtr;
+
+private:
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_cond; // work for the workers
+  std::condition_variable m_ready_cond; // a decode finished
+  std::deque<JobPtr> m_decode_queue;
+  std::deque<JobPtr> m_ready_queue;
+  bool m_quit;
+
+  // only touched by the GL thread
+  std::deque<JobPtr> m_upload_queue;
+  int m_pending;
+  GLuint m_pbo;
+  int m_shared_uploads; // jobs at the UploadThread
+
+  bool m_async;
+  size_t m_upload_budget;
+
+  int m_loaded;
+  size_t m_loaded_bytes;
+  float m_decode_msec;
+  float m_upload_msec;
+
+public:
+  TextureLoader();
+  ~TextureLoader();
+
+  /** Returns a placeholder texture that gets replaced by the content of
+      \a filename once it is decoded and uploaded. A file that can't be
+      read leaves the placeholder in place. */
+  TexturePtr load(std::filesystem::path const& filename, bool build_mipmaps = true);
+
+  /** Loads \a filename into the existing mipmapped \a texture again,
+      without the \a skip_levels finest levels. The texture keeps its
+      current content until the upload is done. */
+  void reload(TexturePtr const& texture, std::filesystem::path const& filename, int skip_levels = 0);
+
+  /** Uploads decoded images, at most the upload budget worth of bytes.
+      Must be called once per frame on the GL thread. */
+  void update();
+
+  /** Blocks until every texture requested so far is uploaded */
+  void finish();
+
+  /** With async off load() decodes and uploads right away */
+  void set_async(bool async) { m_async = async; }
+
+  /** Bytes uploaded per update(), at least one row of one image is
+      always uploaded */
+  void set_upload_budget(size_t bytes) { m_upload_budget = bytes; }
+
+  /** Textures that are still showing their placeholder */
+  int get_pending() const { return m_pending; }
+
+private:
+  void start_threads();
+  void submit(JobPtr job);
+  void worker_main();
+  static void decode(Job& job);
+
+  /** Uploads up to \a budget bytes of \a job, returns the number of
+      bytes uploaded */
+  size_t upload(Job& job, size_t budget);
+  static void upload_mipmaps(Job& job, GLenum target, GLenum format);
+
+  /** Hands the whole job to the UploadThread */
+  void upload_shared(JobPtr job);
+
+  /** Bookkeeping once a job is uploaded or failed */
+  void complete(Job& job);
+
+private:
+  TextureLoader(const TextureLoader&) = delete;
+  TextureLoader& operator=(const TextureLoader&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,505 @@
+#include "triangle_bvh.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "format.hpp"
+
+namespace {
+
+const int k_bins = 16;
+
+/** Deeper than this the builder falls back to median splits, which
+    bounds the depth of the tree and thus the traversal stack */
+const int k_max_sah_depth = 48;
+const int k_stack_size = 256;
+
+float surface_area(AABB const& box)
+{
+  if (box.is_empty())
+  {
+    return 0.0f;
+  }
+  else
+  {
+    glm::vec3 size = box.get_size();
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+  }
+}
+
+int largest_axis(glm::vec3 const& v)
+{
+  if (v.x >= v.y && v.x >= v.z)
+  {
+    return 0;
+  }
+  else if (v.y >= v.z)
+  {
+    return 1;
+  }
+  else
+  {
+    return 2;
+  }
+}
+
+} // namespace
+
+const int TriangleBVH::EMPTY = std::numeric_limits<int>::min();
+
+TriangleBVH::TriangleBVH(std::vector<glm::vec3> const& positions, std::vector<int> const& indices) :
+  m_nodes(),
+  m_packets(),
+  m_bounding_box(),
+  m_triangle_count(static_cast<int>(indices.size() / 3))
+{
+  std::vector<BuildTriangle> triangles(m_triangle_count);
+  for(int i = 0; i < m_triangle_count; ++i)
+  {
+    BuildTriangle& tri = triangles[i];
+    for(int k = 0; k < 3; ++k)
+    {
+      int const index = indices[3 * i + k];
+      if (index < 0 || index >= static_cast<int>(positions.size()))
+      {
+        throw std::runtime_error(format("TriangleBVH: index out of range: %d", index));
+      }
+      tri.bounds.extend(positions[index]);
+    }
+    tri.centroid = tri.bounds.get_center();
+    tri.index = i;
+  }
+
+  if (!triangles.empty())
+  {
+    std::vector<BuildNode> build_nodes;
+    build_nodes.reserve(2 * m_triangle_count / LEAF_SIZE + 1);
+
+    int const root = build(triangles, build_nodes, 0, m_triangle_count, 0);
+    m_bounding_box = build_nodes[root].bounds;
+
+    m_packets.reserve(build_nodes.size() / 2 + 1);
+    flatten(build_nodes, triangles, positions, indices, root);
+  }
+}
+
+int
+TriangleBVH::build(std::vector<BuildTriangle>& triangles, std::vector<BuildNode>& nodes,
+                   int begin, int end, int depth)
+{
+  AABB bounds;
+  AABB centroid_bounds;
+  for(int i = begin; i < end; ++i)
+  {
+    bounds.extend(triangles[i].bounds);
+    centroid_bounds.extend(triangles[i].centroid);
+  }
+
+  int const index = static_cast<int>(nodes.size());
+  nodes.push_back(BuildNode{ bounds, -1, -1, begin, end });
+
+  int const count = end - begin;
+  if (count <= LEAF_SIZE)
+  {
+    return index;
+  }
+
+  glm::vec3 const extent = centroid_bounds.get_size();
+  int const axis = largest_axis(extent);
+  int mid = -1;
+
+  if (extent[axis] > 0.0f && depth < k_max_sah_depth)
+  { // binned surface area heuristic
+    struct Bin
+    {
+      AABB bounds;
+      int count = 0;
+    };
+
+    Bin bins[k_bins];
+    float const scale = static_cast<float>(k_bins) / extent[axis];
+    auto bin_of = [&](BuildTriangle const& tri) {
+      int b = static_cast<int>((tri.centroid[axis] - centroid_bounds.min[axis]) * scale);
+      return std::min(b, k_bins - 1);
+    };
+
+    for(int i = begin; i < end; ++i)
+    {
+      Bin& bin = bins[bin_of(triangles[i])];
+      bin.bounds.extend(triangles[i].bounds);
+      bin.count += 1;
+    }
+
+    // cost of splitting after bin i, the right side is accumulated first
+    float right_cost[k_bins - 1];
+    AABB right_bounds;
+    int right_count = 0;
+    for(int i = k_bins - 1; i > 0; --i)
+    {
+      right_bounds.extend(bins[i].bounds);
+      right_count += bins[i].count;
+      right_cost[i - 1] = surface_area(right_bounds) * static_cast<float>(right_count);
+    }
+
+    int best_split = -1;
+    float best_cost = std::numeric_limits<float>::max();
+    AABB left_bounds;
+    int left_count = 0;
+    for(int i = 0; i < k_bins - 1; ++i)
+    {
+      left_bounds.extend(bins[i].bounds);
+      left_count += bins[i].count;
+      float const cost = surface_area(left_bounds) * static_cast<float>(left_count) + right_cost[i];
+      if (left_count > 0 && left_count < count && cost < best_cost)
+      {
+        best_cost = cost;
+        best_split = i;
+      }
+    }
+
+    if (best_split >= 0)
+    {
+      auto it = std::partition(triangles.begin() + begin, triangles.begin() + end,
+                               [&](BuildTriangle const& tri) { return bin_of(tri) <= best_split; });
+      mid = static_cast<int>(it - triangles.begin());
+    }
+  }
+
+  if (mid <= begin || mid >= end)
+  { // all centroids in one spot or the tree got too deep
+    mid = begin + count / 2;
+    std::nth_element(triangles.begin() + begin, triangles.begin() + mid, triangles.begin() + end,
+                     [axis](BuildTriangle const& lhs, BuildTriangle const& rhs) {
+                       return lhs.centroid[axis] < rhs.centroid[axis];
+                     });
+  }
+
+  int const left = build(triangles, nodes, begin, mid, depth + 1);
+  int const right = build(triangles, nodes, mid, end, depth + 1);
+  nodes[index].left = left;
+  nodes[index].right = right;
+
+  return index;
+}
+
+int
+TriangleBVH::flatten(std::vector<BuildNode> const& build_nodes, std::vector<BuildTriangle> const& triangles,
+                     std::vector<glm::vec3> const& positions, std::vector<int> const& indices,
+                     int build_node)
+{
+  // collapse up to two levels of the binary tree into one node,
+  // always opening the child with the largest surface
+  int children[4];
+  int count = 0;
+
+  BuildNode const& parent = build_nodes[build_node];
+  if (parent.is_leaf())
+  {
+    children[count++] = build_node;
+  }
+  else
+  {
+    children[count++] = parent.left;
+    children[count++] = parent.right;
+
+    while (count < 4)
+    {
+      int best = -1;
+      float best_area = -1.0f;
+      for(int i = 0; i < count; ++i)
+      {
+        BuildNode const& child = build_nodes[children[i]];
+        float const area = surface_area(child.bounds);
+        if (!child.is_leaf() && area > best_area)
+        {
+          best = i;
+          best_area = area;
+        }
+      }
+
+      if (best < 0)
+      {
+        break;
+      }
+
+      BuildNode const& opened = build_nodes[children[best]];
+      children[best] = opened.left;
+      children[count++] = opened.right;
+    }
+  }
+
+  int const index = static_cast<int>(m_nodes.size());
+  m_nodes.emplace_back();
+
+  Node node;
+  for(int i = 0; i < 4; ++i)
+  {
+    node.min_x[i] = node.min_y[i] = node.min_z[i] = std::numeric_limits<float>::max();
+    node.max_x[i] = node.max_y[i] = node.max_z[i] = -std::numeric_limits<float>::max();
+    node.child[i] = EMPTY;
+  }
+
+  for(int i = 0; i < count; ++i)
+  {
+    BuildNode const& child = build_nodes[children[i]];
+
+    node.min_x[i] = child.bounds.min.x;
+    node.min_y[i] = child.bounds.min.y;
+    node.min_z[i] = child.bounds.min.z;
+    node.max_x[i] = child.bounds.max.x;
+    node.max_y[i] = child.bounds.max.y;
+    node.max_z[i] = child.bounds.max.z;
+
+    if (child.is_leaf())
+    {
+      node.child[i] = ~add_packet(triangles, positions, indices, child.begin, child.end);
+    }
+    else
+    {
+      node.child[i] = flatten(build_nodes, triangles, positions, indices, children[i]);
+    }
+  }
+
+  m_nodes[index] = node;
+  return index;
+}
+
+int
+TriangleBVH::add_packet(std::vector<BuildTriangle> const& triangles,
+                        std::vector<glm::vec3> const& positions, std::vector<int> const& indices,
+                        int begin, int end)
+{
+  // unused lanes are degenerate triangles, they never get hit
+  Packet packet = {};
+  for(int i = 0; i < 4; ++i)
+  {
+    packet.triangle[i] = -1;
+  }
+
+  for(int i = 0; i < end - begin; ++i)
+  {
+    int const tri = triangles[begin + i].index;
+    glm::vec3 const& v0 = positions[indices[3 * tri + 0]];
+    glm::vec3 const e1 = positions[indices[3 * tri + 1]] - v0;
+    glm::vec3 const e2 = positions[indices[3 * tri + 2]] - v0;
+
+    packet.v0_x[i] = v0.x;
+    packet.v0_y[i] = v0.y;
+    packet.v0_z[i] = v0.z;
+    packet.e1_x[i] = e1.x;
+    packet.e1_y[i] = e1.y;
+    packet.e1_z[i] = e1.z;
+    packet.e2_x[i] = e2.x;
+    packet.e2_y[i] = e2.y;
+    packet.e2_z[i] = e2.z;
+    packet.triangle[i] = tri;
+  }
+
+  m_packets.push_back(packet);
+  return static_cast<int>(m_packets.size()) - 1;
+}
+
+bool
+TriangleBVH::raycast(Ray const& ray, RayHit& hit) const
+{
+  if (m_nodes.empty())
+  {
+    return false;
+  }
+
+  glm::vec3 const& o = ray.origin;
+  glm::vec3 const& d = ray.direction;
+  glm::vec3 const inv_d(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+#ifdef __SSE2__
+  __m128 const ox = _mm_set1_ps(o.x);
+  __m128 const oy = _mm_set1_ps(o.y);
+  __m128 const oz = _mm_set1_ps(o.z);
+  __m128 const dx = _mm_set1_ps(d.x);
+  __m128 const dy = _mm_set1_ps(d.y);
+  __m128 const dz = _mm_set1_ps(d.z);
+  __m128 const inv_dx = _mm_set1_ps(inv_d.x);
+  __m128 const inv_dy = _mm_set1_ps(inv_d.y);
+  __m128 const inv_dz = _mm_set1_ps(inv_d.z);
+  __m128 const zero = _mm_setzero_ps();
+  __m128 const one = _mm_set1_ps(1.0f);
+#endif
+
+  struct Entry
+  {
+    int node;
+    float distance;
+  };
+
+  Entry stack[k_stack_size];
+  int stack_size = 0;
+  stack[stack_size++] = Entry{ 0, 0.0f };
+
+  bool found = false;
+
+  while (stack_size > 0)
+  {
+    Entry const entry = stack[--stack_size];
+    if (entry.distance >= hit.distance)
+    {
+      continue;
+    }
+
+    float t[4];
+    int mask = 0;
+
+    if (entry.node < 0)
+    { // Moeller-Trumbore against four triangles
+      Packet const& packet = m_packets[~entry.node];
+      float u[4];
+      float v[4];
+
+#ifdef __SSE2__
+      __m128 const e1x = _mm_loadu_ps(packet.e1_x);
+      __m128 const e1y = _mm_loadu_ps(packet.e1_y);
+      __m128 const e1z = _mm_loadu_ps(packet.e1_z);
+      __m128 const e2x = _mm_loadu_ps(packet.e2_x);
+      __m128 const e2y = _mm_loadu_ps(packet.e2_y);
+      __m128 const e2z = _mm_loadu_ps(packet.e2_z);
+
+      __m128 const px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+      __m128 const py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+      __m128 const pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+      __m128 const det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+      __m128 const inv_det = _mm_div_ps(one, det);
+
+      __m128 const tx = _mm_sub_ps(ox, _mm_loadu_ps(packet.v0_x));
+      __m128 const ty = _mm_sub_ps(oy, _mm_loadu_ps(packet.v0_y));
+      __m128 const tz = _mm_sub_ps(oz, _mm_loadu_ps(packet.v0_z));
+      __m128 const uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)),
+                                   inv_det);
+
+      __m128 const qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+      __m128 const qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+      __m128 const qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+      __m128 const vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+                                   inv_det);
+      __m128 const tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+                                   inv_det);
+
+      __m128 inside = _mm_cmpneq_ps(det, zero);
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(uu, zero));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(vv, zero));
+      inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(uu, vv), one));
+      inside = _mm_and_ps(inside, _mm_cmpgt_ps(tt, zero));
+      inside = _mm_and_ps(inside, _mm_cmplt_ps(tt, _mm_set1_ps(hit.distance)));
+      mask = _mm_movemask_ps(inside);
+
+      _mm_storeu_ps(t, tt);
+      _mm_storeu_ps(u, uu);
+      _mm_storeu_ps(v, vv);
+#else
+      for(int i = 0; i < 4; ++i)
+      {
+        glm::vec3 const e1(packet.e1_x[i], packet.e1_y[i], packet.e1_z[i]);
+        glm::vec3 const e2(packet.e2_x[i], packet.e2_y[i], packet.e2_z[i]);
+        glm::vec3 const p = glm::cross(d, e2);
+        float const det = glm::dot(e1, p);
+        float const inv_det = 1.0f / det;
+
+        glm::vec3 const s = o - glm::vec3(packet.v0_x[i], packet.v0_y[i], packet.v0_z[i]);
+        glm::vec3 const q = glm::cross(s, e1);
+        u[i] = glm::dot(s, p) * inv_det;
+        v[i] = glm::dot(d, q) * inv_det;
+        t[i] = glm::dot(e2, q) * inv_det;
+
+        if (det != 0.0f && u[i] >= 0.0f && v[i] >= 0.0f && u[i] + v[i] <= 1.0f &&
+            t[i] > 0.0f && t[i] < hit.distance)
+        {
+          mask |= 1 << i;
+        }
+      }
+#endif
+
+      for(int i = 0; i < 4; ++i)
+      {
+        if ((mask & (1 << i)) && t[i] < hit.distance)
+        {
+          hit.distance = t[i];
+          hit.triangle = packet.triangle[i];
+          hit.u = u[i];
+          hit.v = v[i];
+          found = true;
+        }
+      }
+    }
+    else
+    { // slab test against four boxes
+      Node const& node = m_nodes[entry.node];
+
+#ifdef __SSE2__
+      __m128 const tx0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_x), ox), inv_dx);
+      __m128 const tx1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_x), ox), inv_dx);
+      __m128 const ty0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_y), oy), inv_dy);
+      __m128 const ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_y), oy), inv_dy);
+      __m128 const tz0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_z), oz), inv_dz);
+      __m128 const tz1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_z), oz), inv_dz);
+
+      __m128 const tnear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                                      _mm_max_ps(_mm_min_ps(tz0, tz1), zero));
+      __m128 const tfar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                                     _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(hit.distance)));
+
+      mask = _mm_movemask_ps(_mm_cmple_ps(tnear, tfar));
+      _mm_storeu_ps(t, tnear);
+#else
+      for(int i = 0; i < 4; ++i)
+      {
+        float const tx0 = (node.min_x[i] - o.x) * inv_d.x;
+        float const tx1 = (node.max_x[i] - o.x) * inv_d.x;
+        float const ty0 = (node.min_y[i] - o.y) * inv_d.y;
+        float const ty1 = (node.max_y[i] - o.y) * inv_d.y;
+        float const tz0 = (node.min_z[i] - o.z) * inv_d.z;
+        float const tz1 = (node.max_z[i] - o.z) * inv_d.z;
+
+        float const tnear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)),
+                                     std::max(std::min(tz0, tz1), 0.0f));
+        float const tfar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)),
+                                    std::min(std::max(tz0, tz1), hit.distance));
+
+        t[i] = tnear;
+        if (tnear <= tfar)
+        {
+          mask |= 1 << i;
+        }
+      }
+#endif
+
+      // push the children far to near, so the nearest is visited first
+      // and shrinks hit.distance for the others
+      int order[4];
+      int count = 0;
+      for(int i = 0; i < 4; ++i)
+      {
+        if ((mask & (1 << i)) && node.child[i] != EMPTY)
+        {
+          int j = count++;
+          while (j > 0 && t[order[j - 1]] < t[i])
+          {
+            order[j] = order[j - 1];
+            j -= 1;
+          }
+          order[j] = i;
+        }
+      }
+
+      for(int i = 0; i < count; ++i)
+      {
+        stack[stack_size++] = Entry{ node.child[order[i]], t[order[i]] };
+      }
+    }
+  }
+
+  return found;
+}
+
+/* EOF */
@@ -0,0 +1,118 @@
+#ifndef HEADER_TRIANGLE_BVH_HPP
+#define HEADER_TRIANGLE_BVH_HPP
+
+#include <limits>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "aabb.hpp"
+
+struct Ray
+{
+  glm::vec3 origin;
+  glm::vec3 direction;
+};
+
+/** Closest intersection found so far, only hits closer than
+    \a distance are accepted, so one RayHit can be passed through
+    several raycasts. \a distance is measured in multiples of the ray
+    direction. */
+struct RayHit
+{
+  float distance = std::numeric_limits<float>::infinity();
+  int triangle = -1;
+  float u = 0.0f;
+  float v = 0.0f;
+};
+
+/** Bounding volume hierarchy over a triangle list for ray casting.
+
+    Every node holds the bounds of four children as structure of
+    arrays and every leaf is a packet of up to four triangles, so a
+    ray is tested against four boxes or four triangles at a time with
+    SSE2. The triangles are stored as one vertex and two edges, that
+    is the only copy of the geometry the BVH keeps. */
+class TriangleBVH
+{
+public:
+  static const int LEAF_SIZE = 4;
+
+private:
+  struct Node
+  {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+
+    /** >= 0 is a child node, < 0 is the leaf packet ~child, EMPTY
+        marks an unused slot with empty bounds */
+    int child[4];
+  };
+
+  struct Packet
+  {
+    float v0_x[4], v0_y[4], v0_z[4];
+    float e1_x[4], e1_y[4], e1_z[4];
+    float e2_x[4], e2_y[4], e2_z[4];
+
+    /** index of the triangle in the source index list, -1 for padding */
+    int triangle[4];
+  };
+
+  struct BuildTriangle
+  {
+    AABB bounds;
+    glm::vec3 centroid;
+    int index;
+  };
+
+  struct BuildNode
+  {
+    AABB bounds;
+    int left;
+    int right;
+    int begin;
+    int end;
+
+    bool is_leaf() const { return left < 0; }
+  };
+
+  static const int EMPTY;
+
+private:
+  std::vector<Node> m_nodes;
+  std::vector<Packet> m_packets;
+  AABB m_bounding_box;
+  int m_triangle_count;
+
+public:
+  /** \a indices are triangles, three per triangle */
+  TriangleBVH(std::vector<glm::vec3> const& positions, std::vector<int> const& indices);
+
+  /** Returns true and updates \a hit when the ray hits a triangle
+      closer than hit.distance, both faces of a triangle count */
+  bool raycast(Ray const& ray, RayHit& hit) const;
+
+  AABB const& get_bounding_box() const { return m_bounding_box; }
+  int get_triangle_count() const { return m_triangle_count; }
+  int get_node_count() const { return static_cast<int>(m_nodes.size()); }
+
+private:
+  int build(std::vector<BuildTriangle>& triangles, std::vector<BuildNode>& nodes,
+            int begin, int end, int depth);
+  int flatten(std::vector<BuildNode> const& build_nodes, std::vector<BuildTriangle> const& triangles,
+              std::vector<glm::vec3> const& positions, std::vector<int> const& indices,
+              int build_node);
+  int add_packet(std::vector<BuildTriangle> const& triangles,
+                 std::vector<glm::vec3> const& positions, std::vector<int> const& indices,
+                 int begin, int end);
+
+private:
+  TriangleBVH(const TriangleBVH&) = delete;
+  TriangleBVH& operator=(const TriangleBVH&) = delete;
+};
+
+#endif
+
+/* EOF */
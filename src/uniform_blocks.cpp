@@ -0,0 +1,142 @@
+#include "uniform_blocks.hpp"
+
+#include "camera.hpp"
+#include "render_stats.hpp"
+#include "uniform_ring_buffer.hpp"
+
+namespace {
+
+// room for a few thousand objects before the buffer is orphaned
+GLsizeiptr const RING_BUFFER_SIZE = 1024 * 1024;
+
+} // namespace
+
+UniformBlocks::UniformBlocks() :
+  m_buffer(),
+  m_frame(),
+  m_view(),
+  m_lights(),
+  m_frame_set(false),
+  m_view_set(false),
+  m_lights_set(false)
+{
+}
+
+UniformBlocks::~UniformBlocks()
+{
+}
+
+void
+UniformBlocks::bind_blocks(GLuint program)
+{
+#ifndef HAVE_OPENGLES2
+  struct { char const* name; GLuint binding; } const blocks[] = {
+    { "FrameBlock", FRAME_BINDING },
+    { "ViewBlock", VIEW_BINDING },
+    { "ObjectBlock", OBJECT_BINDING },
+    { "LightBlock", LIGHT_BINDING }
+  };
+
+  for(auto const& block : blocks)
+  {
+    GLuint const index = glGetUniformBlockIndex(program, block.name);
+    if (index != GL_INVALID_INDEX)
+    {
+      glUniformBlockBinding(program, index, block.binding);
+    }
+  }
+#endif
+}
+
+void
+UniformBlocks::set_frame(glm::mat4 const& shadow_matrix, glm::vec4 const& light_world_position)
+{
+  m_frame.shadow_matrix = shadow_matrix;
+  m_frame.light_world_position = light_world_position;
+
+  m_frame_set = true;
+  upload(FRAME_BINDING, &m_frame, sizeof(m_frame));
+}
+
+void
+UniformBlocks::set_view(Camera const& camera, Stereo stereo)
+{
+  m_view.view_matrix = camera.get_view_matrix();
+  m_view.projection_matrix = camera.get_projection_matrix();
+  m_view.light_position = m_view.view_matrix * m_frame.light_world_position;
+  m_view.eye_index = (stereo == Stereo::Right) ? 1 : 0;
+
+  m_view_set = true;
+  upload(VIEW_BINDING, &m_view, sizeof(m_view));
+}
+
+void
+UniformBlocks::set_object(glm::mat4 const& model_matrix)
+{
+  ObjectBlock block;
+  block.model_matrix = model_matrix;
+  block.model_view_matrix = m_view.view_matrix * model_matrix;
+  glm::mat3 const normal_matrix(block.model_view_matrix);
+  for(int i = 0; i < 3; ++i)
+  {
+    block.normal_matrix[i] = glm::vec4(normal_matrix[i], 0.0f);
+  }
+  block.mvp = m_view.projection_matrix * block.model_view_matrix;
+
+  upload(OBJECT_BINDING, &block, sizeof(block));
+}
+
+void
+UniformBlocks::set_lights(LightBlock const& block)
+{
+  m_lights = block;
+  m_lights_set = true;
+  upload(LIGHT_BINDING, &m_lights, sizeof(m_lights));
+}
+
+void
+UniformBlocks::upload(GLuint binding, void const* data, GLsizeiptr size)
+{
+#ifndef HAVE_OPENGLES2
+  if (!m_buffer)
+  {
+    m_buffer = std::make_unique<UniformRingBuffer>(RING_BUFFER_SIZE);
+  }
+
+  unsigned int const generation = m_buffer->get_generation();
+  m_buffer->upload(binding, data, size);
+  g_render_stats.uniform_block_uploads += 1;
+
+  if (m_buffer->get_generation() != generation)
+  {
+    restore(binding);
+  }
+#endif
+}
+
+void
+UniformBlocks::restore(GLuint skip_binding)
+{
+#ifndef HAVE_OPENGLES2
+  // the blocks that outlive a single draw were bound into the orphaned
+  // storage, the ring buffer is far larger than them, so this can't
+  // orphan again
+  if (m_frame_set && skip_binding != FRAME_BINDING)
+  {
+    m_buffer->upload(FRAME_BINDING, &m_frame, sizeof(m_frame));
+    g_render_stats.uniform_block_uploads += 1;
+  }
+  if (m_view_set && skip_binding != VIEW_BINDING)
+  {
+    m_buffer->upload(VIEW_BINDING, &m_view, sizeof(m_view));
+    g_render_stats.uniform_block_uploads += 1;
+  }
+  if (m_lights_set && skip_binding != LIGHT_BINDING)
+  {
+    m_buffer->upload(LIGHT_BINDING, &m_lights, sizeof(m_lights));
+    g_render_stats.uniform_block_uploads += 1;
+  }
+#endif
+}
+
+/* EOF */
@@ -0,0 +1,98 @@
+#ifndef HEADER_UNIFORM_BLOCKS_HPP
+#define HEADER_UNIFORM_BLOCKS_HPP
+
+#include <memory>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "stereo.hpp"
+
+class Camera;
+class UniformRingBuffer;
+
+/** Host side of the std140 blocks in data/glsl/blocks.glsl, member
+    order and padding have to match the GLSL declarations */
+struct FrameBlock
+{
+  glm::mat4 shadow_matrix;
+  glm::vec4 light_world_position;
+};
+
+struct ViewBlock
+{
+  glm::mat4 view_matrix;
+  glm::mat4 projection_matrix;
+  glm::vec4 light_position;
+  int eye_index;
+  int padding[3];
+};
+
+/** Parameters of the LightClusters grid, per view */
+struct LightBlock
+{
+  glm::vec4 cluster_params; // depth slice scale and bias
+  glm::ivec4 cluster_size; // grid size and number of lights
+};
+
+struct ObjectBlock
+{
+  glm::mat4 model_matrix;
+  glm::mat4 model_view_matrix;
+  glm::vec4 normal_matrix[3]; // mat3 columns are padded to vec4 in std140
+  glm::mat4 mvp;
+};
+
+/** Uploads the per-frame, per-view and per-object uniforms that are
+    shared by every program into a UniformRingBuffer, each kind of
+    block has its own binding point. Programs get their blocks
+    connected to those binding points when they are linked. Does
+    nothing on GLES2, where the materials set the same names as plain
+    uniforms. */
+class UniformBlocks
+{
+public:
+  static UniformBlocks& get()
+  {
+    static UniformBlocks instance;
+    return instance;
+  }
+
+  enum { FRAME_BINDING = 0, VIEW_BINDING = 1, OBJECT_BINDING = 2, LIGHT_BINDING = 3 };
+
+  /** Connects the blocks used by \a program to the binding points */
+  static void bind_blocks(GLuint program);
+
+private:
+  std::unique_ptr<UniformRingBuffer> m_buffer;
+  FrameBlock m_frame;
+  ViewBlock m_view;
+  LightBlock m_lights;
+
+  // which of the above were uploaded, they are uploaded again when the
+  // ring buffer orphans the storage they are bound to
+  bool m_frame_set;
+  bool m_view_set;
+  bool m_lights_set;
+
+public:
+  UniformBlocks();
+  ~UniformBlocks();
+
+  void set_frame(glm::mat4 const& shadow_matrix, glm::vec4 const& light_world_position);
+  void set_view(Camera const& camera, Stereo stereo);
+  void set_object(glm::mat4 const& model_matrix);
+  void set_lights(LightBlock const& block);
+
+private:
+  void upload(GLuint binding, void const* data, GLsizeiptr size);
+  void restore(GLuint skip_binding);
+
+private:
+  UniformBlocks(const UniformBlocks&) = delete;
+  UniformBlocks& operator=(const UniformBlocks&) = delete;
+};
+
+#endif
+
+/* EOF */
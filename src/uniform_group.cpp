@@ -18,57 +18,133 @@
 
 #include "log.hpp"
 #include "render_context.hpp"
+#include "render_stats.hpp"
 
-void
-Uniform<UniformSymbol>::apply(ProgramPtr prog, RenderContext const& ctx)
+namespace {
+
+void apply_symbol(Program& prog, GLint loc, UniformSymbol symbol, RenderContext const& ctx)
 {
-  assert_gl("Uniform<UniformSymbol>::apply:enter");
-  switch(m_value)
+  switch(symbol)
   {
     case UniformSymbol::NormalMatrix:
-      prog->set_uniform(m_name, glm::mat3(ctx.get_view_matrix() * ctx.get_model_matrix()));
+      prog.set_uniform(loc, glm::mat3(ctx.get_view_matrix() * ctx.get_model_matrix()));
       break;
 
     case UniformSymbol::ViewMatrix:
-      prog->set_uniform(m_name, ctx.get_view_matrix());
+      prog.set_uniform(loc, ctx.get_view_matrix());
       break;
 
     case UniformSymbol::ModelMatrix:
-      prog->set_uniform(m_name, ctx.get_model_matrix());
+      prog.set_uniform(loc, ctx.get_model_matrix());
       break;
 
     case UniformSymbol::ModelViewMatrix:
-      prog->set_uniform(m_name, ctx.get_view_matrix() * ctx.get_model_matrix());
+      prog.set_uniform(loc, ctx.get_view_matrix() * ctx.get_model_matrix());
       break;
 
     case UniformSymbol::ProjectionMatrix:
-      prog->set_uniform(m_name, ctx.get_projection_matrix());
+      prog.set_uniform(loc, ctx.get_projection_matrix());
       break;
 
     case UniformSymbol::ModelViewProjectionMatrix:
-      prog->set_uniform(m_name, ctx.get_projection_matrix() * ctx.get_view_matrix() * ctx.get_model_matrix());
+      prog.set_uniform(loc, ctx.get_projection_matrix() * ctx.get_view_matrix() * ctx.get_model_matrix());
       break;
 
     default:
-      log_error("unknown UniformSymbol %d", static_cast<int>(m_value));
+      log_error("unknown UniformSymbol %d", static_cast<int>(symbol));
       break;
   }
-  assert_gl("Uniform<UniformSymbol>::apply:exit");
+}
+
+class ApplyVisitor
+{
+private:
+  ProgramPtr const& m_prog;
+  RenderContext const& m_ctx;
+  std::string const& m_name;
+  GLint m_loc;
+
+public:
+  ApplyVisitor(ProgramPtr const& prog, RenderContext const& ctx, std::string const& name, GLint loc) :
+    m_prog(prog),
+    m_ctx(ctx),
+    m_name(name),
+    m_loc(loc)
+  {}
+
+  template<typename T>
+  void operator()(T const& value) const
+  {
+    if (m_loc != -1)
+    {
+      m_prog->set_uniform(m_loc, value);
+      g_render_stats.uniform_calls += 1;
+    }
+  }
+
+  void operator()(UniformSymbol symbol) const
+  {
+    if (m_loc != -1)
+    {
+      apply_symbol(*m_prog, m_loc, symbol, m_ctx);
+      g_render_stats.uniform_calls += 1;
+    }
+  }
+
+  void operator()(UniformCallback const& callback) const
+  {
+    callback(m_prog, m_name, m_ctx);
+  }
+};
+
+} // namespace
+
+UniformGroup::Record*
+UniformGroup::find(std::string_view name)
+{
+  for(auto& record : m_records)
+  {
+    if (record.name == name)
+    {
+      return &record;
+    }
+  }
+  return nullptr;
+}
+
+UniformValue const*
+UniformGroup::get_uniform(std::string_view name) const
+{
+  for(auto const& record : m_records)
+  {
+    if (record.name == name)
+    {
+      return &record.value;
+    }
+  }
+  return nullptr;
 }
 
 void
-Uniform<UniformCallback>::apply(ProgramPtr prog, RenderContext const& ctx)
+UniformGroup::add(std::string_view name, UniformValue value)
 {
-  m_value(prog, m_name, ctx);
+  m_records.push_back(Record{ std::string(name), std::move(value), 0, -1 });
+  g_render_stats.uniform_allocations += 1;
 }
 
 void
-UniformGroup::apply(ProgramPtr prog, RenderContext const& ctx)
+UniformGroup::apply(ProgramPtr const& prog, RenderContext const& ctx)
 {
   assert_gl("apply:enter");
-  for(auto& uniform_it : m_uniforms)
+  for(auto& record : m_records)
   {
-    uniform_it.second->apply(prog, ctx);
+    if (record.program_uid != prog->get_uid())
+    {
+      record.program_uid = prog->get_uid();
+      record.location = prog->get_uniform_location(record.name);
+    }
+
+    std::visit(ApplyVisitor(prog, ctx, record.name, record.location), record.value);
   }
   assert_gl("apply:exit");
 }
@@ -18,14 +18,14 @@
 #define HEADER_UNIFORM_GROUP_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <functional>
-#include <unordered_map>
-#include <tuple>
+#include <variant>
 
 #include "program.hpp"
 
@@ -41,89 +41,61 @@ enum class UniformSymbol {
     ModelViewProjectionMatrix
     };
 
-class UniformBase
-{
-protected:
-  std::string m_name;
+typedef std::function<void (ProgramPtr prog, const std::string& name, RenderContext const& ctx)> UniformCallback;
 
-public:
-  UniformBase(const std::string& name) :
-    m_name(name)
-  {}
-  virtual ~UniformBase() {}
+typedef std::variant<int, unsigned int, float,
+                     glm::vec2, glm::vec3, glm::vec4,
+                     glm::ivec2, glm::ivec3, glm::ivec4,
+                     glm::mat3, glm::mat4,
+                     UniformSymbol, UniformCallback> UniformValue;
 
-  std::string get_name() const { return m_name; }
-  virtual void apply(ProgramPtr prog, RenderContext const& ctx) = 0;
-};
-
-template<typename T>
-class Uniform : public UniformBase
+/** The uniforms of a Material, stored by value in one flat array.
+    Setting an existing uniform overwrites the value in place and
+    apply() doesn't touch the heap, so only adding a new name
+    allocates. */
+class UniformGroup
 {
 private:
-  T m_value;
-
-public:
-  Uniform(const std::string& name, T const& value) :
-    UniformBase(name),
-    m_value(value)
-  {}
-
-  void apply(ProgramPtr prog, RenderContext const& ctx)
+  struct Record
   {
-    prog->set_uniform(m_name, m_value);
-  }
-};
+    std::string name;
+    UniformValue value;
 
-template<>
-class Uniform<UniformSymbol> : public UniformBase
-{
-private:
-  UniformSymbol m_value;
-
-public:
-  Uniform(const std::string& name, UniformSymbol const& value) :
-    UniformBase(name),
-    m_value(value)
-  {}
+    // location in the program that was last applied to
+    unsigned int program_uid;
+    GLint location;
+  };
 
-  void apply(ProgramPtr prog, RenderContext const& ctx);
-};
-
-typedef std::function<void (ProgramPtr prog, const std::string& name, RenderContext const& ctx)> UniformCallback;
-
-template<>
-class Uniform<UniformCallback> : public UniformBase
-{
 private:
-  UniformCallback m_value;
-
-public:
-  Uniform(const std::string& name, UniformCallback const& value) :
-    UniformBase(name),
-    m_value(value)
-  {}
-
-  void apply(ProgramPtr prog, RenderContext const& ctx);
-};
-
-class UniformGroup
-{
-private:
-  std::unordered_map<std::string, std::unique_ptr<UniformBase> > m_uniforms;
+  std::vector<Record> m_records;
 
 public:
   UniformGroup() :
-    m_uniforms()
+    m_records()
   {}
 
   template<typename T>
-  void set_uniform(const std::string& name, T const& value)
+  void set_uniform(std::string_view name, T const& value)
   {
-    // FIXME: reallocating the uniform each time is not such a good idea
-    m_uniforms[name] = std::make_unique<Uniform<T> >(name, value);
+    if (Record* record = find(name))
+    {
+      record->value = value;
+    }
+    else
+    {
+      add(name, UniformValue(value));
+    }
   }
 
-  void apply(ProgramPtr prog, RenderContext const& ctx);
+  /** Returns nullptr when \a name wasn't set */
+  UniformValue const* get_uniform(std::string_view name) const;
+  int get_uniform_count() const { return static_cast<int>(m_records.size()); }
+
+  void apply(ProgramPtr const& prog, RenderContext const& ctx);
+
+private:
+  Record* find(std::string_view name);
+  void add(std::string_view name, UniformValue value);
 
 private:
   UniformGroup(const UniformGroup&);
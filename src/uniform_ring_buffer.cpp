@@ -0,0 +1,78 @@
+#include "uniform_ring_buffer.hpp"
+
+#include <stdexcept>
+#include <string.h>
+
+#include "assert_gl.hpp"
+#include "format.hpp"
+
+UniformRingBuffer::UniformRingBuffer(GLsizeiptr size) :
+  m_buffer(0),
+  m_size(size),
+  m_alignment(256),
+  m_offset(0),
+  m_generation(0)
+{
+#ifndef HAVE_OPENGLES2
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  if (alignment > 0)
+  {
+    m_alignment = alignment;
+  }
+
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  assert_gl("UniformRingBuffer");
+#endif
+}
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+#ifndef HAVE_OPENGLES2
+  glDeleteBuffers(1, &m_buffer);
+#endif
+}
+
+void
+UniformRingBuffer::upload(GLuint binding, void const* data, GLsizeiptr size)
+{
+  if (size > m_size)
+  {
+    throw std::runtime_error(format("UniformRingBuffer: block of %d bytes doesn't fit into %d",
+                                    static_cast<int>(size), static_cast<int>(m_size)));
+  }
+
+#ifndef HAVE_OPENGLES2
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+
+  GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+  if (m_offset + size > m_size)
+  {
+    // orphan the storage, draws still in flight keep the old one
+    glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+    m_offset = 0;
+    m_generation += 1;
+  }
+
+  void* dst = glMapBufferRange(GL_UNIFORM_BUFFER, m_offset, size, access);
+  if (!dst)
+  {
+    throw std::runtime_error("UniformRingBuffer: glMapBufferRange() failed");
+  }
+  memcpy(dst, data, size);
+  glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, m_offset, size);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  m_offset += (size + m_alignment - 1) / m_alignment * m_alignment;
+
+  assert_gl("UniformRingBuffer::upload");
+#endif
+}
+
+/* EOF */
@@ -0,0 +1,48 @@
+#ifndef HEADER_UNIFORM_RING_BUFFER_HPP
+#define HEADER_UNIFORM_RING_BUFFER_HPP
+
+#include <stddef.h>
+
+#include "opengl.hpp"
+
+/** A single GL_UNIFORM_BUFFER that uniform block data is streamed
+    into. Every upload goes to a fresh, suitably aligned range, so the
+    driver never has to wait for draws that still read the previous
+    data. When the end is reached the storage is orphaned and writing
+    starts over at the beginning, ranges bound before that point into
+    the old storage and have to be uploaded again, see
+    get_generation().
+
+    GLES2 has no uniform buffers, there the buffer is never created
+    and upload() does nothing. */
+class UniformRingBuffer
+{
+private:
+  GLuint m_buffer;
+  GLsizeiptr m_size;
+  GLintptr m_alignment;
+  GLintptr m_offset;
+  unsigned int m_generation;
+
+public:
+  UniformRingBuffer(GLsizeiptr size);
+  ~UniformRingBuffer();
+
+  /** Copies \a size bytes from \a data into the buffer and binds the
+      range to the uniform block binding point \a binding */
+  void upload(GLuint binding, void const* data, GLsizeiptr size);
+
+  /** Counts the orphans, a change means that earlier ranges are gone */
+  unsigned int get_generation() const { return m_generation; }
+
+  GLuint get_id() const { return m_buffer; }
+  GLsizeiptr get_size() const { return m_size; }
+
+private:
+  UniformRingBuffer(const UniformRingBuffer&) = delete;
+  UniformRingBuffer& operator=(const UniformRingBuffer&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,212 @@
+#include "upload_thread.hpp"
+
+#include "log.hpp"
+#include "stopwatch.hpp"
+
+UploadThread::UploadThread() :
+  m_thread(),
+  m_mutex(),
+  m_cond(),
+  m_finished_cond(),
+  m_queue(),
+  m_finished(),
+  m_quit(false),
+  m_window(nullptr),
+  m_context(nullptr),
+  m_fenced(),
+  m_in_flight(0),
+  m_uploads(0),
+  m_upload_msec(0.0f)
+{
+}
+
+UploadThread::~UploadThread()
+{
+  if (m_thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+  }
+}
+
+bool
+UploadThread::start(SDL_Window* window, SDL_GLContext context)
+{
+#ifdef HAVE_OPENGLES2
+  log_info("upload thread: not available with GLES2");
+  return false;
+#else
+  if (m_thread.joinable())
+  {
+    return true;
+  }
+
+  // creating a context makes it current, the main one is restored below
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  m_context = SDL_GL_CreateContext(window);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+  SDL_GL_MakeCurrent(window, context);
+
+  if (!m_context)
+  {
+    log_error("upload thread: couldn't create shared context: %s", SDL_GetError());
+    return false;
+  }
+
+  m_window = window;
+  m_thread = std::thread([this]{ thread_main(); });
+  return true;
+#endif
+}
+
+void
+UploadThread::submit(Task upload, Task done)
+{
+  m_in_flight += 1;
+
+  Item item;
+  item.upload = std::move(upload);
+  item.done = std::move(done);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(std::move(item));
+  }
+  m_cond.notify_one();
+}
+
+void
+UploadThread::thread_main()
+{
+#ifndef HAVE_OPENGLES2
+  if (SDL_GL_MakeCurrent(m_window, m_context) != 0)
+  {
+    log_error("upload thread: couldn't make the context current: %s", SDL_GetError());
+  }
+
+  while(true)
+  {
+    Item item;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]{ return m_quit || !m_queue.empty(); });
+      if (m_quit)
+      {
+        break;
+      }
+
+      item = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+
+    Stopwatch stopwatch;
+    try
+    {
+      item.upload();
+    }
+    catch(std::exception const& err)
+    {
+      log_error("upload thread: %s", err.what());
+    }
+
+    // without the flush the fence might never reach the GPU, the GL
+    // thread only waits on it, it can't flush this context
+    item.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    float const msec = stopwatch.get_msec();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_finished.push_back(std::move(item));
+      m_uploads += 1;
+      m_upload_msec += msec;
+    }
+    m_finished_cond.notify_all();
+  }
+
+  SDL_GL_MakeCurrent(m_window, nullptr);
+  SDL_GL_DeleteContext(m_context);
+  m_context = nullptr;
+#endif
+}
+
+void
+UploadThread::update()
+{
+#ifndef HAVE_OPENGLES2
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while(!m_finished.empty())
+    {
+      m_fenced.push_back(std::move(m_finished.front()));
+      m_finished.pop_front();
+    }
+  }
+
+  // the uploads finish in order, the first unfinished one ends the check
+  while(!m_fenced.empty())
+  {
+    GLenum const status = glClientWaitSync(m_fenced.front().fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+      break;
+    }
+    else if (status == GL_WAIT_FAILED)
+    {
+      log_error("upload thread: glClientWaitSync() failed");
+    }
+
+    // done() may submit more work
+    Item item = std::move(m_fenced.front());
+    m_fenced.pop_front();
+    m_in_flight -= 1;
+
+    glDeleteSync(item.fence);
+    if (item.done)
+    {
+      item.done();
+    }
+  }
+#endif
+}
+
+void
+UploadThread::finish()
+{
+#ifndef HAVE_OPENGLES2
+  while(m_in_flight > 0)
+  {
+    update();
+
+    if (!m_fenced.empty())
+    {
+      // one second, in nanoseconds
+      glClientWaitSync(m_fenced.front().fence, 0, 1000 * 1000 * 1000);
+    }
+    else if (m_in_flight > 0)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_finished_cond.wait(lock, [this]{ return !m_finished.empty(); });
+    }
+  }
+#endif
+}
+
+int
+UploadThread::get_uploads()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_uploads;
+}
+
+float
+UploadThread::get_upload_msec()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_upload_msec;
+}
+
+/* EOF */
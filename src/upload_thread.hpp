@@ -0,0 +1,105 @@
+#ifndef HEADER_UPLOAD_THREAD_HPP
+#define HEADER_UPLOAD_THREAD_HPP
+
+#include <SDL.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "opengl.hpp"
+
+/** Runs buffer and texture uploads on a thread with its own GL context
+    that shares objects with the main one, so that glBufferData() and
+    glTexImage2D() of large objects don't stall the frame. After each
+    upload the thread puts a fence into its command stream, update()
+    hands the object back to the GL thread once the fence has passed.
+
+    Objects that are used before they are handed back may show old or
+    partial content. Bindings of the GL thread must be refreshed after
+    the hand over, GL only guarantees that changes made in another
+    context are seen by objects bound after the fence.
+
+    Optional, see start(). Desktop GL only, GLES2 has no fences. */
+class UploadThread
+{
+public:
+  static UploadThread& get()
+  {
+    static UploadThread instance;
+    return instance;
+  }
+
+  typedef std::function<void ()> Task;
+
+private:
+  struct Item
+  {
+    Task upload;
+    Task done;
+#ifndef HAVE_OPENGLES2
+    GLsync fence = nullptr;
+#endif
+  };
+
+private:
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cond; // work for the thread
+  std::condition_variable m_finished_cond; // an upload finished
+  std::deque<Item> m_queue;
+  std::deque<Item> m_finished;
+  bool m_quit;
+
+  SDL_Window* m_window;
+  SDL_GLContext m_context;
+
+  // only touched by the GL thread
+  std::deque<Item> m_fenced;
+  int m_in_flight;
+
+  // guarded by m_mutex
+  int m_uploads;
+  float m_upload_msec;
+
+public:
+  UploadThread();
+  ~UploadThread();
+
+  /** Creates the shared context for \a window and starts the thread,
+      \a context must be current on the calling thread. Returns false
+      when the context can't be created, uploads then have to happen on
+      the GL thread. */
+  bool start(SDL_Window* window, SDL_GLContext context);
+  bool is_running() const { return m_thread.joinable(); }
+
+  /** Runs \a upload on the upload thread, then \a done on the GL thread
+      in update() once the GPU has finished the upload. \a upload must
+      not touch OpenGLStateTracker, it belongs to the main context. */
+  void submit(Task upload, Task done);
+
+  /** Calls the done tasks of finished uploads, without waiting for
+      unfinished ones. Must be called once per frame on the GL thread. */
+  void update();
+
+  /** Blocks until every upload submitted so far is handed back */
+  void finish();
+
+  /** Uploads submitted and not yet handed back */
+  int get_in_flight() const { return m_in_flight; }
+
+  int get_uploads();
+  float get_upload_msec();
+
+private:
+  void thread_main();
+
+private:
+  UploadThread(const UploadThread&) = delete;
+  UploadThread& operator=(const UploadThread&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -41,12 +41,22 @@
 #include "model.hpp"
 #include "opengl_state.hpp"
 #include "program.hpp"
+#include "program_registry.hpp"
+#include "program_cache.hpp"
 #include "render_context.hpp"
+#include "render_stats.hpp"
+#include "residency_manager.hpp"
 #include "scene.hpp"
 #include "scene_manager.hpp"
+#include "shader_source_manager.hpp"
 #include "shader.hpp"
+#include "stopwatch.hpp"
 #include "system.hpp"
+#include "task_scheduler.hpp"
 #include "text_surface.hpp"
+#include "texture_cache.hpp"
+#include "texture_loader.hpp"
+#include "upload_thread.hpp"
 #include "renderbuffer.hpp"
 
 namespace {
@@ -57,9 +67,9 @@ void print_scene_graph(SceneNode* node, int depth = 0)
             << ": " << node->get_position()
             << " " << node->get_scale()
             << " " << node->get_orientation() << std::endl;
-  for(auto const& child : node->get_children())
+  for(SceneNode* child : node->get_children())
   {
-    print_scene_graph(child.get(), depth+1);
+    print_scene_graph(child, depth+1);
   }
 }
 
@@ -82,6 +92,24 @@ Viewer::on_keyboard_event(SDL_KeyboardEvent key)
       m_cfg.m_show_calibration = !m_cfg.m_show_calibration;
       break;
 
+    case SDL_SCANCODE_F5:
+      // report shader programs that are out of date with their files
+      try
+      {
+        for(auto const& filename : ShaderSourceManager::get().poll_changes())
+        {
+          for(auto const& program : ProgramRegistry::get().get_affected(filename))
+          {
+            log_info("%s changed, program needs rebuilding: %s", filename, program);
+          }
+        }
+      }
+      catch(std::exception const& err)
+      {
+        log_error("shader changes: %s", err.what());
+      }
+      break;
+
     case SDL_SCANCODE_ESCAPE:
       exit(EXIT_SUCCESS);
       break;
@@ -126,7 +154,7 @@ Viewer::on_keyboard_event(SDL_KeyboardEvent key)
         clip_plane[2] = (rand() / double(RAND_MAX) - 0.5) * 2.0f;
         clip_plane[3] = (rand() / double(RAND_MAX) - 0.5) * 2.0f;
 
-        glEnable(GL_CLIP_PLANE0);
+        OpenGLStateTracker::get().enable(GL_CLIP_PLANE0);
         glClipPlane(GL_CLIP_PLANE0, clip_plane);
       }
       break;
@@ -135,7 +163,7 @@ Viewer::on_keyboard_event(SDL_KeyboardEvent key)
       {
         GLdouble clip_plane[] = { 0.0, 1.0, 1.0, 0.0 };
         glClipPlane(GL_CLIP_PLANE0, clip_plane);
-        glEnable(GL_CLIP_PLANE0);
+        OpenGLStateTracker::get().enable(GL_CLIP_PLANE0);
       }
       break;
 #endif
@@ -267,8 +295,7 @@ Viewer::init_scene(std::vector<std::string> const& model_filenames)
     material->enable(GL_CULL_FACE);
     material->enable(GL_DEPTH_TEST);
     material->set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
-    material->set_program(Program::create(Shader::from_file(GL_VERTEX_SHADER, g_datadir + "/glsl/shadowmap.vert"),
-                                          Shader::from_file(GL_FRAGMENT_SHADER, g_datadir + "/glsl/shadowmap.frag")));
+    material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/shadowmap.vert", g_datadir + "/glsl/shadowmap.frag"));
     m_scene_manager->set_override_material(material);
   }
 #endif
@@ -276,7 +303,7 @@ Viewer::init_scene(std::vector<std::string> const& model_filenames)
   // build a scene
   for(auto const& model_filename : model_filenames)
   {
-    auto node = Scene::from_file(model_filename);
+    auto node = Scene::from_file(model_filename, m_cfg.m_picking);
 
     std::cout << "SceneGraph(" << model_filename << "):\n";
     print_scene_graph(node.get());
@@ -297,6 +324,24 @@ Viewer::init_scene(std::vector<std::string> const& model_filenames)
   }
 #endif
 
+  // scatter test lights over the area the rooms and cars occupy
+  for(int i = 0; i < m_cfg.m_num_lights; ++i)
+  {
+    LightPtr light = m_scene_manager->create_light();
+    light->set_position(glm::linearRand(glm::vec3(-40.0f, 0.0f, -40.0f), glm::vec3(40.0f, 10.0f, 40.0f)));
+    light->set_radius(glm::linearRand(2.0f, 8.0f));
+    light->set_diffuse(glm::vec4(glm::linearRand(glm::vec3(0.2f), glm::vec3(1.0f)), 1.0f));
+  }
+
+  {
+    Stopwatch stopwatch;
+    m_scene_manager->get_world()->update_transform();
+    log_info("scene graph: %d nodes in %d pool allocations, traversal: %sms",
+             SceneNodePool::get().get_node_count(),
+             SceneNodePool::get().get_allocation_count(),
+             stopwatch.get_msec());
+  }
+
   m_dot_surface = TextSurface::create("+", TextProperties().set_line_width(3.0f));
 
   init_menu();
@@ -355,6 +400,9 @@ Viewer::init_menu()
 
   m_menu->add_item("shadowmap.fov", &m_cfg.m_shadowmap_fov, 1.0f);
 
+  m_menu->add_item("occlusion_culling", &m_cfg.m_occlusion_culling);
+  m_menu->add_item("picking", &m_cfg.m_picking);
+
   m_menu->add_item("FOV", &m_cfg.m_fov, 0.05f);
 #if 0
   m_menu->add_item("Barrel Power", &m_barrel_power, 0.01f);
@@ -762,6 +810,7 @@ void
 Viewer::main_loop(Window& window, GameController& gamecontroller)
 {
   int num_frames = 0;
+  bool first_frame = true;
   unsigned int start_ticks = SDL_GetTicks();
 
   int ticks = SDL_GetTicks();
@@ -771,9 +820,20 @@ Viewer::main_loop(Window& window, GameController& gamecontroller)
     int delta = next - ticks;
     ticks = next;
 
+    UploadThread::get().update();
+    TextureLoader::get().update();
+    ResidencyManager::get().update();
+
     m_compositor->render(*this);
     window.swap();
 
+    if (first_frame)
+    {
+      // deferred shader programs are finished during the first frame
+      log_info("first frame: %sms waiting for shader programs", Program::get_wait_msec());
+      first_frame = false;
+    }
+
     SDL_Delay(1);
 
     process_events(window, gamecontroller);
@@ -804,6 +864,10 @@ Viewer::main_loop(Window& window, GameController& gamecontroller)
                 << " fps: " << static_cast<float>(num_frames) / static_cast<float>(t) * 1000.0f
                 << std::endl;
 
+      g_render_stats.frames = num_frames;
+      g_render_stats.print(std::cout);
+      g_render_stats.reset();
+
       num_frames = 0;
       start_ticks = SDL_GetTicks();
     }
@@ -816,6 +880,27 @@ Viewer::main_loop(Window& window, GameController& gamecontroller)
   }
 }
 
+void
+Viewer::update_hover(Camera const& camera)
+{
+  glm::vec3 const direction = glm::inverse(camera.get_orientation()) * glm::vec3(0.0f, 0.0f, -1.0f);
+  SceneManager::RaycastResult const hover = m_scene_manager->raycast(camera.get_position(), direction);
+
+  if (hover.node != m_hover.node || hover.triangle != m_hover.triangle)
+  {
+    if (hover.node)
+    {
+      log_info("hover: %s, triangle %d, distance %s", hover.node->get_name(), hover.triangle, hover.distance);
+    }
+    else
+    {
+      log_info("hover: nothing");
+    }
+  }
+
+  m_hover = hover;
+}
+
 void
 Viewer::update_offsets(glm::vec2 p1, glm::vec2 p2)
 {
@@ -860,6 +945,59 @@ Viewer::parse_args(int argc, char** argv, Options& opts)
       {
         opts.wiimote = true;
       }
+      else if (strcmp("--lights", argv[i]) == 0)
+      {
+        opts.lights = std::stoi(argv[i+1]);
+        ++i;
+      }
+      else if (strcmp("--threads", argv[i]) == 0)
+      {
+        opts.threads = std::stoi(argv[i+1]);
+        ++i;
+      }
+      else if (strcmp("--picking", argv[i]) == 0)
+      {
+        opts.picking = true;
+      }
+      else if (strcmp("--validate-gl-state", argv[i]) == 0)
+      {
+        opts.validate_gl_state = true;
+      }
+      else if (strcmp("--program-cache", argv[i]) == 0)
+      {
+        opts.program_cache_dir = argv[i+1];
+        ++i;
+      }
+      else if (strcmp("--no-program-cache", argv[i]) == 0)
+      {
+        opts.program_cache = false;
+      }
+      else if (strcmp("--sync-shaders", argv[i]) == 0)
+      {
+        opts.sync_shaders = true;
+      }
+      else if (strcmp("--sync-textures", argv[i]) == 0)
+      {
+        opts.sync_textures = true;
+      }
+      else if (strcmp("--upload-thread", argv[i]) == 0)
+      {
+        opts.upload_thread = true;
+      }
+      else if (strcmp("--mipmaps", argv[i]) == 0)
+      {
+        opts.mipmaps = argv[i+1];
+        ++i;
+        if (opts.mipmaps != "gpu" && opts.mipmaps != "box" && opts.mipmaps != "kaiser")
+        {
+          throw std::runtime_error("expected --mipmaps gpu, box or kaiser, got '" + opts.mipmaps + "'");
+        }
+      }
+      else if (strcmp("--texture-budget", argv[i]) == 0)
+      {
+        opts.texture_budget = std::stoi(argv[i+1]);
+        ++i;
+      }
       else if (strcmp("--video", argv[i]) == 0)
       {
         opts.video.filename = argv[i+1];
@@ -892,6 +1030,17 @@ Viewer::parse_args(int argc, char** argv, Options& opts)
                   << "Options:\n"
                   << "  --datadir DIR      Search for data in DIR\n"
                   << "  --wiimote          Enable Wiimote support\n"
+                  << "  --threads NUM      Number of worker threads, default one per core\n"
+                  << "  --lights NUM       Add NUM random point lights to the scene\n"
+                  << "  --picking          Keep geometry on the CPU and report what is under the crosshair\n"
+                  << "  --validate-gl-state  Check the GL state tracker against the real state, slow\n"
+                  << "  --program-cache DIR  Keep linked shader programs in DIR\n"
+                  << "  --no-program-cache   Always compile shader programs\n"
+                  << "  --sync-shaders     Wait for each shader program at creation instead of on first use\n"
+                  << "  --sync-textures    Load textures before returning instead of in the background\n"
+                  << "  --upload-thread    Upload meshes and textures from a second, shared GL context\n"
+                  << "  --mipmaps MODE     Build mipmaps with 'gpu' (default), 'box' or 'kaiser' filtering\n"
+                  << "  --texture-budget MB  Drop mip levels of unused textures above MB of texture memory\n"
                   << "  --video FILE       Play video\n"
                   << "  --video3d FILE     Play 3D video\n"
                   << "  --video3d-fov H:V  Horizontal and vertical FOV\n";
@@ -917,6 +1066,11 @@ Viewer::main(int argc, char** argv)
 
   g_datadir = opts.datadir;
 
+  if (opts.threads > 0)
+  {
+    TaskScheduler::get().set_num_threads(opts.threads);
+  }
+
   System system = System::create();
   Window window = system.create_gl_window("OpenGL Viewer", m_screen_w, m_screen_h, false, 0);
   //Joystick joystick = system.create_joystick();
@@ -934,6 +1088,30 @@ Viewer::main(int argc, char** argv)
   glBindVertexArray(vao);
 #endif
 
+  OpenGLStateTracker::get().set_validation(opts.validate_gl_state);
+
+  if (opts.upload_thread)
+  {
+    // before anything is loaded, so that all meshes go through it
+    UploadThread::get().start(window.get_sdl_window(), window.get_gl_context());
+  }
+
+  Program::set_deferred(!opts.sync_shaders);
+  TextureLoader::get().set_async(!opts.sync_textures);
+  Texture::set_mipmap_mode(opts.mipmaps == "box" ? Texture::BOX_MIPMAPS :
+                           opts.mipmaps == "kaiser" ? Texture::KAISER_MIPMAPS :
+                           Texture::GPU_MIPMAPS);
+  ResidencyManager::get().set_budget(static_cast<size_t>(opts.texture_budget) * 1024 * 1024);
+  Program::init_parallel_compile();
+
+  ProgramCache::get().set_enabled(opts.program_cache);
+  if (!opts.program_cache_dir.empty())
+  {
+    ProgramCache::get().set_directory(opts.program_cache_dir);
+  }
+
+  Stopwatch startup_stopwatch;
+
   if (opts.wiimote)
   {
     m_wiimote_manager = std::make_unique<WiimoteManager>();
@@ -950,10 +1128,39 @@ Viewer::main(int argc, char** argv)
     init_video_player(opts.video);
   }
 
+  m_cfg.m_picking = opts.picking;
+  m_cfg.m_num_lights = opts.lights;
   init_scene(opts.models);
 
+  log_info("startup: %sms, programs: %d from cache, %d compiled, %sms",
+           startup_stopwatch.get_msec(),
+           ProgramCache::get().get_hits(), ProgramCache::get().get_misses(),
+           ProgramCache::get().get_msec());
+  log_info("shader sources: %d files read", ShaderSourceManager::get().get_reads());
+  log_info("built-in materials: %d of %d built, %sms",
+           MaterialFactory::get().get_built_count(), MaterialFactory::get().get_recipe_count(),
+           MaterialFactory::get().get_build_msec());
+
   std::cout << "main: " << std::this_thread::get_id() << std::endl;
 
+  // the main loop is left through exit()
+  atexit([]{
+      log_info("program registry: %d loads, %d programs built, %d still alive",
+               ProgramRegistry::get().get_loads(), ProgramRegistry::get().get_builds(),
+               ProgramRegistry::get().get_alive());
+      log_info("texture cache: %d hits, %d misses, %sMB saved",
+               TextureCache::get().get_hits(), TextureCache::get().get_misses(),
+               static_cast<float>(TextureCache::get().get_bytes_saved()) / (1024.0f * 1024.0f));
+      log_info("texture residency: %sMB resident, %d evictions, %d reloads",
+               static_cast<float>(Texture::get_total_bytes()) / (1024.0f * 1024.0f),
+               ResidencyManager::get().get_evictions(), ResidencyManager::get().get_reloads());
+      if (UploadThread::get().is_running())
+      {
+        log_info("upload thread: %d uploads, %sms",
+                 UploadThread::get().get_uploads(), UploadThread::get().get_upload_msec());
+      }
+    });
+
   main_loop(window, gamecontroller);
 
   return 0;
@@ -18,6 +18,7 @@
 #include "wiimote_manager.hpp"
 #include "window.hpp"
 
+class Camera;
 class GameController;
 class Compositor;
 
@@ -34,6 +35,17 @@ struct Options
 {
   std::string datadir = "data";
   bool wiimote = false;
+  int threads = 0;
+  bool picking = false;
+  bool validate_gl_state = false;
+  bool program_cache = true;
+  std::string program_cache_dir = {};
+  bool sync_shaders = false;
+  bool sync_textures = false;
+  bool upload_thread = false;
+  std::string mipmaps = "gpu";
+  int texture_budget = 0; // MB, 0 is unlimited
+  int lights = 0;
   VideoOptions video;
   std::vector<std::string> models = {};
 };
@@ -80,6 +92,16 @@ public:
 
   float m_eye_distance = 0.065f;
   float m_convergence = 1.0f;
+
+  bool m_occlusion_culling = true;
+
+  /** raycast along the view direction every frame and report what is
+      under the crosshair, needs the scene loaded with --picking */
+  bool m_picking = false;
+
+  /** random point lights added to the scene, for testing the
+      clustered lighting */
+  int m_num_lights = 0;
 };
 
 class Viewer
@@ -113,6 +135,7 @@ public:
   unsigned int m_hat_autorepeat = 0;
 
   std::unique_ptr<Compositor> m_compositor;
+  SceneManager::RaycastResult m_hover;
   std::vector<std::unique_ptr<Entity> > m_entities;
 
 private:
@@ -134,6 +157,11 @@ private:
   void update_world(float dt);
   void update_offsets(glm::vec2 p1, glm::vec2 p2);
 
+public:
+  void update_hover(Camera const& camera);
+
+private:
+
   void main_loop(Window& window, GameController& gamecontroller);
   void parse_args(int argc, char** argv, Options& opts);
 
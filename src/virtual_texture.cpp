@@ -0,0 +1,270 @@
+#include "virtual_texture.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stdexcept>
+
+#include "assert_gl.hpp"
+#include "format.hpp"
+#include "globals.hpp"
+#include "opengl_state.hpp"
+#include "program_registry.hpp"
+
+// only created by the VirtualTextureManager, which is desktop GL only
+#ifndef HAVE_OPENGLES2
+
+VirtualTexture::VirtualTexture(std::filesystem::path const& filename, int id, int atlas_pages) :
+  m_file(filename),
+  m_page_table(m_file.get_width(), m_file.get_height(), m_file.get_page_size(),
+               m_file.get_levels(), atlas_pages),
+  m_id(id),
+  m_atlas(),
+  m_indirection(),
+  m_feedback_material(),
+  m_requests(),
+  m_reading(),
+  m_failed(),
+  m_cache(),
+  m_cache_index(),
+  m_cache_bytes(0),
+  m_indirection_buffer()
+{
+  // the feedback has a byte per page coordinate
+  if (m_file.get_pages_x(0) > 256 || m_file.get_pages_y(0) > 256)
+  {
+    throw std::runtime_error(format("%s: more than 256 pages along a side", filename));
+  }
+
+  int const atlas_size = atlas_pages * m_file.get_padded_size();
+  m_atlas = Texture::create_empty(GL_TEXTURE_2D, (m_file.get_bytes_per_pixel() == 4) ? GL_RGBA8 : GL_RGB8,
+                                  atlas_size, atlas_size);
+
+  OpenGLState state;
+
+  m_indirection = Texture::create_handle(GL_TEXTURE_2D);
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, m_indirection->get_id());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_file.get_levels() - 1);
+  for(int level = 0; level < m_file.get_levels(); ++level)
+  {
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8,
+                 m_page_table.get_indirection_width(level), m_page_table.get_indirection_height(level), 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+  m_indirection->set_storage(static_cast<size_t>(m_page_table.get_indirection_width(0)) *
+                             m_page_table.get_indirection_height(0) * 4,
+                             m_file.get_levels());
+  assert_gl("VirtualTexture::VirtualTexture");
+
+  // the single page of the coarsest level is what everything falls
+  // back to, it is there from the start
+  int const top = m_file.get_levels() - 1;
+  uint32_t const top_key = PageTable::make_key(top, 0, 0);
+  std::vector<uint8_t> pixels;
+  read_page(top_key, pixels);
+  add_page(top_key, std::move(pixels));
+  upload_page(m_page_table.allocate(top, 0, 0, 0), *find_page(top_key));
+  upload_indirection();
+}
+
+void
+VirtualTexture::set_uniforms(Material& material, float lod_bias) const
+{
+  material.set_uniform("VirtualSize", glm::vec4(m_file.get_width(), m_file.get_height(),
+                                                m_file.get_levels(), m_file.get_page_size()));
+  material.set_uniform("VirtualAtlasParams", glm::vec4(m_file.get_padded_size(), m_file.get_border(),
+                                                       m_page_table.get_atlas_pages() * m_file.get_padded_size(),
+                                                       lod_bias));
+}
+
+MaterialPtr
+VirtualTexture::get_feedback_material(int feedback_scale)
+{
+  if (!m_feedback_material)
+  {
+    m_feedback_material = std::make_shared<Material>();
+    m_feedback_material->enable(GL_DEPTH_TEST);
+    m_feedback_material->enable(GL_CULL_FACE);
+    m_feedback_material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/virtual_feedback.vert",
+                                                                 g_datadir + "/glsl/virtual_feedback.frag"));
+    // derivatives in the smaller buffer are that much larger
+    set_uniforms(*m_feedback_material, -log2f(static_cast<float>(feedback_scale)));
+    m_feedback_material->set_uniform("VirtualId", static_cast<float>(m_id));
+  }
+  return m_feedback_material;
+}
+
+void
+VirtualTexture::request(int level, int x, int y)
+{
+  if (level < m_file.get_levels() &&
+      x < m_file.get_pages_x(level) &&
+      y < m_file.get_pages_y(level))
+  {
+    m_requests.push_back(PageTable::make_key(level, x, y));
+  }
+}
+
+int
+VirtualTexture::update(unsigned int frame, int max_uploads, int max_reads, std::vector<uint32_t>& reads)
+{
+  std::sort(m_requests.begin(), m_requests.end());
+  m_requests.erase(std::unique(m_requests.begin(), m_requests.end()), m_requests.end());
+
+  // the pages above a wanted one are shown while it loads, they stay
+  // resident as long as anything below them is wanted
+  size_t const count = m_requests.size();
+  for(size_t i = 0; i < count; ++i)
+  {
+    PageTable::Page const page = PageTable::from_key(m_requests[i]);
+    for(int level = page.level + 1; level < m_file.get_levels(); ++level)
+    {
+      int const shift = level - page.level;
+      m_requests.push_back(PageTable::make_key(level, page.x >> shift, page.y >> shift));
+    }
+  }
+
+  // the level is in the top bits, so this puts coarse pages first
+  std::sort(m_requests.begin(), m_requests.end(), std::greater<uint32_t>());
+  m_requests.erase(std::unique(m_requests.begin(), m_requests.end()), m_requests.end());
+
+  // touch every resident page before allocating, otherwise a new page
+  // could evict one that is wanted this frame but comes later in the list
+  std::vector<uint32_t> missing;
+  for(uint32_t key : m_requests)
+  {
+    PageTable::Page const page = PageTable::from_key(key);
+    int const slot = m_page_table.get_slot(page.level, page.x, page.y);
+    if (slot != -1)
+    {
+      m_page_table.touch(slot, frame);
+    }
+    else
+    {
+      missing.push_back(key);
+    }
+  }
+  m_requests.clear();
+
+  int uploads = 0;
+  for(uint32_t key : missing)
+  {
+    if (std::vector<uint8_t> const* pixels = find_page(key))
+    {
+      if (uploads < max_uploads)
+      {
+        PageTable::Page const page = PageTable::from_key(key);
+        int const slot = m_page_table.allocate(page.level, page.x, page.y, frame);
+        if (slot != -1)
+        {
+          upload_page(slot, *pixels);
+          uploads += 1;
+        }
+      }
+    }
+    else if (static_cast<int>(reads.size()) < max_reads &&
+             m_failed.count(key) == 0 &&
+             m_reading.insert(key).second)
+    {
+      reads.push_back(key);
+    }
+  }
+
+  if (uploads > 0)
+  {
+    upload_indirection();
+  }
+
+  return uploads;
+}
+
+void
+VirtualTexture::read_page(uint32_t key, std::vector<uint8_t>& pixels)
+{
+  PageTable::Page const page = PageTable::from_key(key);
+  m_file.read_page(page.level, page.x, page.y, pixels);
+}
+
+std::vector<uint8_t> const*
+VirtualTexture::find_page(uint32_t key)
+{
+  auto it = m_cache_index.find(key);
+  if (it == m_cache_index.end())
+  {
+    return nullptr;
+  }
+
+  m_cache.splice(m_cache.begin(), m_cache, it->second);
+  return &it->second->second;
+}
+
+void
+VirtualTexture::add_page(uint32_t key, std::vector<uint8_t> pixels)
+{
+  m_reading.erase(key);
+
+  if (pixels.empty())
+  {
+    m_failed.insert(key);
+    return;
+  }
+
+  if (m_cache_index.count(key))
+  {
+    return;
+  }
+
+  m_cache_bytes += pixels.size();
+  m_cache.emplace_front(key, std::move(pixels));
+  m_cache_index[key] = m_cache.begin();
+
+  while(m_cache_bytes > CACHE_BYTES && m_cache.size() > 1)
+  {
+    m_cache_bytes -= m_cache.back().second.size();
+    m_cache_index.erase(m_cache.back().first);
+    m_cache.pop_back();
+  }
+}
+
+void
+VirtualTexture::upload_page(int slot, std::vector<uint8_t> const& pixels)
+{
+  OpenGLState state;
+
+  int const padded = m_file.get_padded_size();
+  int const atlas_pages = m_page_table.get_atlas_pages();
+
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, m_atlas->get_id());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % atlas_pages) * padded, (slot / atlas_pages) * padded,
+                  padded, padded, (m_file.get_bytes_per_pixel() == 4) ? GL_RGBA : GL_RGB,
+                  GL_UNSIGNED_BYTE, pixels.data());
+  assert_gl("VirtualTexture::upload_page");
+}
+
+void
+VirtualTexture::upload_indirection()
+{
+  OpenGLState state;
+
+  OpenGLStateTracker::get().bind_texture(GL_TEXTURE_2D, m_indirection->get_id());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  for(int level = 0; level < m_file.get_levels(); ++level)
+  {
+    m_page_table.build_indirection(level, m_indirection_buffer);
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0,
+                    m_page_table.get_indirection_width(level), m_page_table.get_indirection_height(level),
+                    GL_RGBA, GL_UNSIGNED_BYTE, m_indirection_buffer.data());
+  }
+  assert_gl("VirtualTexture::upload_indirection");
+}
+
+#endif
+
+/* EOF */
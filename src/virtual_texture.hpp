@@ -0,0 +1,112 @@
+#ifndef HEADER_VIRTUAL_TEXTURE_HPP
+#define HEADER_VIRTUAL_TEXTURE_HPP
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "material.hpp"
+#include "page_table.hpp"
+#include "texture.hpp"
+#include "virtual_texture_file.hpp"
+
+/** A .vtex file sampled through a fixed size atlas of pages and an
+    indirection texture that maps every page of every level to its
+    slot in the atlas, see data/glsl/virtual_texture.glsl. Only the
+    pages the feedback pass asked for are read and uploaded, so the
+    GPU memory depends on the atlas size, not on the image size.
+
+    Pages are read from the file by the reader thread of the
+    VirtualTextureManager, update() only uploads pages that are already
+    in memory. Recently read pages stay in a CPU cache, so pages that
+    drop out of the atlas come back without going to the disk again. */
+class VirtualTexture
+{
+public:
+  /** Bytes of pages kept in memory after they are uploaded */
+  enum { CACHE_BYTES = 32 * 1024 * 1024 };
+
+private:
+  typedef std::list<std::pair<uint32_t, std::vector<uint8_t>>> PageCache;
+
+private:
+  VirtualTextureFile m_file;
+  PageTable m_page_table;
+  int m_id;
+
+  TexturePtr m_atlas;
+  TexturePtr m_indirection;
+  MaterialPtr m_feedback_material;
+
+  // pages asked for by the last feedback, as PageTable keys
+  std::vector<uint32_t> m_requests;
+
+  // pages handed to the reader and pages it couldn't read
+  std::unordered_set<uint32_t> m_reading;
+  std::unordered_set<uint32_t> m_failed;
+
+  // most recently used at the front
+  PageCache m_cache;
+  std::unordered_map<uint32_t, PageCache::iterator> m_cache_index;
+  size_t m_cache_bytes;
+
+  std::vector<uint8_t> m_indirection_buffer;
+
+public:
+  /** \a id tells the pages of this texture apart in the feedback,
+      \a atlas_pages is the number of pages along one side of the atlas */
+  VirtualTexture(std::filesystem::path const& filename, int id, int atlas_pages);
+
+  int get_id() const { return m_id; }
+  std::filesystem::path const& get_filename() const { return m_file.get_filename(); }
+
+  TexturePtr get_atlas() const { return m_atlas; }
+  TexturePtr get_indirection() const { return m_indirection; }
+
+  /** Sets the uniforms of data/glsl/virtual_texture.glsl on \a material */
+  void set_uniforms(Material& material, float lod_bias) const;
+
+  /** Draws the feedback of surfaces that use this texture, set up for
+      a feedback buffer \a feedback_scale times smaller than the screen */
+  MaterialPtr get_feedback_material(int feedback_scale);
+
+  /** Asks for a page, collected until the next update() */
+  void request(int level, int x, int y);
+
+  /** Makes the requested pages resident, at most \a max_uploads new
+      ones, coarse levels first. Pages that aren't in memory yet are
+      added to \a reads, at most \a max_reads of them, for the reader
+      to pass to read_page() and then to add_page(). Returns the number
+      of pages uploaded. */
+  int update(unsigned int frame, int max_uploads, int max_reads, std::vector<uint32_t>& reads);
+
+  /** Reads a page from the file, throws on errors. Called on the reader
+      thread, nothing else uses the file after the constructor. */
+  void read_page(uint32_t key, std::vector<uint8_t>& pixels);
+
+  /** Puts a page the reader finished into the cache, empty \a pixels
+      mark a failed read that isn't tried again */
+  void add_page(uint32_t key, std::vector<uint8_t> pixels);
+
+  int get_resident_count() const { return m_page_table.get_resident_count(); }
+
+private:
+  /** The cached page, nullptr when it isn't in memory */
+  std::vector<uint8_t> const* find_page(uint32_t key);
+  void upload_page(int slot, std::vector<uint8_t> const& pixels);
+  void upload_indirection();
+
+private:
+  VirtualTexture(const VirtualTexture&) = delete;
+  VirtualTexture& operator=(const VirtualTexture&) = delete;
+};
+
+#endif
+
+/* EOF */
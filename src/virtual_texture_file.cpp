@@ -0,0 +1,223 @@
+#include "virtual_texture_file.hpp"
+
+#include <stdexcept>
+#include <string.h>
+
+#include "format.hpp"
+#include "mipmap_builder.hpp"
+
+namespace {
+
+uint32_t const VTEX_MAGIC = 'V' | ('T' << 8) | ('E' << 16) | ('X' << 24);
+uint32_t const VTEX_VERSION = 1;
+size_t const VTEX_HEADER_SIZE = 8 * sizeof(uint32_t);
+
+/** Copies page \a px, \a py of a level with its border into \a page,
+    texels outside the level repeat the edge */
+void copy_page(uint8_t const* pixels, int width, int height, int bytes_per_pixel,
+               int page_size, int border, int px, int py, uint8_t* page)
+{
+  int const padded = page_size + 2 * border;
+  int const x0 = px * page_size - border;
+  int const y0 = py * page_size - border;
+
+  // the page starts inside the level, so the middle run is never empty
+  int const first = std::max(0, -x0);
+  int const last = std::min(padded, width - x0);
+
+  for(int row = 0; row < padded; ++row)
+  {
+    int const sy = std::max(0, std::min(height - 1, y0 + row));
+    uint8_t const* src = pixels + static_cast<size_t>(sy) * width * bytes_per_pixel;
+    uint8_t* dst = page + static_cast<size_t>(row) * padded * bytes_per_pixel;
+
+    for(int col = 0; col < first; ++col)
+    {
+      memcpy(dst + col * bytes_per_pixel, src, bytes_per_pixel);
+    }
+    memcpy(dst + first * bytes_per_pixel, src + (x0 + first) * bytes_per_pixel,
+           (last - first) * bytes_per_pixel);
+    for(int col = last; col < padded; ++col)
+    {
+      memcpy(dst + col * bytes_per_pixel, src + (width - 1) * bytes_per_pixel, bytes_per_pixel);
+    }
+  }
+}
+
+} // namespace
+
+void
+VirtualTextureFile::write(std::filesystem::path const& filename,
+                          uint8_t const* pixels, int width, int height, int bytes_per_pixel,
+                          int page_size, int border)
+{
+  if (width <= 0 || height <= 0 || page_size <= 0 || border < 0 || border > page_size ||
+      (bytes_per_pixel != 3 && bytes_per_pixel != 4))
+  {
+    throw std::runtime_error(format("%s: invalid virtual texture parameters", filename));
+  }
+
+  int const levels = get_level_count(width, height, page_size);
+
+  std::vector<MipmapBuilder::Level> mipmaps;
+  if (levels > 1)
+  {
+    mipmaps = MipmapBuilder::build(pixels, width, height, width * bytes_per_pixel, bytes_per_pixel,
+                                   MipmapBuilder::BOX, true);
+  }
+
+  std::ofstream out(filename, std::ios::binary);
+  if (!out)
+  {
+    throw std::runtime_error("couldn't write " + filename.string());
+  }
+
+  uint32_t const header[8] = {
+    VTEX_MAGIC, VTEX_VERSION,
+    static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+    static_cast<uint32_t>(page_size), static_cast<uint32_t>(border),
+    static_cast<uint32_t>(bytes_per_pixel), static_cast<uint32_t>(levels)
+  };
+  out.write(reinterpret_cast<char const*>(header), sizeof(header));
+
+  int const padded = page_size + 2 * border;
+  std::vector<uint8_t> page(static_cast<size_t>(padded) * padded * bytes_per_pixel);
+  for(int level = 0; level < levels; ++level)
+  {
+    uint8_t const* level_pixels = (level == 0) ? pixels : mipmaps[level - 1].pixels.data();
+    int const level_width = (level == 0) ? width : mipmaps[level - 1].width;
+    int const level_height = (level == 0) ? height : mipmaps[level - 1].height;
+
+    for(int py = 0; py < (level_height + page_size - 1) / page_size; ++py)
+    {
+      for(int px = 0; px < (level_width + page_size - 1) / page_size; ++px)
+      {
+        copy_page(level_pixels, level_width, level_height, bytes_per_pixel,
+                  page_size, border, px, py, page.data());
+        out.write(reinterpret_cast<char const*>(page.data()), page.size());
+      }
+    }
+  }
+
+  if (!out)
+  {
+    throw std::runtime_error("couldn't write " + filename.string());
+  }
+}
+
+std::filesystem::path
+VirtualTextureFile::find_sibling(std::filesystem::path const& filename)
+{
+  std::error_code ec;
+  std::filesystem::file_time_type const image_time = std::filesystem::last_write_time(filename, ec);
+
+  std::filesystem::path sibling = filename;
+  sibling.replace_extension(".vtex");
+
+  std::error_code sibling_ec;
+  std::filesystem::file_time_type const sibling_time = std::filesystem::last_write_time(sibling, sibling_ec);
+  if (!sibling_ec && (ec || sibling_time >= image_time))
+  {
+    return sibling;
+  }
+
+  return {};
+}
+
+int
+VirtualTextureFile::get_level_count(int width, int height, int page_size)
+{
+  int levels = 1;
+  while(width > page_size || height > page_size)
+  {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    levels += 1;
+  }
+  return levels;
+}
+
+VirtualTextureFile::VirtualTextureFile(std::filesystem::path const& filename) :
+  m_filename(filename),
+  m_in(filename, std::ios::binary),
+  m_width(0),
+  m_height(0),
+  m_page_size(0),
+  m_border(0),
+  m_bytes_per_pixel(0),
+  m_levels(0),
+  m_level_pages()
+{
+  if (!m_in)
+  {
+    throw std::runtime_error("couldn't open " + filename.string());
+  }
+
+  uint32_t header[8];
+  if (!m_in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+      header[0] != VTEX_MAGIC)
+  {
+    throw std::runtime_error(format("%s: not a virtual texture", filename));
+  }
+  if (header[1] != VTEX_VERSION)
+  {
+    throw std::runtime_error(format("%s: unsupported version %d", filename, header[1]));
+  }
+
+  m_width = static_cast<int>(header[2]);
+  m_height = static_cast<int>(header[3]);
+  m_page_size = static_cast<int>(header[4]);
+  m_border = static_cast<int>(header[5]);
+  m_bytes_per_pixel = static_cast<int>(header[6]);
+  m_levels = static_cast<int>(header[7]);
+
+  if (m_width <= 0 || m_height <= 0 || m_page_size <= 0 ||
+      m_border < 0 || m_border > m_page_size ||
+      (m_bytes_per_pixel != 3 && m_bytes_per_pixel != 4) ||
+      m_levels != get_level_count(m_width, m_height, m_page_size))
+  {
+    throw std::runtime_error(format("%s: broken header", filename));
+  }
+
+  size_t pages = 0;
+  for(int level = 0; level < m_levels; ++level)
+  {
+    m_level_pages.push_back(pages);
+    pages += static_cast<size_t>(get_pages_x(level)) * get_pages_y(level);
+  }
+
+  std::error_code ec;
+  if (std::filesystem::file_size(filename, ec) < VTEX_HEADER_SIZE + pages * get_page_bytes())
+  {
+    throw std::runtime_error(format("%s: file is truncated", filename));
+  }
+}
+
+size_t
+VirtualTextureFile::get_page_bytes() const
+{
+  return static_cast<size_t>(get_padded_size()) * get_padded_size() * m_bytes_per_pixel;
+}
+
+void
+VirtualTextureFile::read_page(int level, int x, int y, std::vector<uint8_t>& pixels)
+{
+  if (level < 0 || level >= m_levels ||
+      x < 0 || x >= get_pages_x(level) ||
+      y < 0 || y >= get_pages_y(level))
+  {
+    throw std::runtime_error(format("%s: page %d,%d of level %d out of range", m_filename, x, y, level));
+  }
+
+  size_t const page = m_level_pages[level] + static_cast<size_t>(y) * get_pages_x(level) + x;
+  pixels.resize(get_page_bytes());
+
+  m_in.clear();
+  m_in.seekg(VTEX_HEADER_SIZE + page * get_page_bytes());
+  if (!m_in.read(reinterpret_cast<char*>(pixels.data()), pixels.size()))
+  {
+    throw std::runtime_error(format("%s: couldn't read page %d,%d of level %d", m_filename, x, y, level));
+  }
+}
+
+/* EOF */
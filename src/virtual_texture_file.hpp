@@ -0,0 +1,85 @@
+#ifndef HEADER_VIRTUAL_TEXTURE_FILE_HPP
+#define HEADER_VIRTUAL_TEXTURE_FILE_HPP
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdint.h>
+#include <vector>
+
+/** An image cut into square pages for every mip level, as written by
+    grumgl-texconv --virtual. Levels are added until the whole level
+    fits into a single page. Each page carries a border of texels from
+    its neighbours, clamped at the image edges, so that bilinear
+    filtering in the atlas doesn't bleed between pages.
+
+    The .vtex layout is a header of eight uint32 values, "VTEX",
+    version, width, height, page size, border, bytes per pixel and
+    level count, followed by the pages of level 0, level 1 and so on,
+    each level row by row. Rows are bottom to top like all other
+    textures. */
+class VirtualTextureFile
+{
+public:
+  enum { DEFAULT_PAGE_SIZE = 128, DEFAULT_BORDER = 1 };
+
+  /** Cuts \a pixels, tightly packed and bottom row first, into pages
+      and writes them to \a filename */
+  static void write(std::filesystem::path const& filename,
+                    uint8_t const* pixels, int width, int height, int bytes_per_pixel,
+                    int page_size = DEFAULT_PAGE_SIZE, int border = DEFAULT_BORDER);
+
+  /** The .vtex file next to the image \a filename, empty when there is
+      none or it is older than the image */
+  static std::filesystem::path find_sibling(std::filesystem::path const& filename);
+
+  /** Number of levels for an image of the given size */
+  static int get_level_count(int width, int height, int page_size);
+
+private:
+  std::filesystem::path m_filename;
+  std::ifstream m_in;
+
+  int m_width;
+  int m_height;
+  int m_page_size;
+  int m_border;
+  int m_bytes_per_pixel;
+  int m_levels;
+
+  // index of the first page of each level
+  std::vector<size_t> m_level_pages;
+
+public:
+  /** Opens \a filename and reads the header, throws on errors */
+  VirtualTextureFile(std::filesystem::path const& filename);
+
+  std::filesystem::path const& get_filename() const { return m_filename; }
+
+  int get_width() const { return m_width; }
+  int get_height() const { return m_height; }
+  int get_page_size() const { return m_page_size; }
+  int get_border() const { return m_border; }
+  int get_bytes_per_pixel() const { return m_bytes_per_pixel; }
+  int get_levels() const { return m_levels; }
+
+  int get_level_width(int level) const { return std::max(1, m_width >> level); }
+  int get_level_height(int level) const { return std::max(1, m_height >> level); }
+  int get_pages_x(int level) const { return (get_level_width(level) + m_page_size - 1) / m_page_size; }
+  int get_pages_y(int level) const { return (get_level_height(level) + m_page_size - 1) / m_page_size; }
+
+  /** Size of a page including its border */
+  int get_padded_size() const { return m_page_size + 2 * m_border; }
+  size_t get_page_bytes() const;
+
+  /** Reads page \a x, \a y of \a level with its border */
+  void read_page(int level, int x, int y, std::vector<uint8_t>& pixels);
+
+private:
+  VirtualTextureFile(const VirtualTextureFile&) = delete;
+  VirtualTextureFile& operator=(const VirtualTextureFile&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,256 @@
+#include "virtual_texture_manager.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "assert_gl.hpp"
+#include "camera.hpp"
+#include "format.hpp"
+#include "globals.hpp"
+#include "log.hpp"
+#include "opengl_state.hpp"
+#include "program_registry.hpp"
+#include "render_stats.hpp"
+#include "scene_manager.hpp"
+
+// GLES2 has no pixel buffer objects, the compositor skips the manager there
+#ifndef HAVE_OPENGLES2
+
+VirtualTextureManager::VirtualTextureManager() :
+  m_textures(),
+  m_thread(),
+  m_mutex(),
+  m_cond(),
+  m_read_queue(),
+  m_done_queue(),
+  m_quit(false),
+  m_pending_reads(0),
+  m_feedback(),
+  m_depth_material(),
+  m_pbo(0),
+  m_pbo_pending(false),
+  m_frame(0)
+{
+}
+
+VirtualTextureManager::~VirtualTextureManager()
+{
+  if (m_thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+  }
+}
+
+VirtualTexture&
+VirtualTextureManager::load(std::filesystem::path const& filename)
+{
+  for(auto const& texture : m_textures)
+  {
+    if (texture->get_filename() == filename)
+    {
+      return *texture;
+    }
+  }
+
+  if (m_textures.size() >= MAX_TEXTURES)
+  {
+    throw std::runtime_error(format("%s: more than %d virtual textures", filename, MAX_TEXTURES));
+  }
+
+  m_textures.push_back(std::make_unique<VirtualTexture>(filename, static_cast<int>(m_textures.size()) + 1,
+                                                        ATLAS_PAGES));
+  log_info("virtual texture: %s", filename);
+
+  if (!m_thread.joinable())
+  {
+    m_thread = std::thread([this]{ reader_main(); });
+  }
+
+  return *m_textures.back();
+}
+
+void
+VirtualTextureManager::update(SceneManager& scene_manager, Camera const& camera, int screen_w, int screen_h)
+{
+  if (m_textures.empty())
+  {
+    return;
+  }
+
+  OpenGLState state;
+
+  int const width = std::max(1, screen_w / FEEDBACK_SCALE);
+  int const height = std::max(1, screen_h / FEEDBACK_SCALE);
+  if (!m_feedback || m_feedback->get_width() != width || m_feedback->get_height() != height)
+  {
+    m_feedback = std::make_unique<Framebuffer>(width, height);
+    m_pbo_pending = false;
+  }
+
+  if (!m_depth_material)
+  {
+    // fills the depth buffer for surfaces without a virtual texture,
+    // so that they hide the ones behind them
+    m_depth_material = std::make_shared<Material>();
+    m_depth_material->enable(GL_DEPTH_TEST);
+    m_depth_material->enable(GL_CULL_FACE);
+    m_depth_material->color_mask(false, false, false, false);
+    m_depth_material->set_program(ProgramRegistry::get().load(g_datadir + "/glsl/virtual_feedback.vert",
+                                                              g_datadir + "/glsl/virtual_feedback.frag"));
+  }
+
+  if (m_pbo_pending)
+  {
+    read_feedback();
+  }
+
+  collect_reads();
+
+  // the budgets are shared, the texture that goes first changes every
+  // frame so that none of them starves the others
+  m_frame += 1;
+  int uploads = 0;
+  std::vector<uint32_t> reads;
+  for(size_t i = 0; i < m_textures.size(); ++i)
+  {
+    VirtualTexture& texture = *m_textures[(m_frame + i) % m_textures.size()];
+
+    reads.clear();
+    uploads += texture.update(m_frame, PAGES_PER_FRAME - uploads, MAX_PENDING_READS - m_pending_reads, reads);
+    g_render_stats.virtual_pages_resident += texture.get_resident_count();
+
+    if (!reads.empty())
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for(uint32_t key : reads)
+      {
+        m_read_queue.push_back(PageRead{ &texture, key, {} });
+      }
+    }
+    m_pending_reads += static_cast<int>(reads.size());
+    g_render_stats.virtual_page_reads += static_cast<int>(reads.size());
+  }
+  m_cond.notify_one();
+  g_render_stats.virtual_page_uploads += uploads;
+
+  // draw the feedback for the next frame
+  m_feedback->bind();
+  glViewport(0, 0, width, height);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+  scene_manager.draw_feedback(camera, m_depth_material);
+
+  // the depth material may be the last one drawn, with color writes
+  // off the glClear() of the scene pass would do nothing
+  OpenGLStateTracker::get().color_mask(true, true, true, true);
+  OpenGLStateTracker::get().depth_mask(true);
+
+  if (!m_pbo)
+  {
+    glGenBuffers(1, &m_pbo);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+  glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<size_t>(width) * height * 4, nullptr, GL_STREAM_READ);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  m_feedback->unbind();
+  m_pbo_pending = true;
+
+  assert_gl("VirtualTextureManager::update");
+}
+
+void
+VirtualTextureManager::read_feedback()
+{
+  size_t const size = static_cast<size_t>(m_feedback->get_width()) * m_feedback->get_height() * 4;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+  uint8_t const* texels = static_cast<uint8_t const*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                                                       GL_MAP_READ_BIT));
+  if (texels)
+  {
+    // neighbouring pixels mostly want the same page, those are only
+    // passed on once
+    uint32_t last = 0;
+    for(size_t i = 0; i < size; i += 4)
+    {
+      uint32_t const value = texels[i] | (texels[i + 1] << 8) | (texels[i + 2] << 16);
+      if (value == last)
+      {
+        continue;
+      }
+      last = value;
+
+      int const id = texels[i + 2] >> 4;
+      if (id > 0 && id <= static_cast<int>(m_textures.size()))
+      {
+        m_textures[id - 1]->request(texels[i + 2] & 15, texels[i], texels[i + 1]);
+        g_render_stats.virtual_page_requests += 1;
+      }
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  m_pbo_pending = false;
+}
+
+void
+VirtualTextureManager::collect_reads()
+{
+  std::deque<PageRead> done;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    done.swap(m_done_queue);
+  }
+
+  for(auto& read : done)
+  {
+    read.texture->add_page(read.key, std::move(read.pixels));
+    m_pending_reads -= 1;
+  }
+}
+
+void
+VirtualTextureManager::reader_main()
+{
+  while(true)
+  {
+    PageRead read;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]{ return m_quit || !m_read_queue.empty(); });
+      if (m_quit)
+      {
+        return;
+      }
+
+      read = std::move(m_read_queue.front());
+      m_read_queue.pop_front();
+    }
+
+    try
+    {
+      read.texture->read_page(read.key, read.pixels);
+    }
+    catch(std::exception const& err)
+    {
+      log_error("virtual texture: %s", err.what());
+      read.pixels.clear();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_done_queue.push_back(std::move(read));
+    }
+  }
+}
+
+#endif
+
+/* EOF */
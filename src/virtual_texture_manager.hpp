@@ -0,0 +1,115 @@
+#ifndef HEADER_VIRTUAL_TEXTURE_MANAGER_HPP
+#define HEADER_VIRTUAL_TEXTURE_MANAGER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.hpp"
+#include "material.hpp"
+#include "virtual_texture.hpp"
+
+class Camera;
+class SceneManager;
+
+/** Owns the VirtualTextures and decides which of their pages are
+    needed. Every frame the visible surfaces that use one are drawn
+    into a small feedback buffer that stores texture id, mip level and
+    page for each pixel, see data/glsl/virtual_feedback.frag. The
+    buffer is read back through a pixel buffer object and decoded one
+    frame later, so the read doesn't stall on the draw.
+
+    Pages that aren't in memory are read from the files by a thread of
+    the manager and uploaded on the GL thread once they arrived. Like
+    the TextureLoader workers it is separate from the TaskScheduler,
+    waiting on the disk there would stall the frame.
+
+    Desktop GL only, GLES2 has no texelFetch() and no pixel buffer
+    objects, there the regular texture is used. */
+class VirtualTextureManager
+{
+public:
+  static VirtualTextureManager& get()
+  {
+    static VirtualTextureManager instance;
+    return instance;
+  }
+
+  /** The feedback buffer is this many times smaller than the screen */
+  enum { FEEDBACK_SCALE = 8 };
+
+  /** Ids are stored in four bits of the feedback, 0 is no texture */
+  enum { MAX_TEXTURES = 15 };
+
+  /** Pages along one side of the atlas of each texture */
+  enum { ATLAS_PAGES = 16 };
+
+  /** New pages uploaded per frame, over all textures */
+  enum { PAGES_PER_FRAME = 8 };
+
+  /** Page reads queued for the reader thread at a time, over all
+      textures */
+  enum { MAX_PENDING_READS = 16 };
+
+private:
+  struct PageRead
+  {
+    VirtualTexture* texture;
+    uint32_t key;
+    std::vector<uint8_t> pixels; // empty when the read failed
+  };
+
+private:
+  std::vector<std::unique_ptr<VirtualTexture>> m_textures;
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cond; // work for the reader
+  std::deque<PageRead> m_read_queue;
+  std::deque<PageRead> m_done_queue;
+  bool m_quit;
+
+  // only touched by the GL thread
+  int m_pending_reads;
+
+  std::unique_ptr<Framebuffer> m_feedback;
+  MaterialPtr m_depth_material;
+  GLuint m_pbo;
+  bool m_pbo_pending;
+
+  unsigned int m_frame;
+
+public:
+  VirtualTextureManager();
+  ~VirtualTextureManager();
+
+  /** Returns the texture for \a filename, loading it on first use */
+  VirtualTexture& load(std::filesystem::path const& filename);
+
+  bool empty() const { return m_textures.empty(); }
+
+  /** Reads back the last feedback, uploads the pages it asked for
+      that are in memory, queues reads for the others and draws the
+      feedback of \a camera for the next frame. Uses the draw
+      list of the last SceneManager::prepare(). */
+  void update(SceneManager& scene_manager, Camera const& camera, int screen_w, int screen_h);
+
+private:
+  void read_feedback();
+
+  /** Hands the pages the reader finished to their textures */
+  void collect_reads();
+  void reader_main();
+
+private:
+  VirtualTextureManager(const VirtualTextureManager&) = delete;
+  VirtualTextureManager& operator=(const VirtualTextureManager&) = delete;
+};
+
+#endif
+
+/* EOF */
@@ -16,6 +16,9 @@ public:
   Window(Window&& other);
   ~Window();
 
+  SDL_Window* get_sdl_window() const { return m_window; }
+  SDL_GLContext get_gl_context() const { return m_gl_context.get(); }
+
   void swap();
   void grab(bool grabbed);
 
@@ -0,0 +1,220 @@
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_encoder.hpp"
+#include "compressed_image.hpp"
+
+namespace {
+
+/** Decodes texel \a i of a BC1 block in four color mode */
+void decode_bc1(uint8_t const* block, int i, int* rgb)
+{
+  uint16_t c[2];
+  memcpy(c, block, 4);
+  uint32_t indices;
+  memcpy(&indices, block + 4, 4);
+
+  int palette[4][3];
+  for(int k = 0; k < 2; ++k)
+  {
+    int const r = (c[k] >> 11) & 31, g = (c[k] >> 5) & 63, b = c[k] & 31;
+    palette[k][0] = (r << 3) | (r >> 2);
+    palette[k][1] = (g << 2) | (g >> 4);
+    palette[k][2] = (b << 3) | (b >> 2);
+  }
+  for(int ch = 0; ch < 3; ++ch)
+  {
+    palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+    palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+  }
+  memcpy(rgb, palette[(indices >> (2 * i)) & 3], sizeof(int) * 3);
+}
+
+void write_dds(std::filesystem::path const& filename, int width, int height, char const* code,
+               std::vector<uint8_t> const& blocks)
+{
+  std::vector<uint8_t> file(128, 0);
+  uint32_t const header[] = { 0x20534444, 124, 0, static_cast<uint32_t>(height), static_cast<uint32_t>(width) };
+  memcpy(file.data(), header, sizeof(header));
+  memcpy(file.data() + 84, code, 4);
+  file.insert(file.end(), blocks.begin(), blocks.end());
+  std::ofstream(filename, std::ios::binary).write(reinterpret_cast<char const*>(file.data()), file.size());
+}
+
+} // namespace
+
+int main()
+{
+  std::filesystem::path const dir = std::filesystem::temp_directory_path() / "compressed_image_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  assert(CompressedImage::get_level_size(CompressedImage::BC1_RGB, 1, 1) == 8);
+  assert(CompressedImage::get_level_size(CompressedImage::BC3_RGBA, 5, 4) == 32);
+  assert(CompressedImage::get_block_bytes(0x1234) == 0);
+
+  // a gradient survives BC1 with a small error
+  {
+    std::vector<uint8_t> pixels(8 * 8 * 4);
+    for(int i = 0; i < 64; ++i)
+    {
+      pixels[4 * i + 0] = static_cast<uint8_t>(i * 4);
+      pixels[4 * i + 1] = static_cast<uint8_t>(255 - i * 4);
+      pixels[4 * i + 2] = 64;
+      pixels[4 * i + 3] = 255;
+    }
+
+    std::vector<uint8_t> const data = block_encoder::encode(CompressedImage::BC1_RGB, pixels.data(), 8, 8);
+    assert(data.size() == 4 * 8);
+    for(int y = 0; y < 8; ++y)
+      for(int x = 0; x < 8; ++x)
+      {
+        int rgb[3];
+        decode_bc1(data.data() + 8 * ((y / 4) * 2 + x / 4), (y % 4) * 4 + x % 4, rgb);
+        for(int c = 0; c < 3; ++c)
+        {
+          assert(abs(rgb[c] - pixels[4 * (y * 8 + x) + c]) <= 16);
+        }
+      }
+  }
+
+  // flat alpha needs no indices
+  {
+    std::vector<uint8_t> pixels(4 * 4 * 4, 128);
+    std::vector<uint8_t> const data = block_encoder::encode(CompressedImage::BC3_RGBA, pixels.data(), 4, 4);
+    assert(data.size() == 16);
+    assert(data[0] == 128 && data[1] == 128);
+    for(int i = 2; i < 8; ++i)
+    {
+      assert(data[i] == 0);
+    }
+  }
+
+  // KTX round trip
+  {
+    std::vector<CompressedImage::Level> levels;
+    for(int size = 16; size >= 1; size /= 2)
+    {
+      std::vector<uint8_t> data(CompressedImage::get_level_size(CompressedImage::BC3_RGBA, size, size * 2));
+      for(auto& value : data)
+      {
+        value = static_cast<uint8_t>(rand());
+      }
+      levels.push_back({ size, size * 2, data });
+    }
+    // 16x32 goes down to 1x2 and then 1x1
+    levels.push_back({ 1, 1, std::vector<uint8_t>(16, 7) });
+
+    CompressedImage const image(CompressedImage::BC3_RGBA, levels);
+    image.save_ktx(dir / "image.ktx");
+
+    CompressedImage const loaded = CompressedImage::from_file(dir / "image.ktx");
+    assert(loaded.get_format() == CompressedImage::BC3_RGBA);
+    assert(loaded.get_width() == 16 && loaded.get_height() == 32);
+    assert(loaded.get_levels().size() == levels.size());
+    for(size_t i = 0; i < levels.size(); ++i)
+    {
+      assert(loaded.get_levels()[i].data == levels[i].data);
+    }
+  }
+
+  // DDS with a DXT1 FourCC and two levels
+  {
+    std::vector<uint8_t> file(128 + 16 + 8, 0);
+    uint32_t const header[] = { 0x20534444, 124, 0, 4, 8 };
+    memcpy(file.data(), header, sizeof(header));
+    uint32_t const levels = 2;
+    memcpy(file.data() + 28, &levels, 4);
+    memcpy(file.data() + 84, "DXT1", 4);
+    file[128] = 42;
+    file[144] = 43;
+    std::ofstream(dir / "image.dds", std::ios::binary).write(reinterpret_cast<char const*>(file.data()), file.size());
+
+    CompressedImage const image = CompressedImage::from_file(dir / "image.dds");
+    assert(image.get_format() == CompressedImage::BC1_RGBA);
+    assert(image.get_width() == 8 && image.get_height() == 4);
+    assert(image.get_levels().size() == 2);
+    assert(image.get_levels()[1].width == 4 && image.get_levels()[1].height == 2);
+    assert(image.get_levels()[0].data[0] == 42);
+    assert(image.get_levels()[1].data[0] == 43);
+  }
+
+  // DDS rows go top to bottom, block rows and the rows inside each
+  // block are swapped
+  {
+    write_dds(dir / "flip.dds", 4, 8, "DXT1", {
+        1, 0, 0, 0, 0x00, 0x55, 0xAA, 0xFF,
+        2, 0, 0, 0, 0x01, 0x02, 0x03, 0x04 });
+
+    CompressedImage const image = CompressedImage::from_file(dir / "flip.dds");
+    std::vector<uint8_t> const expected = {
+      2, 0, 0, 0, 0x04, 0x03, 0x02, 0x01,
+      1, 0, 0, 0, 0xFF, 0xAA, 0x55, 0x00 };
+    assert(image.get_levels()[0].data == expected);
+  }
+
+  // BC3 alpha indices are twelve bits per row
+  {
+    uint64_t const rows = 0x001 | (0x002 << 12) | (0x003 << 24) | (uint64_t(0x004) << 36);
+    std::vector<uint8_t> block(16, 0);
+    memcpy(block.data() + 2, &rows, 6);
+    write_dds(dir / "flip_bc3.dds", 4, 4, "DXT5", block);
+
+    CompressedImage const image = CompressedImage::from_file(dir / "flip_bc3.dds");
+    uint64_t flipped = 0;
+    memcpy(&flipped, image.get_levels()[0].data.data() + 2, 6);
+    assert(flipped == (0x004 | (0x003 << 12) | (0x002 << 24) | (uint64_t(0x001) << 36)));
+  }
+
+  // heights that don't fill the last block row can't be flipped
+  {
+    write_dds(dir / "odd.dds", 4, 6, "DXT1", std::vector<uint8_t>(16, 0));
+    bool thrown = false;
+    try
+    {
+      CompressedImage::from_file(dir / "odd.dds");
+    }
+    catch(std::exception const&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+
+  // truncated files are reported
+  {
+    std::ofstream(dir / "broken.ktx") << "KTX";
+    bool thrown = false;
+    try
+    {
+      CompressedImage::from_file(dir / "broken.ktx");
+    }
+    catch(std::exception const&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+
+  // siblings older than the image are ignored
+  {
+    std::ofstream(dir / "image.png") << "png";
+    auto const now = std::filesystem::last_write_time(dir / "image.png");
+    std::filesystem::last_write_time(dir / "image.ktx", now + std::chrono::seconds(1));
+    assert(CompressedImage::find_sibling(dir / "image.png") == dir / "image.ktx");
+    std::filesystem::last_write_time(dir / "image.ktx", now - std::chrono::seconds(10));
+    std::filesystem::last_write_time(dir / "image.dds", now - std::chrono::seconds(10));
+    assert(CompressedImage::find_sibling(dir / "image.png").empty());
+  }
+
+  std::filesystem::remove_all(dir);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
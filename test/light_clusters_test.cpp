@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <iostream>
+
+#include "camera.hpp"
+#include "light_clusters.hpp"
+
+int main()
+{
+  Camera camera;
+  camera.perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+  camera.look_at(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  std::vector<LightPtr> lights;
+
+  // small light straight ahead
+  lights.push_back(std::make_shared<Light>());
+  lights.back()->set_position(glm::vec3(0.0f, 0.0f, -10.0f));
+  lights.back()->set_radius(1.0f);
+
+  // behind the camera
+  lights.push_back(std::make_shared<Light>());
+  lights.back()->set_position(glm::vec3(0.0f, 0.0f, 10.0f));
+  lights.back()->set_radius(1.0f);
+
+  // beside the frustum
+  lights.push_back(std::make_shared<Light>());
+  lights.back()->set_position(glm::vec3(50.0f, 0.0f, -10.0f));
+  lights.back()->set_radius(1.0f);
+
+  // surrounding the camera, touches every cluster near the camera
+  lights.push_back(std::make_shared<Light>());
+  lights.back()->set_position(glm::vec3(0.0f, 0.0f, 0.0f));
+  lights.back()->set_radius(0.5f);
+
+  LightClusters clusters;
+  clusters.build(lights, camera.get_view_matrix(), camera.get_projection_matrix(),
+                 camera.get_znear(), camera.get_zfar());
+
+  // only the lights inside the frustum are kept
+  assert(clusters.get_light_count() == 2);
+
+  // the light ahead lands in the center tiles of its depth slice
+  int const slice = static_cast<int>(logf(10.0f) * clusters.get_slice_scale() + clusters.get_slice_bias());
+  std::vector<uint32_t> const center = clusters.get_cluster(LightClusters::GRID_X / 2, LightClusters::GRID_Y / 2, slice);
+  assert(center.size() == 1 && center[0] == 0);
+
+  // but not in the corner
+  assert(clusters.get_cluster(0, 0, slice).empty());
+
+  // nor in a far slice
+  assert(clusters.get_cluster(LightClusters::GRID_X / 2, LightClusters::GRID_Y / 2, LightClusters::GRID_Z - 1).empty());
+
+  // the light around the camera covers the whole first slice
+  for(int y = 0; y < LightClusters::GRID_Y; ++y)
+  {
+    for(int x = 0; x < LightClusters::GRID_X; ++x)
+    {
+      std::vector<uint32_t> const cluster = clusters.get_cluster(x, y, 0);
+      assert(cluster.size() == 1 && cluster[0] == 1);
+    }
+  }
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,72 @@
+#include <assert.h>
+#include <iostream>
+#include <stdlib.h>
+
+#include "mipmap_builder.hpp"
+
+int main()
+{
+  assert(MipmapBuilder::get_level_count(1, 1) == 1);
+  assert(MipmapBuilder::get_level_count(256, 256) == 9);
+  assert(MipmapBuilder::get_level_count(300, 20) == 9);
+
+  // no rescaling, odd sizes round down
+  {
+    std::vector<uint8_t> image(300 * 20 * 3, 77);
+    auto levels = MipmapBuilder::build(image.data(), 300, 20, 300 * 3, 3, MipmapBuilder::BOX, true, false);
+    assert(levels.size() == 8);
+    assert(levels[0].width == 150 && levels[0].height == 10);
+    assert(levels[1].width == 75 && levels[1].height == 5);
+    assert(levels[2].width == 37 && levels[2].height == 2);
+    assert(levels.back().width == 1 && levels.back().height == 1);
+
+    // a flat image stays flat with either filter, sRGB values round trip
+    for(auto const& level : levels)
+      for(uint8_t value : level.pixels)
+        assert(value == 77);
+
+    levels = MipmapBuilder::build(image.data(), 300, 20, 300 * 3, 3, MipmapBuilder::KAISER, true);
+    for(auto const& level : levels)
+      for(uint8_t value : level.pixels)
+        assert(abs(value - 77) <= 1);
+  }
+
+  // black and white texels average to half the light, not to 128
+  {
+    std::vector<uint8_t> image(2 * 2 * 4);
+    for(int i = 0; i < 4; ++i)
+    {
+      uint8_t const v = (i % 2) ? 255 : 0;
+      image[4 * i + 0] = image[4 * i + 1] = image[4 * i + 2] = v;
+      image[4 * i + 3] = v;
+    }
+
+    auto levels = MipmapBuilder::build(image.data(), 2, 2, 2 * 4, 4, MipmapBuilder::BOX, true);
+    assert(levels.size() == 1);
+    assert(abs(levels[0].pixels[0] - 188) <= 1);
+    // alpha is linear
+    assert(abs(levels[0].pixels[3] - 128) <= 1);
+
+    levels = MipmapBuilder::build(image.data(), 2, 2, 2 * 4, 4, MipmapBuilder::BOX, false);
+    assert(abs(levels[0].pixels[0] - 128) <= 1);
+  }
+
+  // rows may be padded
+  {
+    int const pitch = 4 * 3 + 4;
+    std::vector<uint8_t> image(4 * pitch, 0);
+    for(int y = 0; y < 4; ++y)
+      for(int i = 0; i < 4 * 3; ++i)
+        image[y * pitch + i] = 200;
+
+    auto levels = MipmapBuilder::build(image.data(), 4, 4, pitch, 3, MipmapBuilder::BOX, false);
+    assert(levels.size() == 2);
+    assert(levels[1].pixels[0] == 200);
+  }
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
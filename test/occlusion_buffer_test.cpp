@@ -0,0 +1,75 @@
+#include <assert.h>
+#include <iostream>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "occlusion_buffer.hpp"
+#include "task_scheduler.hpp"
+
+int main()
+{
+  glm::mat4 view_projection =
+    glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 100.0f) *
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  // a 4x4 wall five units in front of the camera
+  std::vector<glm::vec3> positions = {
+    { -2.0f, -2.0f, -5.0f },
+    {  2.0f, -2.0f, -5.0f },
+    {  2.0f,  2.0f, -5.0f },
+    { -2.0f,  2.0f, -5.0f }
+  };
+  std::vector<int> indices = { 0, 1, 2, 0, 2, 3 };
+
+  OcclusionBuffer buffer(256, 192);
+  buffer.clear(view_projection);
+  buffer.add_occluder(glm::mat4(1.0f), positions, indices);
+  buffer.rasterize();
+
+  assert(buffer.get_triangle_count() == 2);
+  assert(buffer.get_depth(128, 96) < 1.0f);
+  assert(buffer.get_depth(0, 0) == 1.0f);
+
+  // hidden behind the wall
+  assert(!buffer.is_visible(AABB(glm::vec3(-0.5f, -0.5f, -11.0f), glm::vec3(0.5f, 0.5f, -10.0f))));
+
+  // in front of the wall
+  assert(buffer.is_visible(AABB(glm::vec3(-0.5f, -0.5f, -4.0f), glm::vec3(0.5f, 0.5f, -3.0f))));
+
+  // behind the wall, but sticking out to the side
+  assert(buffer.is_visible(AABB(glm::vec3(-0.5f, -0.5f, -11.0f), glm::vec3(8.0f, 0.5f, -10.0f))));
+
+  // crossing the near plane
+  assert(buffer.is_visible(AABB(glm::vec3(-0.5f, -0.5f, -11.0f), glm::vec3(0.5f, 0.5f, 1.0f))));
+
+  // an occluder crossing the near plane has to be clipped, not dropped
+  std::vector<glm::vec3> floor = {
+    { -50.0f, -1.0f,  10.0f },
+    {  50.0f, -1.0f,  10.0f },
+    {  50.0f, -1.0f, -50.0f },
+    { -50.0f, -1.0f, -50.0f }
+  };
+  buffer.clear(view_projection);
+  buffer.add_occluder(glm::mat4(1.0f), floor, indices);
+  buffer.rasterize();
+  assert(!buffer.is_visible(AABB(glm::vec3(-0.5f, -3.0f, -11.0f), glm::vec3(0.5f, -2.0f, -10.0f))));
+  assert(buffer.is_visible(AABB(glm::vec3(-0.5f, 0.0f, -11.0f), glm::vec3(0.5f, 1.0f, -10.0f))));
+
+  // large occluder count goes through the threaded path
+  TaskScheduler::get().set_num_threads(4);
+  buffer.clear(view_projection);
+  for(int i = 0; i < 400; ++i)
+  {
+    buffer.add_occluder(glm::mat4(1.0f), positions, indices);
+  }
+  buffer.rasterize();
+  assert(!buffer.is_visible(AABB(glm::vec3(-0.5f, -0.5f, -11.0f), glm::vec3(0.5f, 0.5f, -10.0f))));
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
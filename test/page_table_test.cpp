@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <iostream>
+
+#include "page_table.hpp"
+
+int main()
+{
+  // 1000x600 in 128 pages: 8x5, 4x3, 2x2, 1x1
+  PageTable table(1000, 600, 128, 4, 2);
+  assert(table.get_pages_x(0) == 8 && table.get_pages_y(0) == 5);
+  assert(table.get_pages_x(1) == 4 && table.get_pages_y(1) == 3);
+  assert(table.get_pages_x(3) == 1 && table.get_pages_y(3) == 1);
+  assert(table.get_indirection_width(0) == 8 && table.get_indirection_height(0) == 8);
+  assert(table.get_indirection_width(3) == 1 && table.get_indirection_height(3) == 1);
+
+  PageTable::Page const page = PageTable::from_key(PageTable::make_key(2, 7, 4));
+  assert(page.level == 2 && page.x == 7 && page.y == 4);
+  assert(PageTable::make_key(1, 0, 0) > PageTable::make_key(0, 255, 255));
+
+  // four slots, the top page is pinned
+  int const top = table.allocate(3, 0, 0, 0);
+  assert(top == 0);
+  assert(table.get_slot(3, 0, 0) == top);
+  assert(table.allocate(2, 1, 1, 1) == 1);
+  assert(table.allocate(1, 2, 2, 2) == 2);
+  assert(table.allocate(0, 5, 4, 3) == 3);
+  assert(table.get_resident_count() == 4);
+
+  // lookups fall back to the finest resident page above
+  std::vector<uint8_t> texels;
+  table.build_indirection(0, texels);
+  assert(texels.size() == 8 * 8 * 4);
+  uint8_t const* texel = &texels[(4 * 8 + 5) * 4];
+  assert(texel[0] == 1 && texel[1] == 1 && texel[2] == 0);
+  texel = &texels[(4 * 8 + 4) * 4];
+  assert(texel[0] == 0 && texel[1] == 1 && texel[2] == 1);
+  texel = &texels[0];
+  assert(texel[0] == 0 && texel[1] == 0 && texel[2] == 3);
+
+  // the least recently used page goes first, pages used in the current
+  // frame and the top page never
+  table.touch(1, 4);
+  assert(table.allocate(0, 0, 0, 4) == 2);
+  assert(table.get_slot(1, 2, 2) == -1);
+  assert(table.allocate(0, 1, 0, 4) == 3);
+  assert(table.allocate(0, 2, 0, 4) == -1);
+  assert(table.get_slot(3, 0, 0) == top);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
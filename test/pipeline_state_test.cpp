@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "material.hpp"
+#include "pipeline_state.hpp"
+
+int main()
+{
+  // raster word round trip
+  uint32_t const raster = PipelineState::pack_raster(true, false, true, false, false,
+                                                     GL_FRONT, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  PipelineState state;
+  state.raster = raster;
+  assert(state.color_mask(0) && !state.color_mask(1) && state.color_mask(2) && !state.color_mask(3));
+  assert(!state.depth_mask());
+  assert(state.cull_face() == GL_FRONT);
+  assert(state.blend_sfactor() == GL_SRC_ALPHA);
+  assert(state.blend_dfactor() == GL_ONE_MINUS_SRC_ALPHA);
+
+  assert(PipelineState::capability_from_bit(PipelineState::capability_bit(GL_DEPTH_TEST)) == GL_DEPTH_TEST);
+
+  bool thrown = false;
+  try
+  {
+    PipelineState::capability_bit(GL_TEXTURE_2D);
+  }
+  catch(std::exception const&)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // finalize() bakes the material state
+  Material opaque;
+  opaque.enable(GL_DEPTH_TEST);
+  opaque.disable(GL_CULL_FACE);
+  opaque.depth_mask(false);
+  PipelineState const& baked = opaque.get_pipeline_state();
+  assert(baked.enabled_caps == (1u << PipelineState::capability_bit(GL_DEPTH_TEST)));
+  assert(baked.specified_caps == ((1u << PipelineState::capability_bit(GL_DEPTH_TEST)) |
+                                  (1u << PipelineState::capability_bit(GL_CULL_FACE))));
+  assert(!baked.depth_mask());
+  assert(baked.cull_face() == GL_BACK);
+  assert(baked.texture_count == 0);
+  assert(baked.program == 0);
+
+  // changes after finalize() are picked up again
+  uint64_t const opaque_key = opaque.get_sort_key();
+  opaque.cull_face(GL_FRONT);
+  assert(opaque.get_pipeline_state().cull_face() == GL_FRONT);
+  assert(opaque.get_sort_key() != opaque_key);
+
+  // blended materials sort after opaque ones
+  Material blended;
+  blended.enable(GL_BLEND);
+  blended.blend_func(GL_ONE, GL_ONE);
+  assert(opaque.get_sort_key() < blended.get_sort_key());
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "pixel_kernels.hpp"
+
+namespace {
+
+std::vector<uint8_t> random_pixels(size_t size)
+{
+  std::vector<uint8_t> pixels(size);
+  for(auto& value : pixels)
+  {
+    value = static_cast<uint8_t>(rand());
+  }
+  return pixels;
+}
+
+} // namespace
+
+int main()
+{
+  // counts that don't fill a whole SIMD register leave a scalar tail
+  for(size_t count : { 0, 1, 3, 4, 5, 15, 16, 17, 63, 1000 })
+  {
+    for(int bpp : { 3, 4 })
+    {
+      std::vector<uint8_t> const orig = random_pixels(count * bpp);
+      std::vector<uint8_t> simd = orig;
+      std::vector<uint8_t> ref = orig;
+      pixel_kernels::swap_red_blue(simd.data(), count, bpp);
+      pixel_kernels::scalar::swap_red_blue(ref.data(), count, bpp);
+      assert(simd == ref);
+      for(size_t i = 0; i < count; ++i)
+      {
+        assert(simd[i * bpp + 0] == orig[i * bpp + 2]);
+        assert(simd[i * bpp + 1] == orig[i * bpp + 1]);
+      }
+    }
+
+    for(bool swap : { false, true })
+    {
+      std::vector<uint8_t> simd = random_pixels(count * 4);
+      std::vector<uint8_t> ref = simd;
+      pixel_kernels::unpremultiply(simd.data(), count, swap);
+      pixel_kernels::scalar::unpremultiply(ref.data(), count, swap);
+      assert(simd == ref);
+    }
+  }
+
+  // the table gives the same as a divide, give or take rounding
+  {
+    uint8_t pixels[] = { 64, 32, 0, 128,   255, 255, 255, 255,   10, 20, 30, 0,   200, 100, 50, 100 };
+    pixel_kernels::unpremultiply(pixels, 4, true);
+    uint8_t const expected[] = { 0, 63, 127, 128,   255, 255, 255, 255,   0, 0, 0, 0,   127, 255, 255, 100 };
+    for(size_t i = 0; i < sizeof(pixels); ++i)
+    {
+      assert(abs(pixels[i] - expected[i]) <= 1);
+    }
+  }
+
+  // rows are flipped, padding stays
+  for(int height : { 1, 2, 5 })
+  {
+    size_t const row_bytes = 37;
+    size_t const pitch = 40;
+    std::vector<uint8_t> const orig = random_pixels(height * pitch);
+    std::vector<uint8_t> pixels = orig;
+    pixel_kernels::flip_rows(pixels.data(), height, row_bytes, pitch);
+    for(int y = 0; y < height; ++y)
+    {
+      assert(memcmp(pixels.data() + y * pitch, orig.data() + (height - y - 1) * pitch, row_bytes) == 0);
+      assert(memcmp(pixels.data() + y * pitch + row_bytes, orig.data() + y * pitch + row_bytes, pitch - row_bytes) == 0);
+    }
+  }
+
+  std::cout << "OK " << pixel_kernels::get_isa() << std::endl;
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,55 @@
+#include <assert.h>
+#include <iostream>
+
+#include "residency_manager.hpp"
+
+int main()
+{
+  size_t const total = Texture::get_total_bytes();
+
+  // 1024x1024 RGBA with a full mip chain
+  TexturePtr texture = std::make_shared<Texture>(GL_TEXTURE_2D, 0);
+  texture->set_storage(1024 * 1024 * 4, 11);
+  assert(texture->get_level_bytes(0) == 1024 * 1024 * 4);
+  assert(texture->get_level_bytes(4) == 64 * 64 * 4);
+
+  size_t bytes = 0;
+  for(int level = 0; level < 11; ++level)
+  {
+    bytes += texture->get_level_bytes(level);
+  }
+  assert(texture->get_bytes() == bytes);
+  assert(Texture::get_total_bytes() == total + bytes);
+
+  // eviction keeps the 64x64 level and everything below it
+  assert(ResidencyManager::get_evict_level(*texture) == 4);
+
+  // small textures have nothing to give back
+  TexturePtr small = std::make_shared<Texture>(GL_TEXTURE_2D, 0);
+  small->set_storage(32 * 32 * 4, 6);
+  assert(ResidencyManager::get_evict_level(*small) == 0);
+  small.reset();
+  assert(Texture::get_total_bytes() == total + bytes);
+
+  // textures that are drawn every frame stay resident, whatever the budget
+  ResidencyManager manager;
+  manager.set_budget(1);
+  manager.add(texture, "texture.png", 0);
+  for(int frame = 0; frame < 2 * ResidencyManager::GRACE_FRAMES; ++frame)
+  {
+    manager.update();
+    texture->set_last_used(manager.get_frame());
+  }
+  assert(manager.get_evictions() == 0);
+  assert(manager.get_reloads() == 0);
+  assert(texture->get_bytes() == bytes);
+
+  texture.reset();
+  assert(Texture::get_total_bytes() == total);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
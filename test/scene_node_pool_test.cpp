@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "scene_node.hpp"
+
+static std::vector<std::string> child_names(SceneNode* node)
+{
+  std::vector<std::string> names;
+  for(SceneNode* child : node->get_children())
+  {
+    names.push_back(child->get_name());
+  }
+  return names;
+}
+
+int main()
+{
+  SceneNodePool& pool = SceneNodePool::get();
+  int const initial_count = pool.get_node_count();
+
+  {
+    SceneNodePtr root = SceneNode::create("root");
+    assert(root->get_children().empty());
+    assert(root->get_parent() == nullptr);
+
+    root->attach_child(SceneNode::create("a"));
+    root->attach_child(SceneNode::create("b"));
+    root->attach_child(SceneNode::create("c"));
+    assert((child_names(root.get()) == std::vector<std::string>{ "a", "b", "c" }));
+    assert(pool.get_node_count() == initial_count + 4);
+
+    // detach from the middle, the siblings stay linked
+    SceneNode* b = *std::next(root->get_children().begin());
+    assert(b->get_parent() == root.get());
+    SceneNodePtr detached = b->detach();
+    assert(detached->get_parent() == nullptr);
+    assert((child_names(root.get()) == std::vector<std::string>{ "a", "c" }));
+
+    // reattach at the end
+    root->attach_child(std::move(detached));
+    assert((child_names(root.get()) == std::vector<std::string>{ "a", "c", "b" }));
+
+    // detach first and last
+    SceneNodePtr a = (*root->get_children().begin())->detach();
+    SceneNode* last = nullptr;
+    for(SceneNode* child : root->get_children())
+    {
+      last = child;
+    }
+    SceneNodePtr last_ptr = last->detach();
+    assert((child_names(root.get()) == std::vector<std::string>{ "c" }));
+
+    // destroyed handles are reused
+    SceneNodeHandle handle = a->get_handle();
+    a.reset();
+    SceneNodePtr reused = SceneNode::create("d");
+    assert(reused->get_handle() == handle);
+    assert(pool.resolve(handle) == reused.get());
+
+    // deep trees are destroyed with their root
+    SceneNode* node = root.get();
+    for(int i = 0; i < 3000; ++i)
+    {
+      node = node->create_child();
+    }
+    assert(pool.get_node_count() == initial_count + 3004);
+    assert(pool.get_allocation_count() >= 3);
+  }
+
+  assert(pool.get_node_count() == initial_count);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
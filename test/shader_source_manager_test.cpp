@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "shader_source_manager.hpp"
+
+namespace {
+
+void write_file(std::filesystem::path const& filename, std::string const& text)
+{
+  std::ofstream out(filename);
+  out << text;
+}
+
+bool contains(std::string const& text, std::string const& part)
+{
+  return text.find(part) != std::string::npos;
+}
+
+} // namespace
+
+int main()
+{
+  std::filesystem::path const dir = std::filesystem::temp_directory_path() / "shader_source_manager_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "lib");
+
+  write_file(dir / "lib" / "common.glsl", "float common_value;\n");
+  write_file(dir / "lib" / "light.glsl", "#include \"common.glsl\"\nfloat light_value;\n");
+  write_file(dir / "a.frag", "void a();\n#  include \"lib/light.glsl\"\nvoid main() {}\n");
+  write_file(dir / "b.frag", "#include \"lib/common.glsl\" // trailing comment\nvoid main() {}\n");
+
+  ShaderSourceManager manager;
+
+  // includes are expanded recursively, relative to the including file
+  std::string const a = manager.get_source(dir / "a.frag");
+  assert(contains(a, "void a();"));
+  assert(contains(a, "float common_value;"));
+  assert(contains(a, "float light_value;"));
+  assert(!contains(a, "#  include"));
+  assert(manager.get_reads() == 3);
+
+  // the including file continues with its own line numbers
+  int const a_id = manager.get_source_id(dir / "a.frag");
+  assert(a_id >= ShaderSourceManager::FIRST_FILE_ID);
+  assert(manager.get_filename(a_id) == ShaderSourceManager::normalize(dir / "a.frag"));
+#ifndef HAVE_OPENGLES2
+  assert(contains(a, "#line 3 " + std::to_string(a_id) + "\nvoid main() {}\n"));
+#endif
+
+  // already read files aren't read again, whatever the path spelling
+  manager.get_source(dir / "lib" / ".." / "a.frag");
+  manager.get_source(dir / "b.frag");
+  assert(manager.get_reads() == 4);
+
+  // relative paths are resolved against the working directory
+  std::filesystem::path const old_path = std::filesystem::current_path();
+  std::filesystem::current_path(dir / "lib");
+  manager.get_source("../b.frag");
+  assert(manager.get_reads() == 4);
+  std::filesystem::current_path(old_path);
+
+  assert(manager.depends_on(dir / "a.frag", dir / "lib" / "common.glsl"));
+  assert(manager.depends_on(dir / "b.frag", dir / "lib" / "common.glsl"));
+  assert(!manager.depends_on(dir / "b.frag", dir / "lib" / "light.glsl"));
+  assert(manager.get_dependencies(dir / "a.frag").size() == 3);
+
+  // invalidating a file drops everything that includes it
+  std::vector<std::string> const dropped = manager.invalidate(dir / "lib" / "light.glsl");
+  assert(dropped.size() == 2);
+  manager.get_source(dir / "b.frag");
+  assert(manager.get_reads() == 4);
+  manager.get_source(dir / "a.frag");
+  assert(manager.get_reads() == 6);
+
+  // ids survive invalidation
+  assert(manager.get_source_id(dir / "a.frag") == a_id);
+
+  // ids don't depend on the order files are read in
+  {
+    ShaderSourceManager other;
+    other.get_source(dir / "b.frag");
+    other.get_source(dir / "a.frag");
+    assert(other.get_source_id(dir / "a.frag") == a_id);
+    assert(other.get_source(dir / "a.frag") == manager.get_source(dir / "a.frag"));
+  }
+
+  // include cycles are reported instead of recursing forever
+  write_file(dir / "cycle1.glsl", "#include \"cycle2.glsl\"\n");
+  write_file(dir / "cycle2.glsl", "#include \"cycle1.glsl\"\n");
+  bool thrown = false;
+  try
+  {
+    manager.get_source(dir / "cycle1.glsl");
+  }
+  catch(std::exception const&)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  std::filesystem::remove_all(dir);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
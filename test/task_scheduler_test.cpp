@@ -0,0 +1,71 @@
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "task_scheduler.hpp"
+
+int main()
+{
+  for(int num_threads : { 1, 2, 4, 8 })
+  {
+    TaskScheduler scheduler(num_threads);
+
+    // every element is visited exactly once
+    std::vector<int> visits(100000, 0);
+    scheduler.parallel_for(0, visits.size(), 1000,
+                           [&visits](size_t begin, size_t end) {
+                             for(size_t i = begin; i < end; ++i)
+                             {
+                               visits[i] += 1;
+                             }
+                           });
+    for(int v : visits)
+    {
+      assert(v == 1);
+    }
+
+    // tasks can spawn and wait for tasks themselves
+    std::atomic<int> count(0);
+    TaskGroup group;
+    for(int i = 0; i < 16; ++i)
+    {
+      scheduler.run(group, [&scheduler, &count]{
+          scheduler.parallel_for(0, 64, 4, [&count](size_t begin, size_t end) {
+              count += static_cast<int>(end - begin);
+            });
+        });
+    }
+    scheduler.wait(group);
+    assert(count == 16 * 64);
+
+    // a throwing task doesn't keep wait() from returning, it rethrows
+    TaskGroup throwing;
+    for(int i = 0; i < 8; ++i)
+    {
+      scheduler.run(throwing, [i]{
+          if (i == 3)
+          {
+            throw std::runtime_error("task failed");
+          }
+        });
+    }
+    bool thrown = false;
+    try
+    {
+      scheduler.wait(throwing);
+    }
+    catch(std::runtime_error const&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+
+    std::cout << num_threads << " threads: OK" << std::endl;
+  }
+
+  return 0;
+}
+
+/* EOF */
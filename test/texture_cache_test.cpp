@@ -0,0 +1,55 @@
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+
+#include "texture_cache.hpp"
+
+int main()
+{
+  std::filesystem::path const dir = std::filesystem::temp_directory_path() / "texture_cache_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "a.png") << "a";
+
+  TextureCache cache;
+  size_t const bytes = 64 * 64 * 3;
+
+  TexturePtr texture = std::make_shared<Texture>(GL_TEXTURE_2D, 0);
+  cache.insert(dir / "a.png", GL_TEXTURE_2D, true, texture, bytes);
+
+  // hits regardless of the path spelling
+  assert(cache.find(dir / "." / "a.png", GL_TEXTURE_2D, true) == texture);
+  assert(cache.get_hits() == 1);
+  assert(cache.get_bytes_saved() == bytes);
+
+  // different sampling parameters are separate textures
+  assert(!cache.find(dir / "a.png", GL_TEXTURE_2D, false));
+  assert(!cache.find(dir / "a.png", GL_TEXTURE_CUBE_MAP, true));
+  assert(cache.get_misses() == 2);
+
+  // a modified file is loaded again
+  std::filesystem::last_write_time(dir / "a.png",
+                                   std::filesystem::last_write_time(dir / "a.png") + std::chrono::seconds(1));
+  assert(!cache.find(dir / "a.png", GL_TEXTURE_2D, true));
+
+  // erasing only drops the entry of the given texture
+  cache.insert(dir / "a.png", GL_TEXTURE_2D, true, texture, bytes);
+  TexturePtr const other = std::make_shared<Texture>(GL_TEXTURE_2D, 0);
+  cache.erase(dir / "a.png", GL_TEXTURE_2D, true, *other);
+  assert(cache.find(dir / "a.png", GL_TEXTURE_2D, true) == texture);
+  cache.erase(dir / "a.png", GL_TEXTURE_2D, true, *texture);
+  assert(!cache.find(dir / "a.png", GL_TEXTURE_2D, true));
+
+  // only weak references are kept
+  cache.insert(dir / "a.png", GL_TEXTURE_2D, true, texture, bytes);
+  texture.reset();
+  assert(!cache.find(dir / "a.png", GL_TEXTURE_2D, true));
+
+  std::filesystem::remove_all(dir);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
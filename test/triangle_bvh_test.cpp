@@ -0,0 +1,132 @@
+#include <assert.h>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "mesh.hpp"
+#include "model.hpp"
+#include "scene_manager.hpp"
+#include "triangle_bvh.hpp"
+
+// reference intersection, Moeller-Trumbore against every triangle
+static RayHit brute_force(std::vector<glm::vec3> const& positions, std::vector<int> const& indices,
+                          Ray const& ray)
+{
+  RayHit hit;
+  for(size_t i = 0; i < indices.size() / 3; ++i)
+  {
+    glm::vec3 const& v0 = positions[indices[3 * i + 0]];
+    glm::vec3 const e1 = positions[indices[3 * i + 1]] - v0;
+    glm::vec3 const e2 = positions[indices[3 * i + 2]] - v0;
+    glm::vec3 const p = glm::cross(ray.direction, e2);
+    float const det = glm::dot(e1, p);
+    if (det == 0.0f)
+    {
+      continue;
+    }
+
+    glm::vec3 const s = ray.origin - v0;
+    glm::vec3 const q = glm::cross(s, e1);
+    float const u = glm::dot(s, p) / det;
+    float const v = glm::dot(ray.direction, q) / det;
+    float const t = glm::dot(e2, q) / det;
+    if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < hit.distance)
+    {
+      hit.distance = t;
+      hit.triangle = static_cast<int>(i);
+    }
+  }
+  return hit;
+}
+
+int main()
+{
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+  std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+
+  // random soup of small triangles
+  std::vector<glm::vec3> positions;
+  std::vector<int> indices;
+  for(int i = 0; i < 2000; ++i)
+  {
+    glm::vec3 const center(coord(rng), coord(rng), coord(rng));
+    for(int k = 0; k < 3; ++k)
+    {
+      indices.push_back(static_cast<int>(positions.size()));
+      positions.push_back(center + glm::vec3(offset(rng), offset(rng), offset(rng)));
+    }
+  }
+
+  TriangleBVH bvh(positions, indices);
+  assert(bvh.get_triangle_count() == 2000);
+
+  int hits = 0;
+  for(int i = 0; i < 2000; ++i)
+  {
+    Ray ray{ glm::vec3(coord(rng), coord(rng), coord(rng)) * 2.0f,
+             glm::vec3(coord(rng), coord(rng), coord(rng)) };
+
+    RayHit const expected = brute_force(positions, indices, ray);
+    RayHit hit;
+    bool const found = bvh.raycast(ray, hit);
+
+    assert(found == (expected.triangle >= 0));
+    if (found)
+    {
+      assert(std::abs(hit.distance - expected.distance) <= 1e-4f * expected.distance);
+      hits += 1;
+    }
+  }
+  assert(hits > 0);
+
+  // an existing hit limits the search
+  {
+    Ray ray{ glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+    std::vector<glm::vec3> quad = {
+      { -1.0f, -1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { -1.0f, 1.0f, 0.0f }
+    };
+    std::vector<int> quad_indices = { 0, 1, 2, 0, 2, 3 };
+    TriangleBVH quad_bvh(quad, quad_indices);
+
+    RayHit hit;
+    assert(quad_bvh.raycast(ray, hit));
+    assert(std::abs(hit.distance - 5.0f) < 1e-5f);
+
+    RayHit closer;
+    closer.distance = 4.0f;
+    assert(!quad_bvh.raycast(ray, closer));
+    assert(closer.triangle == -1);
+
+    // the same quad in the scene graph, scaled and moved away, the
+    // mesh has no buffers, so it is created and destroyed without a GL
+    // context
+    SceneManager mgr;
+    auto mesh = std::make_unique<Mesh>(GL_TRIANGLES);
+    mesh->build_bvh(quad, quad_indices);
+    ModelPtr model = std::make_shared<Model>();
+    model->add_mesh(std::move(mesh));
+
+    SceneNode* node = mgr.get_world()->create_child();
+    node->set_position(glm::vec3(0.0f, 0.0f, -10.0f));
+    node->set_scale(glm::vec3(4.0f, 4.0f, 4.0f));
+    node->attach_model(model);
+    mgr.get_world()->update_transform();
+
+    SceneManager::RaycastResult result = mgr.raycast(glm::vec3(3.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    assert(result.node == node);
+    assert(result.model == model.get());
+    assert(result.mesh == 0);
+    assert(std::abs(result.distance - 10.0f) < 1e-4f);
+
+    result = mgr.raycast(glm::vec3(5.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    assert(result.node == nullptr);
+  }
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
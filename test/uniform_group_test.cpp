@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "uniform_group.hpp"
+
+static int g_allocations = 0;
+
+void* operator new(size_t size)
+{
+  g_allocations += 1;
+  if (void* p = std::malloc(size))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+int main()
+{
+  UniformGroup group;
+
+  group.set_uniform("eye_index", 0);
+  group.set_uniform("material.shininess_with_a_long_name", 1.0f);
+  group.set_uniform("light.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
+  group.set_uniform("ShadowMapMatrix", glm::mat4(1.0f));
+  group.set_uniform("MVP", UniformSymbol::ModelViewProjectionMatrix);
+  assert(group.get_uniform_count() == 5);
+
+  // updating existing uniforms doesn't allocate
+  g_allocations = 0;
+  for(int i = 0; i < 1000; ++i)
+  {
+    group.set_uniform("eye_index", i % 2);
+    group.set_uniform("material.shininess_with_a_long_name", static_cast<float>(i));
+    group.set_uniform("light.diffuse", glm::vec3(static_cast<float>(i), 0.0f, 0.0f));
+    group.set_uniform("ShadowMapMatrix", glm::mat4(static_cast<float>(i)));
+    group.set_uniform("MVP", UniformSymbol::ModelViewMatrix);
+  }
+  assert(g_allocations == 0);
+  assert(group.get_uniform_count() == 5);
+
+  assert(std::get<int>(*group.get_uniform("eye_index")) == 1);
+  assert(std::get<float>(*group.get_uniform("material.shininess_with_a_long_name")) == 999.0f);
+  assert(std::get<UniformSymbol>(*group.get_uniform("MVP")) == UniformSymbol::ModelViewMatrix);
+  assert(group.get_uniform("missing") == nullptr);
+
+  // a value of a different type replaces the old one
+  group.set_uniform("eye_index", 2.0f);
+  assert(std::get<float>(*group.get_uniform("eye_index")) == 2.0f);
+  assert(group.get_uniform_count() == 5);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
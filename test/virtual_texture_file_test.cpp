@@ -0,0 +1,86 @@
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "virtual_texture_file.hpp"
+
+int main()
+{
+  std::filesystem::path const filename = std::filesystem::temp_directory_path() / "virtual_texture_file_test.vtex";
+
+  // 40x20 RGB, every texel tells where it came from
+  int const width = 40;
+  int const height = 20;
+  std::vector<uint8_t> pixels(width * height * 3);
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      pixels[(y * width + x) * 3 + 0] = static_cast<uint8_t>(x);
+      pixels[(y * width + x) * 3 + 1] = static_cast<uint8_t>(y);
+      pixels[(y * width + x) * 3 + 2] = 7;
+    }
+  }
+
+  assert(VirtualTextureFile::get_level_count(40, 20, 16) == 3);
+  assert(VirtualTextureFile::get_level_count(16, 16, 16) == 1);
+  VirtualTextureFile::write(filename, pixels.data(), width, height, 3, 16, 2);
+
+  {
+    VirtualTextureFile file(filename);
+    assert(file.get_width() == width && file.get_height() == height);
+    assert(file.get_levels() == 3);
+    assert(file.get_padded_size() == 20);
+    assert(file.get_pages_x(0) == 3 && file.get_pages_y(0) == 2);
+    assert(file.get_pages_x(1) == 2 && file.get_pages_y(1) == 1);
+    assert(file.get_pages_x(2) == 1 && file.get_pages_y(2) == 1);
+
+    std::vector<uint8_t> page;
+    file.read_page(0, 1, 1, page);
+    assert(page.size() == 20 * 20 * 3);
+    // the border reaches into the neighbours, the texel at 2,2 is 16,16
+    assert(page[(2 * 20 + 2) * 3 + 0] == 16 && page[(2 * 20 + 2) * 3 + 1] == 16);
+    assert(page[(0 * 20 + 0) * 3 + 0] == 14 && page[(0 * 20 + 0) * 3 + 1] == 14);
+    // and repeats the edge past the image
+    assert(page[(19 * 20 + 19) * 3 + 0] == 33 && page[(19 * 20 + 19) * 3 + 1] == 19);
+
+    file.read_page(0, 2, 0, page);
+    assert(page[(2 * 20 + 19) * 3 + 0] == 39);
+
+    file.read_page(2, 0, 0, page);
+    assert(page[(2 * 20 + 2) * 3 + 2] == 7);
+
+    bool thrown = false;
+    try
+    {
+      file.read_page(1, 2, 0, page);
+    }
+    catch(std::exception const&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+
+  // truncated files are refused up front
+  std::filesystem::resize_file(filename, std::filesystem::file_size(filename) - 1);
+  bool thrown = false;
+  try
+  {
+    VirtualTextureFile file(filename);
+  }
+  catch(std::exception const&)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  std::filesystem::remove(filename);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
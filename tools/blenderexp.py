@@ -64,6 +64,8 @@ def write_mesh(obj):
         outfile.write("mat %s.material\n" % obj.material_slots[0].name)
     if obj.parent and (obj.parent.type == 'MESH' or obj.parent.type == 'EMPTY'):
         outfile.write("parent %s\n" % obj.parent.name)
+    if obj.get("occluder"):
+        outfile.write("occluder\n")
     m = obj.matrix_local
     loc   = b2gl_vec3(m.to_translation())
     quat  = b2gl_quat(m.to_quaternion())
@@ -0,0 +1,39 @@
+#!/usr/bin/env python3
+
+import os
+import sys
+from PIL import Image
+
+if len(sys.argv) != 3:
+    print("Usage: %s DIRECTORY FILENAME" % sys.argv[0])
+    print("Takes the up, dn, ft, bk, lf and rt images in DIRECTORY")
+    print("and joins them into a single image in the form:")
+    print("+--------+")
+    print("|  []    |")
+    print("|[][][][]|")
+    print("|  []    |")
+    print("+--------+")
+    print("The reverse of splitcubemap.py.")
+else:
+    spec = [("up", 1, 0),
+            ("dn", 1, 2),
+            ("ft", 1, 1),
+            ("bk", 3, 1),
+            ("lf", 0, 1),
+            ("rt", 2, 1)]
+
+    faces = {}
+    for name, x, y in spec:
+        faces[name] = Image.open(os.path.join(sys.argv[1], name + ".png"))
+
+    w, h = faces["up"].size
+    for name, x, y in spec:
+        if faces[name].size != (w, h):
+            sys.exit("%s.png: expected %dx%d, got %dx%d" % ((name, w, h) + faces[name].size))
+
+    img = Image.new(faces["up"].mode, (4 * w, 3 * h))
+    for name, x, y in spec:
+        img.paste(faces[name], (x * w, y * h))
+    img.save(sys.argv[2])
+
+# EOF #
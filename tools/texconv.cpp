@@ -0,0 +1,266 @@
+// Converts the textures referenced by .material files into KTX files
+// with BC1 or BC3 data and a full mip chain, or with --virtual into
+// paged .vtex files for VirtualTexture. MaterialParser picks them up in
+// place of the original images.
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string.h>
+
+#include "block_encoder.hpp"
+#include "compressed_image.hpp"
+#include "format.hpp"
+#include "mipmap_builder.hpp"
+#include "pixel_kernels.hpp"
+#include "tokenize.hpp"
+#include "virtual_texture_file.hpp"
+
+namespace {
+
+struct Options
+{
+  std::string format = "auto";
+  bool force = false;
+  bool virtual_texture = false;
+  std::vector<std::filesystem::path> materials = {};
+};
+
+/** The image files a material uses, the same ones MaterialParser
+    loads through load_texture() */
+std::vector<std::filesystem::path> collect_textures(std::filesystem::path const& filename, bool diffuse_only)
+{
+  std::ifstream in(filename.string());
+  if (!in)
+  {
+    throw std::runtime_error("couldn't open " + filename.string());
+  }
+
+  std::vector<std::filesystem::path> result;
+  std::string line;
+  while(std::getline(in, line))
+  {
+    std::vector<std::string> const args = argument_parse(line);
+    if (!args.empty() &&
+        (args[0] == "material.diffuse_texture" ||
+         (!diffuse_only && args[0] == "material.specular_texture")))
+    {
+      for(size_t i = 1; i < args.size(); ++i)
+      {
+        if (args[i].compare(0, 10, "buildin://") != 0)
+        {
+          result.push_back(filename.parent_path() / args[i]);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+/** Tightly packed RGBA, bottom row first like Texture uploads it */
+std::vector<uint8_t> load_pixels(std::filesystem::path const& filename, int& width, int& height)
+{
+  SDL_Surface* loaded = IMG_Load(filename.c_str());
+  if (!loaded)
+  {
+    throw std::runtime_error("couldn't load " + filename.string() + ": " + SDL_GetError());
+  }
+  SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ABGR8888, 0);
+  SDL_FreeSurface(loaded);
+  if (!surface)
+  {
+    throw std::runtime_error("couldn't convert " + filename.string() + ": " + SDL_GetError());
+  }
+
+  width = surface->w;
+  height = surface->h;
+  std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+  for(int y = 0; y < height; ++y)
+  {
+    memcpy(pixels.data() + static_cast<size_t>(y) * width * 4,
+           static_cast<uint8_t const*>(surface->pixels) + y * surface->pitch,
+           static_cast<size_t>(width) * 4);
+  }
+  SDL_FreeSurface(surface);
+  pixel_kernels::flip_rows(pixels.data(), height, static_cast<size_t>(width) * 4, static_cast<size_t>(width) * 4);
+  return pixels;
+}
+
+bool has_alpha(std::vector<uint8_t> const& pixels)
+{
+  for(size_t i = 3; i < pixels.size(); i += 4)
+  {
+    if (pixels[i] != 255)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void convert_virtual(std::filesystem::path const& filename, Options const& opts)
+{
+  std::filesystem::path output = filename;
+  output.replace_extension(".vtex");
+
+  if (!opts.force && VirtualTextureFile::find_sibling(filename) == output)
+  {
+    std::cout << output.string() << ": up to date" << std::endl;
+    return;
+  }
+
+  int width;
+  int height;
+  std::vector<uint8_t> pixels = load_pixels(filename, width, height);
+
+  // pages without alpha are stored as RGB
+  int bytes_per_pixel = 4;
+  if (!has_alpha(pixels))
+  {
+    for(size_t i = 0; i < pixels.size() / 4; ++i)
+    {
+      memmove(pixels.data() + i * 3, pixels.data() + i * 4, 3);
+    }
+    pixels.resize(pixels.size() / 4 * 3);
+    bytes_per_pixel = 3;
+  }
+
+  VirtualTextureFile::write(output, pixels.data(), width, height, bytes_per_pixel);
+
+  VirtualTextureFile const vtex(output);
+  int pages = 0;
+  for(int level = 0; level < vtex.get_levels(); ++level)
+  {
+    pages += vtex.get_pages_x(level) * vtex.get_pages_y(level);
+  }
+  std::cout << format("%s: %dx%d, %d levels, %d pages of %dx%d",
+                      output.string(), width, height, vtex.get_levels(), pages,
+                      vtex.get_page_size(), vtex.get_page_size())
+            << std::endl;
+}
+
+void convert(std::filesystem::path const& filename, Options const& opts)
+{
+  std::filesystem::path output = filename;
+  output.replace_extension(".ktx");
+
+  if (!opts.force && CompressedImage::find_sibling(filename) == output)
+  {
+    std::cout << output.string() << ": up to date" << std::endl;
+    return;
+  }
+
+  int width;
+  int height;
+  std::vector<uint8_t> const pixels = load_pixels(filename, width, height);
+
+  uint32_t const block_format = (opts.format == "bc3" || (opts.format == "auto" && has_alpha(pixels)))
+    ? CompressedImage::BC3_RGBA
+    : CompressedImage::BC1_RGB;
+
+  std::vector<CompressedImage::Level> levels;
+  levels.push_back({ width, height, block_encoder::encode(block_format, pixels.data(), width, height) });
+  for(auto const& mip : MipmapBuilder::build(pixels.data(), width, height, width * 4, 4,
+                                             MipmapBuilder::BOX, true))
+  {
+    levels.push_back({ mip.width, mip.height,
+                       block_encoder::encode(block_format, mip.pixels.data(), mip.width, mip.height) });
+  }
+
+  CompressedImage const image(block_format, std::move(levels));
+  image.save_ktx(output);
+
+  std::cout << format("%s: %dx%d %s, %d levels, %d KB -> %d KB",
+                      output.string(), width, height,
+                      (block_format == CompressedImage::BC3_RGBA) ? "BC3" : "BC1",
+                      image.get_levels().size(),
+                      pixels.size() / 1024, image.get_size() / 1024)
+            << std::endl;
+}
+
+Options parse_args(int argc, char** argv)
+{
+  Options opts;
+  for(int i = 1; i < argc; ++i)
+  {
+    if (strcmp("--help", argv[i]) == 0 || strcmp("-h", argv[i]) == 0)
+    {
+      std::cout << "Usage: " << argv[0] << " [OPTIONS] FILE.material...\n"
+                << "\n"
+                << "Writes a .ktx next to every image the materials use, or a .vtex\n"
+                << "next to every diffuse texture with --virtual\n"
+                << "\n"
+                << "Options:\n"
+                << "  --format FMT  'bc1', 'bc3' or 'auto' (default), auto picks BC3 for images with alpha\n"
+                << "  --force       Convert images even if the output is up to date\n"
+                << "  --virtual     Write virtual textures for texture streaming\n";
+      exit(0);
+    }
+    else if (strcmp("--format", argv[i]) == 0 && i + 1 < argc)
+    {
+      opts.format = argv[++i];
+      if (opts.format != "bc1" && opts.format != "bc3" && opts.format != "auto")
+      {
+        throw std::runtime_error("expected --format bc1, bc3 or auto, got '" + opts.format + "'");
+      }
+    }
+    else if (strcmp("--force", argv[i]) == 0)
+    {
+      opts.force = true;
+    }
+    else if (strcmp("--virtual", argv[i]) == 0)
+    {
+      opts.virtual_texture = true;
+    }
+    else if (argv[i][0] == '-')
+    {
+      throw std::runtime_error("unknown option: " + std::string(argv[i]));
+    }
+    else
+    {
+      opts.materials.push_back(argv[i]);
+    }
+  }
+  return opts;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  try
+  {
+    Options const opts = parse_args(argc, argv);
+
+    std::set<std::filesystem::path> done;
+    for(auto const& material : opts.materials)
+    {
+      for(auto const& texture : collect_textures(material, opts.virtual_texture))
+      {
+        if (done.insert(texture.lexically_normal()).second)
+        {
+          if (opts.virtual_texture)
+          {
+            convert_virtual(texture, opts);
+          }
+          else
+          {
+            convert(texture, opts);
+          }
+        }
+      }
+    }
+  }
+  catch(std::exception const& err)
+  {
+    std::cerr << "error: " << err.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* EOF */